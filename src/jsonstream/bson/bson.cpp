@@ -25,6 +25,19 @@ const int initialBufferSize = 128;
 /* only need one of these */
 static const int zero = 0;
 
+/* two decimal digits for each value below 100, for formatting numbers a pair at a time */
+static const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
 /* ----------------------------
    READING
    ------------------------------ */
@@ -356,9 +369,21 @@ void bson_append64(bson_buffer * b, const void * data){
     b->cur += 8;
 }
 
+static bson_buffer * bson_buffer_grow( bson_buffer * b , const int new_size ){
+    int pos = b->cur - b->buf;
+
+    b->buf = (char *)realloc(b->buf, new_size);
+    if (!b->buf)
+        bson_fatal_msg(!!b->buf, "realloc() failed");
+
+    b->bufSize = new_size;
+    b->cur = b->buf + pos;
+
+    return b;
+}
+
 bson_buffer * bson_ensure_space( bson_buffer * b , const int bytesNeeded ){
     int pos = b->cur - b->buf;
-    int new_size;
 
     if (b->finished) {
         bson_fatal_msg(!!b->buf, "trying to append to finished buffer");
@@ -367,15 +392,21 @@ bson_buffer * bson_ensure_space( bson_buffer * b , const int bytesNeeded ){
     if (pos + bytesNeeded <= b->bufSize)
         return b;
 
-    new_size = 1.5 * (b->bufSize + bytesNeeded);
-    b->buf = (char *)realloc(b->buf, new_size);
-    if (!b->buf)
-        bson_fatal_msg(!!b->buf, "realloc() failed");
+    return bson_buffer_grow(b, 1.5 * (b->bufSize + bytesNeeded));
+}
 
-    b->bufSize = new_size;
-    b->cur = b->buf + pos;
+/* grows the buffer to exactly the space needed, when the final size is known */
+bson_buffer * bson_buffer_reserve( bson_buffer * b , const int bytesNeeded ){
+    int pos = b->cur - b->buf;
 
-    return b;
+    if (b->finished) {
+        bson_fatal_msg(!!b->buf, "trying to append to finished buffer");
+    }
+
+    if (pos + bytesNeeded <= b->bufSize)
+        return b;
+
+    return bson_buffer_grow(b, pos + bytesNeeded);
 }
 
 char * bson_buffer_finish( bson_buffer * b ){
@@ -592,5 +623,42 @@ void bson_fatal_msg( int ok , const char* msg){
 }
 
 void bson_numstr(char* str, int i){
-    sprintf(str,"%d", i);
+    char digits[12];
+    char * p = digits + sizeof(digits);
+    unsigned int u = i < 0 ? 0u - (unsigned int)i : (unsigned int)i;
+
+    *--p = 0;
+    while (u >= 100) {
+        unsigned int q = u / 100;
+        p -= 2;
+        memcpy(p, digitPairs + 2 * (u - q * 100), 2);
+        u = q;
+    }
+    if (u >= 10) {
+        p -= 2;
+        memcpy(p, digitPairs + 2 * u, 2);
+    } else {
+        *--p = '0' + u;
+    }
+    if (i < 0)
+        *--p = '-';
+    memcpy(str, p, digits + sizeof(digits) - p);
+}
+
+/* turns the decimal number in str into the next one, for the keys of array elements */
+int bson_incnumstr(char* str){
+    int len = strlen(str);
+    char * p = str + len - 1;
+
+    while (p >= str && *p == '9')
+        *p-- = '0';
+    if (p >= str) {
+        ++*p;
+        return len;
+    }
+    /* all digits were nines */
+    str[0] = '1';
+    str[len] = '0';
+    str[len + 1] = 0;
+    return len + 1;
 }
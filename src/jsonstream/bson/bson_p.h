@@ -158,6 +158,7 @@ void bson_iterator_subiterator(const bson_iterator * i, bson_iterator * sub);
 
 bson_buffer * bson_buffer_init( bson_buffer * b );
 bson_buffer * bson_ensure_space( bson_buffer * b , const int bytesNeeded );
+bson_buffer * bson_buffer_reserve( bson_buffer * b , const int bytesNeeded );
 
 /**
  * @return the raw data.  you either should free this OR call bson_destroy not both
@@ -192,7 +193,7 @@ bson_buffer * bson_append_start_array( bson_buffer * b , const char * name );
 bson_buffer * bson_append_finish_object( bson_buffer * b );
 
 void bson_numstr(char* str, int i);
-void bson_incnumstr(char* str);
+int bson_incnumstr(char* str); /* returns the new length */
 
 
 /* ------------------------------
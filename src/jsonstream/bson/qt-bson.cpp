@@ -40,10 +40,28 @@
 ****************************************************************************/
 
 
+#include <QSet>
+
 #include "qt-bson_p.h"
 
 static bool sMetatypeRegistered = qRegisterMetaType<BsonObject>("BsonObject");
 
+// depth of bson_buffer::stack, the number of nested documents a buffer can track
+const int knBSON_MAX_NESTING = 32;
+// nesting BsonObject::visit() and bsonToJsonObject() follow before they give up
+const int knBSON_MAX_VISIT_NESTING = 512;
+
+static int bsonVariantSize(const QVariantMap &map);
+static int bsonVariantSize(const QVariantList &list);
+
+// copies the \a numChars UTF-16 code units at \a data, which need not be aligned
+static QString bsonUtf16String(const char *data, int numChars)
+{
+    QString s(numChars, Qt::Uninitialized);
+    memcpy(s.data(), data, numChars * sizeof(QChar));
+    return s;
+}
+
 BsonData::BsonData()
 {
     memset(&mBsonBuffer, 0, sizeof(mBsonBuffer));
@@ -85,18 +103,50 @@ BsonObject::BsonObject(char *data, int /* size */)
     d->mBsonBuffer.finished = true;
 }
 
+/*
+    Returns true if the \a size bytes at \a data start with a complete document.
+*/
+static bool isBsonDocument(const char *data, int size)
+{
+    if (size < 5)
+        return false;
+    int documentSize;
+    bson_little_endian32(&documentSize, data);
+    return documentSize >= 5 && documentSize <= size && data[documentSize - 1] == 0;
+}
+
 /*!
-    Creates a BsonObject from a byte array which in principle converts it back
-    into a QVariantMap (via toMap).
+    Creates a BsonObject from the document starting at \a offset in the byte array
+    \a data which in principle converts it back into a QVariantMap (via toMap).
+
+    The document is not copied: the object shares \a data, and value(), contains()
+    and subObject() read the elements in place.
 */
-BsonObject::BsonObject(const QByteArray &data)
+BsonObject::BsonObject(const QByteArray &data, int offset)
   : d(new BsonData())
 {
-    char *mydata = (char *)malloc(data.size()+1);
-    memcpy(mydata, data.data(), data.size());
-    mydata[data.size()] = 0;
-    bson_init(&d->mBson, mydata, 1);
     d->mBsonBuffer.finished = true;
+    if (offset >= 0 && isBsonDocument(data.constData() + offset, data.size() - offset)) {
+        d->mRawData = data;
+        bson_init(&d->mBson, const_cast<char *>(d->mRawData.constData()) + offset, 0);
+    } else if (!data.isEmpty()) {
+        qWarning() << "BsonObject: incomplete BSON document";
+    }
+}
+
+/*!
+    Creates a BsonObject that reads the document of at most \a size bytes at \a data
+    in place, without copying or decoding it.  \a data must remain valid and unmodified
+    for as long as the returned object, or any object obtained from it, exists.
+*/
+BsonObject BsonObject::fromRawData(const char *data, int size)
+{
+    BsonObject bson;
+    if (isBsonDocument(data, size))
+        bson_init(&bson.d->mBson, const_cast<char *>(data), 0);
+    else
+        qWarning() << "BsonObject: incomplete BSON document";
+    return bson;
 }
 
 BsonObject::BsonObject(bson_iterator *it, const BsonObject *parent, bson_type bt)
@@ -112,9 +162,10 @@ BsonObject::BsonObject(bson_iterator *it, const BsonObject *parent, bson_type bt
 BsonObject::BsonObject(const QVariantMap &v)
   : d(new BsonData())
 {
-    for (QVariantMap::const_iterator it = v.begin(); it != v.end(); ++it) {
-        insert(it.key(), it.value());
-    }
+    start();
+    // the buffer is allocated once, with the size of the whole document
+    bson_buffer_reserve(&d->mBsonBuffer, bsonVariantSize(v) - 4);
+    appendElements(&d->mBsonBuffer, v);
     finish();
 #if 0
     qDebug() << "BsonObject::BsonObject" << v;
@@ -129,9 +180,9 @@ BsonObject::BsonObject(const QVariantList &v)
   : d(new BsonData())
 {
     d->mBsonType = bson_array;
-    for (int i = 0; i < v.size(); i++) {
-        insert(QString::number(i), v[i]);
-    }
+    start();
+    bson_buffer_reserve(&d->mBsonBuffer, bsonVariantSize(v) - 4);
+    appendElements(&d->mBsonBuffer, v);
     finish();
 }
 
@@ -140,7 +191,6 @@ bool BsonObject::start()
     if (d->mBsonBuffer.finished) {
         //qDebug() << "BsonObject::start()" << __LINE__ << QString("%1").arg((long)d.data(), 4, 16);
         bson_buffer_init(&d->mBsonBuffer);
-        d->mAddedKeys.clear();
         return true;
     } else {
         return false;
@@ -150,15 +200,16 @@ bool BsonObject::start()
 void BsonObject::finish()
 {
     if (!d->mBsonBuffer.finished) {
-        d->mAddedKeys.clear();
         //qDebug() << "BsonObject::finish()" << __LINE__ << QString("%1").arg((long)d.data(), 4, 16);
         if (bson_size(&d->mBson) > 5) {
+            // elements were inserted into an existing document: merge, new values win
             bson bson;
             bson_from_buffer(&bson, &d->mBsonBuffer);
 
             bson_buffer_init(&d->mBsonBuffer);
 
-            QSet<QString> newKeys;
+            // raw keys point into bson and d->mBson, both alive until the end of the merge
+            QSet<QByteArray> newKeys;
 
             //qDebug() << "finish()" << bson_size(&bson) << QByteArray(bson.data, bson_size(&bson)).toHex();
             //qDebug() << "BsonObject::finish()" << __LINE__ << QByteArray(d->mBson.data, bson_size(&d->mBson)).toHex();
@@ -168,31 +219,30 @@ void BsonObject::finish()
                 bson_iterator_init(&j, bson.data);
                 while (bson_iterator_next(&j) != bson_eoo) {
                     const char *jkey = bson_iterator_key(&j);
-                    QString s = QString::fromUtf8(jkey);
-                    if (newKeys.contains(s)) {
-                        qCritical() << "BsonObject::finish" << "duplicate key" << s;
+                    QByteArray k = QByteArray::fromRawData(jkey, strlen(jkey));
+                    if (newKeys.contains(k)) {
+                        qCritical() << "BsonObject::finish" << "duplicate key" << jkey;
                     }
-                    newKeys.insert(s);
+                    newKeys.insert(k);
 
-                    //qDebug() << "key" << jkey << bson_iterator_type(&j) << QString(s).toLatin1().toHex();
+                    //qDebug() << "key" << jkey << bson_iterator_type(&j);
                     bson_append_element(&d->mBsonBuffer, 0, &j);
                 }
             }
-            bson_destroy(&bson);
 
             bson_iterator i;
             bson_iterator_init(&i, d->mBson.data);
             while (bson_iterator_next(&i) != bson_eoo) {
                 const char *ikey = bson_iterator_key(&i);
-                QString s = QString::fromUtf8(ikey);
-                if (newKeys.contains(s)) {
+                if (newKeys.contains(QByteArray::fromRawData(ikey, strlen(ikey)))) {
                     continue;
                 }
-                newKeys.insert(s);
                 bson_append_element(&d->mBsonBuffer, 0, &i);
             }
-            bson_destroy(&d->mBson);
+            newKeys.clear();
+            bson_destroy(&bson);
         }
+        bson_destroy(&d->mBson);
         bson_from_buffer(&d->mBson, &d->mBsonBuffer);
         //qDebug() << "BsonObject::finish()" << __LINE__ << QByteArray(d->mBson.data, bson_size(&d->mBson)).toHex();
     }
@@ -228,13 +278,10 @@ QVariantList BsonObject::toList()
 
     bson_iterator it;
     bson_iterator_init(&it, d->mBson.data);
+    // array elements are stored in index order, so their keys need not be parsed
     bson_type bt;
-    while ((bt = bson_iterator_next(&it)) && (bt != bson_eoo)) {
-        const char *ckey = bson_iterator_key(&it);
-        int i = strtoul(ckey, 0, 10);
-        QVariant v = elementToVariant(bt, &it);
-        list.insert(i, v);
-    }
+    while ((bt = bson_iterator_next(&it)) && (bt != bson_eoo))
+        list.append(elementToVariant(bt, &it));
     return list;
 }
 
@@ -280,7 +327,7 @@ QVariant BsonObject::elementToVariant(bson_type bt, bson_iterator *it)
         v = QString::fromUtf8(bson_iterator_string(it));
         break;
     case bson_utf16:
-        v = QString((QChar *)bson_iterator_utf16(it), bson_iterator_utf16_numchars(it));
+        v = bsonUtf16String((const char *)bson_iterator_utf16(it), bson_iterator_utf16_numchars(it));
         break;
     case bson_object: {
         BsonObject subBson(it, this, bt);
@@ -325,6 +372,12 @@ QByteArray BsonObject::data()
 
     return QByteArray(d->mBson.data, bson_size(&d->mBson));
 }
+const char *BsonObject::constData()
+{
+    finish();
+
+    return d->mBson.data;
+}
 int BsonObject::dataSize()
 {
     finish();
@@ -357,143 +410,75 @@ int BsonObject::count()
 
 BsonObject &BsonObject::insert(const QString &key, int v)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
     bson_append_int(&d->mBsonBuffer, key.toUtf8().data(), v);
     return *this;
 }
 
 BsonObject &BsonObject::insert(const QString &key, quint32 v)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
     bson_append_int(&d->mBsonBuffer, key.toUtf8().data(), v);
     return *this;
 }
 
 BsonObject &BsonObject::insert(const QString &key, double v)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
     bson_append_double(&d->mBsonBuffer, key.toUtf8().data(), v);
     return *this;
 }
 
 BsonObject &BsonObject::insert(const QString &key, bool v)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
     bson_append_bool(&d->mBsonBuffer, key.toUtf8().data(), v);
     return *this;
 }
 
 BsonObject &BsonObject::insert(const QString &key, const char *s)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
-    d->mAddedKeys.insert(key);
     return insert(key, QString::fromUtf8(s));
 }
 
 BsonObject &BsonObject::insert(const QString &key, const QString &v)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
     bson_append_utf16(&d->mBsonBuffer, key.toUtf8().data(), v.constData(), v.size());
     return *this;
 }
 
 BsonObject &BsonObject::insert(const QString &key, const QVariantMap &v)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
-    BsonObject b(v);
-    b.finish();
-    bson_append_bson(&d->mBsonBuffer, key.toUtf8().data(), b.d->mBsonType, &b.d->mBson);
+    appendMap(&d->mBsonBuffer, key.toUtf8().data(), v);
     return *this;
 }
 
 BsonObject &BsonObject::insert(const QString &key, const QVariant &v)
 {
-    if (!v.isValid()) {
-        if (false && d->mAddedKeys.contains(key)) {
-            finish();
-        }
-        start();
-        d->mAddedKeys.insert(key);
-        bson_append_undefined(&d->mBsonBuffer, key.toUtf8().data());
-        return *this;
-    }
-    switch (v.type()) {
-    case QVariant::Bool:
-        insert(key, v.toBool());
-        break;
-    case QVariant::Int:
-        insert(key, v.toInt());
-        break;
-    case QVariant::Double:
-        insert(key, v.toDouble());
-        break;
-    case QVariant::String:
-        insert(key, v.toString());
-        break;
-    case QVariant::List:
-        insert(key, v.toList());
-        break;
-    case QVariant::Map:
-        insert(key, v.toMap());
-        break;
-    default:
-        insert(key, v.toString());
-        break;
-    }
+    start();
+    appendVariant(&d->mBsonBuffer, key.toUtf8().data(), v);
     return *this;
 }
 
 BsonObject &BsonObject::insert(const QString &key, const QVariantList &list)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
-    bson_append_start_array(&d->mBsonBuffer, key.toUtf8().data());
-    for (int i = 0; i < list.size(); i++) {
-        insert(QString::number(i), list[i]);
-    }
-    bson_append_finish_object(&d->mBsonBuffer);
+    appendList(&d->mBsonBuffer, key.toUtf8().data(), list);
     return *this;
 }
 
 BsonObject &BsonObject::insert(const QString &key, const BsonList &list)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
     bson_append_start_array(&d->mBsonBuffer, key.toUtf8().data());
+    char index[12] = "0";
     for (int i = 0; i < list.size(); i++) {
-        insert(QString::number(i), list[i]);
+        BsonObject b = list[i];
+        b.finish();
+        bson_append_bson(&d->mBsonBuffer, index, b.d->mBsonType, &b.d->mBson);
+        bson_incnumstr(index);
     }
     bson_append_finish_object(&d->mBsonBuffer);
     return *this;
@@ -502,14 +487,13 @@ BsonObject &BsonObject::insert(const QString &key, const BsonList &list)
 
 BsonObject &BsonObject::insert(const QString &key, const QStringList &list)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
     bson_append_start_array(&d->mBsonBuffer, key.toUtf8().data());
+    char index[12] = "0";
     for (int i = 0; i < list.size(); i++) {
-        insert(QString::number(i), list[i]);
+        const QString &v = list.at(i);
+        bson_append_utf16(&d->mBsonBuffer, index, v.constData(), v.size());
+        bson_incnumstr(index);
     }
     bson_append_finish_object(&d->mBsonBuffer);
     return *this;
@@ -517,11 +501,7 @@ BsonObject &BsonObject::insert(const QString &key, const QStringList &list)
 
 BsonObject &BsonObject::insert(const QString &key, BsonObject b)
 {
-    if (false && d->mAddedKeys.contains(key)) {
-      finish();
-    }
     start();
-    d->mAddedKeys.insert(key);
 
     Q_ASSERT(!d->mBsonBuffer.finished);
     b.finish();
@@ -529,6 +509,84 @@ BsonObject &BsonObject::insert(const QString &key, BsonObject b)
 
     return *this;
 }
+
+/*
+    Builder functions.  These append straight into a bson_buffer, nested maps and
+    lists included, so a document built from a QVariantMap or QVariantList takes a
+    single pass and never needs to be merged by finish().  Keys are unique because
+    they come from a map or are list indexes.
+*/
+
+void BsonObject::appendVariant(bson_buffer *b, const char *key, const QVariant &v)
+{
+    if (!v.isValid()) {
+        bson_append_undefined(b, key);
+        return;
+    }
+    switch (v.type()) {
+    case QVariant::Bool:
+        bson_append_bool(b, key, v.toBool());
+        break;
+    case QVariant::Int:
+        bson_append_int(b, key, v.toInt());
+        break;
+    case QVariant::Double:
+        bson_append_double(b, key, v.toDouble());
+        break;
+    case QVariant::List:
+        appendList(b, key, v.toList());
+        break;
+    case QVariant::Map:
+        appendMap(b, key, v.toMap());
+        break;
+    default: {
+        QString s = v.toString();
+        bson_append_utf16(b, key, s.constData(), s.size());
+    } break;
+    }
+}
+
+void BsonObject::appendMap(bson_buffer *b, const char *key, const QVariantMap &map)
+{
+    if (b->stackPos >= knBSON_MAX_NESTING) {
+        // the buffer cannot track deeper nesting, so build this level separately
+        BsonObject sub(map);
+        bson_append_bson(b, key, bson_object, &sub.d->mBson);
+        return;
+    }
+    bson_append_start_object(b, key);
+    appendElements(b, map);
+    bson_append_finish_object(b);
+}
+
+void BsonObject::appendList(bson_buffer *b, const char *key, const QVariantList &list)
+{
+    if (b->stackPos >= knBSON_MAX_NESTING) {
+        BsonObject sub(list);
+        bson_append_bson(b, key, bson_array, &sub.d->mBson);
+        return;
+    }
+    bson_append_start_array(b, key);
+    appendElements(b, list);
+    bson_append_finish_object(b);
+}
+
+void BsonObject::appendElements(bson_buffer *b, const QVariantMap &map)
+{
+    for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it)
+        appendVariant(b, it.key().toUtf8().constData(), it.value());
+}
+
+void BsonObject::appendElements(bson_buffer *b, const QVariantList &list)
+{
+    // the keys of consecutive elements are counted up rather than formatted
+    char index[12] = "0";
+    for (int i = 0; i < list.size(); i++) {
+        appendVariant(b, index, list.at(i));
+        bson_incnumstr(index);
+    }
+}
+
 bool BsonObject::contains(const QString &key)
 {
     finish();
@@ -577,7 +635,7 @@ QVariant BsonObject::value(const QString &key)
     case bson_string:
         return QString::fromUtf8(bson_iterator_string(&it));
     case bson_utf16:
-        return QString((QChar *)bson_iterator_utf16(&it), bson_iterator_utf16_numchars(&it));
+        return bsonUtf16String((const char *)bson_iterator_utf16(&it), bson_iterator_utf16_numchars(&it));
     case bson_array:
     case bson_object: {
         BsonObject bson(&it, this, t);
@@ -641,7 +699,7 @@ QString BsonObject::valueString(const QString &key)
     case bson_string:
         return QString::fromUtf8(bson_iterator_string(&it));
     case bson_utf16:
-        return QString((QChar *)bson_iterator_utf16(&it), bson_iterator_utf16_numchars(&it));
+        return bsonUtf16String((const char *)bson_iterator_utf16(&it), bson_iterator_utf16_numchars(&it));
     default:
         return value(key).toString();
     }
@@ -653,6 +711,479 @@ void BsonObject::dump()
     bson_print(&d->mBson);
 }
 
+/*!
+    Returns an iterator to the first element of the document.  Iterating reads the
+    elements in place, so a large document costs no more memory than it occupies.
+*/
+BsonObject::const_iterator BsonObject::begin() const
+{
+    return const_iterator(*this, false);
+}
+
+/*!
+    Returns an iterator past the last element of the document.
+*/
+BsonObject::const_iterator BsonObject::end() const
+{
+    return const_iterator(*this, true);
+}
+
+BsonObject::const_iterator::const_iterator(const BsonObject &object, bool atEnd)
+    : mObject(object)
+{
+    // pending insertions are merged first; the elements do not change
+    mObject.finish();
+    const char *data = mObject.d->mBson.data;
+    if (!data || bson_size(&mObject.d->mBson) < 5) {
+        // no document: begin() and end() are the same null iterator
+        mIterator.cur = 0;
+        mIterator.first = false;
+        mType = bson_eoo;
+    } else if (atEnd) {
+        mIterator.cur = data + bson_size(&mObject.d->mBson) - 1;
+        mIterator.first = false;
+        mType = bson_eoo;
+    } else {
+        bson_iterator_init(&mIterator, data);
+        mType = bson_iterator_next(&mIterator);
+    }
+}
+
+BsonObject::const_iterator &BsonObject::const_iterator::operator++()
+{
+    if (mType != bson_eoo)
+        mType = bson_iterator_next(&mIterator);
+    return *this;
+}
+
+BsonObject::const_iterator BsonObject::const_iterator::operator++(int)
+{
+    const_iterator it = *this;
+    ++*this;
+    return it;
+}
+
+QByteArray BsonObject::const_iterator::key() const
+{
+    if (mType == bson_eoo)
+        return QByteArray();
+    return QByteArray(bson_iterator_key(&mIterator));
+}
+
+/*!
+    Returns the value of the current element.  Nested documents are converted as a
+    whole; use subObject() to step into them instead.
+*/
+QVariant BsonObject::const_iterator::value() const
+{
+    if (mType == bson_eoo)
+        return QVariant();
+    BsonObject object(mObject);
+    bson_iterator it = mIterator;
+    return object.elementToVariant(mType, &it);
+}
+
+/*!
+    Returns the nested document or array of the current element without decoding it,
+    or an empty object if the element holds neither.
+*/
+BsonObject BsonObject::const_iterator::subObject() const
+{
+    if (mType != bson_object && mType != bson_array)
+        return BsonObject();
+    bson_iterator it = mIterator;
+    return BsonObject(&it, &mObject, mType);
+}
+
+/*!
+    Walks the document depth first and reports every element to \a visitor without
+    building a QVariant for any nested document, so that documents of any size can
+    be processed element by element.  Returns false if the visitor stopped the walk
+    or the document is nested too deeply.
+*/
+bool BsonObject::visit(BsonVisitor *visitor)
+{
+    finish();
+    bson_iterator it;
+    bson_iterator_init(&it, d->mBson.data);
+    return visitElements(&it, visitor, 0);
+}
+
+bool BsonObject::visitElements(bson_iterator *it, BsonVisitor *visitor, int depth)
+{
+    bson_type bt;
+    while ((bt = bson_iterator_next(it)) && (bt != bson_eoo)) {
+        const char *key = bson_iterator_key(it);
+        if (bt == bson_object || bt == bson_array) {
+            if (depth >= knBSON_MAX_VISIT_NESTING) {
+                qWarning() << "BsonObject::visit: documents nested too deeply";
+                return false;
+            }
+            bool isArray = (bt == bson_array);
+            if (!visitor->beginDocument(key, isArray))
+                continue;
+            bson_iterator sub;
+            bson_iterator_subiterator(it, &sub);
+            if (!visitElements(&sub, visitor, depth + 1))
+                return false;
+            visitor->endDocument(key, isArray);
+        } else if (!visitor->value(key, elementToVariant(bt, it))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BsonVisitor::beginDocument(const char *, bool)
+{
+    return true;
+}
+
+void BsonVisitor::endDocument(const char *, bool)
+{
+}
+
+/*
+    Direct conversion between QJsonObject and BSON.
+
+    The encoder sizes the document in a first pass and then writes it in place,
+    so a frame costs a single allocation.  The output is identical to that of
+    BsonObject(QJsonDocument(object).toVariant().toMap()): numbers are stored as
+    doubles, strings as bson_utf16 and null as bson_undefined.
+*/
+
+static int bsonDocumentSize(const QJsonObject &object);
+static int bsonDocumentSize(const QJsonArray &array);
+static char *bsonWriteDocument(char *p, const QJsonObject &object);
+static char *bsonWriteDocument(char *p, const QJsonArray &array);
+
+static inline bool isAscii(const QString &key)
+{
+    const QChar *c = key.constData();
+    for (const QChar *e = c + key.size(); c != e; ++c) {
+        if (c->unicode() >= 0x80)
+            return false;
+    }
+    return true;
+}
+
+// size of the key including its terminating zero
+static inline int bsonKeySize(const QString &key)
+{
+    return (isAscii(key) ? key.size() : key.toUtf8().size()) + 1;
+}
+
+// total size of the keys "0" to "count - 1", including their terminating zeros
+static int bsonIndexKeysSize(int count)
+{
+    int size = 2 * count;
+    for (qint64 limit = 10; limit < count; limit *= 10)
+        size += count - limit;
+    return size;
+}
+
+static int bsonValueSize(const QJsonValue &value)
+{
+    switch (value.type()) {
+    case QJsonValue::Bool:
+        return 1;
+    case QJsonValue::Double:
+        return 8;
+    case QJsonValue::String:
+        return 4 + (value.toString().size() + 1) * 2;
+    case QJsonValue::Array:
+        return bsonDocumentSize(value.toArray());
+    case QJsonValue::Object:
+        return bsonDocumentSize(value.toObject());
+    default:
+        return 0;
+    }
+}
+
+static int bsonDocumentSize(const QJsonObject &object)
+{
+    int size = 5;
+    for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it)
+        size += 1 + bsonKeySize(it.key()) + bsonValueSize(it.value());
+    return size;
+}
+
+static int bsonDocumentSize(const QJsonArray &array)
+{
+    int size = 5 + array.size() + bsonIndexKeysSize(array.size());
+    for (int i = 0; i < array.size(); i++)
+        size += bsonValueSize(array.at(i));
+    return size;
+}
+
+/*
+    The size of the document BsonObject's builder functions write for a QVariantMap
+    or QVariantList, so that its buffer can be allocated up front.
+*/
+static int bsonVariantValueSize(const QVariant &v)
+{
+    if (!v.isValid())
+        return 0;
+    switch (v.type()) {
+    case QVariant::Bool:
+        return 1;
+    case QVariant::Int:
+        return 4;
+    case QVariant::Double:
+        return 8;
+    case QVariant::List:
+        return bsonVariantSize(v.toList());
+    case QVariant::Map:
+        return bsonVariantSize(v.toMap());
+    default:
+        return 4 + (v.toString().size() + 1) * 2;
+    }
+}
+
+static int bsonVariantSize(const QVariantMap &map)
+{
+    int size = 5;
+    for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it)
+        size += 1 + bsonKeySize(it.key()) + bsonVariantValueSize(it.value());
+    return size;
+}
+
+static int bsonVariantSize(const QVariantList &list)
+{
+    int size = 5 + list.size() + bsonIndexKeysSize(list.size());
+    for (int i = 0; i < list.size(); i++)
+        size += bsonVariantValueSize(list.at(i));
+    return size;
+}
+
+static char *bsonWriteKey(char *p, const QString &key)
+{
+    if (isAscii(key)) {
+        const QChar *c = key.constData();
+        for (const QChar *e = c + key.size(); c != e; ++c)
+            *p++ = (char)c->unicode();
+        *p++ = 0;
+    } else {
+        QByteArray utf8 = key.toUtf8();
+        memcpy(p, utf8.constData(), utf8.size() + 1);
+        p += utf8.size() + 1;
+    }
+    return p;
+}
+
+static char *bsonWriteValue(char *p, char *type, const QJsonValue &value)
+{
+    switch (value.type()) {
+    case QJsonValue::Bool:
+        *type = bson_bool;
+        *p++ = value.toBool() ? bson_true : bson_false;
+        break;
+    case QJsonValue::Double: {
+        *type = bson_double;
+        double d = value.toDouble();
+        bson_little_endian64(p, &d);
+        p += 8;
+    } break;
+    case QJsonValue::String: {
+        *type = bson_utf16;
+        QString s = value.toString();
+        int len = (s.size() + 1) * 2;   // includes the terminating zero
+        bson_little_endian32(p, &len);
+        memcpy(p + 4, s.constData(), len);
+        p += 4 + len;
+    } break;
+    case QJsonValue::Array:
+        *type = bson_array;
+        p = bsonWriteDocument(p, value.toArray());
+        break;
+    case QJsonValue::Object:
+        *type = bson_object;
+        p = bsonWriteDocument(p, value.toObject());
+        break;
+    default:
+        *type = bson_undefined;
+        break;
+    }
+    return p;
+}
+
+static char *bsonWriteDocument(char *p, const QJsonObject &object)
+{
+    char *start = p;
+    p += 4;
+    for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it) {
+        char *type = p++;
+        p = bsonWriteKey(p, it.key());
+        p = bsonWriteValue(p, type, it.value());
+    }
+    *p++ = 0;
+    int size = p - start;
+    bson_little_endian32(start, &size);
+    return p;
+}
+
+static char *bsonWriteDocument(char *p, const QJsonArray &array)
+{
+    char *start = p;
+    p += 4;
+    char index[12] = "0";
+    int indexSize = 1;
+    for (int i = 0; i < array.size(); i++) {
+        char *type = p++;
+        memcpy(p, index, indexSize + 1);
+        p = bsonWriteValue(p + indexSize + 1, type, array.at(i));
+        indexSize = bson_incnumstr(index);
+    }
+    *p++ = 0;
+    int size = p - start;
+    bson_little_endian32(start, &size);
+    return p;
+}
+
+/*!
+    Appends \a object encoded as a BSON document to \a out, preceded by \a tag if
+    it is not null.  \a out is grown exactly once.
+*/
+void bsonAppendJsonObject(QByteArray &out, const QJsonObject &object, const char *tag)
+{
+    int tagSize = tag ? strlen(tag) : 0;
+    int offset = out.size();
+    out.resize(offset + tagSize + bsonDocumentSize(object));
+    char *p = out.data() + offset;
+    if (tagSize)
+        memcpy(p, tag, tagSize);
+    char *end = bsonWriteDocument(p + tagSize, object);
+    Q_ASSERT(end == out.constData() + out.size());
+    Q_UNUSED(end);
+}
+
+/*
+    Reads the BSON document of at most \a size bytes at \a data into \a object or,
+    if \a object is null, into \a array.  \a depth is the nesting of the document.
+    Returns false if the document is malformed or nested too deeply.
+*/
+static bool bsonReadDocument(const char *data, int size, QJsonObject *object, QJsonArray *array,
+                             int depth)
+{
+    if (depth > knBSON_MAX_VISIT_NESTING) {
+        qWarning() << "bsonToJsonObject: documents nested too deeply";
+        return false;
+    }
+    if (size < 5)
+        return false;
+    int documentSize;
+    bson_little_endian32(&documentSize, data);
+    if (documentSize < 5 || documentSize > size || data[documentSize - 1] != 0)
+        return false;
+
+    const char *p = data + 4;
+    const char *end = data + documentSize - 1;
+    while (p < end) {
+        bson_type type = (bson_type)*p++;
+        const char *key = p;
+        const char *keyEnd = (const char *)memchr(p, 0, end - p);
+        if (!keyEnd)
+            return false;
+        p = keyEnd + 1;
+
+        int remaining = end - p;
+        int len = 0;
+        QJsonValue value;
+        switch (type) {
+        case bson_double: {
+            if (remaining < 8)
+                return false;
+            double d;
+            bson_little_endian64(&d, p);
+            value = d;
+            p += 8;
+        } break;
+        case bson_int: {
+            if (remaining < 4)
+                return false;
+            int i;
+            bson_little_endian32(&i, p);
+            value = i;
+            p += 4;
+        } break;
+        case bson_long: {
+            if (remaining < 8)
+                return false;
+            int64_t l;
+            bson_little_endian64(&l, p);
+            value = (double)l;
+            p += 8;
+        } break;
+        case bson_bool:
+            if (remaining < 1)
+                return false;
+            value = (*p++ == bson_true);
+            break;
+        case bson_string:
+            if (remaining < 4)
+                return false;
+            bson_little_endian32(&len, p);
+            if (len < 1 || len > remaining - 4 || p[4 + len - 1] != 0)
+                return false;
+            value = QString::fromUtf8(p + 4, len - 1);
+            p += 4 + len;
+            break;
+        case bson_utf16:
+            if (remaining < 4)
+                return false;
+            bson_little_endian32(&len, p);
+            if (len < 2 || len > remaining - 4 || (len & 1) || p[4 + len - 2] != 0 || p[4 + len - 1] != 0)
+                return false;
+            value = bsonUtf16String(p + 4, len / 2 - 1);
+            p += 4 + len;
+            break;
+        case bson_object: {
+            QJsonObject subObject;
+            if (!bsonReadDocument(p, remaining, &subObject, 0, depth + 1))
+                return false;
+            bson_little_endian32(&len, p);
+            value = subObject;
+            p += len;
+        } break;
+        case bson_array: {
+            QJsonArray subArray;
+            if (!bsonReadDocument(p, remaining, 0, &subArray, depth + 1))
+                return false;
+            bson_little_endian32(&len, p);
+            value = subArray;
+            p += len;
+        } break;
+        case bson_null:
+        case bson_undefined:
+            value = QJsonValue(QJsonValue::Null);
+            break;
+        default:
+            qCritical() << "bsonToJsonObject: unimplemented conversion of bson_type:" << type;
+            return false;
+        }
+
+        if (object)
+            object->insert(QString::fromUtf8(key, keyEnd - key), value);
+        else
+            array->append(value);
+    }
+    return true;
+}
+
+/*!
+    Decodes the BSON document of \a size bytes at \a data directly into a QJsonObject.
+    Returns an empty object if the document is malformed.
+*/
+QJsonObject bsonToJsonObject(const char *data, int size)
+{
+    QJsonObject object;
+    if (!bsonReadDocument(data, size, &object, 0, 0)) {
+        qWarning() << "bsonToJsonObject: malformed BSON document";
+        return QJsonObject();
+    }
+    return object;
+}
+
 #if 0
 BsonList::BsonList()
 {
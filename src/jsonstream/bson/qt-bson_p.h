@@ -51,6 +51,8 @@
 #include <QVariant>
 #include <QVariantList>
 #include <QVariantMap>
+#include <QJsonObject>
+#include <QJsonArray>
 
 #include "bson_p.h"
 
@@ -66,7 +68,7 @@ private:
     bson        mBson;
     bson_type   mBsonType; // bson_object or bson_array
     QSharedPointer<BsonData> p;
-    QSet<QString> mAddedKeys;
+    QByteArray  mRawData; // keeps shared data alive for a document that was not copied
 
     friend class BsonObject;
     friend QDebug operator<<(QDebug d, BsonObject bson);
@@ -74,22 +76,39 @@ private:
 
 typedef QList<BsonObject> BsonList;
 
+/*
+    Receives the elements of a document from BsonObject::visit(), in document order.
+    Keys are only valid during the call.
+*/
+class BsonVisitor {
+public:
+    virtual ~BsonVisitor() {}
+
+    // return false to skip the elements of the nested document
+    virtual bool beginDocument(const char *key, bool isArray);
+    virtual void endDocument(const char *key, bool isArray);
+    // return false to stop the walk
+    virtual bool value(const char *key, const QVariant &value) = 0;
+};
+
 class BsonObject {
 public:
     BsonObject();
     BsonObject(char *data, int size);
-    BsonObject(const QByteArray &data);
+    BsonObject(const QByteArray &data, int offset = 0);
     BsonObject(const BsonObject &);
     BsonObject(const QVariantMap &);
     BsonObject(const QVariantList &);
 private:
     BsonObject(bson_iterator *it, const BsonObject *parent, bson_type bt);
 public:
+    static BsonObject fromRawData(const char *data, int size);
 
     QVariantMap toMap();
     QVariantList toList();
     QList<BsonObject> toBsonList();
     QByteArray data();
+    const char *constData(); // the document in place, dataSize() bytes
     int size(); // same as count()
     int count();
     int dataSize(); // bytes of data after encoding
@@ -121,25 +140,55 @@ public:
 
     void dump();
 
-    class const_iterator {
-    public:
-      bool operator!=(const_iterator) const;
-      void operator++();
-      QByteArray key();
-      QVariant value();
-    };
+    class const_iterator;
     const_iterator begin() const;
     const_iterator end() const;
 
+    bool visit(BsonVisitor *visitor);
+
 protected:
     bool start();
     void finish();
     QVariant elementToVariant(bson_type bt, bson_iterator *it);
+    bool visitElements(bson_iterator *it, BsonVisitor *visitor, int depth);
+
+    static void appendVariant(bson_buffer *b, const char *key, const QVariant &v);
+    static void appendMap(bson_buffer *b, const char *key, const QVariantMap &map);
+    static void appendList(bson_buffer *b, const char *key, const QVariantList &list);
+    static void appendElements(bson_buffer *b, const QVariantMap &map);
+    static void appendElements(bson_buffer *b, const QVariantList &list);
 
     QSharedPointer<BsonData> d;
     friend QDebug operator<<(QDebug d, BsonObject bson);
 };
 
+/*
+    Steps through the elements of a document in place; nested documents are only
+    decoded when value() is called.
+*/
+class BsonObject::const_iterator {
+public:
+    const_iterator() : mType(bson_eoo) { mIterator.cur = 0; mIterator.first = false; }
+
+    bool operator==(const const_iterator &other) const { return mIterator.cur == other.mIterator.cur; }
+    bool operator!=(const const_iterator &other) const { return mIterator.cur != other.mIterator.cur; }
+    const_iterator &operator++();
+    const_iterator operator++(int);
+
+    QByteArray key() const;
+    QVariant value() const;
+    QVariant operator*() const { return value(); }
+    bson_type type() const { return mType; }
+    BsonObject subObject() const;
+
+private:
+    const_iterator(const BsonObject &object, bool atEnd);
+
+    BsonObject    mObject;  // keeps the document alive
+    bson_iterator mIterator;
+    bson_type     mType;
+    friend class BsonObject;
+};
 
 #if 0
 class BsonList : public BsonObject {
@@ -169,6 +218,10 @@ public:
 };
 #endif
 
+// direct QJsonObject <-> BSON conversion, without going through QVariantMap
+void bsonAppendJsonObject(QByteArray &out, const QJsonObject &object, const char *tag = 0);
+QJsonObject bsonToJsonObject(const char *data, int size);
+
 QDebug operator<<(QDebug, BsonObject);
 Q_DECLARE_METATYPE(BsonObject)
 
@@ -25,6 +25,10 @@ SCHEMA_PUBLIC_HEADERS = \
 
 SCHEMA_HEADERS = \
     $$PWD/qtjsonschema/schemaobject_p.h \
+    $$PWD/qtjsonschema/schemaprogram_p.h \
+    $$PWD/qtjsonschema/schemaformat_p.h \
+    $$PWD/qtjsonschema/schemaenumindex_p.h \
+    $$PWD/qtjsonschema/schemadiscriminator_p.h \
     $$PWD/qtjsonschema/checkpoints_p.h \
     $$PWD/qtjsonschema/schemamanager_impl_p.h \
     $$PWD/qtjsonschema/schemamanager_p.h \
@@ -33,6 +37,10 @@ SCHEMA_HEADERS = \
 
 SCHEMA_SOURCES = \
     $$PWD/qtjsonschema/qjsonschemaerror.cpp \
+    $$PWD/qtjsonschema/schemaprogram.cpp \
+    $$PWD/qtjsonschema/schemaformat.cpp \
+    $$PWD/qtjsonschema/schemaenumindex.cpp \
+    $$PWD/qtjsonschema/schemadiscriminator.cpp \
     $$PWD/qtjsonschema/qjsonschemavalidator.cpp
 
 PUBLIC_HEADERS += \
@@ -46,13 +54,18 @@ PUBLIC_HEADERS += \
     $$PWD/qjsonstream-global.h \
     $$PWD/qjsonserverclient.h \
     $$PWD/qjsonpipe.h \
+    $$PWD/qjsoncodec.h \
     $$PWD/qjsonconnection.h \
     $$PWD/qjsonendpoint.h \
+    $$PWD/qjsonrpcclient.h \
+    $$PWD/qjsonrpcserver.h \
     $$SCHEMA_PUBLIC_HEADERS
 
 HEADERS += \
    $$PWD/qjsonbuffer_p.h \
+   $$PWD/qjsoncbor_p.h \
    $$PWD/qjsonconnectionprocessor_p.h \
+   $$PWD/qjsonconnectionthreadpool_p.h \
    $$PWD/qjsonendpointmanager_p.h \
    $$BSON_HEADERS \
    $$PUBLIC_HEADERS \
@@ -61,6 +74,8 @@ HEADERS += \
 SOURCES += \
     $$PWD/qjsonstream.cpp \
     $$PWD/qjsonbuffer.cpp \
+    $$PWD/qjsoncbor.cpp \
+    $$PWD/qjsoncodec.cpp \
     $$PWD/bson/bson.cpp \
     $$PWD/bson/qt-bson.cpp \
     $$PWD/qjsonclient.cpp \
@@ -73,8 +88,11 @@ SOURCES += \
     $$PWD/qjsonpipe.cpp \
     $$PWD/qjsonconnection.cpp \
     $$PWD/qjsonconnectionprocessor.cpp \
+    $$PWD/qjsonconnectionthreadpool.cpp \
     $$PWD/qjsonendpoint.cpp \
     $$PWD/qjsonendpointmanager.cpp \
+    $$PWD/qjsonrpcclient.cpp \
+    $$PWD/qjsonrpcserver.cpp \
     $$SCHEMA_SOURCES \
 
 mac:QMAKE_FRAMEWORK_BUNDLE_NAME = $$TARGET
@@ -41,24 +41,22 @@
 
 #include <QDebug>
 #include <QtEndian>
-#include <QJsonDocument>
-#include <QTextCodec>
 #include <QMutexLocker>
+#include <QElapsedTimer>
 
 #include <unistd.h> // for ::read
 
 #include "qjsonbuffer_p.h"
-#include "qjsondocument.h"
 #include "qjsonobject.h"
 #include "bson/qt-bson_p.h"
 
 QT_BEGIN_NAMESPACE_JSONSTREAM
 
-template <typename T>
-inline bool isjsonws(T c)
-{
-    return c == '\n' || c == ' ' || c == '\t' || c == '\r';
-}
+// a compressed frame is this marker, the size of the compressed data (32-bit
+// little endian) and the output of qCompress() for a frame in the stream format
+static const char kCompressedFrameMarker[] = "\xc1jsz";
+const int knCOMPRESSED_MARKER_SIZE = 4;
+const int knCOMPRESSED_HEADER_SIZE = 8;
 
 /*!
   \class QJsonBuffer
@@ -78,16 +76,17 @@ inline bool isjsonws(T c)
 
 QJsonBuffer::QJsonBuffer(QObject *parent)
     : QObject(parent)
-    , mFormat(FormatUndefined)
-    , mParserState(ParseNormal)
-    , mParserDepth(0)
-    , mParserOffset(0)
-    , mParserStartOffset(-1)
+    , mCodec(0)
     , mEmittedReadyRead(false)
     , mMessageAvailable(false)
-    , mMessageSize(0)
     , mEnabled(true)
     , mThreadProtection(false)
+    , mInflatedGrowth(0)
+    , mMaxFrameSize(0)
+    , mInflatedFrames(0)
+    , mInflatedCompressedBytes(0)
+    , mInflatedBytes(0)
+    , mInflateNsecs(0)
 {
 }
 
@@ -113,6 +112,22 @@ QJsonBuffer::QJsonBuffer(QObject *parent)
     \sa isEnabled(), readyReadMessage()
 */
 
+/*!
+    \fn qint64 QJsonBuffer::maxFrameSize() const
+    \internal
+
+    Returns the largest size a compressed frame may have once decompressed.
+    A value of 0 means there is no limit.
+*/
+
+/*!
+    \fn void QJsonBuffer::setMaxFrameSize(qint64 size)
+    \internal
+
+    Sets the largest \a size a compressed frame may have once decompressed.
+    Frames that would grow beyond it are discarded without being inflated.
+*/
+
 /*!
     \fn int QJsonBuffer::size() const
 
@@ -190,56 +205,105 @@ void QJsonBuffer::clear()
     QScopedPointer<QMutexLocker> locker(createLocker());
     mBuffer.clear();
     resetParser();
+    mInflatedGrowth = 0;
+    // the next data comes from a new session
+    mSession.reset(mCodec ? mCodec->createSession() : 0);
 }
 
 /*!
   \internal
 */
+void QJsonBuffer::resetParser()
+{
+    mScan = QJsonCodec::ScanState();
+    mMessageAvailable = false;
+}
 
-bool QJsonBuffer::scanUtf( int c )
+/*!
+  \internal
+  If the next message in the buffer is a compressed frame, replaces the frame
+  with the message it holds.  Must only be called between messages.  Returns
+  \b false if more data is needed to tell.  A frame that cannot be decompressed,
+  or is too large, is dropped and reported with frameDiscarded().
+*/
+bool QJsonBuffer::inflateFrame()
 {
-    switch (mParserState) {
-    case ParseNormal:
-        if ( c == '{' ) {
-            if ( mParserDepth == 0 )
-                mParserStartOffset = mParserOffset;
-            mParserDepth += 1;
-        }
-        else if ( c == '}' && mParserDepth > 0 ) {
-            mParserDepth -= 1;
-            if ( mParserDepth == 0 ) {
-                return true;
-            }
-        }
-        else if ( c == '"' ) {
-            mParserState = ParseInString;
+    // text messages may be separated by whitespace
+    int offset = mCodec ? mCodec->separatorSize(mBuffer.constData(), mBuffer.size()) : 0;
+    int available = mBuffer.size() - offset;
+    if (memcmp(mBuffer.constData() + offset, kCompressedFrameMarker,
+               qMin(available, knCOMPRESSED_MARKER_SIZE)) != 0)
+        return true;
+    if (available < knCOMPRESSED_HEADER_SIZE)
+        return false;
+
+    qint32 size = qFromLittleEndian<qint32>(reinterpret_cast<const uchar *>(mBuffer.constData()) + offset + 4);
+    if (size < 0 || available - knCOMPRESSED_HEADER_SIZE < size)
+        return size < 0;
+
+    // qCompress() puts the size of the uncompressed data, 32-bit big endian,
+    // in front of its output; check it before letting zlib allocate anything
+    const uchar *data = reinterpret_cast<const uchar *>(mBuffer.constData()) + offset + knCOMPRESSED_HEADER_SIZE;
+    quint32 declared = size >= 4 ? qFromBigEndian<quint32>(data) : 0;
+    QByteArray frame;
+    if (mMaxFrameSize > 0 && declared > mMaxFrameSize) {
+        qWarning() << "QJsonBuffer: discarding a compressed frame of" << declared
+                   << "bytes, the limit is" << mMaxFrameSize;
+    }
+    else {
+        QElapsedTimer timer;
+        timer.start();
+        frame = qUncompress(data, size);
+        mInflateNsecs += timer.nsecsElapsed();
+        if (frame.isEmpty()) {
+            qWarning() << "QJsonBuffer: discarding a compressed frame that cannot be decompressed";
         }
-        break;
-    case ParseInString:
-        if ( c == '"' ) {
-            mParserState = ParseNormal;
-        } else if ( c == '\\' ) {
-            mParserState = ParseInBackslash;
+        else if ((mMaxFrameSize > 0 && frame.size() > mMaxFrameSize) || (quint32)frame.size() != declared) {
+            qWarning() << "QJsonBuffer: discarding a compressed frame of" << frame.size()
+                       << "bytes that declared" << declared;
+            frame.clear();
         }
-        break;
-    case ParseInBackslash:
-        mParserState = ParseInString;
-        break;
     }
-    return false;
+
+    if (frame.isEmpty())
+        emit frameDiscarded();
+
+    mBuffer.replace(offset, knCOMPRESSED_HEADER_SIZE + size, frame);
+    mInflatedGrowth += frame.size() - (knCOMPRESSED_HEADER_SIZE + size);
+    mInflatedFrames++;
+    mInflatedCompressedBytes += knCOMPRESSED_HEADER_SIZE + size;
+    mInflatedBytes += frame.size();
+    return true;
 }
 
 /*!
   \internal
+  Returns \a frame compressed with qCompress() at the given \a level, framed so
+  that the receiving QJsonBuffer decompresses it before parsing it in its format.
 */
-void QJsonBuffer::resetParser()
+QByteArray QJsonBuffer::compressFrame(const QByteArray& frame, int level)
 {
-    mParserState  = ParseNormal;
-    mParserDepth  = 0;
-    mParserOffset = 0;
-    mParserStartOffset = -1;
-    mMessageAvailable = false;
-    mMessageSize = 0;
+    QByteArray compressed = qCompress(frame, level);
+    char header[knCOMPRESSED_HEADER_SIZE];
+    memcpy(header, kCompressedFrameMarker, knCOMPRESSED_MARKER_SIZE);
+    qToLittleEndian<qint32>(compressed.size(), reinterpret_cast<uchar *>(header) + knCOMPRESSED_MARKER_SIZE);
+    compressed.prepend(header, knCOMPRESSED_HEADER_SIZE);
+    return compressed;
+}
+
+/*!
+  \internal
+  Reports the number of compressed \a frames received so far, their size in
+  \a compressedBytes, their size once decompressed in \a bytes, and the time
+  spent decompressing them in \a nsecs.
+*/
+void QJsonBuffer::inflateStatistics(qint64 *frames, qint64 *compressedBytes, qint64 *bytes, qint64 *nsecs)
+{
+    QScopedPointer<QMutexLocker> locker(createLocker());
+    *frames = mInflatedFrames;
+    *compressedBytes = mInflatedCompressedBytes;
+    *bytes = mInflatedBytes;
+    *nsecs = mInflateNsecs;
 }
 
 /*!
@@ -274,224 +338,119 @@ bool QJsonBuffer::messageAvailable()
         return false;
     }
 
-    if (mFormat == FormatUndefined && mBuffer.size() >= 4) {
-        if (strncmp("bson", mBuffer.constData(), 4) == 0)
-            mFormat = FormatBSON;
-        else if (QJsonDocument::BinaryFormatTag == *((uint *) mBuffer.constData()))
-            mFormat = FormatQBJS;
-        else {
-            uchar u0 = mBuffer.at(0), u1 = mBuffer.at(1), u2 = mBuffer.at(2), u3 = mBuffer.at(3);
-            // has a BOM?
-            if (u0 == 0xFF && u1 == 0xFE) { // utf-32 le or utf-16 le + BOM
-                mFormat = (u2 == 0 && u3 == 0 ) ? FormatUTF32LE : FormatUTF16LE;
-                mParserOffset++;
-            }
-            else if (u0 == 0xFE && u1 == 0xFF) { // utf16 be + BOM
-                mFormat = FormatUTF16BE;
-                mParserOffset++;
-            }
-            else if (u0 == 0x00 && u1 == 0x00 && u2 == 0xFE && u3 == 0xFF ) { // utf-32 be + BOM
-                mFormat = FormatUTF32BE;
-                mParserOffset++;
-            }
-            else if (u0 == 0xEF && u1 == 0xBB && u2 == 0xBF) { // utf8 + BOM
-                mFormat = FormatUTF8;
-                mParserOffset+=3;
-            }
-            // no BOM
-            else if (u0 == 0 && u1 != 0 && u2 == 0 && u3 != 0 ) {
-                mFormat = FormatUTF16BE;
-            }
-            else if (u0 != 0 && u1 == 0 && u2 != 0 && u3 == 0 ) {
-                mFormat = FormatUTF16LE;
-            }
-            else if (u0 == 0 && u1 == 0 && u2 == 0 && u3 != 0 ) {
-                mFormat = FormatUTF32BE;
-            }
-            else if (u0 != 0 && u1 == 0 && u2 == 0 && u3 == 0 ) {
-                mFormat = FormatUTF32LE;
-            }
-            else {
-                mFormat = FormatUTF8;
-            }
-        }
+    if (mScan.start < 0 && !inflateFrame())
+        return false;
+
+    if (!mCodec) {
+        // the codec is chosen once; every later message goes straight to it
+        int preambleSize = 0;
+        mCodec = QJsonCodec::detectCodec(mBuffer.constData(), mBuffer.size(), &preambleSize);
+        if (!mCodec)
+            return false;
+        mSession.reset(mCodec->createSession());
+        mBuffer.remove(0, preambleSize);
     }
 
-    switch (mFormat) {
-    case FormatUndefined:
-        break;
-    case FormatUTF8:
-        for (  ; mParserOffset < mBuffer.size() ; mParserOffset++ ) {
-            char c = mBuffer.at(mParserOffset);
-            if (mMessageAvailable) {
-                if (!isjsonws(c))
-                    break;
-            }
-            else if (scanUtf(c)) {
-                mMessageAvailable = true;
-            }
-        }
-        break;
-    case FormatUTF16BE:
-        for (  ; 2 * mParserOffset < mBuffer.size() ; mParserOffset++ ) {
-            int16_t c = qFromBigEndian(reinterpret_cast<const int16_t *>(mBuffer.constData())[mParserOffset]);
-            if (mMessageAvailable) {
-                if (!isjsonws(c))
-                    break;
-            }
-            else if (scanUtf(c)) {
-                mMessageAvailable = true;
-            }
-        }
-        break;
-    case FormatUTF16LE:
-        for (  ; 2 * mParserOffset < mBuffer.size() ; mParserOffset++ ) {
-            int16_t c = qFromLittleEndian(reinterpret_cast<const int16_t *>(mBuffer.constData())[mParserOffset]);
-            if (mMessageAvailable) {
-                if (!isjsonws(c))
-                    break;
-            }
-            else if (scanUtf(c)) {
-                mMessageAvailable = true;
-            }
-        }
-        break;
-    case FormatUTF32BE:
-        for (  ; 4 * mParserOffset < mBuffer.size() ; mParserOffset++ ) {
-            int32_t c = qFromBigEndian(reinterpret_cast<const int32_t *>(mBuffer.constData())[mParserOffset]);
-            if (mMessageAvailable) {
-                if (!isjsonws(c))
-                    break;
-            }
-            else if (scanUtf(c)) {
-                mMessageAvailable = true;
-            }
-        }
-        break;
-    case FormatUTF32LE:
-        for (  ; 4 * mParserOffset < mBuffer.size() ; mParserOffset++ ) {
-            int32_t c = qFromLittleEndian(reinterpret_cast<const int32_t *>(mBuffer.constData())[mParserOffset]);
-            if (mMessageAvailable) {
-                if (!isjsonws(c))
-                    break;
-            }
-            else if (scanUtf(c)) {
-                mMessageAvailable = true;
-            }
-        }
-        break;
-    case FormatBSON:
-        if (mBuffer.size() >= 8) {
-            qint32 message_size = qFromLittleEndian(((qint32 *)mBuffer.constData())[1]);
-            if (mBuffer.size() >= message_size + 4) {
-                mMessageSize = message_size;
-                mMessageAvailable = true;
-            }
-        }
-        break;
-    case FormatQBJS:
-        if (mBuffer.size() >= 12) {
-            // ### TODO: Should use 'sizeof(Header)'
-            qint32 message_size = qFromLittleEndian(((qint32 *)mBuffer.constData())[2]) + 8;
-            if (mBuffer.size() >= message_size) {
-                mMessageSize = message_size;
-                mMessageAvailable = true;
-            }
-        }
-        break;
+    mMessageAvailable = mCodec->scan(mBuffer, &mScan, mSession.data());
+    if (!mMessageAvailable && mScan.end > 0) {
+        qWarning() << "QJsonBuffer: discarding" << mScan.end << "bytes that do not start with a message";
+        mBuffer.remove(0, mScan.end);
+        resetParser();
     }
     return mMessageAvailable;
 }
 
 /*!
   \internal
+  Removes the next message from the buffer and returns it.  If \a consumed is
+  non-zero, it is set to the number of bytes the message occupied in the buffer.
 */
-QJsonObject QJsonBuffer::readMessage()
+QJsonObject QJsonBuffer::readMessage(int *consumed)
 {
     QJsonObject obj;
+    if (consumed)
+        *consumed = 0;
     if (messageAvailable()) {
         QScopedPointer<QMutexLocker> locker(createLocker());
-        switch (mFormat) {
-        case FormatUndefined:
-            break;
-        case FormatUTF8:
-            if (mParserStartOffset >= 0) {
-                QByteArray msg = rawData(mParserStartOffset, mParserOffset - mParserStartOffset);
-                obj = QJsonDocument::fromJson(msg).object();
-                // prepare for the next
-                mBuffer.remove(0, mParserOffset);
-                resetParser();
-            }
-            break;
-        case FormatUTF16BE:
-            if (mParserStartOffset >= 0) {
-                QByteArray msg = rawData(mParserStartOffset * 2, 2*(mParserOffset - mParserStartOffset));
-                QString s = QTextCodec::codecForName("UTF-16BE")->toUnicode(msg);
-                obj = QJsonDocument::fromJson(s.toUtf8()).object();
-                // prepare for the next
-                mBuffer.remove(0, mParserOffset*2);
-                resetParser();
-            }
-            break;
-        case FormatUTF16LE:
-            if (mParserStartOffset >= 0) {
-                QByteArray msg = rawData(mParserStartOffset * 2, 2*(mParserOffset - mParserStartOffset));
-                QString s = QTextCodec::codecForName("UTF-16LE")->toUnicode(msg);
-                obj = QJsonDocument::fromJson(s.toUtf8()).object();
-                // prepare for the next
-                mBuffer.remove(0, mParserOffset*2);
-                resetParser();
-            }
-            break;
-        case FormatUTF32BE:
-            if (mParserStartOffset >= 0) {
-                QByteArray msg = rawData(mParserStartOffset * 4, 4*(mParserOffset - mParserStartOffset));
-                QString s = QTextCodec::codecForName("UTF-32BE")->toUnicode(msg);
-                obj = QJsonDocument::fromJson(s.toUtf8()).object();
-                // prepare for the next
-                mBuffer.remove(0, mParserOffset*4);
-                resetParser();
-            }
-            break;
-        case FormatUTF32LE:
-            if (mParserStartOffset >= 0) {
-                QByteArray msg = rawData(mParserStartOffset * 4, 4*(mParserOffset - mParserStartOffset));
-                QString s = QTextCodec::codecForName("UTF-32LE")->toUnicode(msg);
-                obj = QJsonDocument::fromJson(s.toUtf8()).object();
-                // prepare for the next
-                mBuffer.remove(0, mParserOffset*4);
-                resetParser();
-            }
-            break;
-        case FormatBSON:
-            if (mMessageSize > 0) {
-                QByteArray msg = rawData(4, mMessageSize);
-                obj = QJsonDocument::fromVariant(BsonObject(msg).toMap()).object();
-                mBuffer.remove(0, mMessageSize+4);
-                mMessageSize = 0;
-            }
-            break;
-        case FormatQBJS:
-            if (mMessageSize > 0) {
-                QByteArray msg = rawData(0, mMessageSize);
-                obj = QJsonDocument::fromBinaryData(msg).object();
-                mBuffer.remove(0, mMessageSize);
-                mMessageSize = 0;
-            }
-            break;
-        }
-        mMessageAvailable = false;
+        int oldSize = mBuffer.size();
+        obj = mCodec->decode(mBuffer.constData() + mScan.start, mScan.size, mSession.data());
+        mBuffer.remove(0, mScan.end);
+        resetParser();
+        // report the size the message had on the wire
+        if (consumed)
+            *consumed = oldSize - mBuffer.size() - mInflatedGrowth;
+        mInflatedGrowth = 0;
     }
     return obj;
 }
 
+/*!
+  \internal
+  Removes the next message from the buffer and returns it as a BsonObject that has
+  not been decoded, so that reading a few fields costs neither a copy nor a full
+  conversion.  If the buffer holds exactly this one message, its memory is handed
+  over as it is.  If \a consumed is non-zero, it is set to the number of bytes the
+  message occupied in the buffer.
+
+  Returns an empty object, and leaves the buffer untouched, unless the format() is
+  FormatBSON.
+
+  QJsonStream reads BSON messages this way, and hands them out with
+  QJsonStream::readBsonMessage() once control messages and credit are dealt with.
+*/
+BsonObject QJsonBuffer::readBsonMessage(int *consumed)
+{
+    BsonObject bson;
+    if (consumed)
+        *consumed = 0;
+    if (messageAvailable()) {
+        QScopedPointer<QMutexLocker> locker(createLocker());
+        if (format() != FormatBSON)
+            return bson;
+
+        int frameSize = mScan.end;
+        if (frameSize == mBuffer.size()) {
+            QByteArray frame;
+            frame.swap(mBuffer);
+            bson = BsonObject(frame, mScan.start);
+        } else {
+            // share the buffer; removing the message then copies only what follows it
+            bson = BsonObject(mBuffer, mScan.start);
+            mBuffer.remove(0, frameSize);
+        }
+        resetParser();
+        if (consumed)
+            *consumed = frameSize - mInflatedGrowth;
+        mInflatedGrowth = 0;
+    }
+    return bson;
+}
+
 /*!
   Return the current encoding format used by the receive buffer
 */
 
 EncodingFormat QJsonBuffer::format() const
 {
-    return mFormat;
+    return mCodec ? mCodec->format() : FormatUndefined;
+}
+
+/*!
+  Parses the data that follows the current message as \a format, without trying
+  to detect it.  Used when the peer announces that it switches formats; must only
+  be called between messages.  With FormatUndefined the format of the next
+  message is detected again.
+*/
+
+void QJsonBuffer::setFormat(EncodingFormat format)
+{
+    const QJsonCodec *codec = QJsonCodec::codecForFormat(format);
+    QScopedPointer<QMutexLocker> locker(createLocker());
+    if (codec == mCodec)
+        return;
+    mCodec = codec;
+    mSession.reset(codec ? codec->createSession() : 0);
+    resetParser();
 }
 
 /*!
@@ -46,10 +46,13 @@
 #include <QByteArray>
 #include <QJsonObject>
 #include <QMutex>
+#include <QScopedPointer>
 
 #include "qjsonstream-global.h"
+#include "qjsoncodec.h"
 
 class QMutexLocker;
+class BsonObject;
 
 QT_BEGIN_NAMESPACE_JSONSTREAM
 
@@ -64,51 +67,55 @@ public:
     void clear();
 
     EncodingFormat  format() const;
+    void            setFormat(EncodingFormat format);
 
     bool messageAvailable();
-    QJsonObject readMessage();
+    QJsonObject readMessage(int *consumed = 0);
+    BsonObject readBsonMessage(int *consumed = 0);
 
     int size() const { return mBuffer.size(); }
 
+    static QByteArray compressFrame(const QByteArray& frame, int level);
+    void inflateStatistics(qint64 *frames, qint64 *compressedBytes, qint64 *bytes, qint64 *nsecs);
+
     inline bool isEnabled() const { return mEnabled; }
     inline void setEnabled(bool enable) { mEnabled = enable; }
 
     inline void setThreadProtection(bool enable) { mThreadProtection = enable; }
 
+    inline qint64 maxFrameSize() const { return mMaxFrameSize; }
+    inline void setMaxFrameSize(qint64 size) { mMaxFrameSize = size; }
+
 signals:
     void readyReadMessage();
+    void frameDiscarded();
 
 protected:
     QMutexLocker *createLocker();
 
 private:
     void processMessages();
-    bool scanUtf(int c);
     void resetParser();
-    QByteArray rawData(int _start, int _len) const;
+    bool inflateFrame();
 
 private:
-    enum UTF8ParsingState { ParseNormal, ParseInString, ParseInBackslash };
-
-    EncodingFormat   mFormat;
+    const QJsonCodec *mCodec;
+    QScopedPointer<QJsonCodecSession> mSession;
     QByteArray       mBuffer;
-    UTF8ParsingState mParserState;
-    int              mParserDepth;
-    int              mParserOffset;
-    int              mParserStartOffset;
+    QJsonCodec::ScanState mScan;
     bool             mEmittedReadyRead;
     bool             mMessageAvailable;
-    int              mMessageSize;
     bool             mEnabled;
     bool             mThreadProtection;
+    int              mInflatedGrowth;
+    qint64           mMaxFrameSize;
+    qint64           mInflatedFrames;
+    qint64           mInflatedCompressedBytes;
+    qint64           mInflatedBytes;
+    qint64           mInflateNsecs;
     QMutex           mMutex;
 };
 
-inline QByteArray QJsonBuffer::rawData(int _start, int _len) const
-{
-    return QByteArray::fromRawData(mBuffer.constData() + _start, _len);
-}
-
 QT_END_NAMESPACE_JSONSTREAM
 
 #endif  // _JSON_BUFFER_H
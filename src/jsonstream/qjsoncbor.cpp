@@ -0,0 +1,569 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include <QDebug>
+#include <QtEndian>
+#include <QJsonArray>
+#include <qnumeric.h>
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "qjsoncbor_p.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+/*
+    A FormatFramedCBOR frame is the CBOR self-describe tag (0xd9 0xd9 0xf7), the size
+    of the payload as an unsigned LEB128 varint and the payload, a CBOR (RFC 7049)
+    map holding the message.  The receiver finds the end of a frame from its first
+    few bytes, without scanning the payload.
+
+    Numbers that are integral and exactly representable as a double are written as
+    CBOR integers, all other numbers as 64-bit floats.  Strings are written as UTF-8.
+
+    FormatCBORDictionary frames start with 0xd9 0xd9 0xf8 instead.  In their maps a
+    key the session has not seen yet is written as a text string, which assigns it
+    the next id on both sides, and a known key as an unsigned integer holding its id.
+    Once knCBOR_MAX_DICTIONARY_KEYS keys are known, new keys are written as text
+    strings and no longer assigned ids.
+*/
+
+const int knCBOR_MAX_VARINT_SIZE = 5;
+const int knCBOR_MAX_NESTING = 512;
+const int knCBOR_MAX_DICTIONARY_KEYS = 65536;
+
+enum CborMajorType {
+    CborUnsigned = 0,
+    CborNegative = 1,
+    CborByteString = 2,
+    CborTextString = 3,
+    CborArray = 4,
+    CborMap = 5,
+    CborTag = 6,
+    CborSimple = 7
+};
+
+// the dictionary keys of the frame being encoded
+struct CborKeys
+{
+    QJsonKeyDictionary *dictionary;     // 0 unless the frame uses the dictionary
+    int                 nextDefinition; // id the next new key is written with
+};
+
+static int cborObjectSize(const QJsonObject &object, CborKeys *keys);
+static int cborArraySize(const QJsonArray &array, CborKeys *keys);
+static uchar *cborWriteObject(uchar *p, const QJsonObject &object, CborKeys *keys);
+static uchar *cborWriteArray(uchar *p, const QJsonArray &array, CborKeys *keys);
+
+static inline int cborHeadSize(quint64 n)
+{
+    if (n < 24)
+        return 1;
+    if (n <= 0xff)
+        return 2;
+    if (n <= 0xffff)
+        return 3;
+    if (n <= 0xffffffffULL)
+        return 5;
+    return 9;
+}
+
+static uchar *cborWriteHead(uchar *p, int major, quint64 n)
+{
+    uchar type = major << 5;
+    if (n < 24) {
+        *p++ = type | n;
+    } else if (n <= 0xff) {
+        *p++ = type | 24;
+        *p++ = n;
+    } else if (n <= 0xffff) {
+        *p++ = type | 25;
+        qToBigEndian<quint16>(n, p);
+        p += 2;
+    } else if (n <= 0xffffffffULL) {
+        *p++ = type | 26;
+        qToBigEndian<quint32>(n, p);
+        p += 4;
+    } else {
+        *p++ = type | 27;
+        qToBigEndian<quint64>(n, p);
+        p += 8;
+    }
+    return p;
+}
+
+// lone surrogates are written as U+FFFD, which also takes three bytes
+static int cborUtf8Size(const QString &s)
+{
+    int size = 0;
+    const ushort *c = s.utf16();
+    for (const ushort *e = c + s.size(); c != e; ++c) {
+        if (*c < 0x80)
+            size += 1;
+        else if (*c < 0x800)
+            size += 2;
+        else if (QChar::isHighSurrogate(*c) && c + 1 != e && QChar::isLowSurrogate(c[1])) {
+            size += 4;
+            ++c;
+        } else
+            size += 3;
+    }
+    return size;
+}
+
+static uchar *cborWriteUtf8(uchar *p, const QString &s)
+{
+    const ushort *c = s.utf16();
+    for (const ushort *e = c + s.size(); c != e; ++c) {
+        uint u = *c;
+        if (u < 0x80) {
+            *p++ = u;
+        } else if (u < 0x800) {
+            *p++ = 0xc0 | (u >> 6);
+            *p++ = 0x80 | (u & 0x3f);
+        } else if (QChar::isHighSurrogate(u) && c + 1 != e && QChar::isLowSurrogate(c[1])) {
+            u = QChar::surrogateToUcs4(u, c[1]);
+            ++c;
+            *p++ = 0xf0 | (u >> 18);
+            *p++ = 0x80 | ((u >> 12) & 0x3f);
+            *p++ = 0x80 | ((u >> 6) & 0x3f);
+            *p++ = 0x80 | (u & 0x3f);
+        } else {
+            if (QChar::isSurrogate(u))
+                u = QChar::ReplacementCharacter;
+            *p++ = 0xe0 | (u >> 12);
+            *p++ = 0x80 | ((u >> 6) & 0x3f);
+            *p++ = 0x80 | (u & 0x3f);
+        }
+    }
+    return p;
+}
+
+static inline bool cborIsInteger(double d, qint64 *i)
+{
+    // 2^53, beyond which a double does not hold every integer
+    const double limit = 9007199254740992.0;
+    if (!(d >= -limit && d <= limit))
+        return false;
+    *i = (qint64)d;
+    return (double)*i == d;
+}
+
+static inline int cborStringSize(const QString &s)
+{
+    int size = cborUtf8Size(s);
+    return cborHeadSize(size) + size;
+}
+
+static uchar *cborWriteString(uchar *p, const QString &s)
+{
+    p = cborWriteHead(p, CborTextString, cborUtf8Size(s));
+    return cborWriteUtf8(p, s);
+}
+
+/*
+    Returns the size of \a key.  Sizing a frame assigns ids to its new keys, so it
+    must be followed by writing the frame.
+*/
+static int cborKeySize(const QString &key, CborKeys *keys)
+{
+    if (QJsonKeyDictionary *dictionary = keys->dictionary) {
+        QHash<QString, int>::const_iterator it = dictionary->mIds.constFind(key);
+        if (it != dictionary->mIds.constEnd())
+            return cborHeadSize(it.value());
+        if (dictionary->mIds.size() < knCBOR_MAX_DICTIONARY_KEYS)
+            dictionary->mIds.insert(key, dictionary->mIds.size());
+    }
+    return cborStringSize(key);
+}
+
+static uchar *cborWriteKey(uchar *p, const QString &key, CborKeys *keys)
+{
+    if (keys->dictionary) {
+        int id = keys->dictionary->mIds.value(key, -1);
+        if (id >= 0 && id < keys->nextDefinition)
+            return cborWriteHead(p, CborUnsigned, id);
+        if (id == keys->nextDefinition)
+            keys->nextDefinition++;     // defined here, by its first use
+    }
+    return cborWriteString(p, key);
+}
+
+static int cborValueSize(const QJsonValue &value, CborKeys *keys)
+{
+    switch (value.type()) {
+    case QJsonValue::Double: {
+        qint64 i;
+        if (!cborIsInteger(value.toDouble(), &i))
+            return 9;
+        return cborHeadSize(i < 0 ? -1 - i : i);
+    }
+    case QJsonValue::String:
+        return cborStringSize(value.toString());
+    case QJsonValue::Array:
+        return cborArraySize(value.toArray(), keys);
+    case QJsonValue::Object:
+        return cborObjectSize(value.toObject(), keys);
+    default:
+        return 1;
+    }
+}
+
+static int cborObjectSize(const QJsonObject &object, CborKeys *keys)
+{
+    int size = cborHeadSize(object.size());
+    for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it)
+        size += cborKeySize(it.key(), keys) + cborValueSize(it.value(), keys);
+    return size;
+}
+
+static int cborArraySize(const QJsonArray &array, CborKeys *keys)
+{
+    int size = cborHeadSize(array.size());
+    for (int i = 0; i < array.size(); i++)
+        size += cborValueSize(array.at(i), keys);
+    return size;
+}
+
+static uchar *cborWriteValue(uchar *p, const QJsonValue &value, CborKeys *keys)
+{
+    switch (value.type()) {
+    case QJsonValue::Bool:
+        *p++ = value.toBool() ? 0xf5 : 0xf4;
+        break;
+    case QJsonValue::Double: {
+        double d = value.toDouble();
+        qint64 i;
+        if (cborIsInteger(d, &i)) {
+            p = i < 0 ? cborWriteHead(p, CborNegative, -1 - i) : cborWriteHead(p, CborUnsigned, i);
+        } else {
+            quint64 bits;
+            memcpy(&bits, &d, sizeof(bits));
+            *p++ = 0xfb;
+            qToBigEndian<quint64>(bits, p);
+            p += 8;
+        }
+    } break;
+    case QJsonValue::String:
+        p = cborWriteString(p, value.toString());
+        break;
+    case QJsonValue::Array:
+        p = cborWriteArray(p, value.toArray(), keys);
+        break;
+    case QJsonValue::Object:
+        p = cborWriteObject(p, value.toObject(), keys);
+        break;
+    default:
+        *p++ = 0xf6;    // null
+        break;
+    }
+    return p;
+}
+
+static uchar *cborWriteObject(uchar *p, const QJsonObject &object, CborKeys *keys)
+{
+    p = cborWriteHead(p, CborMap, object.size());
+    for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it) {
+        p = cborWriteKey(p, it.key(), keys);
+        p = cborWriteValue(p, it.value(), keys);
+    }
+    return p;
+}
+
+static uchar *cborWriteArray(uchar *p, const QJsonArray &array, CborKeys *keys)
+{
+    p = cborWriteHead(p, CborArray, array.size());
+    for (int i = 0; i < array.size(); i++)
+        p = cborWriteValue(p, array.at(i), keys);
+    return p;
+}
+
+static inline int varintSize(quint32 n)
+{
+    int size = 1;
+    for (; n >= 0x80; n >>= 7)
+        size++;
+    return size;
+}
+
+/*!
+    Appends \a object encoded as a FormatFramedCBOR frame to \a out or, if
+    \a dictionary is not null, as a FormatCBORDictionary frame that refers to
+    and extends \a dictionary.  \a out is grown exactly once.
+*/
+void cborAppendFrame(QByteArray &out, const QJsonObject &object, QJsonKeyDictionary *dictionary)
+{
+    CborKeys keys;
+    keys.dictionary = dictionary;
+    keys.nextDefinition = dictionary ? dictionary->mIds.size() : 0;
+    quint32 payloadSize = cborObjectSize(object, &keys);
+    int offset = out.size();
+    out.resize(offset + 3 + varintSize(payloadSize) + payloadSize);
+    uchar *p = reinterpret_cast<uchar *>(out.data()) + offset;
+    *p++ = 0xd9;
+    *p++ = 0xd9;
+    *p++ = dictionary ? 0xf8 : 0xf7;
+    for (; payloadSize >= 0x80; payloadSize >>= 7)
+        *p++ = 0x80 | (payloadSize & 0x7f);
+    *p++ = payloadSize;
+    uchar *end = cborWriteObject(p, object, &keys);
+    Q_ASSERT(end == reinterpret_cast<const uchar *>(out.constData()) + out.size());
+    Q_UNUSED(end);
+}
+
+/*!
+    Parses the header of the FormatFramedCBOR frame of at most \a size bytes at
+    \a data and stores the size of its payload in \a payloadSize.  Returns the
+    size of the header, 0 if more data is needed to tell, or -1 if \a data does
+    not start with a valid frame header.
+*/
+int cborReadFrameHeader(const char *data, int size, int *payloadSize)
+{
+    if (!cborIsFrame(data, size))
+        return size < 3 ? 0 : -1;
+
+    quint64 length = 0;
+    for (int i = 0; i < knCBOR_MAX_VARINT_SIZE; i++) {
+        if (3 + i >= size)
+            return 0;
+        uchar b = data[3 + i];
+        length |= quint64(b & 0x7f) << (7 * i);
+        if (!(b & 0x80)) {
+            if (length == 0 || length > quint64(INT_MAX - 8))
+                return -1;
+            *payloadSize = length;
+            return 4 + i;
+        }
+    }
+    return -1;
+}
+
+static bool cborReadValue(const uchar *&p, const uchar *end, int depth, QJsonKeyDictionary *dictionary,
+                          QJsonValue *value);
+
+/*
+    Reads the initial byte of a data item and its argument.  Indefinite lengths
+    and reserved values are rejected.
+*/
+static bool cborReadHead(const uchar *&p, const uchar *end, int *major, int *info, quint64 *n)
+{
+    if (p >= end)
+        return false;
+    *major = *p >> 5;
+    *info = *p & 0x1f;
+    p++;
+    int size;
+    switch (*info) {
+    case 24: size = 1; break;
+    case 25: size = 2; break;
+    case 26: size = 4; break;
+    case 27: size = 8; break;
+    default:
+        if (*info > 27)
+            return false;
+        *n = *info;
+        return true;
+    }
+    if (end - p < size)
+        return false;
+    switch (size) {
+    case 1: *n = *p; break;
+    case 2: *n = qFromBigEndian<quint16>(p); break;
+    case 4: *n = qFromBigEndian<quint32>(p); break;
+    default: *n = qFromBigEndian<quint64>(p); break;
+    }
+    p += size;
+    return true;
+}
+
+static double cborHalfToDouble(quint16 half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double d;
+    if (exponent == 0)
+        d = ldexp((double)mantissa, -24);
+    else if (exponent != 31)
+        d = ldexp((double)(mantissa + 1024), exponent - 25);
+    else
+        d = mantissa ? qQNaN() : qInf();
+    return (half & 0x8000) ? -d : d;
+}
+
+static bool cborReadSimple(int info, quint64 n, QJsonValue *value)
+{
+    switch (info) {
+    case 20:
+        *value = false;
+        break;
+    case 21:
+        *value = true;
+        break;
+    case 25:
+        *value = cborHalfToDouble(n);
+        break;
+    case 26: {
+        quint32 bits = n;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        *value = (double)f;
+    } break;
+    case 27: {
+        double d;
+        memcpy(&d, &n, sizeof(d));
+        *value = d;
+    } break;
+    default:
+        *value = QJsonValue(QJsonValue::Null);
+        break;
+    }
+    return true;
+}
+
+static bool cborReadKey(const uchar *&p, const uchar *end, QJsonKeyDictionary *dictionary, QString *key)
+{
+    int major, info;
+    quint64 n;
+    if (!cborReadHead(p, end, &major, &info, &n))
+        return false;
+    if (major == CborUnsigned && dictionary) {
+        if (n >= quint64(dictionary->mKeys.size()))
+            return false;
+        *key = dictionary->mKeys.at(n);
+        return true;
+    }
+    if (major != CborTextString || n > quint64(end - p))
+        return false;
+    *key = QString::fromUtf8(reinterpret_cast<const char *>(p), n);
+    p += n;
+    if (dictionary && dictionary->mKeys.size() < knCBOR_MAX_DICTIONARY_KEYS)
+        dictionary->mKeys.append(*key);
+    return true;
+}
+
+static bool cborReadValue(const uchar *&p, const uchar *end, int depth, QJsonKeyDictionary *dictionary,
+                          QJsonValue *value)
+{
+    if (depth > knCBOR_MAX_NESTING)
+        return false;
+
+    int major, info;
+    quint64 n;
+    if (!cborReadHead(p, end, &major, &info, &n))
+        return false;
+
+    switch (major) {
+    case CborUnsigned:
+        *value = (double)n;
+        break;
+    case CborNegative:
+        *value = -1.0 - (double)n;
+        break;
+    case CborByteString:
+    case CborTextString:
+        if (n > quint64(end - p))
+            return false;
+        if (major == CborTextString)
+            *value = QString::fromUtf8(reinterpret_cast<const char *>(p), n);
+        else
+            *value = QString::fromLatin1(QByteArray::fromRawData(reinterpret_cast<const char *>(p), n).toBase64());
+        p += n;
+        break;
+    case CborArray: {
+        // every item takes at least one byte
+        if (n > quint64(end - p))
+            return false;
+        QJsonArray array;
+        for (quint64 i = 0; i < n; i++) {
+            QJsonValue item;
+            if (!cborReadValue(p, end, depth + 1, dictionary, &item))
+                return false;
+            array.append(item);
+        }
+        *value = array;
+    } break;
+    case CborMap: {
+        if (n > quint64(end - p) / 2)
+            return false;
+        QJsonObject object;
+        for (quint64 i = 0; i < n; i++) {
+            QString key;
+            if (!cborReadKey(p, end, dictionary, &key))
+                return false;
+            QJsonValue item;
+            if (!cborReadValue(p, end, depth + 1, dictionary, &item))
+                return false;
+            object.insert(key, item);
+        }
+        *value = object;
+    } break;
+    case CborTag:
+        // tags only annotate the item that follows
+        return cborReadValue(p, end, depth + 1, dictionary, value);
+    default:
+        return cborReadSimple(info, n, value);
+    }
+    return true;
+}
+
+/*!
+    Decodes the CBOR payload of \a size bytes at \a data directly into a QJsonObject.
+    If \a dictionary is not null, the payload is that of a FormatCBORDictionary
+    frame, and its keys are looked up in and added to \a dictionary.  Keys found
+    in the dictionary are not decoded again.
+    Returns an empty object if the payload is malformed or not a map.
+*/
+QJsonObject cborToJsonObject(const char *data, int size, QJsonKeyDictionary *dictionary)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + size;
+    QJsonValue value;
+    if (!cborReadValue(p, end, 0, dictionary, &value) || p != end || !value.isObject()) {
+        qWarning() << "cborToJsonObject: malformed CBOR document";
+        return QJsonObject();
+    }
+    return value.toObject();
+}
+
+QT_END_NAMESPACE_JSONSTREAM
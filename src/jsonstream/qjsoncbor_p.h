@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef _JSON_CBOR_H
+#define _JSON_CBOR_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include "qjsonstream-global.h"
+#include "qjsoncodec.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+/*
+  Keys a FormatCBORDictionary session has assigned small integer ids to.  Each
+  direction of a stream has its own dictionary; the sender fills mIds and the
+  receiver mKeys, in the same order.  The sender only commits the ids of frames
+  that have been written, so that a dropped frame does not leave ids behind
+  that the receiver has never been told.
+*/
+struct QJsonKeyDictionary : public QJsonCodecSession
+{
+    QJsonKeyDictionary() : mCommitted(0) {}
+
+    void clear() { mIds.clear(); mKeys.clear(); mCommitted = 0; }
+    void commit() { mCommitted = mIds.size(); }
+    void rollback()
+    {
+        // ids are handed out in order, so the dropped frames defined the highest ones
+        QHash<QString, int>::iterator it = mIds.begin();
+        while (it != mIds.end()) {
+            if (it.value() >= mCommitted)
+                it = mIds.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    QHash<QString, int> mIds;
+    QVector<QString>    mKeys;
+    int                 mCommitted;
+};
+
+// every frame starts with a CBOR tag: 55799 (self-describe) for FormatFramedCBOR,
+// 55800 for frames whose keys refer to the session dictionary
+inline bool cborIsFrame(const char *data, int size)
+{
+    return size >= 3 && (uchar)data[0] == 0xd9 && (uchar)data[1] == 0xd9 &&
+            ((uchar)data[2] == 0xf7 || (uchar)data[2] == 0xf8);
+}
+
+inline bool cborFrameUsesDictionary(const char *data)
+{
+    return (uchar)data[2] == 0xf8;
+}
+
+Q_ADDON_JSONSTREAM_EXPORT void cborAppendFrame(QByteArray &out, const QJsonObject &object,
+                                               QJsonKeyDictionary *dictionary = 0);
+Q_ADDON_JSONSTREAM_EXPORT int cborReadFrameHeader(const char *data, int size, int *payloadSize);
+Q_ADDON_JSONSTREAM_EXPORT QJsonObject cborToJsonObject(const char *data, int size,
+                                                       QJsonKeyDictionary *dictionary = 0);
+
+QT_END_NAMESPACE_JSONSTREAM
+
+#endif  // _JSON_CBOR_H
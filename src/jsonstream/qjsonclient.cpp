@@ -135,6 +135,7 @@ bool QJsonClient::connectTCP(const QString& hostname, int port)
         Q_D(QJsonClient);
         d->mStream.setDevice(socket);
         connect(&d->mStream, SIGNAL(readyReadMessage()), this, SLOT(processMessages()));
+        d->mStream.negotiateFormat();
 
         return d->mStream.send(d->mRegistrationMessage);
     }
@@ -162,6 +163,7 @@ bool QJsonClient::connectLocal(const QString& socketname)
         Q_D(QJsonClient);
         d->mStream.setDevice(socket);
         connect(&d->mStream, SIGNAL(readyReadMessage()), this, SLOT(processMessages()));
+        d->mStream.negotiateFormat();
         // qDebug() << "Sending local socket registration message" << mRegistrationMessage;
         return d->mStream.send(d->mRegistrationMessage);
     }
@@ -197,6 +199,31 @@ void QJsonClient::setFormat( EncodingFormat format )
     d->mStream.setFormat(format);
 }
 
+/*!
+  Returns the formats offered to the server when connecting, most preferred first.
+*/
+
+QList<EncodingFormat> QJsonClient::acceptedFormats() const
+{
+    Q_D(const QJsonClient);
+    return d->mStream.acceptedFormats();
+}
+
+/*!
+  Sets the \a formats offered to the server when connecting, most preferred first.
+  If the server takes part in format negotiation, both sides switch to the first
+  of the server's accepted formats that is in this list once the connection is
+  established.  An empty list, the default, keeps the format set with setFormat().
+
+  \sa QJsonStream::negotiateFormat()
+*/
+
+void QJsonClient::setAcceptedFormats(const QList<EncodingFormat>& formats)
+{
+    Q_D(QJsonClient);
+    d->mStream.setAcceptedFormats(formats);
+}
+
 /*!
   \internal
 */
@@ -43,6 +43,7 @@
 #define JSON_CLIENT_H
 
 #include <QObject>
+#include <QList>
 #include <QVariant>
 #include <QJsonObject>
 
@@ -66,6 +67,9 @@ public:
     bool send(const QJsonObject&);
     void setFormat( EncodingFormat format );
 
+    QList<EncodingFormat> acceptedFormats() const;
+    void setAcceptedFormats(const QList<EncodingFormat>& formats);
+
     // Do we really need a "connect with delay or error" facility?
     // All singleton information will be put in other classes...
 
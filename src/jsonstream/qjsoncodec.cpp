@@ -0,0 +1,630 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include <QDebug>
+#include <QtEndian>
+#include <QJsonDocument>
+#include <QTextCodec>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <string.h>
+
+#include "qjsoncodec.h"
+#include "qjsoncbor_p.h"
+#include "bson/qt-bson_p.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+template <typename T>
+inline bool isjsonws(T c)
+{
+    return c == '\n' || c == ' ' || c == '\t' || c == '\r';
+}
+
+/****************************************************************************/
+
+enum TextScanMode { ScanNormal, ScanInString, ScanInBackslash };
+
+template <typename Unit, bool BigEndian>
+struct UnitReader
+{
+    static inline uint read(const uchar *p)
+    {
+        return BigEndian ? qFromBigEndian<Unit>(p) : qFromLittleEndian<Unit>(p);
+    }
+};
+
+template <bool BigEndian>
+struct UnitReader<quint8, BigEndian>
+{
+    static inline uint read(const uchar *p) { return *p; }
+};
+
+/*
+  JSON text in UTF-8, UTF-16 or UTF-32.  Messages are delimited by scanning for
+  the brace that closes the top level object; the scanner is specialized for
+  each code unit size and byte order.
+*/
+template <typename Unit, bool BigEndian>
+class QJsonTextCodec : public QJsonCodec
+{
+public:
+    QJsonTextCodec(EncodingFormat format, const char *textCodecName)
+        : QJsonCodec(format), mTextCodecName(textCodecName) {}
+
+    int detect(const char *data, int size) const;
+    int separatorSize(const char *data, int size) const;
+    void encode(QByteArray& out, const QJsonObject& object, QJsonCodecSession *session) const;
+    bool scan(const QByteArray& buffer, ScanState *state, QJsonCodecSession *session) const;
+    QJsonObject decode(const char *data, int size, QJsonCodecSession *session) const;
+
+private:
+    static inline uint unitAt(const uchar *data, int index)
+    {
+        return UnitReader<Unit, BigEndian>::read(data + index * sizeof(Unit));
+    }
+
+    const char *mTextCodecName;
+};
+
+template <typename Unit, bool BigEndian>
+int QJsonTextCodec<Unit, BigEndian>::detect(const char *data, int size) const
+{
+    if (size < 4)
+        return -1;
+    const uchar *u = reinterpret_cast<const uchar *>(data);
+    if (sizeof(Unit) == 1) {
+        // UTF-8 is assumed for anything the other codecs do not recognize
+        return (u[0] == 0xEF && u[1] == 0xBB && u[2] == 0xBF) ? 3 : 0;
+    }
+    if (sizeof(Unit) == 2) {
+        if (BigEndian) {
+            if (u[0] == 0xFE && u[1] == 0xFF)
+                return 2;
+            return (u[0] == 0 && u[1] != 0 && u[2] == 0 && u[3] != 0) ? 0 : -1;
+        }
+        if (u[0] == 0xFF && u[1] == 0xFE)
+            return (u[2] == 0 && u[3] == 0) ? -1 : 2;   // not the UTF-32 BOM
+        return (u[0] != 0 && u[1] == 0 && u[2] != 0 && u[3] == 0) ? 0 : -1;
+    }
+    if (BigEndian) {
+        if (u[0] == 0 && u[1] == 0 && u[2] == 0xFE && u[3] == 0xFF)
+            return 4;
+        return (u[0] == 0 && u[1] == 0 && u[2] == 0 && u[3] != 0) ? 0 : -1;
+    }
+    if (u[0] == 0xFF && u[1] == 0xFE && u[2] == 0 && u[3] == 0)
+        return 4;
+    return (u[0] != 0 && u[1] == 0 && u[2] == 0 && u[3] == 0) ? 0 : -1;
+}
+
+template <typename Unit, bool BigEndian>
+int QJsonTextCodec<Unit, BigEndian>::separatorSize(const char *data, int size) const
+{
+    const uchar *u = reinterpret_cast<const uchar *>(data);
+    int units = size / sizeof(Unit);
+    int n = 0;
+    while (n < units && isjsonws(unitAt(u, n)))
+        n++;
+    return n * sizeof(Unit);
+}
+
+template <typename Unit, bool BigEndian>
+void QJsonTextCodec<Unit, BigEndian>::encode(QByteArray& out, const QJsonObject& object,
+                                             QJsonCodecSession *session) const
+{
+    Q_UNUSED(session);
+    QByteArray json = QJsonDocument(object).toJson();
+    if (sizeof(Unit) == 1)
+        out.append(json);
+    else    // chop off the BOM
+        out.append(QTextCodec::codecForName(mTextCodecName)->fromUnicode(QString::fromUtf8(json)).mid(sizeof(Unit)));
+}
+
+template <typename Unit, bool BigEndian>
+bool QJsonTextCodec<Unit, BigEndian>::scan(const QByteArray& buffer, ScanState *state,
+                                           QJsonCodecSession *session) const
+{
+    Q_UNUSED(session);
+    const uchar *data = reinterpret_cast<const uchar *>(buffer.constData());
+    int units = buffer.size() / sizeof(Unit);
+    for ( ; state->offset < units ; state->offset++ ) {
+        uint c = unitAt(data, state->offset);
+        if (state->size > 0) {
+            // also consume the whitespace that follows the message
+            if (!isjsonws(c))
+                break;
+            continue;
+        }
+        switch (state->mode) {
+        case ScanNormal:
+            if ( c == '{' ) {
+                if ( state->depth == 0 )
+                    state->start = state->offset * sizeof(Unit);
+                state->depth += 1;
+            }
+            else if ( c == '}' && state->depth > 0 ) {
+                state->depth -= 1;
+                if ( state->depth == 0 )
+                    state->size = (state->offset + 1) * sizeof(Unit) - state->start;
+            }
+            else if ( c == '"' ) {
+                state->mode = ScanInString;
+            }
+            break;
+        case ScanInString:
+            if ( c == '"' ) {
+                state->mode = ScanNormal;
+            } else if ( c == '\\' ) {
+                state->mode = ScanInBackslash;
+            }
+            break;
+        case ScanInBackslash:
+            state->mode = ScanInString;
+            break;
+        }
+    }
+    if (state->size == 0)
+        return false;
+    state->end = state->offset * sizeof(Unit);
+    return true;
+}
+
+template <typename Unit, bool BigEndian>
+QJsonObject QJsonTextCodec<Unit, BigEndian>::decode(const char *data, int size,
+                                                    QJsonCodecSession *session) const
+{
+    Q_UNUSED(session);
+    QByteArray msg = QByteArray::fromRawData(data, size);
+    if (sizeof(Unit) == 1)
+        return QJsonDocument::fromJson(msg).object();
+    QString s = QTextCodec::codecForName(mTextCodecName)->toUnicode(msg);
+    return QJsonDocument::fromJson(s.toUtf8()).object();
+}
+
+/****************************************************************************/
+
+class QJsonQbjsCodec : public QJsonCodec
+{
+public:
+    QJsonQbjsCodec() : QJsonCodec(FormatQBJS) {}
+
+    int detect(const char *data, int size) const
+    {
+        if (size < 4)
+            return -1;
+        uint tag;
+        memcpy(&tag, data, sizeof(tag));
+        return tag == QJsonDocument::BinaryFormatTag ? 0 : -1;
+    }
+
+    void encode(QByteArray& out, const QJsonObject& object, QJsonCodecSession *) const
+    {
+        out.append(QJsonDocument(object).toBinaryData());
+    }
+
+    bool scan(const QByteArray& buffer, ScanState *state, QJsonCodecSession *) const
+    {
+        if (buffer.size() < 12)
+            return false;
+        // ### TODO: Should use 'sizeof(Header)'
+        qint32 size = qFromLittleEndian<qint32>(reinterpret_cast<const uchar *>(buffer.constData()) + 8) + 8;
+        if (buffer.size() < size)
+            return false;
+        state->start = 0;
+        state->size = state->end = size;
+        return true;
+    }
+
+    QJsonObject decode(const char *data, int size, QJsonCodecSession *) const
+    {
+        return QJsonDocument::fromBinaryData(QByteArray::fromRawData(data, size)).object();
+    }
+};
+
+/****************************************************************************/
+
+class QJsonBsonCodec : public QJsonCodec
+{
+public:
+    QJsonBsonCodec() : QJsonCodec(FormatBSON) {}
+
+    int detect(const char *data, int size) const
+    {
+        return (size >= 4 && strncmp("bson", data, 4) == 0) ? 0 : -1;
+    }
+
+    void encode(QByteArray& out, const QJsonObject& object, QJsonCodecSession *) const
+    {
+        // the "bson" tag is written in the same allocation as the document
+        bsonAppendJsonObject(out, object, "bson");
+    }
+
+    bool scan(const QByteArray& buffer, ScanState *state, QJsonCodecSession *) const
+    {
+        if (buffer.size() < 8)
+            return false;
+        qint32 size = qFromLittleEndian<qint32>(reinterpret_cast<const uchar *>(buffer.constData()) + 4);
+        if (size < 5) {
+            state->end = buffer.size();
+            return false;
+        }
+        if (buffer.size() < size + 4)
+            return false;
+        state->start = 4;
+        state->size = size;
+        state->end = size + 4;
+        return true;
+    }
+
+    QJsonObject decode(const char *data, int size, QJsonCodecSession *) const
+    {
+        return bsonToJsonObject(data, size);
+    }
+};
+
+/****************************************************************************/
+
+/*
+  FormatFramedCBOR and FormatCBORDictionary differ in how they encode, but both
+  accept either kind of frame, so both keep a key dictionary for the session.
+*/
+class QJsonCborCodec : public QJsonCodec
+{
+public:
+    explicit QJsonCborCodec(EncodingFormat format) : QJsonCodec(format) {}
+
+    int detect(const char *data, int size) const
+    {
+        if (!cborIsFrame(data, size))
+            return -1;
+        return cborFrameUsesDictionary(data) == (format() == FormatCBORDictionary) ? 0 : -1;
+    }
+
+    QJsonCodecSession *createSession() const
+    {
+        return new QJsonKeyDictionary;
+    }
+
+    void encode(QByteArray& out, const QJsonObject& object, QJsonCodecSession *session) const
+    {
+        QJsonKeyDictionary *dictionary = 0;
+        if (format() == FormatCBORDictionary)
+            dictionary = static_cast<QJsonKeyDictionary *>(session);
+        cborAppendFrame(out, object, dictionary);
+    }
+
+    bool scan(const QByteArray& buffer, ScanState *state, QJsonCodecSession *) const
+    {
+        // the header alone tells where the frame ends
+        int payloadSize = 0;
+        int headerSize = cborReadFrameHeader(buffer.constData(), buffer.size(), &payloadSize);
+        if (headerSize < 0) {
+            state->end = buffer.size();
+            return false;
+        }
+        if (headerSize == 0 || buffer.size() - headerSize < payloadSize)
+            return false;
+        state->start = 0;
+        state->size = state->end = headerSize + payloadSize;
+        return true;
+    }
+
+    QJsonObject decode(const char *data, int size, QJsonCodecSession *session) const
+    {
+        int payloadSize = 0;
+        int headerSize = cborReadFrameHeader(data, size, &payloadSize);
+        if (headerSize <= 0)
+            return QJsonObject();
+        QJsonKeyDictionary *dictionary = 0;
+        if (cborFrameUsesDictionary(data))
+            dictionary = static_cast<QJsonKeyDictionary *>(session);
+        return cborToJsonObject(data + headerSize, payloadSize, dictionary);
+    }
+};
+
+/****************************************************************************/
+
+class QJsonCodecRegistry
+{
+public:
+    QJsonCodecRegistry();
+    ~QJsonCodecRegistry();
+
+    QMutex             mMutex;
+    QList<QJsonCodec *> mCodecs;    // in the order they are asked to detect a format
+    QList<QJsonCodec *> mBuiltins;
+};
+
+QJsonCodecRegistry::QJsonCodecRegistry()
+{
+    // UTF-8 accepts anything and has to come last
+    mBuiltins << new QJsonBsonCodec
+              << new QJsonCborCodec(FormatFramedCBOR)
+              << new QJsonCborCodec(FormatCBORDictionary)
+              << new QJsonQbjsCodec
+              << new QJsonTextCodec<quint32, false>(FormatUTF32LE, "UTF-32LE")
+              << new QJsonTextCodec<quint16, false>(FormatUTF16LE, "UTF-16LE")
+              << new QJsonTextCodec<quint16, true>(FormatUTF16BE, "UTF-16BE")
+              << new QJsonTextCodec<quint32, true>(FormatUTF32BE, "UTF-32BE")
+              << new QJsonTextCodec<quint8, false>(FormatUTF8, 0);
+    mCodecs = mBuiltins;
+}
+
+QJsonCodecRegistry::~QJsonCodecRegistry()
+{
+    qDeleteAll(mBuiltins);
+}
+
+Q_GLOBAL_STATIC(QJsonCodecRegistry, codecRegistry)
+
+/****************************************************************************/
+
+/*!
+  \class QJsonCodecSession
+  \inmodule QtJsonStream
+  \brief The QJsonCodecSession class is the base of the state a QJsonCodec keeps
+  for one direction of a connection.
+
+  \sa QJsonCodec::createSession()
+*/
+
+/*!
+  Destroys the session.
+*/
+QJsonCodecSession::~QJsonCodecSession()
+{
+}
+
+/*!
+  Keeps what the frames encoded since the last commit() or rollback() have added
+  to the session, because they have been written or queued for writing.
+
+  The default implementation does nothing.
+*/
+void QJsonCodecSession::commit()
+{
+}
+
+/*!
+  Forgets what the frames encoded since the last commit() or rollback() have added
+  to the session, because they were dropped and the peer will never see them.
+
+  The default implementation does nothing.
+*/
+void QJsonCodecSession::rollback()
+{
+}
+
+/*!
+  \class QJsonCodec
+  \inmodule QtJsonStream
+  \brief The QJsonCodec class encodes and decodes the messages of one EncodingFormat.
+
+  There is one codec object for every format.  QJsonStream, QJsonPipe and the
+  receive buffer behind them look the codec up once, when the format is set or
+  detected, and then call it for every message instead of deciding again what to
+  do for the format.
+
+  Support for another format is added by subclassing QJsonCodec, using a format
+  of at least \l{FormatUser}, and registering an instance with registerCodec().
+  Codecs must be reentrant: the same object is used by all streams at once, and
+  anything that belongs to a connection goes into a QJsonCodecSession.
+*/
+
+/*!
+  \class QJsonCodec::ScanState
+  \inmodule QtJsonStream
+  \brief The ScanState class tracks the search for the next message in a receive buffer.
+
+  scan() may keep its progress in \c offset, \c depth and \c mode, so that it can
+  continue where it stopped when more data arrives.  Once a message is found, it
+  stores the position of the bytes to decode in \c start and \c size, and the
+  number of bytes the message occupies in the buffer in \c end.  A new ScanState
+  is used for every message.
+*/
+
+/*!
+  Constructs a codec for \a format.
+*/
+QJsonCodec::QJsonCodec(EncodingFormat format)
+    : mFormat(format)
+{
+}
+
+/*!
+  Destroys the codec.  A registered codec must not be destroyed.
+*/
+QJsonCodec::~QJsonCodec()
+{
+}
+
+/*!
+  \fn EncodingFormat QJsonCodec::format() const
+
+  Returns the format this codec handles.
+*/
+
+/*!
+  Returns the number of bytes to skip, such as a byte order mark, if the \a size
+  bytes at \a data start a stream in this codec's format, or -1 if they do not.
+  At least four bytes are available.  The default implementation returns -1,
+  meaning the format is never detected and has to be set explicitly.
+*/
+int QJsonCodec::detect(const char *data, int size) const
+{
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    return -1;
+}
+
+/*!
+  Returns a new session for one direction of a connection, or 0 if the codec
+  keeps no state.  The caller takes ownership.  The default implementation
+  returns 0.
+*/
+QJsonCodecSession *QJsonCodec::createSession() const
+{
+    return 0;
+}
+
+/*!
+  Returns the number of bytes at the start of the \a size bytes at \a data that
+  may separate messages, such as whitespace between JSON texts.  The default
+  implementation returns 0.
+*/
+int QJsonCodec::separatorSize(const char *data, int size) const
+{
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    return 0;
+}
+
+/*!
+  \fn void QJsonCodec::encode(QByteArray& out, const QJsonObject& object, QJsonCodecSession *session) const
+
+  Appends \a object, encoded as a complete message, to \a out.  \a session is the
+  sending side's session, or 0 if the message must be decodable without it, for
+  example because it may be written to a later connection.
+*/
+
+/*!
+  \fn bool QJsonCodec::scan(const QByteArray& buffer, ScanState *state, QJsonCodecSession *session) const
+
+  Looks for a complete message at the start of \a buffer and returns \b true if
+  there is one, described by \a state.  \a buffer may have grown since the last
+  call with the same \a state.  If the data cannot be parsed, sets the \c end of
+  \a state to the number of bytes to discard and returns \b false.  \a session
+  is the receiving side's session.
+*/
+
+/*!
+  \fn QJsonObject QJsonCodec::decode(const char *data, int size, QJsonCodecSession *session) const
+
+  Decodes the message in the \a size bytes at \a data, as found by scan(), using
+  the receiving side's \a session.  Returns an empty object if the message is
+  malformed.
+*/
+
+/*!
+  Registers \a codec for its format(), replacing a codec registered for the same
+  format before.  Codecs of new formats are asked to detect() a format before the
+  built-in ones.  The registry does not take ownership; \a codec must stay valid
+  for as long as any stream may use it.
+*/
+void QJsonCodec::registerCodec(QJsonCodec *codec)
+{
+    if (!codec || codec->format() == FormatUndefined) {
+        qWarning() << Q_FUNC_INFO << "Invalid codec";
+        return;
+    }
+    QJsonCodecRegistry *registry = codecRegistry();
+    QMutexLocker locker(&registry->mMutex);
+    for (int i = 0; i < registry->mCodecs.size(); i++) {
+        if (registry->mCodecs.at(i)->format() == codec->format()) {
+            registry->mCodecs[i] = codec;
+            return;
+        }
+    }
+    registry->mCodecs.prepend(codec);
+}
+
+/*!
+  Returns the codec registered for \a format, or 0 if there is none.
+*/
+QJsonCodec *QJsonCodec::codecForFormat(EncodingFormat format)
+{
+    QJsonCodecRegistry *registry = codecRegistry();
+    QMutexLocker locker(&registry->mMutex);
+    foreach (QJsonCodec *codec, registry->mCodecs) {
+        if (codec->format() == format)
+            return codec;
+    }
+    return 0;
+}
+
+/*!
+  Returns the codec whose format the \a size bytes at \a data start with, and
+  stores the number of bytes to skip before the first message in \a preambleSize.
+*/
+QJsonCodec *QJsonCodec::detectCodec(const char *data, int size, int *preambleSize)
+{
+    QJsonCodecRegistry *registry = codecRegistry();
+    QMutexLocker locker(&registry->mMutex);
+    foreach (QJsonCodec *codec, registry->mCodecs) {
+        int preamble = codec->detect(data, size);
+        if (preamble >= 0) {
+            if (preambleSize)
+                *preambleSize = preamble;
+            return codec;
+        }
+    }
+    return 0;
+}
+
+/*!
+  Returns a short, stable name for \a format, such as "utf8" or "cbor", for use in
+  statistics and log messages.  Formats from FormatUser on are named "user+N".
+*/
+QString QJsonCodec::formatName(EncodingFormat format)
+{
+    switch (format) {
+    case FormatUndefined: return QStringLiteral("undefined");
+    case FormatUTF8: return QStringLiteral("utf8");
+    case FormatBSON: return QStringLiteral("bson");
+    case FormatQBJS: return QStringLiteral("qbjs");
+    case FormatUTF16BE: return QStringLiteral("utf16be");
+    case FormatUTF16LE: return QStringLiteral("utf16le");
+    case FormatUTF32BE: return QStringLiteral("utf32be");
+    case FormatUTF32LE: return QStringLiteral("utf32le");
+    case FormatFramedCBOR: return QStringLiteral("cbor");
+    case FormatCBORDictionary: return QStringLiteral("cbordict");
+    default:
+        break;
+    }
+    if (format >= FormatUser)
+        return QStringLiteral("user+%1").arg(format - FormatUser);
+    return QString::number(format);
+}
+
+QT_END_NAMESPACE_JSONSTREAM
@@ -0,0 +1,103 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef _JSON_CODEC_H
+#define _JSON_CODEC_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include "qjsonstream-global.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+class Q_ADDON_JSONSTREAM_EXPORT QJsonCodecSession
+{
+public:
+    virtual ~QJsonCodecSession();
+
+    virtual void commit();
+    virtual void rollback();
+};
+
+class Q_ADDON_JSONSTREAM_EXPORT QJsonCodec
+{
+public:
+    struct ScanState
+    {
+        ScanState() : offset(0), depth(0), mode(0), start(-1), size(0), end(0) {}
+
+        int offset;
+        int depth;
+        int mode;
+        int start;
+        int size;
+        int end;
+    };
+
+    explicit QJsonCodec(EncodingFormat format);
+    virtual ~QJsonCodec();
+
+    EncodingFormat format() const { return mFormat; }
+
+    virtual int detect(const char *data, int size) const;
+    virtual QJsonCodecSession *createSession() const;
+    virtual int separatorSize(const char *data, int size) const;
+
+    virtual void encode(QByteArray& out, const QJsonObject& object, QJsonCodecSession *session) const = 0;
+    virtual bool scan(const QByteArray& buffer, ScanState *state, QJsonCodecSession *session) const = 0;
+    virtual QJsonObject decode(const char *data, int size, QJsonCodecSession *session) const = 0;
+
+    static void registerCodec(QJsonCodec *codec);
+    static QJsonCodec *codecForFormat(EncodingFormat format);
+    static QJsonCodec *detectCodec(const char *data, int size, int *preambleSize);
+
+    static QString formatName(EncodingFormat format);
+
+private:
+    Q_DISABLE_COPY(QJsonCodec)
+    EncodingFormat mFormat;
+};
+
+QT_END_NAMESPACE_JSONSTREAM
+
+#endif  // _JSON_CODEC_H
@@ -43,6 +43,7 @@
 #include "qjsonconnectionprocessor_p.h"
 #include "qjsonendpoint.h"
 #include "qjsonendpointmanager_p.h"
+#include "qjsonconnectionthreadpool_p.h"
 #include <QThread>
 #include <QTimer>
 #include <QDebug>
@@ -55,12 +56,23 @@ public:
     QJsonConnectionPrivate()
         : mTcpHostPort(0)
         , mAutoReconnectEnabled(false)
+        , mReconnectInitialDelay(5000)
+        , mReconnectMultiplier(1.0)
+        , mReconnectMaximumDelay(60000)
+        , mReconnectJitter(0.0)
+        , mReconnectImmediately(false)
+        , mReplayUnacknowledged(false)
+        , mOutboundBufferMaxBytes(0)
+        , mOutboundBufferMaxMessages(0)
+        , mFlowControlWindow(0)
+        , mFlowControlWindowBytes(0)
         , mUseSeparateThread(false)
         , mReadBufferSize(0)
         , mWriteBufferSize(0)
         , mManager(0)
         , mConnected(0)
         , mProcessorThread(0)
+        , mPooledThread(false)
         , mError(QJsonConnection::NoError)
         , mSubError(0) {}
 
@@ -68,6 +80,18 @@ public:
     QString     mTcpHostName;
     int         mTcpHostPort;
     bool        mAutoReconnectEnabled;
+    int         mReconnectInitialDelay;
+    qreal       mReconnectMultiplier;
+    int         mReconnectMaximumDelay;
+    qreal       mReconnectJitter;
+    bool        mReconnectImmediately;
+    bool        mReplayUnacknowledged;
+    qint64      mOutboundBufferMaxBytes;
+    int         mOutboundBufferMaxMessages;
+    QString     mOutboundBufferSpillFile;
+    int         mFlowControlWindow;
+    qint64      mFlowControlWindowBytes;
+    QList<EncodingFormat> mAcceptedFormats;
     bool        mUseSeparateThread;
     qint64      mReadBufferSize;
     qint64      mWriteBufferSize;
@@ -75,6 +99,7 @@ public:
     QJsonConnectionProcessor *mProcessor;
     bool mConnected;
     QThread *mProcessorThread;
+    bool mPooledThread;
 
     QJsonConnection::Error mError;
     int                   mSubError;
@@ -88,6 +113,12 @@ public:
         if (!mUseSeparateThread)
             return;
 
+        if ((mProcessorThread = QJsonConnectionThreadPool::instance()->acquire()) != 0) {
+            mPooledThread = true;
+            mProcessor->moveToThread(mProcessorThread);
+            return;
+        }
+
         mProcessorThread = new QThread();
         QObject::connect(mProcessorThread, SIGNAL(finished()), mProcessor, SLOT(deleteLater()));
         QObject::connect(mProcessorThread, SIGNAL(finished()), mProcessorThread, SLOT(deleteLater()));
@@ -95,6 +126,74 @@ public:
         mProcessor->moveToThread(mProcessorThread);
         mProcessorThread->start();
     }
+
+    /*!
+      \internal
+     */
+    void updateReconnectPolicy()
+    {
+        if (!mUseSeparateThread || !mConnected)
+            mProcessor->setReconnectPolicy(mReconnectInitialDelay, mReconnectMultiplier,
+                                           mReconnectMaximumDelay, mReconnectJitter,
+                                           mReconnectImmediately);
+        else
+            QMetaObject::invokeMethod(mProcessor,
+                                      "setReconnectPolicy",
+                                      Qt::QueuedConnection,
+                                      QGenericReturnArgument(),
+                                      Q_ARG(int, mReconnectInitialDelay),
+                                      Q_ARG(qreal, mReconnectMultiplier),
+                                      Q_ARG(int, mReconnectMaximumDelay),
+                                      Q_ARG(qreal, mReconnectJitter),
+                                      Q_ARG(bool, mReconnectImmediately));
+    }
+
+    /*!
+      \internal
+     */
+    void updateOutboundBuffer()
+    {
+        if (!mUseSeparateThread || !mConnected)
+            mProcessor->setOutboundBuffer(mOutboundBufferMaxBytes, mOutboundBufferMaxMessages,
+                                          mOutboundBufferSpillFile);
+        else
+            QMetaObject::invokeMethod(mProcessor,
+                                      "setOutboundBuffer",
+                                      Qt::QueuedConnection,
+                                      QGenericReturnArgument(),
+                                      Q_ARG(qint64, mOutboundBufferMaxBytes),
+                                      Q_ARG(int, mOutboundBufferMaxMessages),
+                                      Q_ARG(QString, mOutboundBufferSpillFile));
+    }
+
+    void updateFlowControl()
+    {
+        if (!mUseSeparateThread || !mConnected)
+            mProcessor->setFlowControlWindow(mFlowControlWindow, mFlowControlWindowBytes);
+        else
+            QMetaObject::invokeMethod(mProcessor,
+                                      "setFlowControlWindow",
+                                      Qt::QueuedConnection,
+                                      QGenericReturnArgument(),
+                                      Q_ARG(int, mFlowControlWindow),
+                                      Q_ARG(qint64, mFlowControlWindowBytes));
+    }
+
+    void updateAcceptedFormats()
+    {
+        // a QVariantList can be queued without registering another type
+        QVariantList formats;
+        foreach (EncodingFormat format, mAcceptedFormats)
+            formats.append((int)format);
+        if (!mUseSeparateThread || !mConnected)
+            mProcessor->setAcceptedFormats(formats);
+        else
+            QMetaObject::invokeMethod(mProcessor,
+                                      "setAcceptedFormats",
+                                      Qt::QueuedConnection,
+                                      QGenericReturnArgument(),
+                                      Q_ARG(QVariantList, formats));
+    }
 };
 
 /****************************************************************************/
@@ -139,6 +238,18 @@ public:
     \value TcpSocketError subError() is a TCP socket error code.
 */
 
+/*!
+    \enum QJsonConnection::ThreadAssignment
+
+    This enumeration describes how connections are assigned to the shared
+    processing threads.
+
+    \value RoundRobin Connections are assigned to the threads in turn.
+    \value LeastLoaded A connection is assigned to the thread with the fewest connections.
+
+    \sa setProcessingThreadPoolSize()
+*/
+
 /*!
   Constructs a \c QJsonConnection object with \a parent.
  */
@@ -152,6 +263,7 @@ QJsonConnection::QJsonConnection(QObject *parent)
     d->mProcessor = new QJsonConnectionProcessor();
     d->mProcessor->setEndpointManager(d->mManager);
     connect(d->mProcessor, SIGNAL(disconnected()), SIGNAL(disconnected()));
+    connect(d->mProcessor, SIGNAL(outboundBufferOverflow(qint64)), SIGNAL(outboundBufferOverflow(qint64)));
     qRegisterMetaType<QJsonConnection::State>("QJsonConnection::State");
     connect(d->mProcessor, SIGNAL(stateChanged(QJsonConnection::State)), SIGNAL(stateChanged(QJsonConnection::State)));
     qRegisterMetaType<QJsonConnection::Error>("QJsonConnection::Error");
@@ -166,7 +278,12 @@ QJsonConnection::~QJsonConnection()
 {
     Q_D(QJsonConnection);
     d->mProcessor->setEndpointManager(0);
-    if (d->mProcessorThread)
+    if (d->mPooledThread) {
+        // the thread is shared, so only the processor goes away
+        d->mProcessor->deleteLater();
+        QJsonConnectionThreadPool::instance()->release(d->mProcessorThread);
+    }
+    else if (d->mProcessorThread)
         d->mProcessorThread->quit();
     if (!d->mUseSeparateThread)
         delete d->mProcessor;
@@ -293,6 +410,256 @@ void QJsonConnection::setAutoReconnectEnabled(bool enabled)
     d->mProcessor->setAutoReconnectEnabled(enabled);
 }
 
+/*!
+  Returns the delay in milliseconds before the first reconnection attempt.
+*/
+int QJsonConnection::reconnectInitialDelay() const
+{
+    Q_D(const QJsonConnection);
+    return d->mReconnectInitialDelay;
+}
+
+/*!
+  Sets the delay before the first reconnection attempt to \a delay milliseconds.
+*/
+void QJsonConnection::setReconnectInitialDelay(int delay)
+{
+    if (delay >= 0) {
+        Q_D(QJsonConnection);
+        d->mReconnectInitialDelay = delay;
+        if (d->mReconnectMaximumDelay < delay)
+            d->mReconnectMaximumDelay = delay;
+        d->updateReconnectPolicy();
+    }
+}
+
+/*!
+  Returns the factor the reconnection delay is multiplied by after each failed attempt.
+*/
+qreal QJsonConnection::reconnectBackoffMultiplier() const
+{
+    Q_D(const QJsonConnection);
+    return d->mReconnectMultiplier;
+}
+
+/*!
+  Sets the factor the reconnection delay is multiplied by after each failed attempt
+  to \a multiplier.  Values smaller than 1.0 are ignored.
+*/
+void QJsonConnection::setReconnectBackoffMultiplier(qreal multiplier)
+{
+    if (multiplier >= 1.0) {
+        Q_D(QJsonConnection);
+        d->mReconnectMultiplier = multiplier;
+        d->updateReconnectPolicy();
+    }
+}
+
+/*!
+  Returns the maximum delay in milliseconds between reconnection attempts.
+*/
+int QJsonConnection::reconnectMaximumDelay() const
+{
+    Q_D(const QJsonConnection);
+    return d->mReconnectMaximumDelay;
+}
+
+/*!
+  Sets the maximum delay between reconnection attempts to \a delay milliseconds.
+*/
+void QJsonConnection::setReconnectMaximumDelay(int delay)
+{
+    if (delay >= 0) {
+        Q_D(QJsonConnection);
+        d->mReconnectMaximumDelay = delay;
+        if (d->mReconnectInitialDelay > delay)
+            d->mReconnectInitialDelay = delay;
+        d->updateReconnectPolicy();
+    }
+}
+
+/*!
+  Returns the fraction by which each reconnection delay is randomized.
+*/
+qreal QJsonConnection::reconnectJitter() const
+{
+    Q_D(const QJsonConnection);
+    return d->mReconnectJitter;
+}
+
+/*!
+  Sets the fraction by which each reconnection delay is randomized to \a jitter.
+  The value must be between 0.0 and 1.0.
+*/
+void QJsonConnection::setReconnectJitter(qreal jitter)
+{
+    if (jitter >= 0.0 && jitter <= 1.0) {
+        Q_D(QJsonConnection);
+        d->mReconnectJitter = jitter;
+        d->updateReconnectPolicy();
+    }
+}
+
+/*!
+  Returns whether the first reconnection attempt is made immediately after the
+  connection is lost.
+*/
+bool QJsonConnection::reconnectImmediately() const
+{
+    Q_D(const QJsonConnection);
+    return d->mReconnectImmediately;
+}
+
+/*!
+  Sets whether the first reconnection attempt is made immediately after the
+  connection is lost to \a immediately.
+*/
+void QJsonConnection::setReconnectImmediately(bool immediately)
+{
+    Q_D(QJsonConnection);
+    d->mReconnectImmediately = immediately;
+    d->updateReconnectPolicy();
+}
+
+/*!
+  Returns whether unacknowledged messages are sent again after reconnection.
+*/
+bool QJsonConnection::replayUnacknowledgedMessages() const
+{
+    Q_D(const QJsonConnection);
+    return d->mReplayUnacknowledged;
+}
+
+/*!
+  Sets whether unacknowledged messages are sent again after reconnection to \a enabled.
+*/
+void QJsonConnection::setReplayUnacknowledgedMessages(bool enabled)
+{
+    Q_D(QJsonConnection);
+    d->mReplayUnacknowledged = enabled;
+
+    if (!d->mUseSeparateThread || !d->mConnected)
+        d->mProcessor->setReplayUnacknowledgedMessages(enabled);
+    else
+        QMetaObject::invokeMethod(d->mProcessor,
+                              "setReplayUnacknowledgedMessages",
+                              Qt::QueuedConnection,
+                              QGenericReturnArgument(),
+                              Q_ARG(bool, enabled));
+}
+
+/*!
+  Returns the maximum number of bytes buffered while the connection is being
+  re-established.  A value of 0 means messages are not buffered.
+*/
+qint64 QJsonConnection::outboundBufferMaxBytes() const
+{
+    Q_D(const QJsonConnection);
+    return d->mOutboundBufferMaxBytes;
+}
+
+/*!
+  Sets the maximum number of bytes buffered while the connection is being
+  re-established to \a sz.  A value of 0 disables buffering.
+*/
+void QJsonConnection::setOutboundBufferMaxBytes(qint64 sz)
+{
+    if (sz >= 0) {
+        Q_D(QJsonConnection);
+        d->mOutboundBufferMaxBytes = sz;
+        d->updateOutboundBuffer();
+    }
+}
+
+/*!
+  Returns the maximum number of messages buffered while the connection is being
+  re-established.  A value of 0 means the number of messages is not limited.
+*/
+int QJsonConnection::outboundBufferMaxMessages() const
+{
+    Q_D(const QJsonConnection);
+    return d->mOutboundBufferMaxMessages;
+}
+
+/*!
+  Sets the maximum number of messages buffered while the connection is being
+  re-established to \a count.  A value of 0 means the number of messages is not limited.
+*/
+void QJsonConnection::setOutboundBufferMaxMessages(int count)
+{
+    if (count >= 0) {
+        Q_D(QJsonConnection);
+        d->mOutboundBufferMaxMessages = count;
+        d->updateOutboundBuffer();
+    }
+}
+
+/*!
+  Returns the path of the file buffered messages are spilled to.
+*/
+QString QJsonConnection::outboundBufferSpillFile() const
+{
+    Q_D(const QJsonConnection);
+    return d->mOutboundBufferSpillFile;
+}
+
+/*!
+  Sets the path of the file buffered messages are spilled to once the in-memory
+  buffer is full to \a fileName.  An empty name keeps all buffered messages in memory.
+*/
+void QJsonConnection::setOutboundBufferSpillFile(const QString &fileName)
+{
+    Q_D(QJsonConnection);
+    d->mOutboundBufferSpillFile = fileName;
+    d->updateOutboundBuffer();
+}
+
+/*!
+  Returns the number of messages the server may send before it has to wait for
+  the endpoints to read them.  A value of 0 means the number of messages is not limited.
+*/
+int QJsonConnection::flowControlWindow() const
+{
+    Q_D(const QJsonConnection);
+    return d->mFlowControlWindow;
+}
+
+/*!
+  Sets the number of messages the server may send ahead of the endpoints
+  reading them to \a messages.  A value of 0 means the number of messages is not limited.
+*/
+void QJsonConnection::setFlowControlWindow(int messages)
+{
+    if (messages >= 0) {
+        Q_D(QJsonConnection);
+        d->mFlowControlWindow = messages;
+        d->updateFlowControl();
+    }
+}
+
+/*!
+  Returns the number of bytes the server may send before it has to wait for
+  the endpoints to read them.  A value of 0 means the number of bytes is not limited.
+*/
+qint64 QJsonConnection::flowControlWindowBytes() const
+{
+    Q_D(const QJsonConnection);
+    return d->mFlowControlWindowBytes;
+}
+
+/*!
+  Sets the number of bytes the server may send ahead of the endpoints
+  reading them to \a bytes.  A value of 0 means the number of bytes is not limited.
+*/
+void QJsonConnection::setFlowControlWindowBytes(qint64 bytes)
+{
+    if (bytes >= 0) {
+        Q_D(QJsonConnection);
+        d->mFlowControlWindowBytes = bytes;
+        d->updateFlowControl();
+    }
+}
+
 /*!
     Returns the property which value in message object will be used as an endpoint name.
 */
@@ -417,6 +784,43 @@ bool QJsonConnection::useSeparateThreadForProcessing() const
     return d->mUseSeparateThread;
 }
 
+/*!
+  Returns the number of threads shared by all connections that use a separate
+  processing thread.  A value of 0 means each such connection creates its own thread.
+*/
+int QJsonConnection::processingThreadPoolSize()
+{
+    return QJsonConnectionThreadPool::instance()->maxThreadCount();
+}
+
+/*!
+  Sets the number of threads shared by all connections that use a separate
+  processing thread to \a count.  The value only affects connections that
+  connect afterwards.  A value of 0 makes each connection create its own thread.
+
+  \sa setProcessingThreadAssignment(), useSeparateThreadForProcessing
+*/
+void QJsonConnection::setProcessingThreadPoolSize(int count)
+{
+    QJsonConnectionThreadPool::instance()->setMaxThreadCount(count);
+}
+
+/*!
+  Returns how connections are assigned to the shared processing threads.
+*/
+QJsonConnection::ThreadAssignment QJsonConnection::processingThreadAssignment()
+{
+    return QJsonConnectionThreadPool::instance()->assignment();
+}
+
+/*!
+  Sets how connections are assigned to the shared processing threads to \a assignment.
+*/
+void QJsonConnection::setProcessingThreadAssignment(ThreadAssignment assignment)
+{
+    QJsonConnectionThreadPool::instance()->setAssignment(assignment);
+}
+
 /*!
   Returns the default endpoint.  This endpoint will be used to process any
   messages that cannot be directed to a named endpoint.  You must not change
@@ -515,6 +919,32 @@ void QJsonConnection::setFormat( EncodingFormat format )
                               Q_ARG(int, format));
 }
 
+/*!
+  Returns the formats offered to the server whenever the connection is
+  established, most preferred first.
+*/
+QList<EncodingFormat> QJsonConnection::acceptedFormats() const
+{
+    Q_D(const QJsonConnection);
+    return d->mAcceptedFormats;
+}
+
+/*!
+  Sets the \a formats offered to the server whenever the connection is
+  established, most preferred first.  If the server takes part in format
+  negotiation, both sides switch to the first of the server's accepted formats
+  that is in this list.  An empty list, the default, keeps the format set with
+  setFormat().
+
+  \sa QJsonStream::negotiateFormat()
+*/
+void QJsonConnection::setAcceptedFormats(const QList<EncodingFormat>& formats)
+{
+    Q_D(QJsonConnection);
+    d->mAcceptedFormats = formats;
+    d->updateAcceptedFormats();
+}
+
 /*!
   \internal
 */
@@ -556,6 +986,75 @@ void QJsonConnection::handleError(QJsonConnection::Error err, int suberr, QStrin
   Specifies if automatic reconnection to the server should be attempted if the connection is lost.
 */
 
+/*! \property QJsonConnection::reconnectInitialDelay
+  The delay in milliseconds before the first automatic reconnection attempt.
+  The default is 5000.
+*/
+
+/*! \property QJsonConnection::reconnectBackoffMultiplier
+  The factor each reconnection delay is multiplied by when an attempt fails, giving
+  an exponential backoff.  The default of 1.0 retries at a fixed interval.
+*/
+
+/*! \property QJsonConnection::reconnectMaximumDelay
+  The upper bound in milliseconds for the delay between reconnection attempts.
+  The default is 60000.
+*/
+
+/*! \property QJsonConnection::reconnectJitter
+  The fraction by which every reconnection delay is randomly lengthened or shortened,
+  so that clients which lost the same server do not reconnect in lockstep.  A value
+  of 0.2 spreads a 1000 ms delay over 800 to 1200 ms.  The default is 0.0.
+*/
+
+/*! \property QJsonConnection::reconnectImmediately
+  Specifies whether the first reconnection attempt is made without delay.  The
+  backoff sequence starts with the following attempt.
+*/
+
+/*! \property QJsonConnection::replayUnacknowledgedMessages
+  Specifies whether messages that were still waiting in the socket's write buffer
+  when the connection was lost are sent again once the connection is re-established.
+  Messages are replayed in order; the server may receive some of them twice.
+*/
+
+/*! \property QJsonConnection::outboundBufferMaxBytes
+  The maximum number of bytes of encoded messages held while the connection is
+  in the Connecting state, for example during automatic reconnection.  Buffered
+  messages are written in one go once the connection is re-established, and are
+  discarded if the connection gives up.  A value of 0, the default, disables
+  buffering so that sending fails while the connection is down.
+*/
+
+/*! \property QJsonConnection::outboundBufferMaxMessages
+  The maximum number of messages held in the outbound buffer.  A value of 0, the
+  default, means only outboundBufferMaxBytes limits the buffer.
+*/
+
+/*! \property QJsonConnection::outboundBufferSpillFile
+  The file the outbound buffer spills to once its in-memory part is full.  The
+  file is removed when the buffer is flushed.  By default all buffered messages
+  are kept in memory.
+*/
+
+/*! \property QJsonConnection::flowControlWindow
+  The number of messages the server may send before it has to wait for the
+  endpoints to read them.  The window is advertised to the server when the
+  connection is established, and further credit is granted as messages are read.
+  The server holds back messages once the credit is used up.  A value of 0, the
+  default, means the number of messages is not limited.
+
+  \sa QJsonStream::setFlowControlWindow()
+*/
+
+/*! \property QJsonConnection::flowControlWindowBytes
+  The number of bytes the server may send before it has to wait for the
+  endpoints to read them.  A value of 0, the default, means the number of bytes
+  is not limited.
+
+  \sa flowControlWindow
+*/
+
 /*! \property QJsonConnection::endpointPropertyName
   Specifies a property in inbound JSON messages whose value will be used to determine
   which endpoint the message should be delivered to.
@@ -574,7 +1073,9 @@ void QJsonConnection::handleError(QJsonConnection::Error err, int suberr, QStrin
 
 /*! \property QJsonConnection::useSeparateThreadForProcessing
   Specifies whether the connection should be processed in a separate thread (created and
-  controlled by QJsonConnection) or in the object's affined thread.
+  controlled by QJsonConnection) or in the object's affined thread.  If
+  processingThreadPoolSize() is not 0, the thread is taken from a pool shared by
+  all connections.
 */
 
 /*! \property QJsonConnection::defaultEndpoint
@@ -600,6 +1101,13 @@ void QJsonConnection::handleError(QJsonConnection::Error err, int suberr, QStrin
   the connection is closed.
 */
 
+/*! \fn QJsonConnection::outboundBufferOverflow(qint64 bytes)
+
+  This signal is emitted when a message of \a bytes bytes was dropped because it
+  did not fit into the outbound buffer while the connection was being
+  re-established.  The corresponding QJsonEndpoint::send() call returns \b false.
+*/
+
 /*!
     \fn void QJsonConnection::stateChanged(QJsonConnection::State state)
 
@@ -44,6 +44,7 @@
 
 #include "qjsonstream-global.h"
 #include <QObject>
+#include <QList>
 
 QT_BEGIN_NAMESPACE_JSONSTREAM
 
@@ -60,6 +61,17 @@ class Q_ADDON_JSONSTREAM_EXPORT QJsonConnection : public QObject
     Q_PROPERTY(int tcpHostPort READ tcpHostPort WRITE setTcpHostPort)
     Q_PROPERTY(QString endpointPropertyName READ endpointPropertyName WRITE setEndpointPropertyName)
     Q_PROPERTY(bool autoReconnectEnabled READ autoReconnectEnabled WRITE setAutoReconnectEnabled)
+    Q_PROPERTY(int reconnectInitialDelay READ reconnectInitialDelay WRITE setReconnectInitialDelay)
+    Q_PROPERTY(qreal reconnectBackoffMultiplier READ reconnectBackoffMultiplier WRITE setReconnectBackoffMultiplier)
+    Q_PROPERTY(int reconnectMaximumDelay READ reconnectMaximumDelay WRITE setReconnectMaximumDelay)
+    Q_PROPERTY(qreal reconnectJitter READ reconnectJitter WRITE setReconnectJitter)
+    Q_PROPERTY(bool reconnectImmediately READ reconnectImmediately WRITE setReconnectImmediately)
+    Q_PROPERTY(bool replayUnacknowledgedMessages READ replayUnacknowledgedMessages WRITE setReplayUnacknowledgedMessages)
+    Q_PROPERTY(qint64 outboundBufferMaxBytes READ outboundBufferMaxBytes WRITE setOutboundBufferMaxBytes)
+    Q_PROPERTY(int outboundBufferMaxMessages READ outboundBufferMaxMessages WRITE setOutboundBufferMaxMessages)
+    Q_PROPERTY(QString outboundBufferSpillFile READ outboundBufferSpillFile WRITE setOutboundBufferSpillFile)
+    Q_PROPERTY(int flowControlWindow READ flowControlWindow WRITE setFlowControlWindow)
+    Q_PROPERTY(qint64 flowControlWindowBytes READ flowControlWindowBytes WRITE setFlowControlWindowBytes)
     Q_PROPERTY(bool useSeparateThreadForProcessing READ useSeparateThreadForProcessing WRITE setUseSeparateThreadForProcessing)
     Q_PROPERTY(qint64 readBufferSize READ readBufferSize WRITE setReadBufferSize)
     Q_PROPERTY(qint64 writeBufferSize READ writeBufferSize WRITE setWriteBufferSize)
@@ -86,6 +98,12 @@ public:
     };
     Q_ENUMS(Error)
 
+    enum ThreadAssignment {
+        RoundRobin = 0,
+        LeastLoaded
+    };
+    Q_ENUMS(ThreadAssignment)
+
     Error error() const;
     int subError() const;
     QString errorString() const;
@@ -105,9 +123,48 @@ public:
     bool autoReconnectEnabled() const;
     void setAutoReconnectEnabled(bool);
 
+    int reconnectInitialDelay() const;
+    void setReconnectInitialDelay(int);
+
+    qreal reconnectBackoffMultiplier() const;
+    void setReconnectBackoffMultiplier(qreal);
+
+    int reconnectMaximumDelay() const;
+    void setReconnectMaximumDelay(int);
+
+    qreal reconnectJitter() const;
+    void setReconnectJitter(qreal);
+
+    bool reconnectImmediately() const;
+    void setReconnectImmediately(bool);
+
+    bool replayUnacknowledgedMessages() const;
+    void setReplayUnacknowledgedMessages(bool);
+
+    qint64 outboundBufferMaxBytes() const;
+    void setOutboundBufferMaxBytes(qint64);
+
+    int outboundBufferMaxMessages() const;
+    void setOutboundBufferMaxMessages(int);
+
+    QString outboundBufferSpillFile() const;
+    void setOutboundBufferSpillFile(const QString &);
+
+    int flowControlWindow() const;
+    void setFlowControlWindow(int);
+
+    qint64 flowControlWindowBytes() const;
+    void setFlowControlWindowBytes(qint64);
+
     bool useSeparateThreadForProcessing() const;
     void setUseSeparateThreadForProcessing(bool);
 
+    static int processingThreadPoolSize();
+    static void setProcessingThreadPoolSize(int);
+
+    static ThreadAssignment processingThreadAssignment();
+    static void setProcessingThreadAssignment(ThreadAssignment);
+
     qint64 readBufferSize() const;
     void setReadBufferSize(qint64);
 
@@ -123,11 +180,15 @@ public:
 
     void setFormat( EncodingFormat format );
 
+    QList<EncodingFormat> acceptedFormats() const;
+    void setAcceptedFormats(const QList<EncodingFormat>& formats);
+
     QJsonConnectionProcessor *processor() const;
 
 signals:
     void bytesWritten(qint64);
     void readBufferOverflow(qint64);
+    void outboundBufferOverflow(qint64);
     void stateChanged(QJsonConnection::State);
     void disconnected();
     void error(QJsonConnection::Error, int);
@@ -50,8 +50,15 @@
 #include <QFile>
 #include <QDir>
 #include <QTimer>
+#include <QDateTime>
+#include <QCoreApplication>
+#include <QtEndian>
+#include <qmath.h>
 
 const int knAUTO_RECONNECTION_TIMEOUT = 5000;
+const int knAUTO_RECONNECTION_MAXIMUM_DELAY = 60000;
+const int knMAX_UNACKNOWLEDGED_MESSAGES = 1024;
+const int knSPOOL_MEMORY_LIMIT = 256*1024;
 const int knSOCKET_READ_BUFFER_SIZE = 64*1024;
 
 QT_BEGIN_NAMESPACE_JSONSTREAM
@@ -66,8 +73,33 @@ public:
         , mAutoReconnectEnabled(false)
         , mExplicitDisconnect(false)
         , mReconnectionTimer(0)
+        , mPendingSocket(0)
+        , mReconnectInitialDelay(knAUTO_RECONNECTION_TIMEOUT)
+        , mReconnectMultiplier(1.0)
+        , mReconnectMaximumDelay(knAUTO_RECONNECTION_MAXIMUM_DELAY)
+        , mReconnectJitter(0.0)
+        , mReconnectImmediately(false)
+        , mReconnectAttempt(0)
+        , mRandomState(0)
+        , mReplayUnacknowledged(false)
+        , mSpoolMaxBytes(0)
+        , mSpoolMaxMessages(0)
+        , mSpoolBytes(0)
+        , mSpoolMessages(0)
+        , mSpoolFile(0)
+        , mSpoolReadPos(0)
+        , mNegotiateFormat(false)
     {}
 
+    // xorshift32; every client seeds it differently so that jittered delays diverge
+    quint32 random()
+    {
+        mRandomState ^= mRandomState << 13;
+        mRandomState ^= mRandomState >> 17;
+        mRandomState ^= mRandomState << 5;
+        return mRandomState;
+    }
+
     QJsonConnection::State mState;
     QJsonEndpointManager *mManager;
     QJsonStream mStream;
@@ -82,8 +114,50 @@ public:
     bool mAutoReconnectEnabled;
     bool mExplicitDisconnect;
     QTimer *mReconnectionTimer;
+    QIODevice *mPendingSocket;
+
+    // reconnection policy
+    int   mReconnectInitialDelay;
+    qreal mReconnectMultiplier;
+    int   mReconnectMaximumDelay;
+    qreal mReconnectJitter;
+    bool  mReconnectImmediately;
+    int   mReconnectAttempt;
+    quint32 mRandomState;
+
+    // messages not yet handed over to the operating system
+    bool mReplayUnacknowledged;
+    QList<QJsonObject> mUnacknowledged;
+
+    // outbound spool of encoded frames used while (re)connecting
+    qint64 mSpoolMaxBytes;
+    int    mSpoolMaxMessages;
+    QString mSpoolFileName;
+    QList<QByteArray> mSpool;
+    qint64 mSpoolBytes;
+    int    mSpoolMessages;
+    QFile  *mSpoolFile;
+    qint64 mSpoolReadPos;
+    bool   mNegotiateFormat;
+
+    // messages sent while the spool is still being flushed to the connected device
+    QList<QJsonObject> mFlushQueue;
 };
 
+/*!
+  \internal
+  Returns an absolute path for the local socket \a socketname.
+*/
+static QString localSocketPath(const QString &socketname)
+{
+    QString socketPath(socketname);
+#if defined(Q_OS_UNIX)
+    if (!socketPath.startsWith(QLatin1Char('/')))
+        socketPath.prepend(QDir::tempPath() + QLatin1Char('/'));
+#endif
+    return socketPath;
+}
+
 /****************************************************************************/
 
 /*!
@@ -107,6 +181,11 @@ QJsonConnectionProcessor::QJsonConnectionProcessor()
     Q_D(QJsonConnectionProcessor);
     d->mStream.setParent(this);
     d->mStream.setThreadProtection(true);
+    d->mRandomState = quint32(QDateTime::currentMSecsSinceEpoch())
+            ^ quint32(QCoreApplication::applicationPid() << 16)
+            ^ quint32(quintptr(this));
+    if (!d->mRandomState)
+        d->mRandomState = 0x9e3779b9;
 }
 
 /*!
@@ -117,6 +196,7 @@ QJsonConnectionProcessor::~QJsonConnectionProcessor()
 {
     // Variant streams don't own the socket
     Q_D(QJsonConnectionProcessor);
+    clearSpool();
     QIODevice *device = d->mStream.device();
     if (device) {
         device->disconnect(this);
@@ -163,21 +243,18 @@ bool QJsonConnectionProcessor::connectTCP(const QString& hostname, int port)
     if (QJsonConnection::Connecting != d->mState)
         emit stateChanged(d->mState = QJsonConnection::Connecting);
 
+    if (d->mReconnectionTimer)
+        d->mReconnectionTimer->stop();
+
     QTcpSocket *socket = new QTcpSocket(this);
     connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
             SLOT(handleSocketError(QAbstractSocket::SocketError)));
     socket->connectToHost(hostname, port);
 
     if (socket->waitForConnected()) {
-        connect(socket, SIGNAL(disconnected()), SLOT(handleSocketDisconnected()));
-        d->mStream.setDevice(socket);
-        connect(&d->mStream, SIGNAL(readyReadMessage()), this, SLOT(processMessage()));
-        connect(&d->mStream, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)));
-        connect(&d->mStream, SIGNAL(readBufferOverflow(qint64)), this, SIGNAL(readBufferOverflow(qint64)));
         d->mServerName = hostname;
         d->mPort = port;
-        d->mState = QJsonConnection::Connected;
-        emit stateChanged(d->mState);
+        setupConnectedSocket(socket);
         return true;
     }
 
@@ -193,12 +270,7 @@ bool QJsonConnectionProcessor::connectTCP(const QString& hostname, int port)
  */
 bool QJsonConnectionProcessor::connectLocal(const QString& socketname)
 {
-    QString socketPath(socketname);
-#if defined(Q_OS_UNIX)
-    if (!socketPath.startsWith(QLatin1Char('/')))
-        socketPath.prepend(QDir::tempPath() + QLatin1Char('/'));
-#endif
-
+    QString socketPath(localSocketPath(socketname));
     if (!QFile::exists(socketPath)) {
         qWarning() << Q_FUNC_INFO << "socket does not exist" << socketPath;
         return false;
@@ -208,6 +280,9 @@ bool QJsonConnectionProcessor::connectLocal(const QString& socketname)
     if (QJsonConnection::Connecting != d->mState)
         emit stateChanged(d->mState = QJsonConnection::Connecting);
 
+    if (d->mReconnectionTimer)
+        d->mReconnectionTimer->stop();
+
     QLocalSocket *socket = new QLocalSocket(this);
     connect(socket, SIGNAL(error(QLocalSocket::LocalSocketError)),
             SLOT(handleSocketError(QLocalSocket::LocalSocketError)));
@@ -215,15 +290,9 @@ bool QJsonConnectionProcessor::connectLocal(const QString& socketname)
     socket->connectToServer(socketPath);
 
     if (socket->waitForConnected()) {
-        connect(socket, SIGNAL(disconnected()), SLOT(handleSocketDisconnected()));
-        d->mStream.setDevice(socket);
-        connect(&d->mStream, SIGNAL(readyReadMessage()), this, SLOT(processMessage()));
-        connect(&d->mStream, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)));
-        connect(&d->mStream, SIGNAL(readBufferOverflow(qint64)), this, SIGNAL(readBufferOverflow(qint64)));
         d->mServerName = socketname;
         d->mPort = -1; // local socket
-        d->mState = QJsonConnection::Connected;
-        emit stateChanged(d->mState);
+        setupConnectedSocket(socket);
         return true;
     }
 
@@ -233,6 +302,227 @@ bool QJsonConnectionProcessor::connectLocal(const QString& socketname)
     return false;
 }
 
+/*!
+  \internal
+  Attaches the connected \a socket to the stream, switches to the Connected state
+  and replays any unacknowledged messages left over from the previous connection,
+  followed by the outbound spool.  Formats are negotiated once the spool, encoded
+  in the format the connection started with, has been flushed.
+*/
+void QJsonConnectionProcessor::setupConnectedSocket(QIODevice *socket)
+{
+    Q_D(QJsonConnectionProcessor);
+    connect(socket, SIGNAL(disconnected()), SLOT(handleSocketDisconnected()));
+    d->mStream.setDevice(socket);
+    connect(&d->mStream, SIGNAL(readyReadMessage()), this, SLOT(processMessage()), Qt::UniqueConnection);
+    connect(&d->mStream, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)), Qt::UniqueConnection);
+    connect(&d->mStream, SIGNAL(bytesWritten(qint64)), this, SLOT(handleBytesWritten()), Qt::UniqueConnection);
+    connect(&d->mStream, SIGNAL(readBufferOverflow(qint64)), this, SIGNAL(readBufferOverflow(qint64)), Qt::UniqueConnection);
+    d->mReconnectAttempt = 0;
+    d->mState = QJsonConnection::Connected;
+    emit stateChanged(d->mState);
+
+    if (!d->mUnacknowledged.isEmpty()) {
+        QList<QJsonObject> messages;
+        messages.swap(d->mUnacknowledged);
+        foreach (const QJsonObject &message, messages)
+            sendToStream(message);
+    }
+    d->mNegotiateFormat = true;
+    flushSpool();
+}
+
+/*!
+  \internal
+  Appends the encoded \a frame to the outbound spool.  Frames go to the spill file once
+  the in-memory part of the spool is full.  Returns false if the frame does not fit.
+  The size limits do not apply to a frame that has been accepted already, if \a force
+  is true.
+*/
+bool QJsonConnectionProcessor::spool(const QByteArray &frame, bool force)
+{
+    Q_D(QJsonConnectionProcessor);
+    if (!force && (d->mSpoolBytes + frame.size() > d->mSpoolMaxBytes
+            || (d->mSpoolMaxMessages > 0 && d->mSpoolMessages >= d->mSpoolMaxMessages))) {
+        emit outboundBufferOverflow(frame.size());
+        return false;
+    }
+
+    // once spilling has started all further frames go to the file to keep them in order
+    if (!d->mSpoolFile && !d->mSpoolFileName.isEmpty()
+            && d->mSpoolBytes + frame.size() > knSPOOL_MEMORY_LIMIT) {
+        d->mSpoolFile = new QFile(d->mSpoolFileName);
+        if (!d->mSpoolFile->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+            qWarning() << Q_FUNC_INFO << "Unable to open spool file" << d->mSpoolFileName
+                       << d->mSpoolFile->errorString();
+            delete d->mSpoolFile;
+            d->mSpoolFile = 0;
+            emit outboundBufferOverflow(frame.size());
+            return false;
+        }
+    }
+
+    if (d->mSpoolFile) {
+        // frames in the file are prefixed with their size so that they can be read back one by one
+        uchar header[4];
+        qToLittleEndian<quint32>(frame.size(), header);
+        d->mSpoolFile->seek(d->mSpoolFile->size());
+        if (d->mSpoolFile->write((const char *)header, sizeof(header)) != sizeof(header)
+                || d->mSpoolFile->write(frame) != frame.size()) {
+            qWarning() << Q_FUNC_INFO << "Write to spool file failed" << d->mSpoolFile->errorString();
+            emit outboundBufferOverflow(frame.size());
+            return false;
+        }
+    }
+    else {
+        d->mSpool.append(frame);
+    }
+    d->mSpoolBytes += frame.size();
+    d->mSpoolMessages++;
+    return true;
+}
+
+/*!
+  \internal
+  Reads the next frame from the spill file into \a frame.  Returns false if the file
+  cannot be read.
+*/
+bool QJsonConnectionProcessor::readSpoolFrame(QByteArray *frame)
+{
+    Q_D(QJsonConnectionProcessor);
+    uchar header[4];
+    if (!d->mSpoolFile->seek(d->mSpoolReadPos)
+            || d->mSpoolFile->read((char *)header, sizeof(header)) != sizeof(header))
+        return false;
+    quint32 size = qFromLittleEndian<quint32>(header);
+    *frame = d->mSpoolFile->read(size);
+    if ((quint32)frame->size() != size)
+        return false;
+    d->mSpoolReadPos += sizeof(header) + size;
+    return true;
+}
+
+/*!
+  \internal
+  Writes spooled frames to the connected device until about knSPOOL_MEMORY_LIMIT bytes
+  are waiting to be written, including frames held back by flow control.  The rest
+  follows as the device drains, so that a spill file is never read into memory as a whole.
+  Messages sent in the meantime are written after the spool, and tracked for replay
+  like any other message.
+*/
+void QJsonConnectionProcessor::flushSpool()
+{
+    Q_D(QJsonConnectionProcessor);
+    while (d->mSpoolMessages && d->mStream.bytesToWrite() < knSPOOL_MEMORY_LIMIT) {
+        QByteArray frame;
+        bool fromFile = d->mSpool.isEmpty();
+        if (!fromFile) {
+            frame = d->mSpool.takeFirst();
+        }
+        else if (!d->mSpoolFile || !readSpoolFrame(&frame)) {
+            qWarning() << Q_FUNC_INFO << "Unable to read the spool file" << d->mSpoolFileName;
+            clearSpool();
+            return;
+        }
+
+        // the frames have been accepted already, so they are not subject to the write buffer
+        // limit, but they still have to wait for credit if the server uses flow control
+        qint64 writeBufferSize = d->mStream.writeBufferSize();
+        d->mStream.setWriteBufferSize(0);
+        bool accepted = d->mStream.sendFrame(frame);
+        d->mStream.setWriteBufferSize(writeBufferSize);
+        if (!accepted) {
+            qWarning() << Q_FUNC_INFO << "Unable to flush the outbound buffer";
+            if (fromFile)
+                d->mSpoolReadPos -= 4 + frame.size();
+            else
+                d->mSpool.prepend(frame);
+            return;
+        }
+        d->mSpoolBytes -= frame.size();
+        d->mSpoolMessages--;
+    }
+    if (d->mSpoolMessages)
+        return;
+
+    clearSpool();
+    while (!d->mFlushQueue.isEmpty() && d->mStream.bytesToWrite() < knSPOOL_MEMORY_LIMIT) {
+        // accepted already as well
+        qint64 writeBufferSize = d->mStream.writeBufferSize();
+        d->mStream.setWriteBufferSize(0);
+        bool accepted = sendToStream(d->mFlushQueue.first());
+        d->mStream.setWriteBufferSize(writeBufferSize);
+        if (!accepted) {
+            qWarning() << Q_FUNC_INFO << "Unable to flush the outbound buffer";
+            return;
+        }
+        d->mFlushQueue.removeFirst();
+    }
+    if (d->mFlushQueue.isEmpty() && d->mNegotiateFormat) {
+        d->mNegotiateFormat = false;
+        d->mStream.negotiateFormat();
+    }
+}
+
+/*!
+  \internal
+  Drops all spooled frames and removes the spill file.
+*/
+void QJsonConnectionProcessor::clearSpool()
+{
+    Q_D(QJsonConnectionProcessor);
+    d->mSpool.clear();
+    d->mSpoolBytes = 0;
+    d->mSpoolMessages = 0;
+    d->mSpoolReadPos = 0;
+    if (d->mSpoolFile) {
+        d->mSpoolFile->remove();
+        delete d->mSpoolFile;
+        d->mSpoolFile = 0;
+    }
+}
+
+/*!
+  \internal
+  Returns the delay before the next reconnection attempt and advances the attempt counter.
+*/
+int QJsonConnectionProcessor::nextReconnectDelay()
+{
+    Q_D(QJsonConnectionProcessor);
+    int attempt = d->mReconnectAttempt++;
+    if (d->mReconnectImmediately) {
+        if (attempt == 0)
+            return 0;
+        --attempt;
+    }
+
+    qreal delay = d->mReconnectInitialDelay * qPow(d->mReconnectMultiplier, attempt);
+    delay = qMin(delay, qreal(d->mReconnectMaximumDelay));
+    if (d->mReconnectJitter > 0) {
+        // spread the delay uniformly over [delay * (1 - jitter), delay * (1 + jitter)]
+        qreal r = d->random() / qreal(0xffffffffu);
+        delay += delay * d->mReconnectJitter * (2 * r - 1);
+        delay = qMin(delay, qreal(d->mReconnectMaximumDelay));
+    }
+    return qMax(0, qRound(delay));
+}
+
+/*!
+  \internal
+  Starts the reconnection timer with the delay of the current reconnection attempt.
+*/
+void QJsonConnectionProcessor::scheduleReconnect()
+{
+    Q_D(QJsonConnectionProcessor);
+    if (!d->mReconnectionTimer) {
+        // create timer
+        d->mReconnectionTimer = new QTimer(this);
+        d->mReconnectionTimer->setSingleShot(true);
+        connect(d->mReconnectionTimer, SIGNAL(timeout()), SLOT(handleReconnect()));
+    }
+    d->mReconnectionTimer->start(nextReconnectDelay());
+}
+
 /*!
   \internal
 */
@@ -249,21 +539,25 @@ void QJsonConnectionProcessor::handleSocketDisconnected()
 
     if (d->mAutoReconnectEnabled && !d->mExplicitDisconnect)
     {
-        if (!d->mReconnectionTimer || !d->mReconnectionTimer->isActive())
+        // messages still waiting for the spool to drain go back behind it,
+        // ahead of anything sent while reconnecting
+        foreach (const QJsonObject &message, d->mFlushQueue)
+            spool(d->mStream.encode(message), true);
+        d->mFlushQueue.clear();
+
+        if ((!d->mReconnectionTimer || !d->mReconnectionTimer->isActive()) && !d->mPendingSocket)
         {
-            if (!d->mReconnectionTimer) {
-                // create timer
-                d->mReconnectionTimer = new QTimer(this);
-                d->mReconnectionTimer->setInterval(knAUTO_RECONNECTION_TIMEOUT);
-                connect(d->mReconnectionTimer, SIGNAL(timeout()), SLOT(handleReconnect()));
-            }
+            d->mReconnectAttempt = 0;
             d->mState = QJsonConnection::Connecting;
             emit stateChanged(d->mState);
-            d->mReconnectionTimer->start();
+            scheduleReconnect();
         }
         return;
     }
 
+    d->mUnacknowledged.clear();
+    d->mFlushQueue.clear();
+    clearSpool();
     d->mState = QJsonConnection::Unconnected;
     emit disconnected();
     emit stateChanged(d->mState);
@@ -295,16 +589,94 @@ void QJsonConnectionProcessor::handleSocketError(QLocalSocket::LocalSocketError
 void QJsonConnectionProcessor::handleReconnect()
 {
     Q_D(QJsonConnectionProcessor);
-    d->mReconnectionTimer->stop();
+    if (QJsonConnection::Connecting != d->mState || d->mPendingSocket)
+        return;
 
-    if (QJsonConnection::Connecting == d->mState) {
-        if (d->mPort < 0)
-            connectLocal(d->mServerName);
-        else
-            connectTCP(d->mServerName, d->mPort);
+    // connect asynchronously so that the processing thread is not blocked
+    if (d->mPort < 0) {
+        QString socketPath(localSocketPath(d->mServerName));
+        if (!QFile::exists(socketPath)) {
+            scheduleReconnect();
+            return;
+        }
+
+        QLocalSocket *socket = new QLocalSocket(this);
+        connect(socket, SIGNAL(error(QLocalSocket::LocalSocketError)),
+                SLOT(handleSocketError(QLocalSocket::LocalSocketError)));
+        connect(socket, SIGNAL(error(QLocalSocket::LocalSocketError)), SLOT(handleReconnectFailed()));
+        connect(socket, SIGNAL(connected()), SLOT(handleReconnected()));
+        socket->setReadBufferSize(knSOCKET_READ_BUFFER_SIZE);
+        d->mPendingSocket = socket;
+        socket->connectToServer(socketPath);
+    }
+    else {
+        QTcpSocket *socket = new QTcpSocket(this);
+        connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
+                SLOT(handleSocketError(QAbstractSocket::SocketError)));
+        connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(handleReconnectFailed()));
+        connect(socket, SIGNAL(connected()), SLOT(handleReconnected()));
+        d->mPendingSocket = socket;
+        socket->connectToHost(d->mServerName, d->mPort);
     }
 }
 
+/*!
+  \internal
+*/
+void QJsonConnectionProcessor::handleReconnected()
+{
+    Q_D(QJsonConnectionProcessor);
+    QIODevice *socket = d->mPendingSocket;
+    if (!socket || socket != sender())
+        return;
+
+    d->mPendingSocket = 0;
+    socket->disconnect(this, SLOT(handleReconnected()));
+    socket->disconnect(this, SLOT(handleReconnectFailed()));
+    setupConnectedSocket(socket);
+}
+
+/*!
+  \internal
+*/
+void QJsonConnectionProcessor::handleReconnectFailed()
+{
+    Q_D(QJsonConnectionProcessor);
+    QIODevice *socket = d->mPendingSocket;
+    if (!socket || socket != sender())
+        return;
+
+    d->mPendingSocket = 0;
+    socket->disconnect(this);
+    socket->deleteLater();
+
+    if (QJsonConnection::Connecting == d->mState && d->mAutoReconnectEnabled) {
+        scheduleReconnect();
+        return;
+    }
+
+    d->mUnacknowledged.clear();
+    d->mFlushQueue.clear();
+    clearSpool();
+    d->mState = QJsonConnection::Unconnected;
+    emit disconnected();
+    emit stateChanged(d->mState);
+}
+
+/*!
+  \internal
+  Forget the unacknowledged messages once the device has handed all data to the system,
+  and refill it from the outbound spool.
+*/
+void QJsonConnectionProcessor::handleBytesWritten()
+{
+    Q_D(QJsonConnectionProcessor);
+    if (!d->mStream.bytesToWrite())
+        d->mUnacknowledged.clear();
+    if ((d->mSpoolMessages || !d->mFlushQueue.isEmpty()) && QJsonConnection::Connected == d->mState)
+        flushSpool();
+}
+
 /*!
   \internal
   Handle a received readyReadMessage signal and emit the correct signals
@@ -414,6 +786,78 @@ void QJsonConnectionProcessor::setWriteBufferSize(qint64 sz)
     }
 }
 
+/*!
+  Sets the reconnection policy used when the server connection is lost.
+
+  The first attempt is made after \a initialDelay milliseconds, or immediately if
+  \a immediateRetry is true.  Each subsequent delay is multiplied by \a multiplier
+  up to \a maximumDelay milliseconds, and randomized by up to \a jitter of its
+  value in either direction.
+*/
+void QJsonConnectionProcessor::setReconnectPolicy(int initialDelay, qreal multiplier, int maximumDelay,
+                                                  qreal jitter, bool immediateRetry)
+{
+    Q_D(QJsonConnectionProcessor);
+    d->mReconnectInitialDelay = qMax(0, initialDelay);
+    d->mReconnectMultiplier = qMax(qreal(1.0), multiplier);
+    d->mReconnectMaximumDelay = qMax(d->mReconnectInitialDelay, maximumDelay);
+    d->mReconnectJitter = qBound(qreal(0.0), jitter, qreal(1.0));
+    d->mReconnectImmediately = immediateRetry;
+}
+
+/*!
+  Sets whether messages that were not yet written to the system when the connection
+  was lost should be sent again after reconnection to \a enabled.
+*/
+void QJsonConnectionProcessor::setReplayUnacknowledgedMessages(bool enabled)
+{
+    Q_D(QJsonConnectionProcessor);
+    d->mReplayUnacknowledged = enabled;
+    if (!enabled)
+        d->mUnacknowledged.clear();
+}
+
+/*!
+  Sets the outbound buffer used while the connection is being re-established.
+  Up to \a maxBytes bytes and \a maxMessages messages are held; a \a maxBytes of 0
+  disables buffering and a \a maxMessages of 0 means no message limit.  If
+  \a spillFileName is not empty, frames that do not fit into memory are written to
+  that file.
+*/
+void QJsonConnectionProcessor::setOutboundBuffer(qint64 maxBytes, int maxMessages, const QString &spillFileName)
+{
+    Q_D(QJsonConnectionProcessor);
+    d->mSpoolMaxBytes = qMax(Q_INT64_C(0), maxBytes);
+    d->mSpoolMaxMessages = qMax(0, maxMessages);
+    if (d->mSpoolFileName != spillFileName && d->mSpoolFile) {
+        // keep spooling to the already opened file
+        qWarning() << Q_FUNC_INFO << "Spill file change takes effect after the outbound buffer is flushed";
+    }
+    d->mSpoolFileName = spillFileName;
+}
+
+/*!
+  Sets the flow control window advertised to the server to \a messages and \a bytes.
+*/
+void QJsonConnectionProcessor::setFlowControlWindow(int messages, qint64 bytes)
+{
+    Q_D(QJsonConnectionProcessor);
+    d->mStream.setFlowControlWindow(messages);
+    d->mStream.setFlowControlWindowBytes(bytes);
+}
+
+/*!
+  Sets the \a formats offered to the server whenever the connection is established.
+*/
+void QJsonConnectionProcessor::setAcceptedFormats(const QVariantList &formats)
+{
+    Q_D(QJsonConnectionProcessor);
+    QList<EncodingFormat> accepted;
+    foreach (const QVariant &format, formats)
+        accepted.append((EncodingFormat)format.toInt());
+    d->mStream.setAcceptedFormats(accepted);
+}
+
 /*!
   Set the current stream encoding \a format.
   This controls how messages will be sent
@@ -433,7 +877,41 @@ void QJsonConnectionProcessor::setFormat( int format )
 bool QJsonConnectionProcessor::send(QJsonObject message)
 {
     Q_D(QJsonConnectionProcessor);
-    return d->mStream.send(message);
+    if (QJsonConnection::Connecting == d->mState && d->mSpoolMaxBytes > 0) {
+        bool spooled = spool(d->mStream.encode(message));
+        d->mStream.endEncode(spooled);
+        return spooled;
+    }
+    if (QJsonConnection::Connected == d->mState && (d->mSpoolMessages || !d->mFlushQueue.isEmpty())) {
+        // queue behind the frames still being flushed to keep the order
+        d->mFlushQueue.append(message);
+        flushSpool();
+        return true;
+    }
+    return sendToStream(message);
+}
+
+/*!
+  \internal
+  Sends \a message on the stream and keeps it for replay until it has been written.
+*/
+bool QJsonConnectionProcessor::sendToStream(const QJsonObject &message)
+{
+    Q_D(QJsonConnectionProcessor);
+    bool ret = d->mStream.send(message);
+    if (ret && d->mReplayUnacknowledged) {
+        // includes messages held back by flow control
+        if (d->mStream.bytesToWrite() > 0) {
+            if (d->mUnacknowledged.size() >= knMAX_UNACKNOWLEDGED_MESSAGES)
+                d->mUnacknowledged.removeFirst();
+            d->mUnacknowledged.append(message);
+        }
+        else {
+            // everything up to and including this message has been written
+            d->mUnacknowledged.clear();
+        }
+    }
+    return ret;
 }
 
 /*!
@@ -467,6 +945,12 @@ bool QJsonConnectionProcessor::send(QJsonObject message)
   but the message is not complete.
 */
 
+/*! \fn QJsonConnectionProcessor::outboundBufferOverflow(qint64 bytes)
+
+  This signal is emitted when a message of \a bytes bytes could not be added to the
+  outbound buffer while the connection is being re-established.
+*/
+
 /*!
     \fn void QJsonConnectionProcessor::readyReadMessage()
 
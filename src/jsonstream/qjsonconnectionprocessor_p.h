@@ -47,6 +47,7 @@
 
 #include <QLocalSocket>
 #include <QTcpSocket>
+#include <QVariant>
 class QJsonObject;
 
 QT_BEGIN_NAMESPACE_JSONSTREAM
@@ -76,6 +77,7 @@ signals:
     void disconnected();
     void bytesWritten(qint64);
     void readBufferOverflow(qint64);
+    void outboundBufferOverflow(qint64);
     void error(QJsonConnection::Error,int,QString);
 
 public slots:
@@ -84,6 +86,11 @@ public slots:
     void setFormat(int);
     void setReadBufferSize(qint64);
     void setWriteBufferSize(qint64);
+    void setReconnectPolicy(int initialDelay, qreal multiplier, int maximumDelay, qreal jitter, bool immediateRetry);
+    void setReplayUnacknowledgedMessages(bool);
+    void setOutboundBuffer(qint64 maxBytes, int maxMessages, const QString &spillFileName);
+    void setFlowControlWindow(int messages, qint64 bytes);
+    void setAcceptedFormats(const QVariantList &formats);
     bool send(QJsonObject message);
     bool messageAvailable(QJsonEndpoint *);
     QJsonObject readMessage(QJsonEndpoint *);
@@ -92,12 +99,24 @@ protected slots:
     void processMessage(QJsonEndpoint* = 0);
     void handleSocketDisconnected();
     void handleReconnect();
+    void handleReconnected();
+    void handleReconnectFailed();
+    void handleBytesWritten();
     void handleSocketError(QAbstractSocket::SocketError);
     void handleSocketError(QLocalSocket::LocalSocketError);
 
 protected:
 
 private:
+    void setupConnectedSocket(QIODevice *socket);
+    bool sendToStream(const QJsonObject &message);
+    void scheduleReconnect();
+    int nextReconnectDelay();
+    bool spool(const QByteArray &frame, bool force = false);
+    bool readSpoolFrame(QByteArray *frame);
+    void flushSpool();
+    void clearSpool();
+
     Q_DECLARE_PRIVATE(QJsonConnectionProcessor)
     QScopedPointer<QJsonConnectionProcessorPrivate> d_ptr;
 
@@ -0,0 +1,192 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qjsonconnectionthreadpool_p.h"
+
+#include <QThread>
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+Q_GLOBAL_STATIC(QJsonConnectionThreadPool, threadPool)
+
+/*!
+    \class QJsonConnectionThreadPool
+    \brief The QJsonConnectionThreadPool class shares processing threads between connections
+    \internal
+
+    QJsonConnection objects that use a separate processing thread normally get a thread
+    of their own.  When the pool has a non-zero maxThreadCount(), their processors are
+    instead distributed over at most that many threads, which are started on demand
+    and kept for the lifetime of the process.
+*/
+
+/*!
+  Constructs an empty \c QJsonConnectionThreadPool.
+ */
+QJsonConnectionThreadPool::QJsonConnectionThreadPool()
+    : mMaxThreadCount(0)
+    , mAssignment(QJsonConnection::RoundRobin)
+    , mNext(0)
+{
+}
+
+/*!
+  Stops all pool threads.
+ */
+QJsonConnectionThreadPool::~QJsonConnectionThreadPool()
+{
+    foreach (const Entry &entry, mThreads) {
+        entry.thread->quit();
+        entry.thread->wait();
+        delete entry.thread;
+    }
+}
+
+/*!
+  Returns the process wide pool.
+ */
+QJsonConnectionThreadPool *QJsonConnectionThreadPool::instance()
+{
+    return threadPool();
+}
+
+/*!
+  Returns the maximum number of threads in the pool.  A value of 0 means
+  that the pool is not used.
+ */
+int QJsonConnectionThreadPool::maxThreadCount() const
+{
+    QMutexLocker locker(&mMutex);
+    return mMaxThreadCount;
+}
+
+/*!
+  Sets the maximum number of threads in the pool to \a count.  Lowering the
+  value does not move processors that are already assigned to a thread.
+ */
+void QJsonConnectionThreadPool::setMaxThreadCount(int count)
+{
+    QMutexLocker locker(&mMutex);
+    mMaxThreadCount = qMax(0, count);
+}
+
+/*!
+  Returns how processors are assigned to pool threads.
+ */
+QJsonConnection::ThreadAssignment QJsonConnectionThreadPool::assignment() const
+{
+    QMutexLocker locker(&mMutex);
+    return mAssignment;
+}
+
+/*!
+  Sets how processors are assigned to pool threads to \a assignment.
+ */
+void QJsonConnectionThreadPool::setAssignment(QJsonConnection::ThreadAssignment assignment)
+{
+    QMutexLocker locker(&mMutex);
+    mAssignment = assignment;
+}
+
+/*!
+  Returns the number of threads currently running in the pool.
+ */
+int QJsonConnectionThreadPool::threadCount() const
+{
+    QMutexLocker locker(&mMutex);
+    return mThreads.size();
+}
+
+/*!
+  Returns the thread a new processor should be moved to, starting a new thread if
+  the pool is not full yet.  Returns 0 if the pool is disabled.
+ */
+QThread *QJsonConnectionThreadPool::acquire()
+{
+    QMutexLocker locker(&mMutex);
+    if (mMaxThreadCount <= 0)
+        return 0;
+
+    int index = -1;
+    int count = qMin(mThreads.size(), mMaxThreadCount);
+    if (mAssignment == QJsonConnection::LeastLoaded) {
+        for (int i = 0; i < count; i++) {
+            if (index < 0 || mThreads.at(i).load < mThreads.at(index).load)
+                index = i;
+        }
+        // an idle thread is as good as a new one
+        if (count < mMaxThreadCount && (index < 0 || mThreads.at(index).load > 0))
+            index = -1;
+    }
+    else if (count == mMaxThreadCount) {
+        index = mNext++ % count;
+    }
+
+    if (index < 0) {
+        Entry entry;
+        entry.thread = new QThread();
+        entry.thread->setObjectName(QString::fromLatin1("QJsonConnection pool %1").arg(mThreads.size()));
+        entry.thread->start();
+        entry.load = 0;
+        mThreads.append(entry);
+        index = mThreads.size() - 1;
+    }
+
+    mThreads[index].load++;
+    return mThreads.at(index).thread;
+}
+
+/*!
+  Tells the pool that a processor running in \a thread has been released.
+ */
+void QJsonConnectionThreadPool::release(QThread *thread)
+{
+    QMutexLocker locker(&mMutex);
+    for (int i = 0; i < mThreads.size(); i++) {
+        if (mThreads.at(i).thread == thread) {
+            mThreads[i].load--;
+            break;
+        }
+    }
+}
+
+QT_END_NAMESPACE_JSONSTREAM
@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef _JSON_CONNECTION_THREAD_POOL_H
+#define _JSON_CONNECTION_THREAD_POOL_H
+
+#include <QList>
+#include <QMutex>
+#include "qjsonstream-global.h"
+#include "qjsonconnection.h"
+
+class QThread;
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+class QJsonConnectionThreadPool
+{
+public:
+    QJsonConnectionThreadPool();
+    ~QJsonConnectionThreadPool();
+
+    static QJsonConnectionThreadPool *instance();
+
+    int maxThreadCount() const;
+    void setMaxThreadCount(int count);
+
+    QJsonConnection::ThreadAssignment assignment() const;
+    void setAssignment(QJsonConnection::ThreadAssignment assignment);
+
+    int threadCount() const;
+
+    QThread *acquire();
+    void release(QThread *thread);
+
+private:
+    struct Entry {
+        QThread *thread;
+        int load;
+    };
+
+    mutable QMutex mMutex;
+    int mMaxThreadCount;
+    QJsonConnection::ThreadAssignment mAssignment;
+    int mNext;
+    QList<Entry> mThreads;
+};
+
+QT_END_NAMESPACE_JSONSTREAM
+
+#endif // _JSON_CONNECTION_THREAD_POOL_H
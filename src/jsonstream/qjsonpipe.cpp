@@ -43,9 +43,7 @@
 #include <QtEndian>
 #include <QSocketNotifier>
 #include <QElapsedTimer>
-#include <qjsondocument.h>
 #include <qjsonobject.h>
-#include <QTextCodec>
 
 #include <sys/select.h>
 #include <stdio.h>
@@ -54,7 +52,7 @@
 
 #include "qjsonpipe.h"
 #include "qjsonbuffer_p.h"
-#include "bson/qt-bson_p.h"
+#include "qjsoncodec.h"
 
 QT_BEGIN_NAMESPACE_JSONSTREAM
 
@@ -66,13 +64,16 @@ public:
     QJsonPipePrivate()
         : mIn(0)
         , mOut(0)
-        , mFormat(FormatUndefined) {}
+        , mFormat(FormatUndefined)
+        , mCodec(0) {}
 
     QJsonBuffer      *mInBuffer;
     QByteArray       mOutBuffer;
     QSocketNotifier *mIn;
     QSocketNotifier *mOut;
     EncodingFormat   mFormat;
+    const QJsonCodec *mCodec;
+    QScopedPointer<QJsonCodecSession> mSession;
 };
 
 /****************************************************************************/
@@ -234,38 +235,13 @@ bool QJsonPipe::send(const QJsonObject& object)
     if (!d->mOut)
         return false;
 
-    QJsonDocument document(object);
-
-    switch (d->mFormat) {
-    case FormatUndefined:
-        d->mFormat = FormatQBJS;
-        // Deliberate fall through
-    case FormatQBJS:
-        d->mOutBuffer.append(document.toBinaryData());
-        break;
-    case FormatUTF8:
-        d->mOutBuffer.append(document.toJson());
-        break;
-    case FormatUTF16BE:
-        d->mOutBuffer.append( QTextCodec::codecForName("UTF-16BE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(2) );
-        break;
-    case FormatUTF16LE:
-        d->mOutBuffer.append( QTextCodec::codecForName("UTF-16LE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(2) );
-        break;
-    case FormatUTF32BE:
-        d->mOutBuffer.append( QTextCodec::codecForName("UTF-32BE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(4) );
-        break;
-    case FormatUTF32LE:
-        d->mOutBuffer.append( QTextCodec::codecForName("UTF-32LE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(4) );
-        break;
-    case FormatBSON:
-    {
-        BsonObject bson(document.toVariant().toMap());
-        d->mOutBuffer.append("bson");
-        d->mOutBuffer.append(bson.data());
-        break;
-    }
+    if (d->mFormat == FormatUndefined)
+        setFormat(FormatQBJS);
+    if (!d->mCodec) {
+        qWarning() << Q_FUNC_INFO << "No codec registered for format" << d->mFormat;
+        return false;
     }
+    d->mCodec->encode(d->mOutBuffer, object, d->mSession.data());
     if (d->mOutBuffer.size())
         d->mOut->setEnabled(true);
     return true;
@@ -280,7 +256,7 @@ void QJsonPipe::objectReceived(const QJsonObject& object)
 {
     Q_D(QJsonPipe);
     if (d->mFormat == FormatUndefined)
-        d->mFormat = d->mInBuffer->format();
+        setFormat(d->mInBuffer->format());
     emit messageReceived(object);
 }
 
@@ -310,13 +286,16 @@ EncodingFormat QJsonPipe::format() const
 }
 
 /*!
-  Set the EncodingFormat to \a format.
+  Set the EncodingFormat to \a format.  Messages are sent with the QJsonCodec
+  registered for \a format.
  */
 
 void QJsonPipe::setFormat( EncodingFormat format )
 {
     Q_D(QJsonPipe);
     d->mFormat = format;
+    d->mCodec = QJsonCodec::codecForFormat(format);
+    d->mSession.reset(d->mCodec ? d->mCodec->createSession() : 0);
 }
 
 /*!
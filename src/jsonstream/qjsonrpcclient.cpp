@@ -0,0 +1,390 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qjsonrpcclient.h"
+#include "qjsonendpoint.h"
+#include "qjsonconnection.h"
+
+#include <QFutureInterface>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QVector>
+#include <QTimer>
+#include <QDebug>
+
+const int knRPC_DEFAULT_TIMEOUT = 30000;
+const int knRPC_WHEEL_TICK = 10;     // milliseconds per slot
+const int knRPC_WHEEL_SIZE = 512;    // slots per revolution
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+static const QLatin1String kstrIdKey("id");
+static const QLatin1String kstrMethodKey("method");
+static const QLatin1String kstrParamsKey("params");
+static const QLatin1String kstrResultKey("result");
+static const QLatin1String kstrErrorKey("error");
+static const QLatin1String kstrCodeKey("code");
+static const QLatin1String kstrMessageKey("message");
+
+class QJsonRpcClientPrivate
+{
+public:
+    struct WheelEntry {
+        quint32 id;
+        int rounds;
+    };
+
+    struct Call {
+        QFutureInterface<QJsonObject> result;
+        int slot;   // timer wheel slot, or -1 without a timeout
+    };
+
+    QJsonRpcClientPrivate()
+        : mEndpoint(0)
+        , mDefaultTimeout(knRPC_DEFAULT_TIMEOUT)
+        , mNextId(1)
+        , mWheel(knRPC_WHEEL_SIZE)
+        , mWheelEntries(0)
+        , mWheelPosition(0)
+        , mWheelTime(0)
+    {
+        mClock.start();
+    }
+
+    /*!
+      \internal
+      Completes the pending call \a id with \a response.  Returns false if there is
+      no such call, for example because it has timed out already.
+     */
+    bool finish(quint32 id, const QJsonObject &response)
+    {
+        QHash<quint32, Call>::iterator it = mPending.find(id);
+        if (it == mPending.end())
+            return false;
+
+        QFutureInterface<QJsonObject> result = it.value().result;
+        if (it.value().slot >= 0)
+            unschedule(id, it.value().slot);
+        mPending.erase(it);
+        result.reportResult(response);
+        result.reportFinished();
+        return true;
+    }
+
+    /*!
+      \internal
+      Arms a timeout of \a msecs milliseconds for the call \a id.  The slot is counted
+      from the time of the current wheel position, which lags behind when a tick is
+      late, so that the call never times out early.
+     */
+    void schedule(quint32 id, int msecs)
+    {
+        qint64 now = mClock.elapsed();
+        if (!mWheelEntries) {
+            mWheelTime = now;
+            mTimer.start();
+        }
+
+        qint64 delay = now - mWheelTime + msecs;
+        int ticks = qMax(qint64(1), (delay + knRPC_WHEEL_TICK - 1) / knRPC_WHEEL_TICK);
+        int slot = (mWheelPosition + ticks) % knRPC_WHEEL_SIZE;
+        WheelEntry entry;
+        entry.id = id;
+        entry.rounds = (ticks - 1) / knRPC_WHEEL_SIZE;
+        mWheel[slot].append(entry);
+        mWheelEntries++;
+        mPending[id].slot = slot;
+    }
+
+    /*!
+      \internal
+      Removes the timeout of the call \a id from \a slot, and stops the timer once no
+      call has a timeout any more.
+     */
+    void unschedule(quint32 id, int slot)
+    {
+        QVector<WheelEntry> &entries = mWheel[slot];
+        for (int i = 0; i < entries.size(); ++i) {
+            if (entries[i].id == id) {
+                entries[i] = entries.last();
+                entries.removeLast();
+                if (!--mWheelEntries)
+                    mTimer.stop();
+                return;
+            }
+        }
+    }
+
+    static QJsonObject errorResponse(quint32 id, int code, const QString &message)
+    {
+        QJsonObject error;
+        error.insert(kstrCodeKey, code);
+        error.insert(kstrMessageKey, message);
+        QJsonObject response;
+        response.insert(kstrIdKey, double(id));
+        response.insert(kstrErrorKey, error);
+        return response;
+    }
+
+    QJsonEndpoint *mEndpoint;
+    int mDefaultTimeout;
+    quint32 mNextId;
+    QHash<quint32, Call> mPending;
+
+    // timer wheel; the timer only runs while calls with a timeout are pending
+    QVector<QVector<WheelEntry> > mWheel;
+    int mWheelEntries;
+    int mWheelPosition;
+    qint64 mWheelTime;
+    QElapsedTimer mClock;
+    QTimer mTimer;
+};
+
+/****************************************************************************/
+
+/*!
+    \class QJsonRpcClient
+    \inmodule QtJsonStream
+    \brief The QJsonRpcClient class makes request/response calls over a QJsonEndpoint.
+
+    QJsonRpcClient sends call messages over an endpoint and matches the responses to
+    the calls by a generated correlation identifier.  Each call() returns a QFuture
+    that finishes when the response arrives or the call times out, so any number of
+    calls may be in flight on one connection at the same time.
+
+    A call is sent as
+
+    \code
+    { "id": 17, "method": "add", "params": [1, 2] }
+    \endcode
+
+    and the server is expected to answer with either a \c result or an \c error
+    member carrying the same \c id, as QJsonRpcServer does:
+
+    \code
+    { "id": 17, "result": 3 }
+    { "id": 17, "error": { "code": -32601, "message": "Unknown method" } }
+    \endcode
+
+    The future's result is the whole response object.  A call that times out or
+    cannot be sent finishes with an error response whose code is one of
+    QJsonRpcClient::CallError.
+
+    The client reads all messages arriving on its endpoint.  Messages that are not
+    responses to pending calls are passed on with messageReceived().
+    QJsonRpcClient must be used from the thread it lives in.
+*/
+
+/*!
+    \enum QJsonRpcClient::CallError
+
+    This enumeration describes the error codes the client reports itself.
+
+    \value TimeoutError No response arrived within the call's timeout.
+    \value SendError The call could not be sent over the endpoint.
+*/
+
+/*!
+  Constructs a \c QJsonRpcClient object with \a parent, making calls over \a endpoint.
+ */
+QJsonRpcClient::QJsonRpcClient(QJsonEndpoint *endpoint, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new QJsonRpcClientPrivate())
+{
+    Q_D(QJsonRpcClient);
+    d->mEndpoint = endpoint;
+    d->mTimer.setInterval(knRPC_WHEEL_TICK);
+    connect(&d->mTimer, SIGNAL(timeout()), SLOT(handleTick()));
+    if (endpoint)
+        connect(endpoint, SIGNAL(readyReadMessage()), SLOT(processMessages()));
+}
+
+/*!
+  Deletes the \c QJsonRpcClient object.  Calls that are still pending are canceled.
+ */
+QJsonRpcClient::~QJsonRpcClient()
+{
+    Q_D(QJsonRpcClient);
+    foreach (QJsonRpcClientPrivate::Call call, d->mPending) {
+        call.result.reportCanceled();
+        call.result.reportFinished();
+    }
+}
+
+/*!
+  Returns the endpoint the calls are made over.
+ */
+QJsonEndpoint *QJsonRpcClient::endpoint() const
+{
+    Q_D(const QJsonRpcClient);
+    return d->mEndpoint;
+}
+
+/*!
+  Returns the timeout in milliseconds used for calls that do not specify one.
+ */
+int QJsonRpcClient::defaultTimeout() const
+{
+    Q_D(const QJsonRpcClient);
+    return d->mDefaultTimeout;
+}
+
+/*!
+  Sets the timeout used for calls that do not specify one to \a msecs milliseconds.
+  A value of 0 means such calls never time out.
+ */
+void QJsonRpcClient::setDefaultTimeout(int msecs)
+{
+    if (msecs >= 0) {
+        Q_D(QJsonRpcClient);
+        d->mDefaultTimeout = msecs;
+    }
+}
+
+/*!
+  Returns the number of calls waiting for a response.
+ */
+int QJsonRpcClient::pendingCallCount() const
+{
+    Q_D(const QJsonRpcClient);
+    return d->mPending.size();
+}
+
+/*!
+  Calls \a method with \a params and returns a future for the response.
+  If no response arrives within \a timeout milliseconds, the call finishes with a
+  TimeoutError.  A negative \a timeout uses defaultTimeout(), 0 waits forever.
+ */
+QFuture<QJsonObject> QJsonRpcClient::call(const QString &method, const QJsonValue &params, int timeout)
+{
+    Q_D(QJsonRpcClient);
+    quint32 id = d->mNextId++;
+
+    QJsonRpcClientPrivate::Call pending;
+    pending.result.reportStarted();
+    pending.slot = -1;
+    QFuture<QJsonObject> future = pending.result.future();
+    d->mPending.insert(id, pending);
+
+    QJsonObject message;
+    message.insert(kstrIdKey, double(id));
+    message.insert(kstrMethodKey, method);
+    if (!params.isNull() && !params.isUndefined())
+        message.insert(kstrParamsKey, params);
+
+    // route the response back to our endpoint
+    QJsonConnection *connection = d->mEndpoint ? d->mEndpoint->connection() : 0;
+    if (connection && d->mEndpoint != connection->defaultEndpoint())
+        message.insert(connection->endpointPropertyName(), d->mEndpoint->name());
+
+    if (!d->mEndpoint || !d->mEndpoint->send(message)) {
+        d->finish(id, QJsonRpcClientPrivate::errorResponse(id, SendError, QStringLiteral("Unable to send call")));
+        return future;
+    }
+
+    if (timeout < 0)
+        timeout = d->mDefaultTimeout;
+    if (timeout > 0)
+        d->schedule(id, timeout);
+    return future;
+}
+
+/*!
+  \internal
+  Reads the messages on the endpoint and completes the matching calls.
+ */
+void QJsonRpcClient::processMessages()
+{
+    Q_D(QJsonRpcClient);
+    while (d->mEndpoint->messageAvailable()) {
+        QJsonObject message = d->mEndpoint->readMessage();
+        QJsonValue id = message.value(kstrIdKey);
+        if (id.isDouble() && !message.contains(kstrMethodKey)
+                && (message.contains(kstrResultKey) || message.contains(kstrErrorKey))
+                && d->finish(quint32(id.toDouble()), message))
+            continue;
+        if (!message.isEmpty())
+            emit messageReceived(message);
+    }
+}
+
+/*!
+  \internal
+  Advances the timer wheel and fails the calls whose timeout has expired.
+ */
+void QJsonRpcClient::handleTick()
+{
+    Q_D(QJsonRpcClient);
+    qint64 now = d->mClock.elapsed();
+    while (now - d->mWheelTime >= knRPC_WHEEL_TICK) {
+        d->mWheelTime += knRPC_WHEEL_TICK;
+        d->mWheelPosition = (d->mWheelPosition + 1) % knRPC_WHEEL_SIZE;
+
+        QVector<quint32> expired;
+        QVector<QJsonRpcClientPrivate::WheelEntry> &slot = d->mWheel[d->mWheelPosition];
+        for (int i = 0; i < slot.size(); ++i) {
+            if (slot[i].rounds > 0)
+                slot[i].rounds--;
+            else
+                expired.append(slot[i].id);
+        }
+        // finish() takes the calls off the wheel
+        foreach (quint32 id, expired)
+            d->finish(id, QJsonRpcClientPrivate::errorResponse(id, TimeoutError, QStringLiteral("Call timed out")));
+    }
+}
+
+/*! \property QJsonRpcClient::defaultTimeout
+  The timeout in milliseconds for calls that do not specify their own.  The default
+  is 30000.  A value of 0 means such calls never time out.
+*/
+
+/*!
+    \fn void QJsonRpcClient::messageReceived(const QJsonObject &message)
+
+    This signal is emitted for every \a message received on the endpoint that is
+    not the response to a pending call.
+*/
+
+#include "moc_qjsonrpcclient.cpp"
+
+QT_END_NAMESPACE_JSONSTREAM
@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef _JSON_RPC_CLIENT_H
+#define _JSON_RPC_CLIENT_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QFuture>
+#include "qjsonstream-global.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+class QJsonEndpoint;
+
+class QJsonRpcClientPrivate;
+class Q_ADDON_JSONSTREAM_EXPORT QJsonRpcClient : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int defaultTimeout READ defaultTimeout WRITE setDefaultTimeout)
+public:
+    QJsonRpcClient(QJsonEndpoint *endpoint, QObject *parent = 0);
+    ~QJsonRpcClient();
+
+    enum CallError {
+        TimeoutError = -32000,
+        SendError = -32001
+    };
+    Q_ENUMS(CallError)
+
+    QJsonEndpoint *endpoint() const;
+
+    int defaultTimeout() const;
+    void setDefaultTimeout(int msecs);
+
+    int pendingCallCount() const;
+
+    QFuture<QJsonObject> call(const QString &method, const QJsonValue &params = QJsonValue(), int timeout = -1);
+
+signals:
+    void messageReceived(const QJsonObject &message);
+
+private slots:
+    void processMessages();
+    void handleTick();
+
+private:
+    Q_DECLARE_PRIVATE(QJsonRpcClient)
+    QScopedPointer<QJsonRpcClientPrivate> d_ptr;
+
+    // forbid copy constructor
+    QJsonRpcClient(const QJsonRpcClient &);
+    void operator=(const QJsonRpcClient &);
+};
+
+QT_END_NAMESPACE_JSONSTREAM
+
+#endif // _JSON_RPC_CLIENT_H
@@ -0,0 +1,222 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qjsonrpcserver.h"
+#include "qjsonserver.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+static const QLatin1String kstrIdKey("id");
+static const QLatin1String kstrMethodKey("method");
+static const QLatin1String kstrParamsKey("params");
+static const QLatin1String kstrResultKey("result");
+static const QLatin1String kstrErrorKey("error");
+static const QLatin1String kstrCodeKey("code");
+static const QLatin1String kstrMessageKey("message");
+static const QLatin1String kstrEndpointKey("endpoint");
+
+class QJsonRpcServerPrivate
+{
+public:
+    QJsonRpcServerPrivate()
+        : mServer(0)
+        , mEndpointPropertyName(kstrEndpointKey)
+    {}
+
+    /*!
+      \internal
+      Returns a response skeleton addressed to the sender of \a call.
+     */
+    QJsonObject response(const QJsonObject &call) const
+    {
+        QJsonObject message;
+        message.insert(kstrIdKey, call.value(kstrIdKey));
+        QJsonValue endpoint = call.value(mEndpointPropertyName);
+        if (!endpoint.isUndefined())
+            message.insert(mEndpointPropertyName, endpoint);
+        return message;
+    }
+
+    QJsonServer *mServer;
+    QString mEndpointPropertyName;
+};
+
+/****************************************************************************/
+
+/*!
+    \class QJsonRpcServer
+    \inmodule QtJsonStream
+    \brief The QJsonRpcServer class answers calls made with QJsonRpcClient.
+
+    QJsonRpcServer watches the messages received by a QJsonServer and emits
+    callReceived() for every call.  The application answers a call with reply()
+    or replyError(), in any order and at any time, which allows many calls from
+    the same client to be processed concurrently.
+
+    \code
+    connect(rpc, SIGNAL(callReceived(QString,QString,QJsonValue,QJsonObject)),
+            SLOT(handleCall(QString,QString,QJsonValue,QJsonObject)));
+    <...>
+
+    void MyServer::handleCall(const QString &identifier, const QString &method,
+                              const QJsonValue &params, const QJsonObject &call)
+    {
+        if (method == QLatin1String("echo"))
+            rpc->reply(identifier, call, params);
+        else
+            rpc->replyError(identifier, call, -32601, QStringLiteral("Unknown method"));
+    }
+    \endcode
+
+    Calls are still delivered through QJsonServer::messageReceived() as well.
+    The response carries the caller's endpoint property, so it is routed back
+    to the QJsonEndpoint that made the call.
+*/
+
+/*!
+  Constructs a \c QJsonRpcServer object with \a parent, answering calls received by \a server.
+ */
+QJsonRpcServer::QJsonRpcServer(QJsonServer *server, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new QJsonRpcServerPrivate())
+{
+    Q_D(QJsonRpcServer);
+    d->mServer = server;
+    connect(server, SIGNAL(messageReceived(const QString&, const QJsonObject&)),
+            SLOT(handleMessage(const QString&, const QJsonObject&)));
+}
+
+/*!
+  Deletes the \c QJsonRpcServer object.
+ */
+QJsonRpcServer::~QJsonRpcServer()
+{
+}
+
+/*!
+  Returns the server whose messages are processed.
+ */
+QJsonServer *QJsonRpcServer::server() const
+{
+    Q_D(const QJsonRpcServer);
+    return d->mServer;
+}
+
+/*!
+  Returns the property that routes responses to the calling endpoint.
+ */
+QString QJsonRpcServer::endpointPropertyName() const
+{
+    Q_D(const QJsonRpcServer);
+    return d->mEndpointPropertyName;
+}
+
+/*!
+  Sets the property that routes responses to the calling endpoint to \a property.
+  It must match QJsonConnection::endpointPropertyName() of the clients.
+ */
+void QJsonRpcServer::setEndpointPropertyName(const QString &property)
+{
+    Q_D(QJsonRpcServer);
+    d->mEndpointPropertyName = property;
+}
+
+/*!
+  Returns \b true if \a message is a call, that is, it has a \c method and an \c id.
+ */
+bool QJsonRpcServer::isCall(const QJsonObject &message)
+{
+    return message.value(kstrMethodKey).isString() && message.contains(kstrIdKey);
+}
+
+/*!
+  Sends \a result as the response to \a call to the client \a identifier.
+  Returns \b true if the response was sent or queued.
+ */
+bool QJsonRpcServer::reply(const QString &identifier, const QJsonObject &call, const QJsonValue &result)
+{
+    Q_D(QJsonRpcServer);
+    QJsonObject message = d->response(call);
+    message.insert(kstrResultKey, result);
+    return d->mServer->send(identifier, message);
+}
+
+/*!
+  Sends an error with \a code and \a message as the response to \a call to the
+  client \a identifier.  Returns \b true if the response was sent or queued.
+ */
+bool QJsonRpcServer::replyError(const QString &identifier, const QJsonObject &call, int code, const QString &message)
+{
+    Q_D(QJsonRpcServer);
+    QJsonObject error;
+    error.insert(kstrCodeKey, code);
+    error.insert(kstrMessageKey, message);
+    QJsonObject response = d->response(call);
+    response.insert(kstrErrorKey, error);
+    return d->mServer->send(identifier, response);
+}
+
+/*!
+  \internal
+ */
+void QJsonRpcServer::handleMessage(const QString &identifier, const QJsonObject &message)
+{
+    if (isCall(message))
+        emit callReceived(identifier, message.value(kstrMethodKey).toString(),
+                          message.value(kstrParamsKey), message);
+}
+
+/*! \property QJsonRpcServer::endpointPropertyName
+  The property copied from a call into its response so that QJsonConnection can
+  route the response to the calling endpoint.  The default is \c endpoint.
+*/
+
+/*!
+    \fn void QJsonRpcServer::callReceived(const QString &identifier, const QString &method, const QJsonValue &params, const QJsonObject &call)
+
+    This signal is emitted when the client \a identifier calls \a method with
+    \a params.  Pass \a call to reply() or replyError() to answer it.
+*/
+
+#include "moc_qjsonrpcserver.cpp"
+
+QT_END_NAMESPACE_JSONSTREAM
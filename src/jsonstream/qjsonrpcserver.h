@@ -0,0 +1,92 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef _JSON_RPC_SERVER_H
+#define _JSON_RPC_SERVER_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QJsonValue>
+#include "qjsonstream-global.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+class QJsonServer;
+
+class QJsonRpcServerPrivate;
+class Q_ADDON_JSONSTREAM_EXPORT QJsonRpcServer : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString endpointPropertyName READ endpointPropertyName WRITE setEndpointPropertyName)
+public:
+    QJsonRpcServer(QJsonServer *server, QObject *parent = 0);
+    ~QJsonRpcServer();
+
+    QJsonServer *server() const;
+
+    QString endpointPropertyName() const;
+    void setEndpointPropertyName(const QString &);
+
+    static bool isCall(const QJsonObject &message);
+
+public slots:
+    bool reply(const QString &identifier, const QJsonObject &call, const QJsonValue &result);
+    bool replyError(const QString &identifier, const QJsonObject &call, int code, const QString &message);
+
+signals:
+    void callReceived(const QString &identifier, const QString &method, const QJsonValue &params, const QJsonObject &call);
+
+private slots:
+    void handleMessage(const QString &identifier, const QJsonObject &message);
+
+private:
+    Q_DECLARE_PRIVATE(QJsonRpcServer)
+    QScopedPointer<QJsonRpcServerPrivate> d_ptr;
+
+    // forbid copy constructor
+    QJsonRpcServer(const QJsonRpcServer &);
+    void operator=(const QJsonRpcServer &);
+};
+
+QT_END_NAMESPACE_JSONSTREAM
+
+#endif // _JSON_RPC_SERVER_H
@@ -50,12 +50,15 @@
 #include "qjsonserverclient.h"
 
 #include "qjsonschemavalidator.h"
+#include "qjsoncodec.h"
 
 #include <QtCore>
 #include <QtNetwork>
 
 QT_BEGIN_NAMESPACE_JSONSTREAM
 
+const int knMAX_PENDING_VALIDATIONS = 10000;
+
 
 /*!
   \internal
@@ -65,15 +68,42 @@ inline bool canValidate(QJsonServer::ValidatorFlags flags, QJsonSchemaValidator
     return flags != QJsonServer::NoValidation && validator && !validator->isEmpty();
 }
 
+// validation timings, in nanoseconds
+struct QJsonServerValidationStatistics
+{
+    QJsonServerValidationStatistics()
+        : validated(0), failed(0), skipped(0), pending(0), overflowed(0)
+        , validationTime(0), maxValidationTime(0), queued(0), queueTime(0), maxQueueTime(0) {}
+
+    qint64 validated;
+    qint64 failed;
+    qint64 skipped;    // not sampled
+    qint64 pending;    // waiting for asynchronous validation
+    qint64 overflowed; // not validated because too many were pending
+    qint64 validationTime;
+    qint64 maxValidationTime;
+    qint64 queued;
+    qint64 queueTime;  // from delivery to asynchronous validation
+    qint64 maxQueueTime;
+};
+
 class QJsonServerPrivate
 {
 public:
     QJsonServerPrivate()
         : m_inboundValidator(0)
-        , m_outboundValidator(0) {}
+        , m_outboundValidator(0)
+        , m_flowControlWindow(0)
+        , m_flowControlWindowBytes(0)
+        , m_validationSampleRate(1.0)
+        , m_inboundSampleCredit(0.0)
+        , m_outboundSampleCredit(0.0) {}
 
     ~QJsonServerPrivate()
     {
+        // asynchronous validation uses the validators
+        m_validationPool.waitForDone();
+
         qDeleteAll(m_identifierToClient);
         foreach (QLocalServer *server, m_localServers.keys())
             delete server;
@@ -92,6 +122,99 @@ public:
     QJsonServer::ValidatorFlags             m_validatorFlags;
     QJsonSchemaValidator                       *m_inboundValidator;
     QJsonSchemaValidator                       *m_outboundValidator;
+    int                                     m_flowControlWindow;
+    qint64                                  m_flowControlWindowBytes;
+    QList<EncodingFormat>                   m_acceptedFormats;
+
+    bool sample(bool inbound);
+    void validated(bool valid, qint64 validationTime, qint64 queueTime);
+
+    double                                  m_validationSampleRate;
+    double                                  m_inboundSampleCredit;
+    double                                  m_outboundSampleCredit;
+    QThreadPool                             m_validationPool;
+    mutable QMutex                          m_statisticsMutex;
+    QJsonServerValidationStatistics         m_statistics;
+};
+
+/*!
+  \internal
+  Returns true if the next \a inbound or outbound message is one of the sampled ones.
+  Each direction keeps its own credit, so that traffic one way does not decide which
+  messages are sampled the other way.  The sampled messages are spread evenly rather
+  than randomly; traffic that repeats with the period of the rate, such as alternating
+  message types at a rate of 0.5, has the same messages sampled every time.
+*/
+bool QJsonServerPrivate::sample(bool inbound)
+{
+    double &credit = inbound ? m_inboundSampleCredit : m_outboundSampleCredit;
+    credit += m_validationSampleRate;
+    if (credit < 1.0)
+        return false;
+    credit -= 1.0;
+    return true;
+}
+
+/*!
+  \internal
+  Records a validation that took \a validationTime nsecs after waiting \a queueTime nsecs,
+  or -1 if it was not queued.  Called from the validation threads too.
+*/
+void QJsonServerPrivate::validated(bool valid, qint64 validationTime, qint64 queueTime)
+{
+    QMutexLocker locker(&m_statisticsMutex);
+    m_statistics.validated++;
+    if (!valid)
+        m_statistics.failed++;
+    m_statistics.validationTime += validationTime;
+    m_statistics.maxValidationTime = qMax(m_statistics.maxValidationTime, validationTime);
+    if (queueTime >= 0) {
+        m_statistics.pending--;
+        m_statistics.queued++;
+        m_statistics.queueTime += queueTime;
+        m_statistics.maxQueueTime = qMax(m_statistics.maxQueueTime, queueTime);
+    }
+}
+
+/*!
+  \internal
+  Validates a message that has been delivered already in a thread of the validation pool,
+  and hands the error back to the thread of the server.
+*/
+class QJsonServerValidationTask : public QRunnable
+{
+public:
+    QJsonServerValidationTask(QJsonServer *server, QJsonServerPrivate *d, QJsonSchemaValidator *validator,
+                              const QJsonObject &message, bool inbound, bool warn)
+        : m_server(server), m_d(d), m_validator(validator), m_message(message)
+        , m_inbound(inbound), m_warn(warn)
+    {
+        m_queued.start();
+    }
+
+    void run()
+    {
+        const qint64 queueTime = m_queued.nsecsElapsed();
+        QElapsedTimer timer;
+        timer.start();
+        const bool valid = m_validator->validateSchema(m_message);
+        m_d->validated(valid, timer.nsecsElapsed(), queueTime);
+
+        if (!valid && m_warn) {
+            QMetaObject::invokeMethod(m_server, "asyncValidationFailed", Qt::QueuedConnection,
+                                      Q_ARG(bool, m_inbound), Q_ARG(QJsonObject, m_message),
+                                      Q_ARG(QJsonObject, m_validator->getLastError().object()));
+        }
+    }
+
+private:
+    QJsonServer *m_server;
+    QJsonServerPrivate *m_d;
+    QJsonSchemaValidator *m_validator;
+    QJsonObject m_message;
+    bool m_inbound;
+    bool m_warn;
+    QElapsedTimer m_queued;
 };
 
 /**************************************************************************************************/
@@ -132,6 +255,10 @@ public:
     that has not yet connected.  Calling \c enableQueueing(identifier) will
     enable queueing of messages for that identifier.  Each client must
     be enabled separately; there is no general "queue for everyone" setting.
+
+    Clients that offer to switch to a faster format are answered according to
+    \l setAcceptedFormats().  \l formatStatistics() shows which formats the
+    connected clients ended up with.
 */
 
 /*!
@@ -139,6 +266,22 @@ public:
   The current ValidatorFlags set on this server
 */
 
+/*!
+  \property QJsonServer::flowControlWindow
+  The number of messages each client may send ahead of the server reading them.
+  A value of 0, the default, means the number of messages is not limited.
+
+  \sa QJsonStream::setFlowControlWindow()
+*/
+
+/*!
+  \property QJsonServer::flowControlWindowBytes
+  The number of bytes each client may send ahead of the server reading them.
+  A value of 0, the default, means the number of bytes is not limited.
+
+  \sa QJsonStream::setFlowControlWindowBytes()
+*/
+
 /*!
   Constructs a new QJsonServer instance with \a parent.
 */
@@ -209,6 +352,10 @@ void QJsonServer::handleLocalConnection()
         QJsonServerClient *client = new QJsonServerClient(this);
         client->setAuthority(authority);
         client->setSocket(socket);
+        if (d->m_flowControlWindow > 0 || d->m_flowControlWindowBytes > 0)
+            client->setFlowControlWindow(d->m_flowControlWindow, d->m_flowControlWindowBytes);
+        if (!d->m_acceptedFormats.isEmpty())
+            client->setAcceptedFormats(d->m_acceptedFormats);
         connect(client, SIGNAL(authorized(const QString&)),
                 this, SLOT(handleClientAuthorized(const QString&)));
         connect(client, SIGNAL(disconnected(const QString&)),
@@ -287,17 +434,8 @@ void QJsonServer::receiveMessage(const QString &identifier, const QJsonObject &m
 {
     // do JSON schema validation if required
     Q_D(QJsonServer);
-    if (canValidate(validatorFlags(), d->m_inboundValidator)) {
-        if (!d->m_inboundValidator->validateSchema(message))
-        {
-            if (validatorFlags().testFlag(WarnIfInvalid)) {
-                emit inboundMessageValidationFailed(message, d->m_inboundValidator->getLastError());
-            }
-            if (validatorFlags().testFlag(DropIfInvalid)) {
-                return;
-            }
-        }
-    }
+    if (!validateMessage(d->m_inboundValidator, message, true))
+        return;
 
     emit messageReceived(identifier, message);
 }
@@ -408,17 +546,8 @@ bool QJsonServer::send(const QString &identifier, const QJsonObject &message)
 {
     // do JSON schema validation if required
     Q_D(QJsonServer);
-    if (canValidate(validatorFlags(), d->m_outboundValidator)) {
-        if (!d->m_outboundValidator->validateSchema(message))
-        {
-            if (validatorFlags().testFlag(WarnIfInvalid)) {
-                emit outboundMessageValidationFailed(message, d->m_outboundValidator->getLastError());
-            }
-            if (validatorFlags().testFlag(DropIfInvalid)) {
-                return false;
-            }
-        }
-    }
+    if (!validateMessage(d->m_outboundValidator, message, false))
+        return false;
 
     if (isQueuingEnabled(identifier)) {
         QList<QJsonObject> queue = d->m_messageQueues.value(identifier);
@@ -443,17 +572,8 @@ void QJsonServer::broadcast(const QJsonObject &message)
 {
     // do JSON schema validation if required
     Q_D(QJsonServer);
-    if (canValidate(validatorFlags(), d->m_outboundValidator)) {
-        if (!d->m_outboundValidator->validateSchema(message))
-        {
-            if (validatorFlags().testFlag(WarnIfInvalid)) {
-                emit outboundMessageValidationFailed(message, d->m_outboundValidator->getLastError());
-            }
-            if (validatorFlags().testFlag(DropIfInvalid)) {
-                return;
-            }
-        }
-    }
+    if (!validateMessage(d->m_outboundValidator, message, false))
+        return;
 
     // ### No QJsonServerClient should be repeated in this list
     QList<QJsonServerClient*> clients = d->m_identifierToClient.values();
@@ -494,6 +614,14 @@ void QJsonServer::removeConnection(const QString &identifier)
          Validate and warn about invalid messages.
      \value ApplyDefaultValues
          If a value is missing then use a default attribute's value fron JSON schema.
+     \value SampleValidation
+         Validate only the share of messages set by setValidationSampleRate().  Messages
+         that are not sampled are never dropped.
+     \value AsyncValidation
+         Deliver messages right away and validate them afterwards in a pool of threads.
+         Warnings arrive later, through the thread of the server; DropIfInvalid does not
+         apply to these messages.  Messages that arrive while 10000 others are waiting
+         are not validated.
 
      \omitvalue NoValidation
 */
@@ -516,6 +644,260 @@ void QJsonServer::setValidatorFlags(ValidatorFlags flags)
     d->m_validatorFlags = flags;
 }
 
+/*!
+  Returns the share of messages validated with SampleValidation, between 0 and 1.
+*/
+double QJsonServer::validationSampleRate() const
+{
+    Q_D(const QJsonServer);
+    return d->m_validationSampleRate;
+}
+
+/*!
+  Sets the share of messages validated with SampleValidation to \a rate, between 0
+  (none) and 1 (all, the default).  For example, 0.1 validates every tenth message.
+*/
+void QJsonServer::setValidationSampleRate(double rate)
+{
+    Q_D(QJsonServer);
+    d->m_validationSampleRate = qBound(0.0, rate, 1.0);
+    d->m_inboundSampleCredit = 0.0;
+    d->m_outboundSampleCredit = 0.0;
+}
+
+/*!
+  Returns counters and timings of the schema validation of messages in both
+  directions:
+
+  \table
+  \header \li Key \li Value
+  \row \li \c validated \li Messages validated
+  \row \li \c failed \li Messages that failed validation
+  \row \li \c skipped \li Messages not validated with SampleValidation
+  \row \li \c pending \li Messages waiting for AsyncValidation
+  \row \li \c overflowed \li Messages not validated because too many were waiting for AsyncValidation
+  \row \li \c validationsPerSecond \li Validations one thread does per second of validation time
+  \row \li \c averageValidationUsecs, \c maxValidationUsecs \li Time spent validating a message
+  \row \li \c averageQueueUsecs, \c maxQueueUsecs \li Time from delivery to validation with AsyncValidation
+  \endtable
+
+  \sa resetValidationStatistics()
+*/
+QVariantMap QJsonServer::validationStatistics() const
+{
+    Q_D(const QJsonServer);
+    QJsonServerValidationStatistics statistics;
+    {
+        QMutexLocker locker(&d->m_statisticsMutex);
+        statistics = d->m_statistics;
+    }
+
+    QVariantMap map;
+    map.insert(QStringLiteral("validated"), statistics.validated);
+    map.insert(QStringLiteral("failed"), statistics.failed);
+    map.insert(QStringLiteral("skipped"), statistics.skipped);
+    map.insert(QStringLiteral("pending"), statistics.pending);
+    map.insert(QStringLiteral("overflowed"), statistics.overflowed);
+    map.insert(QStringLiteral("validationsPerSecond"),
+               statistics.validationTime ? statistics.validated * 1e9 / statistics.validationTime : 0.0);
+    map.insert(QStringLiteral("averageValidationUsecs"),
+               statistics.validated ? statistics.validationTime / 1e3 / statistics.validated : 0.0);
+    map.insert(QStringLiteral("maxValidationUsecs"), statistics.maxValidationTime / 1e3);
+    map.insert(QStringLiteral("averageQueueUsecs"),
+               statistics.queued ? statistics.queueTime / 1e3 / statistics.queued : 0.0);
+    map.insert(QStringLiteral("maxQueueUsecs"), statistics.maxQueueTime / 1e3);
+    return map;
+}
+
+/*!
+  Clears the counters and timings returned by validationStatistics(), apart from the
+  messages still pending.
+*/
+void QJsonServer::resetValidationStatistics()
+{
+    Q_D(QJsonServer);
+    QMutexLocker locker(&d->m_statisticsMutex);
+    const qint64 pending = d->m_statistics.pending;
+    d->m_statistics = QJsonServerValidationStatistics();
+    d->m_statistics.pending = pending;
+}
+
+/*!
+  Waits up to \a msecs milliseconds, or forever if \a msecs is -1, for the messages queued
+  with AsyncValidation to be validated.  Returns false on timeout.  The failures are
+  reported once the event loop runs again.
+*/
+bool QJsonServer::waitForValidation(int msecs)
+{
+    Q_D(QJsonServer);
+    return d->m_validationPool.waitForDone(msecs);
+}
+
+/*!
+  \internal
+  Validates an inbound or outbound \a message according to the validator flags.  Returns
+  false if the message must be dropped.
+*/
+bool QJsonServer::validateMessage(QJsonSchemaValidator *validator, const QJsonObject &message, bool inbound)
+{
+    Q_D(QJsonServer);
+    const ValidatorFlags flags = validatorFlags();
+    if (!canValidate(flags, validator))
+        return true;
+
+    if (flags.testFlag(SampleValidation) && !d->sample(inbound)) {
+        QMutexLocker locker(&d->m_statisticsMutex);
+        d->m_statistics.skipped++;
+        return true;
+    }
+
+    if (flags.testFlag(AsyncValidation)) {
+        {
+            // the pool must not fall behind without bound
+            QMutexLocker locker(&d->m_statisticsMutex);
+            if (d->m_statistics.pending >= knMAX_PENDING_VALIDATIONS) {
+                d->m_statistics.overflowed++;
+                return true;
+            }
+            d->m_statistics.pending++;
+        }
+        d->m_validationPool.start(new QJsonServerValidationTask(this, d, validator, message, inbound,
+                                                                flags.testFlag(WarnIfInvalid)));
+        return true;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const bool valid = validator->validateSchema(message);
+    d->validated(valid, timer.nsecsElapsed(), -1);
+    if (valid)
+        return true;
+
+    if (flags.testFlag(WarnIfInvalid)) {
+        if (inbound)
+            emit inboundMessageValidationFailed(message, validator->getLastError());
+        else
+            emit outboundMessageValidationFailed(message, validator->getLastError());
+    }
+    return !flags.testFlag(DropIfInvalid);
+}
+
+/*!
+  \internal
+  Reports the \a error of an inbound or outbound \a message that failed asynchronous validation.
+*/
+void QJsonServer::asyncValidationFailed(bool inbound, const QJsonObject &message, const QJsonObject &error)
+{
+    if (inbound)
+        emit inboundMessageValidationFailed(message, QJsonSchemaError(error));
+    else
+        emit outboundMessageValidationFailed(message, QJsonSchemaError(error));
+}
+
+/*!
+  Returns the number of messages each client may send ahead of the server reading them.
+*/
+int QJsonServer::flowControlWindow() const
+{
+    Q_D(const QJsonServer);
+    return d->m_flowControlWindow;
+}
+
+/*!
+  Sets the number of messages each client may send ahead of the server reading
+  them to \a messages.  Applies to connected clients as well as new ones.
+*/
+void QJsonServer::setFlowControlWindow(int messages)
+{
+    if (messages >= 0) {
+        Q_D(QJsonServer);
+        d->m_flowControlWindow = messages;
+        updateFlowControl();
+    }
+}
+
+/*!
+  Returns the number of bytes each client may send ahead of the server reading them.
+*/
+qint64 QJsonServer::flowControlWindowBytes() const
+{
+    Q_D(const QJsonServer);
+    return d->m_flowControlWindowBytes;
+}
+
+/*!
+  Sets the number of bytes each client may send ahead of the server reading
+  them to \a bytes.  Applies to connected clients as well as new ones.
+*/
+void QJsonServer::setFlowControlWindowBytes(qint64 bytes)
+{
+    if (bytes >= 0) {
+        Q_D(QJsonServer);
+        d->m_flowControlWindowBytes = bytes;
+        updateFlowControl();
+    }
+}
+
+/*!
+  Returns the formats clients may switch to, most preferred first.
+*/
+QList<EncodingFormat> QJsonServer::acceptedFormats() const
+{
+    Q_D(const QJsonServer);
+    return d->m_acceptedFormats;
+}
+
+/*!
+  Sets the \a formats clients may switch to, most preferred first.  When a client
+  offers a list of formats, the server picks the first of \a formats that the client
+  accepts as well, and both sides switch to it.  An empty list, the default, keeps
+  every client on the format it started with.  Applies to new clients.
+
+  \sa QJsonClient::setAcceptedFormats(), QJsonStream::negotiateFormat()
+*/
+void QJsonServer::setAcceptedFormats(const QList<EncodingFormat>& formats)
+{
+    Q_D(QJsonServer);
+    d->m_acceptedFormats = formats;
+}
+
+/*!
+  Returns the format messages are sent to the client \a identifier in, or
+  FormatUndefined if there is no such client or it has not sent anything yet.
+*/
+EncodingFormat QJsonServer::connectionFormat(const QString &identifier) const
+{
+    Q_D(const QJsonServer);
+    QJsonServerClient *client = d->m_identifierToClient.value(identifier);
+    return client ? client->format() : FormatUndefined;
+}
+
+/*!
+  Returns the number of connected clients per format, keyed by
+  QJsonCodec::formatName(), for example \c{{"utf8": 2, "cbor": 5}}.
+*/
+QVariantMap QJsonServer::formatStatistics() const
+{
+    Q_D(const QJsonServer);
+    QVariantMap statistics;
+    foreach (QJsonServerClient *client, d->m_identifierToClient) {
+        QString name = QJsonCodec::formatName(client->format());
+        statistics.insert(name, statistics.value(name).toInt() + 1);
+    }
+    return statistics;
+}
+
+/*!
+  \internal
+  Applies the flow control window to all connected clients.
+*/
+void QJsonServer::updateFlowControl()
+{
+    Q_D(QJsonServer);
+    foreach (QJsonServerClient *client, d->m_identifierToClient)
+        client->setFlowControlWindow(d->m_flowControlWindow, d->m_flowControlWindowBytes);
+}
+
 /*!
   Returns an inbound JSON schema validator object.
 */
@@ -542,13 +924,20 @@ QJsonSchemaValidator *QJsonServer::outboundValidator()
 
 /*!
   \internal
-  Initialize validation if defined by environment
+  Initialize validation if defined by environment.  JSONSERVER_SCHEMA_CACHE_PATH names a folder
+  to cache the parsed schemas in, "precompile" in JSONSERVER_SCHEMA_CONTROL compiles them in the
+  background right after loading and "watch" reloads the schema folders when they change.
+  "sample" validates the share of messages given by JSONSERVER_SCHEMA_SAMPLE_RATE and "async"
+  validates them in the background.
 */
 void QJsonServer::initSchemaValidation()
 {
     QString szInboundPath = QString::fromLocal8Bit(qgetenv("JSONSERVER_SCHEMA_INBOUND_PATH"));
     QString szOutboundPath = QString::fromLocal8Bit(qgetenv("JSONSERVER_SCHEMA_OUTBOUND_PATH"));
     QString strSchemaControl = QString::fromLocal8Bit(qgetenv("JSONSERVER_SCHEMA_CONTROL")); // "warn","drop" or "warn":"drop"
+    QString szCachePath = QString::fromLocal8Bit(qgetenv("JSONSERVER_SCHEMA_CACHE_PATH"));
+    bool bPrecompile = false;
+    bool bWatch = false;
 
     if (!strSchemaControl.isEmpty())
     {
@@ -560,21 +949,53 @@ void QJsonServer::initSchemaValidation()
                 flags |= WarnIfInvalid;
             else if (str == QLatin1String("drop"))
                 flags |= DropIfInvalid;
+            else if (str == QLatin1String("precompile"))
+                bPrecompile = true;
+            else if (str == QLatin1String("watch"))
+                bWatch = true;
+            else if (str == QLatin1String("sample"))
+                flags |= SampleValidation;
+            else if (str == QLatin1String("async"))
+                flags |= AsyncValidation;
         }
         setValidatorFlags(flags);
+
+        QByteArray sampleRate = qgetenv("JSONSERVER_SCHEMA_SAMPLE_RATE");
+        if (!sampleRate.isEmpty()) {
+            bool ok;
+            double rate = sampleRate.toDouble(&ok);
+            if (ok)
+                setValidationSampleRate(rate);
+            else
+                qWarning() << "Invalid JSONSERVER_SCHEMA_SAMPLE_RATE" << sampleRate;
+        }
     }
 
     if (!szInboundPath.isEmpty()) {
         QFileInfo fi(szInboundPath);
         if (fi.exists() && fi.isDir()) {
-            inboundValidator()->loadFromFolder(szInboundPath);
+            if (!szCachePath.isEmpty())
+                inboundValidator()->setSchemaCacheFile(QDir(szCachePath).filePath(QStringLiteral("inbound.schemacache")));
+            if (bPrecompile)
+                inboundValidator()->setPrecompileSchemas(true);
+            if (bWatch)
+                inboundValidator()->watchFolder(szInboundPath);
+            else
+                inboundValidator()->loadFromFolder(szInboundPath);
         }
     }
 
     if (!szOutboundPath.isEmpty()) {
         QFileInfo fi(szOutboundPath);
         if (fi.exists() && fi.isDir()) {
-            outboundValidator()->loadFromFolder(szOutboundPath);
+            if (!szCachePath.isEmpty())
+                outboundValidator()->setSchemaCacheFile(QDir(szCachePath).filePath(QStringLiteral("outbound.schemacache")));
+            if (bPrecompile)
+                outboundValidator()->setPrecompileSchemas(true);
+            if (bWatch)
+                outboundValidator()->watchFolder(szOutboundPath);
+            else
+                outboundValidator()->loadFromFolder(szOutboundPath);
         }
     }
 }
@@ -44,6 +44,8 @@
 
 #include <QObject>
 #include <QJsonObject>
+#include <QList>
+#include <QVariantMap>
 
 #include "qjsonstream-global.h"
 #include "qjsonschemaerror.h"
@@ -58,6 +60,9 @@ class Q_ADDON_JSONSTREAM_EXPORT QJsonServer : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(ValidatorFlags validatorFlags READ validatorFlags WRITE setValidatorFlags)
+    Q_PROPERTY(int flowControlWindow READ flowControlWindow WRITE setFlowControlWindow)
+    Q_PROPERTY(qint64 flowControlWindowBytes READ flowControlWindowBytes WRITE setFlowControlWindowBytes)
+    Q_PROPERTY(double validationSampleRate READ validationSampleRate WRITE setValidationSampleRate)
 
 public:
     QJsonServer(QObject *parent = 0);
@@ -76,12 +81,26 @@ public:
     void enableMultipleConnections(const QString& identifier);
     void disableMultipleConnections(const QString& identifier);
 
+    int flowControlWindow() const;
+    void setFlowControlWindow(int messages);
+
+    qint64 flowControlWindowBytes() const;
+    void setFlowControlWindowBytes(qint64 bytes);
+
+    QList<EncodingFormat> acceptedFormats() const;
+    void setAcceptedFormats(const QList<EncodingFormat>& formats);
+
+    EncodingFormat connectionFormat(const QString &identifier) const;
+    QVariantMap formatStatistics() const;
+
     // schema validation
     enum ValidatorFlag {
         NoValidation = 0x0,
         DropIfInvalid = 0x1,
         WarnIfInvalid = 0x2,
-        ApplyDefaultValues = 0x4 // TODO
+        ApplyDefaultValues = 0x4, // TODO
+        SampleValidation = 0x8,
+        AsyncValidation = 0x10
     };
     Q_DECLARE_FLAGS(ValidatorFlags, ValidatorFlag)
 
@@ -91,6 +110,13 @@ public:
     QJsonSchemaValidator *inboundValidator();
     QJsonSchemaValidator *outboundValidator();
 
+    double validationSampleRate() const;
+    void setValidationSampleRate(double rate);
+
+    QVariantMap validationStatistics() const;
+    void resetValidationStatistics();
+    bool waitForValidation(int msecs = -1);
+
 public slots:
     bool hasConnection(const QString &identifier) const;
     bool send(const QString &identifier, const QJsonObject& message);
@@ -114,9 +140,12 @@ protected slots:
 
 private slots:
     void handleLocalConnection();
+    void asyncValidationFailed(bool inbound, const QJsonObject &message, const QJsonObject &error);
 
 private:
     void initSchemaValidation();
+    bool validateMessage(QJsonSchemaValidator *validator, const QJsonObject &message, bool inbound);
+    void updateFlowControl();
 
 private:
     Q_DECLARE_PRIVATE(QJsonServer)
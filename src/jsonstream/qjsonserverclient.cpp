@@ -98,6 +98,44 @@ void QJsonServerClient::setAuthority(QJsonAuthority *authority)
     d->m_authority = authority;
 }
 
+/*!
+    Sets the flow control window of the client stream to \a messages and \a bytes.
+    Must be called after setSocket().
+
+    \sa QJsonStream::setFlowControlWindow(), QJsonStream::setFlowControlWindowBytes()
+*/
+void QJsonServerClient::setFlowControlWindow(int messages, qint64 bytes)
+{
+    Q_D(QJsonServerClient);
+    if (d->m_stream) {
+        d->m_stream->setFlowControlWindow(messages);
+        d->m_stream->setFlowControlWindowBytes(bytes);
+    }
+}
+
+/*!
+    Sets the \a formats the client stream accepts when the client offers to switch
+    formats.  Must be called after setSocket().
+
+    \sa QJsonStream::setAcceptedFormats()
+*/
+void QJsonServerClient::setAcceptedFormats(const QList<EncodingFormat>& formats)
+{
+    Q_D(QJsonServerClient);
+    if (d->m_stream)
+        d->m_stream->setAcceptedFormats(formats);
+}
+
+/*!
+    Returns the format messages are sent to the client in, which is the negotiated
+    format once format negotiation has completed.
+*/
+EncodingFormat QJsonServerClient::format() const
+{
+    Q_D(const QJsonServerClient);
+    return d->m_stream ? d->m_stream->format() : FormatUndefined;
+}
+
 /*!
   Return the internal socket object
 */
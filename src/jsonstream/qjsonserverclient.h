@@ -44,6 +44,7 @@
 
 #include <QObject>
 #include <QJsonObject>
+#include <QList>
 
 class QLocalSocket;
 
@@ -68,6 +69,11 @@ public:
 
     void setAuthority(QJsonAuthority *authority);
 
+    void setFlowControlWindow(int messages, qint64 bytes);
+    void setAcceptedFormats(const QList<EncodingFormat>& formats);
+
+    EncodingFormat format() const;
+
     const QLocalSocket *socket() const;
     void setSocket(QLocalSocket *socket);
 
@@ -68,7 +68,7 @@
 
 QT_BEGIN_NAMESPACE_JSONSTREAM
 
-enum EncodingFormat { FormatUndefined, FormatUTF8, FormatBSON, FormatQBJS, FormatUTF16BE, FormatUTF16LE, FormatUTF32BE, FormatUTF32LE };
+enum EncodingFormat { FormatUndefined, FormatUTF8, FormatBSON, FormatQBJS, FormatUTF16BE, FormatUTF16LE, FormatUTF32BE, FormatUTF32LE, FormatFramedCBOR, FormatCBORDictionary, FormatUser = 0x100 };
 
 QT_END_NAMESPACE_JSONSTREAM
 
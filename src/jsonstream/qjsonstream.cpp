@@ -44,14 +44,15 @@
 #include <QLocalSocket>
 #include <QAbstractSocket>
 #include <QtEndian>
-#include <qjsondocument.h>
-#include <QTextCodec>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QJsonArray>
 
 #include "qjsonstream.h"
 #include "qjsonbuffer_p.h"
-#include "qjsondocument.h"
-#include "qjsonobject.h"
+#include "qjsoncodec.h"
 #include "bson/qt-bson_p.h"
+#include "qjsonobject.h"
 
 QT_BEGIN_NAMESPACE_JSONSTREAM
 
@@ -60,12 +61,32 @@ QT_BEGIN_NAMESPACE_JSONSTREAM
  *  Note:  We do NOT do DNS resolution, so you must specify an actual host IP address.
  */
 
-static QByteArray bsonToByteArray(BsonObject &bson)
-{
-    QByteArray byteArray = bson.data();
-    byteArray.prepend("bson");
-    return byteArray;
-}
+static const QLatin1String kstrCreditKey("$credit");
+static const QLatin1String kstrWindowKey("window");
+static const QLatin1String kstrWindowBytesKey("windowBytes");
+static const QLatin1String kstrMessagesKey("messages");
+static const QLatin1String kstrBytesKey("bytes");
+static const QLatin1String kstrCompressionKey("$compression");
+static const QLatin1String kstrCodecKey("codec");
+static const QLatin1String kstrZlibCodec("zlib");
+static const QLatin1String kstrFormatsKey("$formats");
+static const QLatin1String kstrAcceptKey("accept");
+static const QLatin1String kstrFormatKey("format");
+static const QLatin1String kstrMessageKey("$message");
+
+static const QLatin1String kstrCompressedFramesKey("compressedFrames");
+static const QLatin1String kstrBytesBeforeCompressionKey("bytesBeforeCompression");
+static const QLatin1String kstrBytesAfterCompressionKey("bytesAfterCompression");
+static const QLatin1String kstrCompressionRatioKey("compressionRatio");
+static const QLatin1String kstrCompressionNsecsKey("compressionNsecs");
+static const QLatin1String kstrCompressionNsecsPerFrameKey("compressionNsecsPerFrame");
+static const QLatin1String kstrDecompressedFramesKey("decompressedFrames");
+static const QLatin1String kstrBytesBeforeDecompressionKey("bytesBeforeDecompression");
+static const QLatin1String kstrBytesAfterDecompressionKey("bytesAfterDecompression");
+static const QLatin1String kstrDecompressionNsecsKey("decompressionNsecs");
+static const QLatin1String kstrDecompressionNsecsPerFrameKey("decompressionNsecsPerFrame");
+
+const int knCOMPRESSION_LEVEL = 1;  // favour speed, large JSON messages compress well anyway
 
 /****************************************************************************/
 
@@ -75,18 +96,119 @@ public:
     QJsonStreamPrivate()
         : mDevice(0)
         , mFormat(FormatUndefined)
+        , mConfiguredFormat(FormatUndefined)
+        , mCodec(0)
         , mReadBufferSize(0)
         , mWriteBufferSize(0)
-        , mLastError(QJsonStream::NoError) {}
+        , mLastError(QJsonStream::NoError)
+        , mHasNextMessage(false)
+        , mNextIsBson(false)
+        , mNextMessageSize(0)
+        , mWindowMessages(0)
+        , mWindowBytes(0)
+        , mConsumedMessages(0)
+        , mConsumedBytes(0)
+        , mGrantedMessages(0)
+        , mGrantedBytes(0)
+        , mGrantPending(false)
+        , mPeerWindowMessages(0)
+        , mPeerWindowBytes(0)
+        , mSentMessages(0)
+        , mSentBytes(0)
+        , mCreditMessages(0)
+        , mCreditBytes(0)
+        , mPendingBytes(0)
+        , mUpdateScheduled(false)
+        , mCompressionThreshold(0)
+        , mPeerAcceptsCompression(false)
+        , mAdvertiseCompression(false)
+        , mCompressedFrames(0)
+        , mBytesBeforeCompression(0)
+        , mBytesAfterCompression(0)
+        , mCompressionNsecs(0)
+        , mOfferFormats(false)
+        , mAwaitingFormat(false)
+        , mSwitchFormat(FormatUndefined) {}
 
     QIODevice       *mDevice;
     QJsonBuffer      *mBuffer;
     EncodingFormat   mFormat;
+    EncodingFormat   mConfiguredFormat;     // set by setFormat(), restored for every new device
+    const QJsonCodec *mCodec;
+    QScopedPointer<QJsonCodecSession> mSession;
     qint64           mReadBufferSize;
     qint64           mWriteBufferSize;
     QJsonStream::QJsonStreamError  mLastError;
+
+    QJsonObject      mNextMessage;
+    BsonObject       mNextBson;         // BSON messages are kept as received until read
+    bool             mHasNextMessage;
+    bool             mNextIsBson;
+    int              mNextMessageSize;
+
+    // flow control, receiving side
+    int              mWindowMessages;
+    qint64           mWindowBytes;
+    qint64           mConsumedMessages;
+    qint64           mConsumedBytes;
+    qint64           mGrantedMessages;
+    qint64           mGrantedBytes;
+    bool             mGrantPending;
+
+    // flow control, sending side
+    int              mPeerWindowMessages;
+    qint64           mPeerWindowBytes;
+    qint64           mSentMessages;
+    qint64           mSentBytes;
+    qint64           mCreditMessages;
+    qint64           mCreditBytes;
+    QList<QByteArray> mPendingFrames;
+    qint64           mPendingBytes;
+
+    // compression
+    int              mCompressionThreshold;
+    bool             mPeerAcceptsCompression;
+    bool             mAdvertiseCompression;
+    qint64           mCompressedFrames;
+    qint64           mBytesBeforeCompression;
+    qint64           mBytesAfterCompression;
+    qint64           mCompressionNsecs;
+
+    // format negotiation
+    QList<EncodingFormat> mAcceptedFormats;
+    bool             mOfferFormats;
+    bool             mAwaitingFormat;
+    EncodingFormat   mSwitchFormat;
+
+    bool             mUpdateScheduled;
+    mutable QMutex   mFlowMutex;
 };
 
+/*!
+  \internal
+  Returns true if \a key is the only key of a control message, or of an application
+  message wrapped so as not to be taken for one.
+*/
+static bool isReservedKey(const QString& key)
+{
+    return key == kstrCreditKey || key == kstrCompressionKey
+            || key == kstrFormatsKey || key == kstrMessageKey;
+}
+
+static bool isReservedEnvelope(const QJsonObject& object)
+{
+    return object.size() == 1 && isReservedKey(object.constBegin().key());
+}
+
+static bool isReservedEnvelope(const BsonObject& bson)
+{
+    BsonObject::const_iterator it = bson.begin();
+    if (it == bson.end())
+        return false;
+    QString key = QString::fromUtf8(it.key());
+    return ++it == bson.end() && isReservedKey(key);
+}
+
 /****************************************************************************/
 
 /*!
@@ -103,6 +225,54 @@ public:
     Both read and write buffer sizes can be set, and data is read from the stream
     using a readyRead scheme, ensuring that too many inbould messages (or too large
     inbound messages) do not overwhelm the receiving application.
+
+    \section1 Flow Control
+
+    Buffer limits protect the receiver, but a sender that outpaces it still fills
+    the socket buffers on both sides.  Credit-based flow control lets the receiving
+    side pace the sender instead.  It is opt-in: the receiver enables it by setting
+    a \l{flowControlWindow()} and/or a \l{flowControlWindowBytes()}.  The window is
+    advertised to the peer as soon as a device is set, and further credit is granted
+    as the application drains messages with \l{readMessage()}, in batches of half
+    a window.
+
+    A sending QJsonStream starts obeying credit once it has received the first
+    advertisement.  When credit runs out, \l{send()} keeps accepting messages and
+    queues them until more credit arrives; \l{isSendPaused()} returns \b true
+    meanwhile and the queued bytes are included in \l{bytesToWrite()}, so the usual
+    \l{writeBufferSize()} limit still applies.  A message larger than the byte
+    window is let through once the peer has drained everything sent before it.
+
+    Credit is carried in small control messages that are never returned by
+    \l{readMessage()} and do not consume credit themselves.  Both peers must use a
+    version of QJsonStream that understands them before flow control is enabled.
+    An application message that looks like a control message, one whose only key
+    is \c{$credit}, \c{$compression}, \c{$formats} or \c{$message}, is wrapped
+    on the wire and delivered unchanged.
+
+    \section1 Compression
+
+    Large messages can be compressed with zlib before they are written.  Setting a
+    \l{compressionThreshold()} tells the peer that this stream accepts compressed
+    messages and compresses the messages of at least that many bytes, once the peer
+    has said the same.  Smaller messages, and messages that do not get any smaller,
+    are sent as they are.  Setting the threshold back to 0 tells the peer to stop
+    compressing.  Compression works with every format() and is negotiated again for
+    every device.  \l{compressionStatistics()} reports how well it pays off.  A
+    compressed message that cannot be decompressed is discarded, and lastError()
+    returns DecompressionFailed.
+
+    \section1 Format Negotiation
+
+    A receiving QJsonStream detects the format of the first message, so peers
+    never have to agree on one.  They can still agree on the fastest one both of
+    them support.  Both peers list the formats they accept with
+    \l{setAcceptedFormats()}, in order of preference, and the connecting side
+    calls \l{negotiateFormat()} once its device is set.  The other side answers
+    with the first of its own formats that both accept and switches to it, and the
+    connecting side switches as soon as it has read the answer.  Messages sent
+    before the switch are not affected.  If either peer does not take part, both
+    keep using the format they started with.
 */
 
 /*!
@@ -116,6 +286,7 @@ QJsonStream::QJsonStream(QIODevice *device)
     Q_D(QJsonStream);
     d->mBuffer = new QJsonBuffer(this);
     connect(d->mBuffer, SIGNAL(readyReadMessage()), SLOT(messageReceived()));
+    connect(d->mBuffer, SIGNAL(frameDiscarded()), SLOT(handleFrameDiscarded()));
     setDevice(device);
 }
 
@@ -141,6 +312,8 @@ QJsonStream::~QJsonStream()
          Write error occurred ( QIODevice::write() returned -1 ).
      \value WriteFailedReturnedZero
          Write error occurred ( QIODevice::write() returned 0 ).
+     \value DecompressionFailed
+         A compressed message was received that could not be decompressed or exceeded the read buffer size; it has been discarded.
  */
 
 /*!
@@ -197,12 +370,35 @@ void QJsonStream::setDevice( QIODevice *device )
         disconnect(d->mDevice, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)));
         disconnect(d->mDevice, SIGNAL(aboutToClose()), this, SIGNAL(aboutToClose()));
         d->mBuffer->clear();
+        // the next peer may send in any format and has not negotiated one with us
+        d->mBuffer->setFormat(FormatUndefined);
     }
     d->mDevice = device;
+    applyFormat(d->mConfiguredFormat);
+    resetFlowControl();
+    {
+        QMutexLocker locker(&d->mFlowMutex);
+        d->mPeerAcceptsCompression = false;
+        d->mAdvertiseCompression = false;
+        d->mOfferFormats = false;
+        d->mAwaitingFormat = false;
+        d->mSwitchFormat = FormatUndefined;
+    }
     if (device) {
         connect(device, SIGNAL(readyRead()), this, SLOT(dataReadyOnSocket()));
         connect(device, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)));
         connect(device, SIGNAL(aboutToClose()), this, SIGNAL(aboutToClose()));
+
+        QMutexLocker locker(&d->mFlowMutex);
+        if (d->mWindowMessages > 0 || d->mWindowBytes > 0) {
+            // advertise the receive window to the new peer
+            d->mGrantPending = true;
+            scheduleFlowControlUpdate();
+        }
+        if (d->mCompressionThreshold > 0) {
+            d->mAdvertiseCompression = true;
+            scheduleFlowControlUpdate();
+        }
     }
 }
 
@@ -214,44 +410,155 @@ void QJsonStream::setDevice( QIODevice *device )
   write buffer of the \l{device()}.  It will not cause that buffer to grow
   larger than \l{writeBufferSize()} at any time.  If this would occur, this
   method will return \b false.
+
+  If the peer uses flow control and has run out of credit, the message is
+  queued until the peer grants more.
+
+  \sa isSendPaused(), compressionThreshold()
 */
 
 bool QJsonStream::send(const QJsonObject& object)
 {
-    bool bRet(false);
-    QJsonDocument document(object);
+    QByteArray frame = encode(object);
+    bool sent = !frame.isEmpty() && sendFrame(frame);
+    endEncode(sent);
+    return sent;
+}
 
+/*!
+  \internal
+  Sends the encoded \a frame, compressed if that has been negotiated, as soon as the
+  peer has granted credit for it.  Returns \b true if the frame was written or queued.
+*/
+bool QJsonStream::sendFrame(QByteArray frame)
+{
     Q_D(QJsonStream);
-    switch (d->mFormat) {
-    case FormatUndefined:
-        d->mFormat = FormatQBJS;
-        // Deliberate fall through
-    case FormatQBJS:
-        bRet = sendInternal( document.toBinaryData() );
-        break;
-    case FormatUTF8:
-        bRet = sendInternal( document.toJson() );
-        break;
-    case FormatUTF16BE:
-        bRet = sendInternal( QTextCodec::codecForName("UTF-16BE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(2) );  // Chop off BOM
-        break;
-    case FormatUTF16LE:
-        bRet = sendInternal( QTextCodec::codecForName("UTF-16LE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(2) );  // Chop off BOM
-        break;
-    case FormatUTF32BE:
-        bRet = sendInternal( QTextCodec::codecForName("UTF-32BE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(4) );  // Chop off BOM
-        break;
-    case FormatUTF32LE:
-        bRet = sendInternal( QTextCodec::codecForName("UTF-32LE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(4) );  // Chop off BOM
-        break;
-    case FormatBSON:
+    compress(frame);
     {
-        BsonObject bson(document.toVariant().toMap());
-        bRet = sendInternal(bsonToByteArray(bson));
-        break;
+        QMutexLocker locker(&d->mFlowMutex);
+        if (!d->mPendingFrames.isEmpty() || !hasCredit(frame.size())) {
+            if (!isOpen()) {
+                d->mLastError = WriteFailedNoConnection;
+                qWarning() << Q_FUNC_INFO << "No device in QJsonStream";
+                return false;
+            }
+            if (d->mWriteBufferSize > 0 &&
+                    d->mDevice->bytesToWrite() + d->mPendingBytes + frame.size() > d->mWriteBufferSize) {
+                d->mLastError = MaxWriteBufferSizeExceeded;
+                return false;
+            }
+            d->mLastError = NoError;
+            d->mPendingFrames.append(frame);
+            d->mPendingBytes += frame.size();
+            return true;
+        }
+        d->mSentMessages++;
+        d->mSentBytes += frame.size();
     }
+
+    if (!sendInternal(frame)) {
+        QMutexLocker locker(&d->mFlowMutex);
+        d->mSentMessages--;
+        d->mSentBytes -= frame.size();
+        return false;
+    }
+    return true;
+}
+
+/*!
+  \internal
+  Returns the application message \a object serialized in the current format() as a
+  complete frame, ready to be written to the device.  Unless \a useSession is true,
+  the frame does not depend on the session of the current device.  Every frame
+  encoded with the session must be followed by endEncode().
+*/
+
+QByteArray QJsonStream::encode(const QJsonObject& object, bool useSession)
+{
+    if (isReservedEnvelope(object)) {
+        // the peer would take it for a control message
+        QJsonObject message;
+        message.insert(kstrMessageKey, object);
+        return encodeFrame(message, useSession);
+    }
+    return encodeFrame(object, useSession);
+}
+
+/*!
+  \internal
+  Returns \a object serialized in the current format() as a complete frame, as is.
+  \a useSession is handled as by encode().
+*/
+QByteArray QJsonStream::encodeFrame(const QJsonObject& object, bool useSession)
+{
+    Q_D(QJsonStream);
+    if (d->mFormat == FormatUndefined)
+        applyFormat(FormatQBJS);
+    QByteArray frame;
+    if (!d->mCodec) {
+        qWarning() << Q_FUNC_INFO << "No codec registered for format" << d->mFormat;
+        return frame;
+    }
+    // frames encoded while there is no device may be written to any later
+    // connection, so they must not depend on the session
+    d->mCodec->encode(frame, object, d->mDevice && useSession ? d->mSession.data() : 0);
+    return frame;
+}
+
+/*!
+  \internal
+  Commits what the frame encoded last added to the session if the frame was \a kept,
+  that is written or queued; otherwise rolls it back, so that later frames do not
+  refer to dictionary entries the peer has never received.
+*/
+void QJsonStream::endEncode(bool kept)
+{
+    Q_D(QJsonStream);
+    if (QJsonCodecSession *session = d->mSession.data()) {
+        if (kept)
+            session->commit();
+        else
+            session->rollback();
     }
-    return bRet;
+}
+
+/*!
+  \internal
+  Writes the control \a message straight to the device, ahead of any queued frames.
+*/
+bool QJsonStream::sendControlMessage(const QJsonObject& message)
+{
+    bool sent = sendInternal(encodeFrame(message));
+    endEncode(sent);
+    return sent;
+}
+
+/*!
+  \internal
+  Replaces \a frame with its compressed form if compression has been negotiated,
+  the frame is at least compressionThreshold() bytes and compressing it pays off.
+*/
+void QJsonStream::compress(QByteArray& frame)
+{
+    Q_D(QJsonStream);
+    QMutexLocker locker(&d->mFlowMutex);
+    if (d->mCompressionThreshold <= 0 || !d->mPeerAcceptsCompression || frame.size() < d->mCompressionThreshold)
+        return;
+    locker.unlock();
+
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray compressed = QJsonBuffer::compressFrame(frame, knCOMPRESSION_LEVEL);
+    qint64 nsecs = timer.nsecsElapsed();
+    int size = frame.size();
+    if (compressed.size() < size)
+        frame = compressed;
+
+    locker.relock();
+    d->mCompressedFrames++;
+    d->mBytesBeforeCompression += size;
+    d->mBytesAfterCompression += frame.size();
+    d->mCompressionNsecs += nsecs;
 }
 
 /*!
@@ -304,6 +611,215 @@ bool QJsonStream::sendInternal(const QByteArray& byteArray)
     return !bFail;
 }
 
+/*!
+  \internal
+  Returns \b true if a frame of \a size bytes may be written without exceeding
+  the credit granted by the peer.  Called with the flow control mutex held.
+*/
+bool QJsonStream::hasCredit(int size) const
+{
+    Q_D(const QJsonStream);
+    if (d->mPeerWindowMessages <= 0 && d->mPeerWindowBytes <= 0)
+        return true;    // the peer did not ask for flow control
+    if (d->mPeerWindowMessages > 0 && d->mSentMessages >= d->mCreditMessages)
+        return false;
+    if (d->mPeerWindowBytes > 0 && d->mSentBytes + size > d->mCreditBytes) {
+        // a frame larger than the window goes out once the peer has drained everything else
+        return d->mSentBytes <= d->mCreditBytes - d->mPeerWindowBytes;
+    }
+    return true;
+}
+
+/*!
+  \internal
+  Applies the \a credit control message received from the peer.
+*/
+void QJsonStream::handleCredit(const QJsonObject& credit)
+{
+    Q_D(QJsonStream);
+    QMutexLocker locker(&d->mFlowMutex);
+    d->mPeerWindowMessages = (int)credit.value(kstrWindowKey).toDouble();
+    d->mPeerWindowBytes = (qint64)credit.value(kstrWindowBytesKey).toDouble();
+    // credit is cumulative, so a reordered or repeated grant never takes credit away
+    d->mCreditMessages = qMax(d->mCreditMessages, (qint64)credit.value(kstrMessagesKey).toDouble());
+    d->mCreditBytes = qMax(d->mCreditBytes, (qint64)credit.value(kstrBytesKey).toDouble());
+    if (!d->mPendingFrames.isEmpty())
+        scheduleFlowControlUpdate();
+}
+
+/*!
+  \internal
+  Applies the \a formats control message received from the peer: either an offer,
+  answered with the first accepted format the peer accepts as well, or the peer's
+  announcement that it sends all further messages in another format.  Called with
+  the flow control mutex held.
+*/
+void QJsonStream::handleFormats(const QJsonObject& formats)
+{
+    Q_D(QJsonStream);
+    if (formats.contains(kstrAcceptKey)) {
+        QJsonArray offer = formats.value(kstrAcceptKey).toArray();
+        foreach (EncodingFormat format, d->mAcceptedFormats) {
+            if (offer.contains((int)format) && QJsonCodec::codecForFormat(format)) {
+                d->mSwitchFormat = format;
+                scheduleFlowControlUpdate();
+                break;
+            }
+        }
+        return;
+    }
+
+    EncodingFormat format = (EncodingFormat)(int)formats.value(kstrFormatKey).toDouble();
+    if (!QJsonCodec::codecForFormat(format)) {
+        qWarning() << Q_FUNC_INFO << "No codec registered for format" << format;
+        return;
+    }
+    d->mBuffer->setFormat(format);
+    if (d->mAwaitingFormat) {
+        // the answer to our offer; switch as well so that both directions use it
+        d->mAwaitingFormat = false;
+        d->mSwitchFormat = format;
+        scheduleFlowControlUpdate();
+    }
+}
+
+/*!
+  \internal
+  Queues a call to updateFlowControl() unless one is already queued.  Flow control
+  state may change in whichever thread reads messages, but the device is only written
+  from the thread the stream lives in.  Called with the flow control mutex held.
+*/
+void QJsonStream::scheduleFlowControlUpdate()
+{
+    Q_D(QJsonStream);
+    if (!d->mUpdateScheduled) {
+        d->mUpdateScheduled = true;
+        QMetaObject::invokeMethod(this, "updateFlowControl", Qt::QueuedConnection);
+    }
+}
+
+/*!
+  \internal
+  Forgets all flow control state of the previous peer.
+*/
+void QJsonStream::resetFlowControl()
+{
+    Q_D(QJsonStream);
+    QMutexLocker locker(&d->mFlowMutex);
+    d->mNextMessage = QJsonObject();
+    d->mNextBson = BsonObject();
+    d->mHasNextMessage = false;
+    d->mNextIsBson = false;
+    d->mNextMessageSize = 0;
+    d->mConsumedMessages = d->mConsumedBytes = 0;
+    d->mGrantedMessages = d->mGrantedBytes = 0;
+    d->mGrantPending = false;
+    d->mPeerWindowMessages = 0;
+    d->mPeerWindowBytes = 0;
+    d->mSentMessages = d->mSentBytes = 0;
+    d->mCreditMessages = d->mCreditBytes = 0;
+    d->mPendingFrames.clear();
+    d->mPendingBytes = 0;
+}
+
+/*!
+  \internal
+  Sends a pending compression advertisement, format offer and credit grant to the
+  peer, writes queued frames the peer has granted credit for and then switches to
+  a negotiated format.
+*/
+void QJsonStream::updateFlowControl()
+{
+    Q_D(QJsonStream);
+    QJsonObject credit;
+    bool advertiseCompression;
+    bool acceptCompression;
+    QJsonArray offer;
+    {
+        QMutexLocker locker(&d->mFlowMutex);
+        d->mUpdateScheduled = false;
+        advertiseCompression = d->mAdvertiseCompression;
+        acceptCompression = d->mCompressionThreshold > 0;
+        d->mAdvertiseCompression = false;
+        if (d->mOfferFormats) {
+            d->mOfferFormats = false;
+            foreach (EncodingFormat format, d->mAcceptedFormats)
+                offer.append((int)format);
+        }
+        if (d->mGrantPending) {
+            d->mGrantPending = false;
+            d->mGrantedMessages = d->mConsumedMessages;
+            d->mGrantedBytes = d->mConsumedBytes;
+            credit.insert(kstrWindowKey, d->mWindowMessages);
+            credit.insert(kstrWindowBytesKey, (double)d->mWindowBytes);
+            credit.insert(kstrMessagesKey, (double)(d->mConsumedMessages + d->mWindowMessages));
+            credit.insert(kstrBytesKey, (double)(d->mConsumedBytes + d->mWindowBytes));
+        }
+    }
+    if (advertiseCompression && isOpen()) {
+        // without a codec the peer stops compressing
+        QJsonObject compression;
+        if (acceptCompression)
+            compression.insert(kstrCodecKey, kstrZlibCodec);
+        QJsonObject message;
+        message.insert(kstrCompressionKey, compression);
+        sendControlMessage(message);
+    }
+    if (!offer.isEmpty() && isOpen()) {
+        QJsonObject formats;
+        formats.insert(kstrAcceptKey, offer);
+        QJsonObject message;
+        message.insert(kstrFormatsKey, formats);
+        sendControlMessage(message);
+    }
+    if (!credit.isEmpty() && isOpen()) {
+        QJsonObject message;
+        message.insert(kstrCreditKey, credit);
+        sendControlMessage(message);
+    }
+
+    forever {
+        QByteArray frame;
+        {
+            QMutexLocker locker(&d->mFlowMutex);
+            if (d->mPendingFrames.isEmpty() || !hasCredit(d->mPendingFrames.first().size()))
+                break;
+            frame = d->mPendingFrames.takeFirst();
+            d->mPendingBytes -= frame.size();
+            d->mSentMessages++;
+            d->mSentBytes += frame.size();
+        }
+        if (!sendInternal(frame)) {
+            QMutexLocker locker(&d->mFlowMutex);
+            d->mSentMessages--;
+            d->mSentBytes -= frame.size();
+            d->mPendingFrames.prepend(frame);
+            d->mPendingBytes += frame.size();
+            break;
+        }
+    }
+
+    EncodingFormat switchFormat = FormatUndefined;
+    {
+        QMutexLocker locker(&d->mFlowMutex);
+        // queued frames are already encoded, so they have to be written first
+        if (d->mSwitchFormat != FormatUndefined && d->mPendingFrames.isEmpty()) {
+            switchFormat = d->mSwitchFormat;
+            d->mSwitchFormat = FormatUndefined;
+        }
+    }
+    if (switchFormat != FormatUndefined && isOpen()) {
+        // the announcement is the last message in the old format
+        QJsonObject formats;
+        formats.insert(kstrFormatKey, (int)switchFormat);
+        QJsonObject message;
+        message.insert(kstrFormatsKey, formats);
+        sendControlMessage(message);
+        if (switchFormat != d->mFormat)
+            applyFormat(switchFormat);
+    }
+}
+
 /*!
   \internal
   Handle a received readyReadMessage signal and emit the correct signals
@@ -313,8 +829,20 @@ void QJsonStream::messageReceived()
 {
     Q_D(QJsonStream);
     if (d->mFormat == FormatUndefined)
-        d->mFormat = d->mBuffer->format();
-    emit readyReadMessage();
+        applyFormat(d->mBuffer->format());
+    // flow control messages are consumed here; only announce messages for the application
+    if (messageAvailable())
+        emit readyReadMessage();
+}
+
+/*!
+  \internal
+  Records that the buffer dropped a compressed message it could not decompress.
+*/
+void QJsonStream::handleFrameDiscarded()
+{
+    Q_D(QJsonStream);
+    d->mLastError = DecompressionFailed;
 }
 
 /*!
@@ -361,13 +889,29 @@ EncodingFormat QJsonStream::format() const
 }
 
 /*!
-  Set the EncodingFormat to \a format.
+  Set the EncodingFormat to \a format.  Messages are sent with the QJsonCodec
+  registered for \a format.  The stream returns to \a format whenever it is
+  given a new device, even if another format has been negotiated since.
  */
 
 void QJsonStream::setFormat( EncodingFormat format )
+{
+    Q_D(QJsonStream);
+    d->mConfiguredFormat = format;
+    applyFormat(format);
+}
+
+/*!
+  \internal
+  Sends further messages in \a format without changing the format setFormat()
+  configured.
+*/
+void QJsonStream::applyFormat(EncodingFormat format)
 {
     Q_D(QJsonStream);
     d->mFormat = format;
+    d->mCodec = QJsonCodec::codecForFormat(format);
+    d->mSession.reset(d->mCodec ? d->mCodec->createSession() : 0);
 }
 
 /*!
@@ -381,13 +925,15 @@ qint64 QJsonStream::readBufferSize() const
 
 /*!
   Sets the maximum size of the inbound message buffer to \a sz thus capping a size
-  of an inbound message.  A value of 0 means the buffer size is unlimited.
+  of an inbound message.  Compressed messages are held to the same cap once
+  decompressed.  A value of 0 means the buffer size is unlimited.
  */
 void QJsonStream::setReadBufferSize(qint64 sz)
 {
     if (sz >= 0) {
         Q_D(QJsonStream);
         d->mReadBufferSize = sz;
+        d->mBuffer->setMaxFrameSize(sz);
     }
 }
 
@@ -421,7 +967,213 @@ void QJsonStream::setWriteBufferSize(qint64 sz)
 qint64 QJsonStream::bytesToWrite() const
 {
     Q_D(const QJsonStream);
-    return (d->mDevice ? d->mDevice->bytesToWrite() : 0);
+    QMutexLocker locker(&d->mFlowMutex);
+    return (d->mDevice ? d->mDevice->bytesToWrite() : 0) + d->mPendingBytes;
+}
+
+/*!
+  Returns the number of messages the peer may send before it has to wait for
+  this stream to read them.  A value of 0, the default, means the number of
+  messages is not limited.
+
+  \sa {Flow Control}
+*/
+int QJsonStream::flowControlWindow() const
+{
+    Q_D(const QJsonStream);
+    return d->mWindowMessages;
+}
+
+/*!
+  Sets the number of messages the peer may send ahead of \l{readMessage()} to
+  \a messages.  A value of 0 means the number of messages is not limited.
+  If a device is set, the new window is advertised to the peer immediately.
+*/
+void QJsonStream::setFlowControlWindow(int messages)
+{
+    if (messages >= 0) {
+        Q_D(QJsonStream);
+        QMutexLocker locker(&d->mFlowMutex);
+        d->mWindowMessages = messages;
+        if (d->mDevice) {
+            d->mGrantPending = true;
+            scheduleFlowControlUpdate();
+        }
+    }
+}
+
+/*!
+  Returns the number of bytes the peer may send before it has to wait for
+  this stream to read them.  A value of 0, the default, means the number of
+  bytes is not limited.
+
+  \sa {Flow Control}
+*/
+qint64 QJsonStream::flowControlWindowBytes() const
+{
+    Q_D(const QJsonStream);
+    return d->mWindowBytes;
+}
+
+/*!
+  Sets the number of bytes the peer may send ahead of \l{readMessage()} to
+  \a bytes.  A value of 0 means the number of bytes is not limited.
+  If a device is set, the new window is advertised to the peer immediately.
+*/
+void QJsonStream::setFlowControlWindowBytes(qint64 bytes)
+{
+    if (bytes >= 0) {
+        Q_D(QJsonStream);
+        QMutexLocker locker(&d->mFlowMutex);
+        d->mWindowBytes = bytes;
+        if (d->mDevice) {
+            d->mGrantPending = true;
+            scheduleFlowControlUpdate();
+        }
+    }
+}
+
+/*!
+  Returns \b true if messages are queued because the peer has not granted
+  enough credit to send them.
+
+  \sa {Flow Control}
+*/
+bool QJsonStream::isSendPaused() const
+{
+    Q_D(const QJsonStream);
+    QMutexLocker locker(&d->mFlowMutex);
+    return !d->mPendingFrames.isEmpty();
+}
+
+/*!
+  Returns the size in bytes from which messages are compressed before they are
+  sent.  A value of 0, the default, disables compression.
+
+  \sa {Compression}
+*/
+int QJsonStream::compressionThreshold() const
+{
+    Q_D(const QJsonStream);
+    QMutexLocker locker(&d->mFlowMutex);
+    return d->mCompressionThreshold;
+}
+
+/*!
+  Compresses messages of at least \a bytes before sending them, provided that the
+  peer has enabled compression as well.  A value of 0 disables compression.
+  If a device is set, the peer is told immediately that this stream accepts
+  compressed messages, or no longer does.
+*/
+void QJsonStream::setCompressionThreshold(int bytes)
+{
+    if (bytes >= 0) {
+        Q_D(QJsonStream);
+        QMutexLocker locker(&d->mFlowMutex);
+        bool advertise = (d->mCompressionThreshold == 0) != (bytes == 0);
+        d->mCompressionThreshold = bytes;
+        if (advertise && d->mDevice) {
+            d->mAdvertiseCompression = true;
+            scheduleFlowControlUpdate();
+        }
+    }
+}
+
+/*!
+  Returns \b true if large messages are being compressed, that is, if a
+  \l{compressionThreshold()} is set and the peer accepts compressed messages.
+*/
+bool QJsonStream::isCompressionActive() const
+{
+    Q_D(const QJsonStream);
+    QMutexLocker locker(&d->mFlowMutex);
+    return d->mCompressionThreshold > 0 && d->mPeerAcceptsCompression;
+}
+
+/*!
+  Returns statistics about the compressed messages sent and received on this
+  stream so far:
+
+  \table
+  \header \li Key \li Description
+  \row \li compressedFrames \li Messages that were large enough to be compressed.
+  \row \li bytesBeforeCompression \li Their size before compression.
+  \row \li bytesAfterCompression \li Their size as sent.
+  \row \li compressionRatio \li bytesAfterCompression divided by bytesBeforeCompression.
+  \row \li compressionNsecs \li Time spent compressing, in nanoseconds.
+  \row \li compressionNsecsPerFrame \li The average time spent per compressed message.
+  \row \li decompressedFrames \li Compressed messages received.
+  \row \li bytesBeforeDecompression \li Their size as received.
+  \row \li bytesAfterDecompression \li Their size after decompression.
+  \row \li decompressionNsecs \li Time spent decompressing, in nanoseconds.
+  \row \li decompressionNsecsPerFrame \li The average time spent per received message.
+  \endtable
+*/
+QVariantMap QJsonStream::compressionStatistics() const
+{
+    Q_D(const QJsonStream);
+    QVariantMap statistics;
+    {
+        QMutexLocker locker(&d->mFlowMutex);
+        statistics.insert(kstrCompressedFramesKey, d->mCompressedFrames);
+        statistics.insert(kstrBytesBeforeCompressionKey, d->mBytesBeforeCompression);
+        statistics.insert(kstrBytesAfterCompressionKey, d->mBytesAfterCompression);
+        statistics.insert(kstrCompressionRatioKey, d->mBytesBeforeCompression ?
+                          (double)d->mBytesAfterCompression / d->mBytesBeforeCompression : 1.0);
+        statistics.insert(kstrCompressionNsecsKey, d->mCompressionNsecs);
+        statistics.insert(kstrCompressionNsecsPerFrameKey, d->mCompressedFrames ?
+                          d->mCompressionNsecs / d->mCompressedFrames : 0);
+    }
+
+    qint64 frames, compressedBytes, bytes, nsecs;
+    d->mBuffer->inflateStatistics(&frames, &compressedBytes, &bytes, &nsecs);
+    statistics.insert(kstrDecompressedFramesKey, frames);
+    statistics.insert(kstrBytesBeforeDecompressionKey, compressedBytes);
+    statistics.insert(kstrBytesAfterDecompressionKey, bytes);
+    statistics.insert(kstrDecompressionNsecsKey, nsecs);
+    statistics.insert(kstrDecompressionNsecsPerFrameKey, frames ? nsecs / frames : 0);
+    return statistics;
+}
+
+/*!
+  Returns the formats this stream accepts in format negotiation, most preferred first.
+
+  \sa {Format Negotiation}
+*/
+QList<EncodingFormat> QJsonStream::acceptedFormats() const
+{
+    Q_D(const QJsonStream);
+    QMutexLocker locker(&d->mFlowMutex);
+    return d->mAcceptedFormats;
+}
+
+/*!
+  Sets the \a formats this stream accepts in format negotiation, most preferred
+  first.  An empty list, the default, leaves offers of the peer unanswered.
+*/
+void QJsonStream::setAcceptedFormats(const QList<EncodingFormat>& formats)
+{
+    Q_D(QJsonStream);
+    QMutexLocker locker(&d->mFlowMutex);
+    d->mAcceptedFormats = formats;
+}
+
+/*!
+  Offers the acceptedFormats() to the peer.  The peer answers with the format both
+  streams switch to, if it takes part in format negotiation.  Does nothing unless
+  a device is set and the list of accepted formats is not empty.
+
+  \sa {Format Negotiation}
+*/
+void QJsonStream::negotiateFormat()
+{
+    Q_D(QJsonStream);
+    QMutexLocker locker(&d->mFlowMutex);
+    if (!d->mDevice || d->mAcceptedFormats.isEmpty())
+        return;
+    d->mOfferFormats = true;
+    d->mAwaitingFormat = true;
+    scheduleFlowControlUpdate();
 }
 
 /*!
@@ -431,7 +1183,74 @@ qint64 QJsonStream::bytesToWrite() const
 QJsonObject QJsonStream::readMessage()
 {
     Q_D(QJsonStream);
-    return d->mBuffer->readMessage();
+    QJsonObject obj;
+    if (messageAvailable()) {
+        QMutexLocker locker(&d->mFlowMutex);
+        if (!d->mHasNextMessage)
+            return obj;     // taken by another thread meanwhile
+        if (d->mNextIsBson)
+            obj = bsonToJsonObject(d->mNextBson.constData(), d->mNextBson.dataSize());
+        else
+            obj = d->mNextMessage;
+        takeNextMessage();
+    }
+    return obj;
+}
+
+/*!
+  \internal
+  Returns the next message as a BsonObject that reads the received document in
+  place, or an empty object if no message is available.  The message is removed
+  from the stream and accounted for flow control like one read by readMessage();
+  control messages never reach it.  Messages received in another format() are
+  converted.
+
+  BsonObject is a private class, so this is meant for code inside the module.
+*/
+BsonObject QJsonStream::readBsonMessage()
+{
+    Q_D(QJsonStream);
+    BsonObject bson;
+    if (messageAvailable()) {
+        QMutexLocker locker(&d->mFlowMutex);
+        if (!d->mHasNextMessage)
+            return bson;    // taken by another thread meanwhile
+        if (d->mNextIsBson)
+            bson = d->mNextBson;
+        else
+            bson = BsonObject(d->mNextMessage.toVariantMap());
+        takeNextMessage();
+    }
+    return bson;
+}
+
+/*!
+  \internal
+  Drops the message held for reading and grants credit for it if that is due.
+  Called with the flow control mutex held.
+*/
+void QJsonStream::takeNextMessage()
+{
+    Q_D(QJsonStream);
+    d->mNextMessage = QJsonObject();
+    d->mNextBson = BsonObject();
+    d->mHasNextMessage = false;
+    d->mNextIsBson = false;
+    d->mConsumedMessages++;
+    d->mConsumedBytes += d->mNextMessageSize;
+
+    if (d->mWindowMessages > 0 || d->mWindowBytes > 0) {
+        qint64 messages = d->mConsumedMessages - d->mGrantedMessages;
+        qint64 bytes = d->mConsumedBytes - d->mGrantedBytes;
+        // grant in batches of half a window; with a byte window also grant whenever
+        // the buffer runs dry, as the sender may be holding back a frame larger than that
+        if ((d->mWindowMessages > 0 && messages >= qMax(1, d->mWindowMessages / 2)) ||
+                (d->mWindowBytes > 0 && (bytes >= qMax(Q_INT64_C(1), d->mWindowBytes / 2) ||
+                                         !d->mBuffer->messageAvailable()))) {
+            d->mGrantPending = true;
+            scheduleFlowControlUpdate();
+        }
+    }
 }
 
 /*!
@@ -440,8 +1259,57 @@ QJsonObject QJsonStream::readMessage()
  */
 bool QJsonStream::messageAvailable()
 {
-    Q_D(const QJsonStream);
-    return d->mBuffer->messageAvailable();
+    Q_D(QJsonStream);
+    forever {
+        QMutexLocker locker(&d->mFlowMutex);
+        if (d->mHasNextMessage)
+            return true;
+        if (!d->mBuffer->messageAvailable())
+            return false;
+
+        int size;
+        QJsonObject obj;
+        if (d->mBuffer->format() == FormatBSON) {
+            BsonObject bson = d->mBuffer->readBsonMessage(&size);
+            if (!isReservedEnvelope(bson)) {
+                // decoded only when read, and not at all by readBsonMessage()
+                d->mNextBson = bson;
+                d->mNextIsBson = true;
+                d->mNextMessageSize = size;
+                d->mHasNextMessage = true;
+                return true;
+            }
+            obj = bsonToJsonObject(bson.constData(), bson.dataSize());
+        }
+        else {
+            obj = d->mBuffer->readMessage(&size);
+        }
+        if (isReservedEnvelope(obj)) {
+            // application messages of this form arrive wrapped
+            if (obj.contains(kstrMessageKey)) {
+                obj = obj.value(kstrMessageKey).toObject();
+            }
+            else if (obj.contains(kstrCreditKey)) {
+                locker.unlock();
+                handleCredit(obj.value(kstrCreditKey).toObject());
+                continue;
+            }
+            else if (obj.contains(kstrCompressionKey)) {
+                // the peer decompresses what it advertises
+                d->mPeerAcceptsCompression =
+                    obj.value(kstrCompressionKey).toObject().value(kstrCodecKey).toString() == kstrZlibCodec;
+                continue;
+            }
+            else {
+                handleFormats(obj.value(kstrFormatsKey).toObject());
+                continue;
+            }
+        }
+        d->mNextMessage = obj;
+        d->mNextMessageSize = size;
+        d->mHasNextMessage = true;
+        return true;
+    }
 }
 
 /*!
@@ -44,8 +44,12 @@
 
 #include <QIODevice>
 #include <QJsonObject>
+#include <QList>
+#include <QVariantMap>
 #include "qjsonstream-global.h"
 
+class BsonObject;
+
 QT_BEGIN_NAMESPACE_JSONSTREAM
 
 class QJsonBuffer;
@@ -77,8 +81,27 @@ public:
 
     qint64 bytesToWrite() const;
 
+    int flowControlWindow() const;
+    void setFlowControlWindow(int messages);
+
+    qint64 flowControlWindowBytes() const;
+    void setFlowControlWindowBytes(qint64 bytes);
+
+    bool isSendPaused() const;
+
+    int compressionThreshold() const;
+    void setCompressionThreshold(int bytes);
+
+    bool isCompressionActive() const;
+    QVariantMap compressionStatistics() const;
+
+    QList<EncodingFormat> acceptedFormats() const;
+    void setAcceptedFormats(const QList<EncodingFormat>& formats);
+    void negotiateFormat();
+
     bool messageAvailable();
     QJsonObject readMessage();
+    BsonObject readBsonMessage();
 
     enum QJsonStreamError
     {
@@ -87,7 +110,8 @@ public:
         MaxReadBufferSizeExceeded,
         MaxWriteBufferSizeExceeded,
         WriteFailed,
-        WriteFailedReturnedZero
+        WriteFailedReturnedZero,
+        DecompressionFailed
     };
 
     QJsonStreamError lastError() const;
@@ -102,12 +126,29 @@ protected slots:
     void dataReadyOnSocket();
     void messageReceived();
 
+private slots:
+    void updateFlowControl();
+    void handleFrameDiscarded();
+
 protected:
     bool sendInternal(const QByteArray& byteArray);
 
 private:
     friend class QJsonConnectionProcessor;
     void setThreadProtection(bool) const;
+    QByteArray encode(const QJsonObject& message, bool useSession = true);
+    QByteArray encodeFrame(const QJsonObject& object, bool useSession = true);
+    bool sendFrame(QByteArray frame);
+    bool sendControlMessage(const QJsonObject& message);
+    void endEncode(bool kept);
+    bool hasCredit(int size) const;
+    void handleCredit(const QJsonObject& credit);
+    void handleFormats(const QJsonObject& formats);
+    void takeNextMessage();
+    void scheduleFlowControlUpdate();
+    void resetFlowControl();
+    void compress(QByteArray& frame);
+    void applyFormat(EncodingFormat format);
 
 private:
     Q_DECLARE_PRIVATE(QJsonStream)
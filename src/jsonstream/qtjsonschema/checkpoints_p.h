@@ -44,18 +44,17 @@
 
 #include <QtCore/qhash.h>
 #include <QtCore/qlist.h>
-#include <QtCore/qregexp.h>
+#include <QtCore/qregularexpression.h>
 
 #include <QStringList>
 #include <QDebug>
-#include <QDate>
-#include <QUrl>
 
 #include <math.h>
 
 QT_BEGIN_HEADER
 
 #include "qjsonschemaerror.h"
+#include "schemaformat_p.h"
 QT_USE_NAMESPACE_JSONSTREAM
 
 namespace SchemaValidation {
@@ -106,7 +105,7 @@ public:
         : Check(schema, data, "") // TODO
     {}
 protected:
-    virtual bool doCheck(const Value&) { return true; }
+    virtual bool doCheck(const Value &, CheckContext &) { return true; }
 };
 
 // 5.1
@@ -193,7 +192,7 @@ public:
 //        qDebug() << Q_FUNC_INFO << m_type << type.toString(&ok);
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
         if (m_type == UnknownType)
             return true;
@@ -318,7 +317,7 @@ public:
         }
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &context)
     {
         bool ok;
         Object object = value.toObject(&ok);
@@ -342,14 +341,14 @@ public:
             Value property = object.property(key);
             foreach (Check *check, checks) {
                 //qDebug()  <<"CHECKING:" << check;
-                if (!check->check(property)) {
+                if (!check->check(property, context)) {
                     return false;
                 }
             }
 
             if (Check::m_data->m_additionalSchema && 0 == checks.count() && !m_checks.keys().contains(key)) {
                 // do an extra property check if a property does not exist in the schema
-                if (!Check::m_data->m_additionalSchema->check(property, Check::m_schema->m_callbacks)) {
+                if (!Check::m_data->m_additionalSchema->check(property, context.m_callbacks)) {
                     return false;
                 }
             }
@@ -437,7 +436,7 @@ public:
         Q_ASSERT(ok);
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &context)
     {
         // most time a check is done in CheckProperties::doCheck
         QFlags<enum CheckSharedData::Flag> flags(Check::m_data->m_flags);
@@ -459,7 +458,7 @@ public:
 
                 foreach (const Key &key, object.propertyNames()) {
                     Value property = object.property(key);
-                    if (!Check::m_data->m_additionalSchema->check(property, Check::m_schema->m_callbacks)) {
+                    if (!Check::m_data->m_additionalSchema->check(property, context.m_callbacks)) {
                         return false;
                     }
                 }
@@ -502,7 +501,7 @@ public:
         Q_ASSERT(ok);
     }
 
-    virtual bool doCheck(const Value& value)
+    virtual bool doCheck(const Value &value, CheckContext &context)
     {
         //qDebug() << Q_FUNC_INFO << this;
         bool ok;
@@ -511,7 +510,7 @@ public:
         {
             Object object = value.toObject(&ok);
             if (ok && m_schema.size() >= 1) {
-                bool bRet = m_schema[0].check(value, Check::m_schema->m_callbacks);
+                bool bRet = m_schema[0].check(value, context.m_callbacks);
                 return bRet;
             }
             return false;
@@ -523,25 +522,26 @@ public:
                 return false; // AdditionalItems is set to false
         }
 
-        int nCnt(0), nIndex(0);
-        Schema<T> & schema = m_schema[0];
+        int nCnt(0);
+        // a pointer, assigning to a reference would overwrite m_schema[0]
+        const Schema<T> *schema = m_schema.size() ? &m_schema[0] : 0;
         typename ValueList::const_iterator i;
         for (i = array.constBegin(); i != array.constEnd(); ++i, nCnt++) {
             if (m_bList) {
                 // for a list each item should have a matching schema
                 if (m_schema.size() > nCnt) {
-                    nIndex = nCnt;
-                    schema = m_schema[nIndex];
+                    schema = &m_schema[nCnt];
                 }
                 else if (Check::m_data->m_additionalSchema) {
-                    schema = *Check::m_data->m_additionalSchema;
+                    schema = Check::m_data->m_additionalSchema.data();
                 }
                 else {
                     return true; // nothing to validate with
                 }
             }
 
-            if (!schema.check(*i, Check::m_schema->m_callbacks)) {
+            Q_ASSERT(schema);
+            if (!schema->check(*i, context.m_callbacks)) {
                 return false;
             }
         }
@@ -574,7 +574,7 @@ public:
         Q_ASSERT(ok);
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &context)
     {
         // most of the time a check is done inside CheckItems::doCheck
         if (!Check::m_data->m_flags.testFlag(CheckSharedData::HasItems)) { // items attribute is absent so do a check here
@@ -590,7 +590,7 @@ public:
 
                 typename ValueList::const_iterator i;
                 for (i = array.constBegin(); i != array.constEnd(); ++i) {
-                    if (!Check::m_data->m_additionalSchema->check(*i, Check::m_schema->m_callbacks)) {
+                    if (!Check::m_data->m_additionalSchema->check(*i, context.m_callbacks)) {
                         return false;
                     }
                 }
@@ -626,11 +626,11 @@ public:
             Check::m_schema->m_maxRequired++;
     }
 
-    virtual bool doCheck(const Value&)
+    virtual bool doCheck(const Value &, CheckContext &context)
     {
         //qDebug() << Q_FUNC_INFO << m_schema << this;
         if (m_req)
-            Check::m_schema->m_requiredCount++;
+            context.m_requiredCount++;
         return true;
     }
 private:
@@ -652,7 +652,7 @@ public:
         }
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
         bool ok;
         double d = value.toDouble(&ok);
@@ -678,7 +678,7 @@ public:
         }
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
         //qDebug() << Q_FUNC_INFO << value << m_max << this;
         bool ok;
@@ -722,7 +722,7 @@ public:
         }
     }
 
-    virtual bool doCheck(const Value &)
+    virtual bool doCheck(const Value &, CheckContext &)
     {
         // check will be done in minimum
         return true;
@@ -762,7 +762,7 @@ public:
         }
     }
 
-    virtual bool doCheck(const Value &)
+    virtual bool doCheck(const Value &, CheckContext &)
     {
         // check will be done in maximum
         return true;
@@ -785,7 +785,7 @@ public:
         }
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
         bool ok;
         int count = value.toList(&ok).count();
@@ -810,7 +810,7 @@ public:
         }
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
         bool ok;
         int count = value.toList(&ok).count();
@@ -830,14 +830,14 @@ public:
     {
         bool ok;
         QString patternString = patternValue.toString(&ok);
-        m_regexp.setPattern(patternString);
+        m_regexp = schemaPattern(patternString);
         if (!ok || !m_regexp.isValid()) {
             Check::m_schema->setLoadError("wrong 'pattern' value", patternValue,
                                           !ok ? QJsonSchemaError::SchemaWrongParamType : QJsonSchemaError::SchemaWrongParamValue);
         }
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
         bool ok;
         QString str = value.toString(&ok);
@@ -846,10 +846,10 @@ public:
             // It is a bit strange, but I think we have to return true here.
             return true;
         }
-        return m_regexp.exactMatch(str);
+        return m_regexp.match(str).hasMatch();
     }
 private:
-    QRegExp m_regexp;
+    QRegularExpression m_regexp;
 };
 
 // 5.17
@@ -864,7 +864,7 @@ public:
         Q_ASSERT(ok);
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
         bool ok;
         QString str = value.toString(&ok);
@@ -892,7 +892,7 @@ public:
         Q_ASSERT(ok);
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
         bool ok;
         QString str = value.toString(&ok);
@@ -916,23 +916,18 @@ public:
         : Check(schema, data, "Enum check failed for %1")
     {
         bool ok;
-        m_enum = value.toList(&ok);
+        value.toList(&ok);
         Q_ASSERT(ok);
+        m_enum = typename T::EnumIndex(value.value().toArray());
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
-        typename ValueList::const_iterator i;
-        for (i = m_enum.constBegin(); i != m_enum.constEnd(); ++i) {
-            if (value.compare(*i)) {
-                return true;
-            }
-        }
-        return false;
+        return value.compare(m_enum);
     }
 
 private:
-    ValueList m_enum;
+    typename T::EnumIndex m_enum;
 };
 
 // 5.20
@@ -946,7 +941,7 @@ public:
         Check::m_data->m_default = QSharedPointer<Value>(new Value(value));
     }
 
-    virtual bool doCheck(const Value &)
+    virtual bool doCheck(const Value &, CheckContext &)
     {
         return true;
     }
@@ -961,95 +956,30 @@ public:
         : Check(schema, data, "Enum format failed for %1")
     {
         bool ok;
-        m_format = value.toString(&ok).toLower();
-        Q_ASSERT(ok && !m_format.isEmpty());
+        m_format = schemaFormat(value.toString(&ok));
+        Q_ASSERT(ok);
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
-        bool ok = true;
-        int hash = QStaticStringHash<>::hash(m_format);
-        switch (hash) {
-        case QStaticStringHash<'d','a','t','e','-','t','i','m','e'>::Hash:
-            if (QString::fromLatin1("date-time") == m_format) {
-                QString str;
-                if (!(str = value.toString(&ok)).isEmpty() && ok) {
-                    return QDateTime::fromString(str, QStringLiteral("yyyy-MM-ddThh:mm:ssZ")).isValid();
-                }
-            }
-            break;
-        case QStaticStringHash<'d','a','t','e'>::Hash:
-            if (QString::fromLatin1("date") == m_format) {
-                QString str;
-                if (!(str = value.toString(&ok)).isEmpty() && ok) {
-                    return QDate::fromString(str, QStringLiteral("yyyy-MM-dd")).isValid();
-                }
-            }
-            break;
-        case QStaticStringHash<'t','i','m','e'>::Hash:
-            if (QString::fromLatin1("time") == m_format) {
-                QString str;
-                if (!(str = value.toString(&ok)).isEmpty() && ok) {
-                    return QTime::fromString(str, QStringLiteral("hh:mm:ss")).isValid();
-                }
-            }
-            break;
-        case QStaticStringHash<'r','e','g','e','x','p'>::Hash:
-            if (QString::fromLatin1("regexp") == m_format) {
-            }
-            break;
-        case QStaticStringHash<'u','r','i'>::Hash:
-            if (QString::fromLatin1("uri") == m_format) {
-                QString str;
-                if (!(str = value.toString(&ok)).isEmpty() && ok) {
-                    return str.contains(':') || QUrl(str, QUrl::StrictMode).isValid(); // URN or URL
-                }
-            }
-            break;
-        case QStaticStringHash<'u','r','l'>::Hash:
-            if (QString::fromLatin1("url") == m_format) {
-                QString str;
-                if (!(str = value.toString(&ok)).isEmpty() && ok) {
-                    return QUrl(str, QUrl::StrictMode).isValid();
-                }
-            }
-            break;
-        case QStaticStringHash<'p','h','o','n','e'>::Hash:
-            if (QString::fromLatin1("phone") == m_format) {
-                //TODO
-            }
-            break;
-        case QStaticStringHash<'e','m','a','i','l'>::Hash:
-            if (QString::fromLatin1("email") == m_format) {
-                //TODO
-            }
-            break;
-        case QStaticStringHash<'i','p','-','a','d','d','r','e','s','s'>::Hash:
-            if (QString::fromLatin1("ip-address") == m_format) {
-                //TODO
-            }
-            break;
-        case QStaticStringHash<'i','p','v','6'>::Hash:
-            if (QString::fromLatin1("ipv6") == m_format) {
-                //TODO
-            }
-            break;
-        case QStaticStringHash<'h','o','s','t','-','n','a','m','e'>::Hash:
-            if (QString::fromLatin1("host-name") == m_format) {
-                //TODO
-            }
-            break;
-        case QStaticStringHash<'n','o','n','n','e','g','a','t','i','v','e','i','n','t','e','g','e','r'>::Hash: // NonNegativeInteger
-            if (QString::fromLatin1("nonnegativeinteger") == m_format) {
-                return (value.toInt(&ok) >= 0 && ok);
-            }
+        bool ok;
+        switch (m_format) {
+        case FormatNone: // regexp, phone, ipv6, host-name and others are not checked
+            return true;
+        case FormatNonNegativeInteger:
+            return (value.toInt(&ok) >= 0 && ok);
+        default:
             break;
         }
-        return ok;
+
+        QString str = value.toString(&ok);
+        if (!ok)
+            return false;
+        return str.isEmpty() || checkSchemaFormat(m_format, str);
     }
 
 private:
-    QString m_format;
+    SchemaFormat m_format;
 };
 
 // 5.24
@@ -1068,7 +998,7 @@ public:
                                           !ok ? QJsonSchemaError::SchemaWrongParamType : QJsonSchemaError::SchemaWrongParamValue);
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &)
     {
         //qDebug() << Q_FUNC_INFO << value << m_div << this;
         bool ok;
@@ -1113,10 +1043,10 @@ public:
         }
     }
 
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &context)
     {
         for (int i = 0; i < m_extendedSchema.count(); ++i) {
-            if (!m_extendedSchema[i].check(value, Check::m_schema->m_callbacks))
+            if (!m_extendedSchema[i].check(value, context.m_callbacks))
                 return false;
         }
         return true;
@@ -1163,9 +1093,9 @@ public:
             }
         }
     }
-    virtual bool doCheck(const Value &value)
+    virtual bool doCheck(const Value &value, CheckContext &context)
     {
-        bool result = m_newSchema.check(value, Check::m_schema->m_callbacks);
+        bool result = m_newSchema.check(value, context.m_callbacks);
 //        qDebug() << Q_FUNC_INFO << result;
         return result;
     }
@@ -1321,31 +1251,16 @@ bool SchemaPrivate<T>::check(const Value &value, Service *callbackToUseForCheck)
     //qDebug() << Q_FUNC_INFO << m_checks.count() << this;
     Q_ASSERT(callbackToUseForCheck);
 
-    // allow recursive calls - save mutable variables
-    Service *savedCallback = m_callbacks;
-    qint32 savedRequiredCount = m_requiredCount;
-
-    m_callbacks = callbackToUseForCheck;
-    bool result = check(value);
-    // restore saved variables
-    m_callbacks = savedCallback;
-    m_requiredCount = savedRequiredCount;
-    return result;
-}
-
-template<class T>
-bool SchemaPrivate<T>::check(const Value &value) const
-{
-    Q_ASSERT(m_callbacks);
-
-    m_requiredCount = 0;
+    // the state of this check lives on the stack, so the same schema can be
+    // checked recursively and from several threads at once
+    CheckContext context(callbackToUseForCheck);
     foreach (Check *check, m_checks) {
-        if (!check->check(value)) {
+        if (!check->check(value, context)) {
             return false;
         }
     }
-    if (m_requiredCount != m_maxRequired) {
-        m_callbacks->setValidationError(QString::fromLatin1("Schema validation error: Required field is missing"));
+    if (context.m_requiredCount != m_maxRequired) {
+        context.m_callbacks->setValidationError(QString::fromLatin1("Schema validation error: Required field is missing"));
         return false;
     }
     return true;
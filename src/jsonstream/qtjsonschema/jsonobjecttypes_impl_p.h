@@ -292,6 +292,11 @@ inline bool JsonObjectTypes::Value::compare(const Value & val) const
     return v0 == v1;
 }
 
+inline bool JsonObjectTypes::Value::compare(const EnumIndex &values) const
+{
+    return values.contains(m_type == Map ? map().value(m_property) : (m_type == List ? list().at(m_index) : QJsonValue()));
+}
+
 inline QJsonValue JsonObjectTypes::Value::value() const
 {
     switch (m_type) {
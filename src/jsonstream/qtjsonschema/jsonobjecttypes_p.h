@@ -43,6 +43,8 @@
 #define JSONOBJECTTYPES_P_H
 
 #include "schemaobject_p.h"
+#include "schemaprogram_p.h"
+#include "schemaenumindex_p.h"
 
 #include <QPair>
 #include <QJsonObject>
@@ -66,6 +68,8 @@ class SchemaManagerBase;
 class JsonObjectTypes {
 public:
     typedef QString Key;
+    typedef SchemaProgram Program;
+    typedef SchemaEnumIndex EnumIndex;
 
     class Value;
     class ValueList : protected QJsonArray
@@ -128,6 +132,7 @@ public:
         inline Object toObject(bool *ok) const;
 
         inline bool compare(const Value &) const;
+        inline bool compare(const EnumIndex &) const; // true if equal to one of the values
         inline QJsonValue value() const;
         inline QString data() const; // human-readable format
 
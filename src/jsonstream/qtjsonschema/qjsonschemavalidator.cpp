@@ -42,15 +42,30 @@
 #include "qjsonschemavalidator.h"
 
 #include "schemamanager_p.h"
+#include "schemadiscriminator_p.h"
 
 #include "jsonobjecttypes_impl_p.h"
 
 #include "qjsondocument.h"
 #include "qjsonobject.h"
+#include "qjsonarray.h"
 
 #include <QFile>
 #include <QDir>
 #include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QTimer>
 
 #include "qjsonschema-global.h"
 
@@ -64,23 +79,772 @@ inline QJsonObject makeError(QJsonSchemaError::ErrorCode code, const QString &me
     return QJsonSchemaError(code, message).object();
 }
 
+// bumped whenever the layout of the schema cache changes
+const int knSchemaCacheVersion = 1;
+// watched folders are reloaded once they have not changed for this many msecs
+const int knReloadDelay = 200;
+
+// a schema file read by loadFromFolder()
+struct SchemaFileLoad
+{
+    SchemaFileLoad() : modified(0), size(0), type(QJsonSchemaValidator::UseFilename), hashContents(false) {}
+
+    QString entry;      // as listed in the folder
+    QString filename;
+    qint64 modified;
+    qint64 size;
+    bool hashContents;  // set sha1 as well, for files of watched folders
+    QByteArray sha1;
+    QJsonSchemaValidator::SchemaNameInitialization type;
+    QString name;
+
+    QJsonObject error;  // empty if the file was read
+    QJsonObject schema;
+    QString schemaName;
+    SchemaProgram program; // compiled if schemas are precompiled
+};
+
+// the SHA-1 of the contents of the file \a filename, empty if it can not be read
+static QByteArray fileSha1(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return QCryptographicHash::hash(file.readAll(), QCryptographicHash::Sha1);
+}
+
+// collects the names of the schemas \a value refers to with "$ref" or "extends"
+static void schemaReferences(const QJsonValue &value, QSet<QString> *names)
+{
+    if (value.isObject()) {
+        const QJsonObject object(value.toObject());
+        for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it) {
+            if (it.value().isString()) {
+                const QString name(it.value().toString());
+                if ((!it.key().compare(QLatin1String("$ref"), Qt::CaseInsensitive) && name != QLatin1String("#")) ||
+                        (!it.key().compare(QLatin1String("extends"), Qt::CaseInsensitive) && !name.isEmpty()))
+                    names->insert(name);
+            }
+            schemaReferences(it.value(), names);
+        }
+    } else if (value.isArray()) {
+        const QJsonArray array(value.toArray());
+        for (QJsonArray::const_iterator it = array.constBegin(); it != array.constEnd(); ++it)
+            schemaReferences(*it, names);
+    }
+}
+
+// the schemas that refer to any of \a names, directly or through other schemas
+static QStringList schemaDependents(const QMap<QString, QJsonObject> &schemas, const QStringList &names)
+{
+    QHash<QString, QStringList> referrers;
+    for (QMap<QString, QJsonObject>::const_iterator it = schemas.constBegin(); it != schemas.constEnd(); ++it) {
+        QSet<QString> references;
+        schemaReferences(it.value(), &references);
+        foreach (const QString &reference, references)
+            referrers[reference].append(it.key());
+    }
+
+    QStringList dependents;
+    QSet<QString> seen(QSet<QString>::fromList(names));
+    QStringList pending(names);
+    while (!pending.isEmpty()) {
+        foreach (const QString &referrer, referrers.value(pending.takeFirst())) {
+            if (!seen.contains(referrer)) {
+                seen.insert(referrer);
+                dependents.append(referrer);
+                pending.append(referrer);
+            }
+        }
+    }
+    return dependents;
+}
+
 class QJsonSchemaValidator::QJsonSchemaValidatorPrivate
 {
 public:
+    typedef SchemaManager<QJsonObject, JsonObjectTypes> Schemas;
+
     QJsonSchemaValidatorPrivate()
-        : m_bInit(false), m_matcher(0)
+        : m_bInit(false), m_generation(0), m_matcher(0), m_cacheLoaded(false), m_cacheDirty(false),
+          m_precompile(false), m_watcher(0), m_reloadTimer(0)
     {
+        m_precompilePool.setMaxThreadCount(1);
+    }
 
+    ~QJsonSchemaValidatorPrivate()
+    {
+        // schemas left are not worth waiting for
+        m_stopPrecompile.store(1);
+        m_precompilePool.waitForDone();
     }
 
+    inline QJsonObject validate(const QString &schemaName, const QJsonObject &object);
+    inline void ensureIndexed();
+    static void buildIndex(const Schemas &schemas, const QRegExp &filter, QStringList *filtered,
+                           QSharedPointer<SchemaNameMatcher> *matcher,
+                           QSharedPointer<const SchemaDiscriminator> *discriminator);
+
+    bool hasCache() { QMutexLocker locker(&m_cacheMutex); return !m_cacheFile.isEmpty(); }
+    bool cachedSchema(const QFileInfo &info, const QByteArray *json, QJsonObject *schema);
+    void cacheSchema(const QFileInfo &info, const QByteArray &json, const QJsonObject &schema);
+    void uncacheSchema(const QString &path);
+    void loadCache();
+    void saveCache();
+
+    static QVector<SchemaFileLoad> folderFiles(const QDir &dir, const QString &schemaNameProperty, const QByteArray &ext);
+    static QJsonObject folderErrors(const QVector<SchemaFileLoad> &loads, const QDir &dir);
+    void readFiles(QJsonSchemaValidator *q, QVector<SchemaFileLoad> *loads);
+    void insertSchemas(const QVector<SchemaFileLoad> &loads);
+
+    QStringList reloadFolder(QJsonSchemaValidator *q, const QString &folder, const QSet<QString> &changedFiles);
+    QStringList replaceSchemas(const QVector<SchemaFileLoad> &loads, const QStringList &removed);
+    void watchFiles(const QString &folder);
+
+    void startPrecompile();
+    void precompile();
+
+    class ReadTask : public QRunnable
+    {
+    public:
+        ReadTask(QJsonSchemaValidator *q, SchemaFileLoad *load, bool compile)
+            : m_q(q), m_load(load), m_compile(compile) {}
+        void run();
+
+    private:
+        QJsonSchemaValidator *m_q;
+        SchemaFileLoad *m_load;
+        bool m_compile;
+    };
+
+    class PrecompileTask : public QRunnable
+    {
+    public:
+        PrecompileTask(QJsonSchemaValidatorPrivate *d) : m_d(d) {}
+        void run() { m_d->precompile(); }
+
+    private:
+        QJsonSchemaValidatorPrivate *m_d;
+    };
+
+    // guards everything below; validation only reads, loading and lazy compilation write
+    QReadWriteLock m_lock;
     SchemaManager<QJsonObject, JsonObjectTypes> mSchemas;
-    QJsonSchemaError mLastError;
 
     QRegExp m_filter;
     bool m_bInit; // filtering & indexing status (false-todo, true-done)
+    int m_generation; // counts changes of the schemas and their indexing
     QStringList m_strsFilteredSchemas;
 
     QSharedPointer<SchemaNameMatcher> m_matcher;
+    QSharedPointer<const SchemaDiscriminator> m_discriminator; // routes objects when there is no matcher
+
+    QThreadStorage<QJsonSchemaError> mLastError; // each thread sees the errors of its own calls
+
+    // guards the schema cache, which is only used while loading
+    QMutex m_cacheMutex;
+    QString m_cacheFile;
+    QJsonObject m_cache; // cache entries by absolute file path
+    bool m_cacheLoaded;
+    bool m_cacheDirty;
+
+    // state of the files in a watched folder, by file name
+    struct WatchedFile
+    {
+        WatchedFile() : modified(0), size(0) {}
+
+        qint64 modified;
+        qint64 size;
+        QByteArray sha1;    // tells edits that keep the size within one modification time apart
+        QString schemaName; // empty if the file could not be loaded
+    };
+    struct WatchedFolder
+    {
+        QString schemaNameProperty;
+        QByteArray ext;
+        QHash<QString, WatchedFile> files;
+    };
+
+    // watching is only done in the thread of the validator
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_reloadTimer;
+    QMap<QString, WatchedFolder> m_watched; // by absolute path
+    QSet<QString> m_changedFolders;
+    QSet<QString> m_changedFiles; // reported by the watcher, by absolute path
+
+    bool m_precompile;
+    QAtomicInt m_stopPrecompile;
+    QThreadPool m_precompilePool; // last, so that it stops before the schemas go away
+};
+
+/*!
+    \internal
+    Validates \a object with the schema \a schemaName.  Schemas that are compiled
+    already are checked under a read lock, so any number of threads can do this at
+    once; only the first use of a schema takes the write lock to compile it.
+*/
+inline QJsonObject QJsonSchemaValidator::QJsonSchemaValidatorPrivate::validate(const QString &schemaName, const QJsonObject &object)
+{
+    QJsonObject error;
+    {
+        QReadLocker locker(&m_lock);
+        if (mSchemas.validateCompiled(schemaName, object, &error))
+            return error;
+    }
+    QWriteLocker locker(&m_lock);
+    return mSchemas.validate(schemaName, object);
+}
+
+/*!
+    \internal
+    Applies the validation filter and indexes the schemas with the matcher, or builds
+    a discriminator without one, once after the schemas have changed.
+*/
+inline void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::ensureIndexed()
+{
+    {
+        QReadLocker locker(&m_lock);
+        if (m_bInit)
+            return;
+    }
+
+    QWriteLocker locker(&m_lock);
+    if (m_bInit)
+        return; // another thread was first
+    buildIndex(mSchemas, m_filter, &m_strsFilteredSchemas, &m_matcher, &m_discriminator);
+    m_bInit = true;
+}
+
+/*!
+    \internal
+    Applies \a filter to \a schemas into \a filtered and indexes them with a copy of
+    \a matcher, or builds a \a discriminator without one.  Other threads may still be
+    matching with the old index, so a new one is always built.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::buildIndex(const Schemas &schemas, const QRegExp &filter,
+                                                                   QStringList *filtered,
+                                                                   QSharedPointer<SchemaNameMatcher> *matcher,
+                                                                   QSharedPointer<const SchemaDiscriminator> *discriminator)
+{
+    if (!filter.isEmpty())
+    {
+        *filtered = schemas.names().filter(filter);
+    }
+
+    // use filtered schemas if filter is set
+    const QStringList strsSchemas(filter.isEmpty() ? schemas.names() : *filtered);
+
+    // do indexing if required
+    if (!*matcher) {
+        *discriminator = QSharedPointer<const SchemaDiscriminator>(
+                    new SchemaDiscriminator(strsSchemas, schemas.schemas()));
+        return;
+    }
+
+    discriminator->clear();
+    if ((*matcher)->canIndex()) {
+        QMap<QString, QJsonObject> map(schemas.schemas());
+
+        QSharedPointer<SchemaNameMatcher> indexed((*matcher)->clone());
+        indexed->reset();
+        foreach (QString strSchema, strsSchemas) {
+            QMap<QString, QJsonObject>::const_iterator it(map.find(strSchema));
+            if (it != map.end())
+                indexed->createIndex(it.key(), it.value());
+        }
+        *matcher = indexed;
+    }
+}
+
+/*!
+    \internal
+    Looks up the cached schema of the file \a info into \a schema.  Without the file
+    contents \a json, the entry must have been made for a file of the same size and
+    modification time; with them, the contents must be the same.
+*/
+bool QJsonSchemaValidator::QJsonSchemaValidatorPrivate::cachedSchema(const QFileInfo &info, const QByteArray *json,
+                                                                     QJsonObject *schema)
+{
+    if (!hasCache())
+        return false;
+    // files are read by several threads at once, hash them outside the lock
+    const QByteArray hash(json ? QCryptographicHash::hash(*json, QCryptographicHash::Sha1).toHex() : QByteArray());
+
+    QMutexLocker locker(&m_cacheMutex);
+    if (m_cacheFile.isEmpty())
+        return false;
+    if (!m_cacheLoaded)
+        loadCache();
+
+    const QString path(info.absoluteFilePath());
+    QJsonObject entry(m_cache.value(path).toObject());
+    if (entry.isEmpty())
+        return false;
+
+    const double modified = info.lastModified().toMSecsSinceEpoch();
+    if (!json) {
+        if (entry.value(QStringLiteral("modified")).toDouble() != modified ||
+                entry.value(QStringLiteral("size")).toDouble() != info.size())
+            return false;
+    } else {
+        if (entry.value(QStringLiteral("sha1")).toString() != QLatin1String(hash))
+            return false;
+
+        // touched but not changed
+        entry.insert(QStringLiteral("modified"), modified);
+        entry.insert(QStringLiteral("size"), double(info.size()));
+        m_cache.insert(path, entry);
+        m_cacheDirty = true;
+    }
+    *schema = entry.value(QStringLiteral("schema")).toObject();
+    return !schema->isEmpty();
+}
+
+/*!
+    \internal
+    Stores \a schema, parsed from the contents \a json of the file \a info, in the cache.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::cacheSchema(const QFileInfo &info, const QByteArray &json,
+                                                                    const QJsonObject &schema)
+{
+    if (!hasCache())
+        return;
+    const QByteArray hash(QCryptographicHash::hash(json, QCryptographicHash::Sha1).toHex());
+
+    QMutexLocker locker(&m_cacheMutex);
+    if (m_cacheFile.isEmpty())
+        return;
+
+    QJsonObject entry;
+    entry.insert(QStringLiteral("modified"), double(info.lastModified().toMSecsSinceEpoch()));
+    entry.insert(QStringLiteral("size"), double(info.size()));
+    entry.insert(QStringLiteral("sha1"), QString::fromLatin1(hash));
+    entry.insert(QStringLiteral("schema"), schema);
+    m_cache.insert(info.absoluteFilePath(), entry);
+    m_cacheDirty = true;
+}
+
+/*!
+    \internal
+    Drops the cache entry of the file \a path, whose contents changed although its size
+    and modification time did not.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::uncacheSchema(const QString &path)
+{
+    if (!hasCache())
+        return;
+
+    QMutexLocker locker(&m_cacheMutex);
+    if (m_cacheFile.isEmpty())
+        return;
+    if (!m_cacheLoaded)
+        loadCache();
+    if (m_cache.contains(path)) {
+        m_cache.remove(path);
+        m_cacheDirty = true;
+    }
+}
+
+/*!
+    \internal
+    Reads the cache file.  It is Qt's binary JSON, which is mapped and checked rather
+    than parsed; a cache that is missing, damaged or of another version is ignored.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::loadCache()
+{
+    m_cacheLoaded = true;
+    m_cache = QJsonObject();
+
+    QFile file(m_cacheFile);
+    if (!file.open(QIODevice::ReadOnly) || !file.size())
+        return;
+    uchar *data = file.map(0, file.size());
+    if (!data)
+        return;
+    // the document keeps a copy, the mapping is not needed afterwards
+    QJsonDocument doc(QJsonDocument::fromBinaryData(
+                          QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size())));
+    file.unmap(data);
+
+    const QJsonObject cache(doc.object());
+    if (cache.value(QStringLiteral("version")).toDouble() == knSchemaCacheVersion)
+        m_cache = cache.value(QStringLiteral("files")).toObject();
+}
+
+/*!
+    \internal
+    Writes the cache file if schema files were parsed since it was read.  Entries of
+    files that are gone are dropped.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::saveCache()
+{
+    QMutexLocker locker(&m_cacheMutex);
+    if (m_cacheFile.isEmpty() || !m_cacheDirty)
+        return;
+
+    QJsonObject::iterator it = m_cache.begin();
+    while (it != m_cache.end()) {
+        if (QFileInfo(it.key()).exists())
+            ++it;
+        else
+            it = m_cache.erase(it);
+    }
+
+    QJsonObject cache;
+    cache.insert(QStringLiteral("version"), knSchemaCacheVersion);
+    cache.insert(QStringLiteral("files"), m_cache);
+
+    // readers of the old file are not disturbed by replacing it
+    QSaveFile file(m_cacheFile);
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(cache).toBinaryData()) < 0 || !file.commit()) {
+        qWarning() << "Unable to write schema cache" << m_cacheFile << file.errorString();
+        return;
+    }
+    m_cacheDirty = false;
+}
+
+/*!
+    \internal
+    Lists the schema files with \a ext extension in \a dir, named by their file name or
+    by their \a schemaNameProperty property.
+*/
+QVector<SchemaFileLoad> QJsonSchemaValidator::QJsonSchemaValidatorPrivate::folderFiles(const QDir &dir,
+                                                                                       const QString &schemaNameProperty,
+                                                                                       const QByteArray &ext)
+{
+    SchemaNameInitialization type(schemaNameProperty.isEmpty() ? UseFilename : UseProperty);
+    QString name(UseProperty == type ? schemaNameProperty : QString::null);
+
+    // create a filter if required
+    QStringList exts;
+    if (!ext.isEmpty())
+        exts.append(QStringLiteral("*.")+QString::fromLatin1(ext));
+
+    const QFileInfoList items(dir.entryInfoList(exts, QDir::Files | QDir::Readable));
+    QVector<SchemaFileLoad> loads(items.size());
+    for (int i = 0; i < items.size(); ++i)
+    {
+        const QString filename(items.at(i).fileName());
+        if (UseFilename == type)
+        {
+            // strip extension from a filename to create an object type
+            name = ext.isEmpty() ? filename : filename.left(filename.length() - ext.length() - 1);
+        }
+        loads[i].entry = filename;
+        loads[i].filename = dir.path() + QDir::separator() + filename;
+        loads[i].modified = items.at(i).lastModified().toMSecsSinceEpoch();
+        loads[i].size = items.at(i).size();
+        loads[i].type = type;
+        loads[i].name = name;
+    }
+    return loads;
+}
+
+/*!
+    \internal
+    Sums up the errors of reading the schema files \a loads of \a dir.
+    Returns empty variant map at success or a map filled with error information otherwise
+*/
+QJsonObject QJsonSchemaValidator::QJsonSchemaValidatorPrivate::folderErrors(const QVector<SchemaFileLoad> &loads,
+                                                                           const QDir &dir)
+{
+    QJsonObject ret;
+    int nLoaded = 0;
+    foreach (const SchemaFileLoad &load, loads)
+    {
+        if (!load.error.isEmpty())
+        {
+            ret.insert(load.entry, load.error);
+        }
+        else
+        {
+            nLoaded++;
+        }
+    }
+
+    // check result for errors
+    if (!ret.isEmpty()) // loading errors
+    {
+        int nFailed = ret.count();
+        ret.insert(QJsonSchemaError::kCodeStr, QJsonSchemaError::InvalidSchemaLoading);
+        ret.insert(QJsonSchemaError::kMessageStr,
+                   QString::fromLatin1("Loading failed for %1 schemas. %2 schemas are loaded successfully.").arg(nFailed).arg(nLoaded));
+
+        if (nLoaded)
+            ret.insert(QJsonSchemaError::kCounterStr, nLoaded);
+    }
+    else if (!nLoaded) // no schemas were found
+    {
+        ret = makeError(QJsonSchemaError::InvalidSchemaLoading,
+                        QString::fromLatin1("Folder '%1' does not contain any schema.").arg(dir.path()));
+    }
+    return ret;
+}
+
+/*!
+    \internal
+    Reads the file of one schema and, if \a m_compile is set, compiles it into a program.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::ReadTask::run()
+{
+    // hashed first, so that a write in between is seen as another change
+    if (m_load->hashContents)
+        m_load->sha1 = fileSha1(m_load->filename);
+    m_load->error = m_q->_readFromFile(m_load->filename, m_load->type, m_load->name,
+                                       &m_load->schema, &m_load->schemaName);
+    if (m_compile && m_load->error.isEmpty())
+        m_load->program = SchemaProgram::compile(m_load->schema);
+}
+
+/*!
+    \internal
+    Reads the schema files \a loads with as many threads as there are cores.  Their programs
+    are compiled at the same time if schemas are precompiled, the Check trees are left to
+    the background compilation since they may refer to each other.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::readFiles(QJsonSchemaValidator *q, QVector<SchemaFileLoad> *loads)
+{
+    bool compile;
+    {
+        QReadLocker locker(&m_lock);
+        compile = m_precompile && mSchemas.useCompiledSchemas();
+    }
+
+    if (loads->size() < 2) {
+        for (int i = 0; i < loads->size(); ++i)
+            ReadTask(q, &(*loads)[i], compile).run();
+        return;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMin(QThread::idealThreadCount(), loads->size()));
+    for (int i = 0; i < loads->size(); ++i)
+        pool.start(new ReadTask(q, &(*loads)[i], compile));
+    pool.waitForDone();
+}
+
+/*!
+    \internal
+    Adds the schemas of \a loads that were read, all at once.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::insertSchemas(const QVector<SchemaFileLoad> &loads)
+{
+    QWriteLocker locker(&m_lock);
+    foreach (const SchemaFileLoad &load, loads) {
+        if (load.error.isEmpty()) {
+            QJsonObject schema(load.schema);
+            mSchemas.insert(load.schemaName, schema, load.program);
+        }
+    }
+    m_bInit = false; // clear last filtering & indexing results
+    ++m_generation;
+}
+
+/*!
+    \internal
+    Queues the compilation of the loaded schemas if precompiling is enabled.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::startPrecompile()
+{
+    {
+        QReadLocker locker(&m_lock);
+        if (!m_precompile)
+            return;
+    }
+    m_precompilePool.start(new PrecompileTask(this));
+}
+
+/*!
+    \internal
+    Compiles the schemas that are not compiled yet, one at a time so that validation
+    can go on in between.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::precompile()
+{
+    QStringList names;
+    {
+        QReadLocker locker(&m_lock);
+        names = mSchemas.names();
+    }
+
+    foreach (const QString &name, names) {
+        if (m_stopPrecompile.load())
+            return;
+        QWriteLocker locker(&m_lock);
+        mSchemas.precompile(name);
+    }
+}
+
+/*!
+    \internal
+    Reads the files of the watched \a folder that were added or changed since it was
+    last read and replaces their schemas.  Files that can not be read keep their old
+    schemas.  The contents of the \a changedFiles the watcher reported are compared as
+    well, since an edit may keep both the size and the modification time, which only
+    has a resolution of a second on some file systems.  Returns the names of the schemas
+    that were replaced, removed or recompiled.
+*/
+QStringList QJsonSchemaValidator::QJsonSchemaValidatorPrivate::reloadFolder(QJsonSchemaValidator *q, const QString &folder,
+                                                                           const QSet<QString> &changedFiles)
+{
+    QMap<QString, WatchedFolder>::iterator watched = m_watched.find(folder);
+    if (watched == m_watched.end())
+        return QStringList();
+
+    const QDir dir(folder);
+    const QVector<SchemaFileLoad> loads(dir.exists() ? folderFiles(dir, watched->schemaNameProperty, watched->ext)
+                                                     : QVector<SchemaFileLoad>());
+    QVector<SchemaFileLoad> changed;
+    QSet<QString> present;
+    foreach (const SchemaFileLoad &load, loads) {
+        present.insert(load.entry);
+        QHash<QString, WatchedFile>::const_iterator it = watched->files.constFind(load.entry);
+        if (it != watched->files.constEnd() && it->modified == load.modified && it->size == load.size) {
+            const QString path(folder + QLatin1Char('/') + load.entry);
+            if (!changedFiles.contains(path) || fileSha1(path) == it->sha1)
+                continue;
+            // the cache can not tell either
+            uncacheSchema(path);
+        }
+        changed.append(load);
+        changed.last().hashContents = true;
+    }
+
+    QStringList removed;
+    QHash<QString, WatchedFile>::iterator it = watched->files.begin();
+    while (it != watched->files.end()) {
+        if (present.contains(it.key())) {
+            ++it;
+        } else {
+            if (!it->schemaName.isEmpty())
+                removed.append(it->schemaName);
+            it = watched->files.erase(it);
+        }
+    }
+    if (changed.isEmpty() && removed.isEmpty())
+        return QStringList();
+
+    readFiles(q, &changed);
+    foreach (const SchemaFileLoad &load, changed) {
+        WatchedFile &file = watched->files[load.entry];
+        file.modified = load.modified;
+        file.size = load.size;
+        file.sha1 = load.sha1;
+        if (!load.error.isEmpty()) {
+            qWarning() << "Unable to reload schema" << QJsonSchemaError(load.error);
+            continue;
+        }
+        if (!file.schemaName.isEmpty() && file.schemaName != load.schemaName)
+            removed.append(file.schemaName);
+        file.schemaName = load.schemaName;
+    }
+
+    // a schema may have moved to another file
+    foreach (const SchemaFileLoad &load, changed) {
+        if (load.error.isEmpty())
+            removed.removeAll(load.schemaName);
+    }
+    return replaceSchemas(changed, removed);
+}
+
+/*!
+    \internal
+    Replaces the schemas of \a loads that were read and removes the schemas \a removed.
+    The schemas that refer to them are compiled again, with all other schemas left as
+    they are.  Everything is done on a copy of the schemas and their index, which is
+    swapped in at the end; validation in other threads goes on meanwhile.  Returns the
+    names of the schemas that were replaced, removed or recompiled.
+*/
+QStringList QJsonSchemaValidator::QJsonSchemaValidatorPrivate::replaceSchemas(const QVector<SchemaFileLoad> &loads,
+                                                                             const QStringList &removed)
+{
+    forever {
+        Schemas schemas;
+        QRegExp filter;
+        QSharedPointer<SchemaNameMatcher> matcher;
+        int generation;
+        {
+            QReadLocker locker(&m_lock);
+            schemas = mSchemas;
+            filter = m_filter;
+            matcher = m_matcher;
+            generation = m_generation;
+        }
+
+        QStringList changed;
+        foreach (const QString &name, removed) {
+            schemas.take(name);
+            changed.append(name);
+        }
+        foreach (const SchemaFileLoad &load, loads) {
+            if (load.error.isEmpty()) {
+                QJsonObject schema(load.schema);
+                schemas.insert(load.schemaName, schema, load.program);
+                changed.append(load.schemaName);
+            }
+        }
+
+        // dependents have compiled in the schemas they refer to
+        const QStringList dependents(schemaDependents(schemas.schemas(), changed));
+        foreach (const QString &name, dependents) {
+            QJsonObject schema(schemas.value(name));
+            schemas.insert(name, schema);
+        }
+        foreach (const QString &name, changed + dependents)
+            schemas.precompile(name);
+
+        QStringList filtered;
+        QSharedPointer<const SchemaDiscriminator> discriminator;
+        buildIndex(schemas, filter, &filtered, &matcher, &discriminator);
+
+        Schemas previous; // released after unlocking
+        {
+            QWriteLocker locker(&m_lock);
+            if (generation != m_generation)
+                continue; // the schemas changed meanwhile, start over
+            previous = mSchemas;
+            mSchemas = schemas;
+            m_strsFilteredSchemas = filtered;
+            m_matcher = matcher;
+            m_discriminator = discriminator;
+            m_bInit = true;
+            ++m_generation;
+        }
+        return changed + dependents;
+    }
+}
+
+/*!
+    \internal
+    Watches the schema files of \a folder for changes.  Files that are replaced rather
+    than written to are no longer watched, so this is done after every reload.
+*/
+void QJsonSchemaValidator::QJsonSchemaValidatorPrivate::watchFiles(const QString &folder)
+{
+    QMap<QString, WatchedFolder>::const_iterator watched = m_watched.constFind(folder);
+    if (watched == m_watched.constEnd())
+        return;
+
+    const QStringList watchedFiles(m_watcher->files());
+    QStringList files;
+    for (QHash<QString, WatchedFile>::const_iterator it = watched->files.constBegin();
+         it != watched->files.constEnd(); ++it) {
+        const QString filename(folder + QLatin1Char('/') + it.key());
+        if (!watchedFiles.contains(filename))
+            files.append(filename);
+    }
+    if (!m_watcher->directories().contains(folder) && QFileInfo(folder).isDir())
+        files.append(folder);
+    if (!files.isEmpty())
+        m_watcher->addPaths(files);
+}
+
+class QJsonSchemaValidator::CompiledSchema::CompiledSchemaPrivate : public QSharedData
+{
+public:
+    QString m_name;
+    SchemaValidation::Schema<JsonObjectTypes> m_schema;
+    SchemaProgram m_program;
 };
 
 /*!
@@ -98,11 +862,25 @@ public:
     that are checked by calling setValidationFilter().  Also, you can greatly speed up
     validation by providing a SchemaNameMatcher object by calling setSchemaNameMatcher().
     A SchemaNameMatcher quickly reduces the number of schemas that need to be checked,
-    so that most of the time only one schema is checked for a valid object.
+    so that most of the time only one schema is checked for a valid object.  Without
+    one, the validator routes objects itself by the required properties of the schemas,
+    their types and the values listed in their "enum".
+
+    Services that load many schema files at startup can keep the parsed schemas in a
+    cache file (setSchemaCacheFile()) and compile them in the background
+    (setPrecompileSchemas()), so that neither parsing nor compiling delays them.
+    Folders loaded with watchFolder() are reloaded when their schema files change.
 
     Schema loading and validation methods all return a boolean value indicating
     whether the operation succeeded.  In the case of failure, call getLastError()
-    to retrieve an object describing the error that occurred.
+    to retrieve an object describing the error that occurred.  The validateSchema()
+    overloads that take a QJsonSchemaError pointer return the error directly and
+    leave getLastError() alone.
+
+    All methods are thread-safe.  Several threads may validate objects with the same
+    validator at once; they only wait for each other while schemas are being loaded
+    or used for the first time.  getLastError() reports the last operation of the
+    calling thread.
 */
 
 /*!
@@ -133,18 +911,33 @@ QJsonSchemaValidator::QJsonSchemaValidator(QObject *parent) :
 
 QJsonSchemaValidator::~QJsonSchemaValidator()
 {
+    // no reloads once the private data is gone
+    delete d_ptr->m_watcher;
+    delete d_ptr->m_reloadTimer;
     delete d_ptr;
 }
 
 /*!
     Returns an error information object describing any errors encountered during
-    the last schema operation.
+    the last schema operation of the calling thread.
 
     \sa loadFromData(), loadFromFile(), loadFromFolder(), validateSchema()
 */
 QJsonSchemaError QJsonSchemaValidator::getLastError() const
 {
-    return d_ptr->mLastError;
+    return d_ptr->mLastError.localData();
+}
+
+/*!
+    \internal
+    Records \a error as the last error of the calling thread.  Returns true if
+    \a error is no error.
+*/
+bool QJsonSchemaValidator::setLastError(const QJsonSchemaError &error)
+{
+    Q_D(QJsonSchemaValidator);
+    d->mLastError.setLocalData(error);
+    return QJsonSchemaError::NoError == error.errorCode();
 }
 
 /*!
@@ -152,6 +945,7 @@ QJsonSchemaError QJsonSchemaValidator::getLastError() const
 */
 bool QJsonSchemaValidator::isEmpty() const
 {
+    QReadLocker locker(&d_ptr->m_lock);
     return d_ptr->mSchemas.isEmpty();
 }
 
@@ -160,6 +954,7 @@ bool QJsonSchemaValidator::isEmpty() const
 */
 QStringList QJsonSchemaValidator::schemaNames() const
 {
+    QReadLocker locker(&d_ptr->m_lock);
     return d_ptr->mSchemas.names();
 }
 
@@ -168,6 +963,7 @@ QStringList QJsonSchemaValidator::schemaNames() const
 */
 bool QJsonSchemaValidator::hasSchema(const QString & name)
 {
+    QReadLocker locker(&d_ptr->m_lock);
     return d_ptr->mSchemas.contains(name);
 }
 
@@ -176,8 +972,10 @@ bool QJsonSchemaValidator::hasSchema(const QString & name)
 */
 void QJsonSchemaValidator::removeSchema(const QString & name)
 {
+    QWriteLocker locker(&d_ptr->m_lock);
     d_ptr->mSchemas.take(name);
     d_ptr->m_bInit = false; // clear last filtering & indexing results
+    ++d_ptr->m_generation;
 }
 
 /*!
@@ -185,7 +983,10 @@ void QJsonSchemaValidator::removeSchema(const QString & name)
 */
 void QJsonSchemaValidator::clear()
 {
+    QWriteLocker locker(&d_ptr->m_lock);
     d_ptr->mSchemas.clear();
+    d_ptr->m_bInit = false; // clear last filtering & indexing results
+    ++d_ptr->m_generation;
 }
 
 /*!
@@ -194,8 +995,10 @@ void QJsonSchemaValidator::clear()
 */
 void QJsonSchemaValidator::setValidationFilter(const QRegExp &filter)
 {
+    QWriteLocker locker(&d_ptr->m_lock);
     d_ptr->m_filter = filter;
     d_ptr->m_bInit = false; // clear last filtering & indexing results
+    ++d_ptr->m_generation;
 }
 
 /*!
@@ -206,10 +1009,288 @@ void QJsonSchemaValidator::setValidationFilter(const QRegExp &filter)
 */
 void QJsonSchemaValidator::setSchemaNameMatcher(const SchemaNameMatcher &matcher)
 {
+    QWriteLocker locker(&d_ptr->m_lock);
     d_ptr->m_matcher = QSharedPointer<SchemaNameMatcher>(matcher.clone());
     d_ptr->m_bInit = false; // clear last filtering & indexing results
+    ++d_ptr->m_generation;
 }
 
+/*!
+    Returns true if schemas are compiled into flat validation programs, the default.
+
+    \sa setUseCompiledSchemas()
+*/
+bool QJsonSchemaValidator::useCompiledSchemas() const
+{
+    QReadLocker locker(&d_ptr->m_lock);
+    return d_ptr->mSchemas.useCompiledSchemas();
+}
+
+/*!
+    Sets whether schemas are compiled into flat validation programs to \a use.
+
+    A compiled schema is an array of instructions that is run directly over the
+    JSON object, without the virtual calls and value wrappers of the tree of
+    checks a schema is otherwise turned into.  Both give the same results.  Schemas that
+    refer to other schemas by name are always checked with the tree.
+*/
+void QJsonSchemaValidator::setUseCompiledSchemas(bool use)
+{
+    QWriteLocker locker(&d_ptr->m_lock);
+    d_ptr->mSchemas.setUseCompiledSchemas(use);
+    ++d_ptr->m_generation;
+}
+
+/*!
+    Returns the schema \a schemaName, compiled for validating objects with
+    CompiledSchema::validate().  Validating through the returned handle skips the
+    schema lookup validateSchema() does for every object.
+
+    Returns an invalid CompiledSchema if there is no such schema or it can not be
+    compiled; getLastError() describes the problem.
+*/
+QJsonSchemaValidator::CompiledSchema QJsonSchemaValidator::compiledSchema(const QString &schemaName)
+{
+    Q_D(QJsonSchemaValidator);
+    CompiledSchema compiled;
+    SchemaValidation::Schema<JsonObjectTypes> schema;
+    SchemaProgram program;
+    bool ok;
+    {
+        QWriteLocker locker(&d->m_lock);
+        ok = setLastError(d->mSchemas.compile(schemaName, &schema, &program));
+    }
+    if (ok) {
+        compiled.d = new CompiledSchema::CompiledSchemaPrivate;
+        compiled.d->m_name = schemaName;
+        compiled.d->m_schema = schema;
+        compiled.d->m_program = program;
+    }
+    return compiled;
+}
+
+/*!
+    Returns the file parsed schema files are cached in, or an empty string if there is
+    no cache.
+
+    \sa setSchemaCacheFile()
+*/
+QString QJsonSchemaValidator::schemaCacheFile() const
+{
+    QMutexLocker locker(&d_ptr->m_cacheMutex);
+    return d_ptr->m_cacheFile;
+}
+
+/*!
+    Sets the file parsed schema files are cached in to \a filename.
+
+    loadFromFolder() and loadFromFile() then take schemas from the cache rather than
+    parsing their files again, as long as the files have the same size and
+    modification time, or the same contents, as when they were cached.  Other files
+    are parsed and the cache is updated afterwards.  The cache is Qt's binary JSON
+    format, which is mapped into memory and only checked when it is read.
+
+    \sa setPrecompileSchemas()
+*/
+void QJsonSchemaValidator::setSchemaCacheFile(const QString &filename)
+{
+    QMutexLocker locker(&d_ptr->m_cacheMutex);
+    d_ptr->m_cacheFile = filename;
+    d_ptr->m_cache = QJsonObject();
+    d_ptr->m_cacheLoaded = false;
+    d_ptr->m_cacheDirty = false;
+}
+
+/*!
+    Returns true if loaded schemas are compiled in the background.
+
+    \sa setPrecompileSchemas()
+*/
+bool QJsonSchemaValidator::precompileSchemas() const
+{
+    QReadLocker locker(&d_ptr->m_lock);
+    return d_ptr->m_precompile;
+}
+
+/*!
+    Sets whether schemas are compiled in a background thread as soon as they are
+    loaded to \a precompile, rather than when they are first used.  This takes the
+    compilation out of the first validations after startup.  Schemas that can not
+    be compiled report their errors when they are used, as usual.
+
+    \sa waitForPrecompiled()
+*/
+void QJsonSchemaValidator::setPrecompileSchemas(bool precompile)
+{
+    {
+        QWriteLocker locker(&d_ptr->m_lock);
+        d_ptr->m_precompile = precompile;
+    }
+    if (precompile)
+        d_ptr->startPrecompile();
+}
+
+/*!
+    Waits up to \a msecs milliseconds, or without a limit if \a msecs is -1, until the
+    loaded schemas are compiled in the background.  Returns true if they are.
+
+    \sa setPrecompileSchemas()
+*/
+bool QJsonSchemaValidator::waitForPrecompiled(int msecs)
+{
+    return d_ptr->m_precompilePool.waitForDone(msecs);
+}
+
+/*!
+    Loads schemas from the folder \a path like loadFromFolder() does with \a schemaNameProperty
+    and \a ext, and then watches the folder for changes.
+
+    When schema files are added, changed or removed, only these files are read
+    again.  Their schemas and the schemas that refer to them by "$ref" or "extends"
+    are compiled again, together with the index setSchemaNameMatcher() or
+    setValidationFilter() call for, into a copy that replaces the current schemas at
+    once.  Validation in other threads does not wait for any of this.  Files that
+    can not be loaded keep their previous schemas and a warning is printed.
+    schemasReloaded() is emitted after each reload.
+
+    The folder is watched through the event loop of the thread the validator lives
+    in, and watchFolder() must be called from that thread.
+
+    Returns true if all schema files were loaded successfully, or false otherwise.  Schema
+    loading error information can be retrieved using getLastError().
+
+    \sa unwatchFolder()
+*/
+bool QJsonSchemaValidator::watchFolder(const QString &path, const QString &schemaNameProperty, const QByteArray &ext)
+{
+    Q_D(QJsonSchemaValidator);
+    QJsonObject ret;
+    QDir dir(!path.isEmpty() ? path : QDir::currentPath());
+    if (dir.exists())
+    {
+        if (!d->m_watcher) {
+            d->m_watcher = new QFileSystemWatcher(this);
+            connect(d->m_watcher, SIGNAL(directoryChanged(QString)), SLOT(folderChanged(QString)));
+            connect(d->m_watcher, SIGNAL(fileChanged(QString)), SLOT(folderChanged(QString)));
+            d->m_reloadTimer = new QTimer(this);
+            d->m_reloadTimer->setSingleShot(true);
+            d->m_reloadTimer->setInterval(knReloadDelay);
+            connect(d->m_reloadTimer, SIGNAL(timeout()), SLOT(reloadFolders()));
+        }
+
+        QVector<SchemaFileLoad> loads(d->folderFiles(dir, schemaNameProperty, ext));
+        for (int i = 0; i < loads.size(); ++i)
+            loads[i].hashContents = true;
+        d->readFiles(this, &loads);
+        ret = d->folderErrors(loads, dir);
+        d->insertSchemas(loads);
+
+        const QString folder(dir.absolutePath());
+        QJsonSchemaValidatorPrivate::WatchedFolder &watched = d->m_watched[folder];
+        watched.schemaNameProperty = schemaNameProperty;
+        watched.ext = ext;
+        watched.files.clear();
+        foreach (const SchemaFileLoad &load, loads) {
+            QJsonSchemaValidatorPrivate::WatchedFile &file = watched.files[load.entry];
+            file.modified = load.modified;
+            file.size = load.size;
+            file.sha1 = load.sha1;
+            file.schemaName = load.schemaName;
+        }
+        d->watchFiles(folder);
+    }
+    else
+    {
+        ret = makeError(QJsonSchemaError::InvalidSchemaFolder,
+                        QString::fromLatin1("Folder '%1' does not exist.").arg(dir.path()));
+    }
+
+    if (!ret.isEmpty())
+        ret.insert(QJsonSchemaError::kSourceStr, dir.path());
+
+    const bool ok = setLastError(ret);
+    d->saveCache();
+    d->startPrecompile();
+    return ok;
+}
+
+/*!
+    Stops watching the folder \a path.  Its schemas stay loaded.
+
+    \sa watchFolder()
+*/
+void QJsonSchemaValidator::unwatchFolder(const QString &path)
+{
+    Q_D(QJsonSchemaValidator);
+    const QString folder(QDir(!path.isEmpty() ? path : QDir::currentPath()).absolutePath());
+    QMap<QString, QJsonSchemaValidatorPrivate::WatchedFolder>::iterator watched = d->m_watched.find(folder);
+    if (watched == d->m_watched.end())
+        return;
+
+    QStringList paths(folder);
+    foreach (const QString &file, watched->files.keys())
+        paths.append(folder + QLatin1Char('/') + file);
+    d->m_watcher->removePaths(paths);
+    d->m_watched.erase(watched);
+    d->m_changedFolders.remove(folder);
+}
+
+/*!
+    Returns the folders that are watched for changes.
+
+    \sa watchFolder()
+*/
+QStringList QJsonSchemaValidator::watchedFolders() const
+{
+    return d_ptr->m_watched.keys();
+}
+
+/*!
+    \fn void QJsonSchemaValidator::schemasReloaded(const QStringList &schemaNames)
+
+    This signal is emitted when a watched folder has been reloaded.  \a schemaNames
+    lists the schemas that were added, changed or removed, and those that were
+    compiled again because they refer to them.
+
+    \sa watchFolder()
+*/
+
+/*!
+    \internal
+    Waits for the folder of \a path to settle before reloading it.
+*/
+void QJsonSchemaValidator::folderChanged(const QString &path)
+{
+    Q_D(QJsonSchemaValidator);
+    const QFileInfo info(path);
+    const QString folder(d->m_watched.contains(info.absoluteFilePath()) ? info.absoluteFilePath() : info.absolutePath());
+    d->m_changedFolders.insert(folder);
+    if (folder != info.absoluteFilePath())
+        d->m_changedFiles.insert(path);
+    d->m_reloadTimer->start();
+}
+
+/*!
+    \internal
+    Reloads the watched folders that changed.
+*/
+void QJsonSchemaValidator::reloadFolders()
+{
+    Q_D(QJsonSchemaValidator);
+    const QSet<QString> folders(d->m_changedFolders);
+    const QSet<QString> files(d->m_changedFiles);
+    d->m_changedFolders.clear();
+    d->m_changedFiles.clear();
+
+    QStringList names;
+    foreach (const QString &folder, folders) {
+        names += d->reloadFolder(this, folder, files);
+        d->watchFiles(folder);
+    }
+    d->saveCache();
+    if (!names.isEmpty())
+        emit schemasReloaded(names);
+}
 
 /*!
     Load schemas from files in folder specified by \a path.  The files may be restricted to those
@@ -217,15 +1298,20 @@ void QJsonSchemaValidator::setSchemaNameMatcher(const SchemaNameMatcher &matcher
     to determine each schema's name, otherwise each file's basename will be used to name
     the schemas (see SchemaNameInitialization for details).
 
+    The files are read and parsed by as many threads as there are cores, and their
+    schemas are added to the validator together once all files are done.  With
+    setPrecompileSchemas(), the schemas are also compiled by these threads.
+
     Returns true if all schema files were loaded successfully, or false otherwise.  Schema
     loading error information can be retrieved using getLastError().
 */
 bool QJsonSchemaValidator::loadFromFolder(const QString & path, const QString & schemaNameProperty, const QByteArray & ext/*= "json"*/)
 {
     Q_D(QJsonSchemaValidator);
-    d->mLastError = _loadFromFolder(path, schemaNameProperty, ext);
-    d_ptr->m_bInit = false; // clear last filtering & indexing results
-    return QJsonSchemaError::NoError == d->mLastError.errorCode();
+    const bool ok = setLastError(_loadFromFolder(path, schemaNameProperty, ext));
+    d->saveCache();
+    d->startPrecompile();
+    return ok;
 }
 
 /*!
@@ -241,9 +1327,10 @@ bool QJsonSchemaValidator::loadFromFolder(const QString & path, const QString &
 bool QJsonSchemaValidator::loadFromFile(const QString &filename, SchemaNameInitialization type, const QString & schemaName)
 {
     Q_D(QJsonSchemaValidator);
-    d->mLastError = _loadFromFile(filename, type, schemaName);
-    d_ptr->m_bInit = false; // clear last filtering & indexing results
-    return QJsonSchemaError::NoError == d->mLastError.errorCode();
+    const bool ok = setLastError(_loadFromFile(filename, type, schemaName));
+    d->saveCache();
+    d->startPrecompile();
+    return ok;
 }
 
 /*!
@@ -258,9 +1345,9 @@ bool QJsonSchemaValidator::loadFromFile(const QString &filename, SchemaNameIniti
 bool QJsonSchemaValidator::loadFromData(const QByteArray & json, const QString & name, SchemaNameInitialization type)
 {
     Q_D(QJsonSchemaValidator);
-    d->mLastError = _loadFromData(json, name, type);
-    d_ptr->m_bInit = false; // clear last filtering & indexing results
-    return QJsonSchemaError::NoError == d->mLastError.errorCode();
+    const bool ok = setLastError(_loadFromData(json, name, type));
+    d->startPrecompile();
+    return ok;
  }
 
 /*!
@@ -269,59 +1356,21 @@ bool QJsonSchemaValidator::loadFromData(const QByteArray & json, const QString &
     in \a path folder.
     Schema name (object type) can be defined by the filename of the schema file or
     from \a schemaNameProperty property in JSON object.
+    Files are read and parsed by a pool of threads, the schemas are added together
+    once all files are done.
     Returns empty variant map at success or a map filled with error information otherwise
 */
 QJsonObject QJsonSchemaValidator::_loadFromFolder(const QString & path, const QString & schemaNameProperty, const QByteArray & ext/*= "json"*/)
 {
+    Q_D(QJsonSchemaValidator);
     QJsonObject ret;
     QDir dir(!path.isEmpty() ? path : QDir::currentPath());
     if (dir.exists())
     {
-        SchemaNameInitialization type(schemaNameProperty.isEmpty() ? UseFilename : UseProperty);
-        QString name(UseProperty == type ? schemaNameProperty : QString::null);
-        int nLoaded = 0;
-
-        // create a filter if required
-        QStringList exts;
-        if (!ext.isEmpty())
-            exts.append(QStringLiteral("*.")+QString::fromLatin1(ext));
-
-        QStringList items(dir.entryList(exts, QDir::Files | QDir::Readable));
-        foreach (QString filename, items)
-        {
-            if (UseFilename == type)
-            {
-                // strip extension from a filename to create an object type
-                name = ext.isEmpty() ? filename : filename.left(filename.length() - ext.length() - 1);
-            }
-
-            QJsonObject ret0 = _loadFromFile(dir.path() + QDir::separator() + filename, type, name);
-            if (!ret0.isEmpty())
-            {
-                ret.insert(filename, ret0);
-            }
-            else
-            {
-                nLoaded++;
-            }
-        }
-
-        // check result for errors
-        if (!ret.isEmpty()) // loading errors
-        {
-            int nFailed = ret.count();
-            ret.insert(QJsonSchemaError::kCodeStr, QJsonSchemaError::InvalidSchemaLoading);
-            ret.insert(QJsonSchemaError::kMessageStr,
-                       QString::fromLatin1("Loading failed for %1 schemas. %2 schemas are loaded successfully.").arg(nFailed).arg(nLoaded));
-
-            if (nLoaded)
-                ret.insert(QJsonSchemaError::kCounterStr, nLoaded);
-        }
-        else if (!nLoaded) // no schemas were found
-        {
-            ret = makeError(QJsonSchemaError::InvalidSchemaLoading,
-                            QString::fromLatin1("Folder '%1' does not contain any schema.").arg(dir.path()));
-        }
+        QVector<SchemaFileLoad> loads(d->folderFiles(dir, schemaNameProperty, ext));
+        d->readFiles(this, &loads);
+        ret = d->folderErrors(loads, dir);
+        d->insertSchemas(loads);
     }
     else
     {
@@ -342,23 +1391,72 @@ QJsonObject QJsonSchemaValidator::_loadFromFolder(const QString & path, const QS
 */
 QJsonObject QJsonSchemaValidator::_loadFromFile(const QString &filename, SchemaNameInitialization type, const QString & shemaName)
 {
+    QJsonObject schemaObject;
+    QString name;
+    QJsonObject ret = _readFromFile(filename, type, shemaName, &schemaObject, &name);
+    if (ret.isEmpty())
+        ret = setSchema(name, schemaObject);
+    return ret;
+}
+
+/*!
+    \internal
+    Supplements a validator object from a QByteArray \a json matching \a name and using \a type.
+    Returns empty variant map at success or a map filled with error information otherwise
+*/
+QJsonObject QJsonSchemaValidator::_loadFromData(const QByteArray & json, const QString & name, SchemaNameInitialization type)
+{
+    QJsonObject schemaObject;
+    QString schemaName;
+    QJsonObject ret = _readFromData(json, name, type, &schemaObject, &schemaName);
+    if (ret.isEmpty())
+        ret = setSchema(schemaName, schemaObject);
+    return ret;
+}
+
+/*!
+    \internal
+    Reads the schema file \a filename into \a schemaObject and names it \a schemaName, using
+    \a type and \a shemaName, without adding it to the validator.  The schema cache is
+    used if there is one.  Safe to call from several threads at once.
+    Returns empty variant map at success or a map filled with error information otherwise
+*/
+QJsonObject QJsonSchemaValidator::_readFromFile(const QString &filename, SchemaNameInitialization type, const QString & shemaName,
+                                                QJsonObject *schemaObject, QString *schemaName)
+{
+    Q_D(QJsonSchemaValidator);
     QJsonObject ret;
     if (!filename.isEmpty())
     {
         QByteArray json;
         QFile schemaFile(QFile::exists(filename) ? filename : QDir::currentPath() + QDir::separator() + filename);
-        if (schemaFile.open(QIODevice::ReadOnly) && !(json = schemaFile.readAll()).isEmpty())
+        const QFileInfo info(schemaFile);
+
+        QString name(shemaName);
+        if (UseFilename == type && shemaName.isEmpty())
+        {
+            // strip extension from a filename to create an object type
+            name = info.baseName();
+        }
+
+        if (d->cachedSchema(info, 0, schemaObject))
+        {
+            ret = _readFromObject(*schemaObject, name, type, schemaName);
+        }
+        else if (schemaFile.open(QIODevice::ReadOnly) && !(json = schemaFile.readAll()).isEmpty())
         {
             schemaFile.close();
 
-            QString name(shemaName);
-            if (UseFilename == type && shemaName.isEmpty())
+            if (d->cachedSchema(info, &json, schemaObject))
             {
-                // strip extension from a filename to create an object type
-                name = QFileInfo(schemaFile).baseName();
+                ret = _readFromObject(*schemaObject, name, type, schemaName);
+            }
+            else
+            {
+                ret = _readFromData(json, name, type, schemaObject, schemaName);
+                if (!schemaObject->isEmpty())
+                    d->cacheSchema(info, json, *schemaObject);
             }
-
-            ret = _loadFromData(json, name, type);
         }
         else
         {   // file open error
@@ -378,10 +1476,12 @@ QJsonObject QJsonSchemaValidator::_loadFromFile(const QString &filename, SchemaN
 
 /*!
     \internal
-    Supplements a validator object from a QByteArray \a json matching \a name and using \a type.
+    Parses \a json into \a schemaObject and names it \a schemaName, using \a name and \a type,
+    without adding it to the validator.  \a schemaObject is set as soon as \a json is parsed.
     Returns empty variant map at success or a map filled with error information otherwise
 */
-QJsonObject QJsonSchemaValidator::_loadFromData(const QByteArray & json, const QString & name, SchemaNameInitialization type)
+QJsonObject QJsonSchemaValidator::_readFromData(const QByteArray & json, const QString & name, SchemaNameInitialization type,
+                                                QJsonObject *schemaObject, QString *schemaName)
 {
     QJsonParseError err;
     QJsonDocument doc = QJsonDocument::fromJson(json, &err );
@@ -403,26 +1503,35 @@ QJsonObject QJsonSchemaValidator::_loadFromData(const QByteArray & json, const Q
         return makeError(QJsonSchemaError::InvalidObject, str);
     }
 
-    QJsonObject schemaObject = doc.object();
-
     //qDebug() << "shemaName " << name << " type= " << type;
-    //qDebug() << "schemaBody " << schemaObject;
+    //qDebug() << "schemaBody " << doc.object();
 
-    if (doc.isNull() || schemaObject.isEmpty())
+    if (doc.isNull() || doc.object().isEmpty())
     {
         return makeError(QJsonSchemaError::InvalidObject, QStringLiteral("schema data can not be empty"));
     }
 
-    QJsonObject ret;
-    QString schemaName;
+    *schemaObject = doc.object();
+    return _readFromObject(*schemaObject, name, type, schemaName);
+}
+
+/*!
+    \internal
+    Finds the name \a schemaName of the parsed \a schemaObject, using \a name and \a type.
+    Returns empty variant map at success or a map filled with error information otherwise
+*/
+QJsonObject QJsonSchemaValidator::_readFromObject(const QJsonObject &schemaObject, const QString &name,
+                                                  SchemaNameInitialization type, QString *schemaName)
+{
+    schemaName->clear();
     if (UseProperty == type && !name.isEmpty() && schemaObject.contains(name))
     {
         // retrive object type from JSON element
-        schemaName = schemaObject[name].toString();
+        *schemaName = schemaObject[name].toString();
     }
     else if (UseProperty != type)
     {
-        schemaName = name;
+        *schemaName = name;
     }
     else if (!name.isEmpty())
     {
@@ -432,17 +1541,13 @@ QJsonObject QJsonSchemaValidator::_loadFromData(const QByteArray & json, const Q
 
     }
 
-    if (!schemaName.isEmpty())
-    {
-        ret = setSchema(schemaName, schemaObject);
-    }
-    else
+    if (schemaName->isEmpty())
     {
         // no schema type
-        ret = makeError(QJsonSchemaError::InvalidSchemaOperation,
-                        QStringLiteral("schema name is missing"));
+        return makeError(QJsonSchemaError::InvalidSchemaOperation,
+                         QStringLiteral("schema name is missing"));
     }
-    return ret;
+    return QJsonObject();
 }
 
 /*!
@@ -453,8 +1558,24 @@ QJsonObject QJsonSchemaValidator::_loadFromData(const QByteArray & json, const Q
 bool QJsonSchemaValidator::validateSchema(const QString &schemaName, const QJsonObject &object)
 {
     Q_D(QJsonSchemaValidator);
-    d->mLastError = d->mSchemas.validate(schemaName, object);
-    return QJsonSchemaError::NoError == d->mLastError.errorCode();
+    return setLastError(d->validate(schemaName, object));
+}
+
+/*!
+    Validates \a object using the schema with name \a schemaName.  Returns true if
+    the object is valid.  Otherwise returns false and, if \a error is not null, sets
+    it to describe why validation failed.  getLastError() is not affected.
+*/
+bool QJsonSchemaValidator::validateSchema(const QString &schemaName, const QJsonObject &object,
+                                          QJsonSchemaError *error)
+{
+    Q_D(QJsonSchemaValidator);
+    QJsonSchemaError result(d->validate(schemaName, object));
+    if (QJsonSchemaError::NoError == result.errorCode())
+        return true;
+    if (error)
+        *error = result;
+    return false;
 }
 
 /*!
@@ -463,61 +1584,71 @@ bool QJsonSchemaValidator::validateSchema(const QString &schemaName, const QJson
     Validation error information can be retrieved using getLastError().
 */
 bool QJsonSchemaValidator::validateSchema(const QJsonObject &object)
+{
+    QJsonSchemaError error;
+    bool ok = validateSchema(object, &error);
+    setLastError(error);
+    return ok;
+}
+
+/*!
+    Validates \a object using all matching schemas in the validator.  Returns true if
+    the object is valid.  Otherwise returns false and, if \a error is not null, sets
+    it to describe why validation against the last schema tried failed.
+    getLastError() is not affected.
+*/
+bool QJsonSchemaValidator::validateSchema(const QJsonObject &object, QJsonSchemaError *error)
 {
     Q_D(QJsonSchemaValidator);
+    QJsonSchemaError last; // of the last schema tried
     //qDebug() << "VALIDATE: " << object;
 
     // do filtering & indexing initialization only once
-    if (!d->m_bInit) {
-        d->m_bInit = true;
-        if (!d->m_filter.isEmpty())
-        {
-            d->m_strsFilteredSchemas = schemaNames().filter(d->m_filter);
-        }
-
-        // do indexing if required
-        if (d->m_matcher && d->m_matcher->canIndex()) {
-            // use filtered schemas if filter is set
-            const QStringList strsSchemas(d->m_filter.isEmpty() ? schemaNames() : d->m_strsFilteredSchemas);
-            QMap<QString, QJsonObject> map(d_ptr->mSchemas.schemas());
-            d->m_matcher->reset();
-            foreach (QString strSchema, strsSchemas) {
-                QMap<QString, QJsonObject>::const_iterator it(map.find(strSchema));
-                if (it != map.end())
-                    d->m_matcher->createIndex(it.key(), it.value());
-            }
-        }
-    }
+    d->ensureIndexed();
 
+    QReadLocker locker(&d->m_lock);
     if (!d->m_matcher) {
-        const QStringList strsSchemas(d->m_filter.isEmpty() ? schemaNames() : d->m_strsFilteredSchemas);
-
-        // iterate through all schemas and find a valid one (not efficient way to do this without matcher)
-        foreach (QString strSchema, strsSchemas) {
-            if (validateSchema(strSchema, object)) {
-                //qDebug() << "found schema: " << strSchema;
+        QSharedPointer<const SchemaDiscriminator> discriminator(d->m_discriminator);
+        locker.unlock();
+        Q_ASSERT(discriminator);
+
+        // only check the schemas the object can match, in the order of all schemas
+        const QStringList &strsSchemas(discriminator->names());
+        const QVector<int> &candidates(discriminator->candidates(object));
+        foreach (int candidate, candidates) {
+            if (validateSchema(strsSchemas.at(candidate), object, &last)) {
+                //qDebug() << "found schema: " << strsSchemas.at(candidate);
                 return true;
             }
         }
+
+        // report the error of the last schema, as if all of them had been checked
+        if (!strsSchemas.isEmpty() && (candidates.isEmpty() || candidates.last() != strsSchemas.size() - 1))
+            validateSchema(strsSchemas.last(), object, &last);
     }
     else {
-        // matcher allows much faster validation
-        QStringList strsSchemas(d->m_matcher->getExactMatches(object));
+        // matcher allows much faster validation; matchers are only read once indexed
+        QSharedPointer<SchemaNameMatcher> matcher(d->m_matcher);
+        locker.unlock();
+
+        QStringList strsSchemas(matcher->getExactMatches(object));
         foreach (QString strSchema, strsSchemas) {
-            if (validateSchema(strSchema, object)) {
+            if (validateSchema(strSchema, object, &last)) {
                 //qDebug() << "found schema @ ex: " << strSchema;
                 return true;
             }
         }
 
-        strsSchemas = d->m_matcher->getPossibleMatches(object);
+        strsSchemas = matcher->getPossibleMatches(object);
         foreach (QString strSchema, strsSchemas) {
-            if (validateSchema(strSchema, object)) {
+            if (validateSchema(strSchema, object, &last)) {
                 //qDebug() << "found schema @ pos: " << strSchema;
                 return true;
             }
         }
     }
+    if (error)
+        *error = last;
     return false;
 }
 
@@ -526,11 +1657,95 @@ bool QJsonSchemaValidator::validateSchema(const QJsonObject &object)
 */
 QJsonObject QJsonSchemaValidator::setSchema(const QString &schemaName, QJsonObject schema)
 {
+    QWriteLocker locker(&d_ptr->m_lock);
     QJsonObject ret = d_ptr->mSchemas.insert(schemaName, schema);
+    d_ptr->m_bInit = false; // clear last filtering & indexing results
+    ++d_ptr->m_generation;
     //qDebug() << "setSchema::errors: " << ret;
     return ret;
 }
 
+/*!
+    \class QJsonSchemaValidator::CompiledSchema
+    \inmodule QtJsonStream
+    \brief The CompiledSchema class is a schema resolved for repeated validation.
+
+    A CompiledSchema is returned by QJsonSchemaValidator::compiledSchema().  It keeps
+    the compiled form of the schema, so validating an object through it involves no
+    lookup by name, and nothing is allocated for a valid object.  It is a snapshot:
+    loading, replacing or removing schemas in the validator afterwards does not
+    affect it.  Since it never changes, it may be used from several threads at once.
+*/
+
+/*!
+    Creates an invalid CompiledSchema.
+*/
+QJsonSchemaValidator::CompiledSchema::CompiledSchema()
+{
+}
+
+/*!
+    Creates a copy of \a other.
+*/
+QJsonSchemaValidator::CompiledSchema::CompiledSchema(const CompiledSchema &other)
+    : d(other.d)
+{
+}
+
+/*!
+    \internal
+*/
+QJsonSchemaValidator::CompiledSchema::~CompiledSchema()
+{
+}
+
+/*!
+    Assigns \a other to this CompiledSchema.
+*/
+QJsonSchemaValidator::CompiledSchema &QJsonSchemaValidator::CompiledSchema::operator=(const CompiledSchema &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+    Returns true if this CompiledSchema can be used to validate objects.
+*/
+bool QJsonSchemaValidator::CompiledSchema::isValid() const
+{
+    return d;
+}
+
+/*!
+    Returns the name of the schema.
+*/
+QString QJsonSchemaValidator::CompiledSchema::name() const
+{
+    return d ? d->m_name : QString();
+}
+
+/*!
+    Validates \a object against the schema.  Returns true if the object is valid.
+    Otherwise returns false and, if \a error is not null, sets it to describe
+    why validation failed.
+*/
+bool QJsonSchemaValidator::CompiledSchema::validate(const QJsonObject &object, QJsonSchemaError *error) const
+{
+    if (!d) {
+        if (error)
+            *error = QJsonSchemaError(QJsonSchemaError::InvalidSchemaOperation,
+                                      QStringLiteral("Schema is not compiled."));
+        return false;
+    }
+
+    const QJsonObject result = SchemaManager<QJsonObject, JsonObjectTypes>::check(d->m_schema, &d->m_program, object);
+    if (result.isEmpty())
+        return true;
+    if (error)
+        *error = QJsonSchemaError(result);
+    return false;
+}
+
 /*!
     \class QJsonSchemaValidator::SchemaNameMatcher
     \inmodule QtJsonStream
@@ -771,7 +1986,7 @@ QStringList QJsonSchemaValidator::SchemaUniqueKeyNameMatcher::getExactMatches(co
 {
     QString str(!m_key.isEmpty() && object.contains(m_key) ? object[m_key].toString() : QString::null);
     QHash<QString,QStringList>::const_iterator it;
-    return !str.isEmpty() && (it = d_ptr->m_items.find(str)) != d_ptr->m_items.end() ? *it : QStringList();
+    return !str.isEmpty() && (it = d_ptr->m_items.constFind(str)) != d_ptr->m_items.constEnd() ? *it : QStringList();
 }
 
 /*!
@@ -46,6 +46,7 @@
 #include <QJsonObject>
 #include <QRegExp>
 #include <QStringList>
+#include <QtCore/qshareddata.h>
 
 #include "qjsonschema-global.h"
 #include "qjsonschemaerror.h"
@@ -70,8 +71,15 @@ public:
     bool loadFromFolder(const QString &, const QString & = QString::null, const QByteArray & ext = "json");
     bool loadFromData(const QByteArray &, const QString &, SchemaNameInitialization = UseParameter);
 
+    // loads a folder and reloads it whenever its schema files change
+    bool watchFolder(const QString &, const QString & = QString::null, const QByteArray & ext = "json");
+    void unwatchFolder(const QString &);
+    QStringList watchedFolders() const;
+
     bool validateSchema(const QString &schemaName, const QJsonObject &object);
     bool validateSchema(const QJsonObject &object);
+    bool validateSchema(const QString &schemaName, const QJsonObject &object, QJsonSchemaError *error);
+    bool validateSchema(const QJsonObject &object, QJsonSchemaError *error);
 
     QJsonSchemaError getLastError() const;
 
@@ -88,18 +96,46 @@ public:
     class SchemaNameMatcher;
     void setSchemaNameMatcher(const SchemaNameMatcher &);
 
+    // validate with schemas compiled into flat programs rather than check trees
+    bool useCompiledSchemas() const;
+    void setUseCompiledSchemas(bool);
+
+    // resolves a schema once for validating many objects
+    class CompiledSchema;
+    CompiledSchema compiledSchema(const QString &schemaName);
+
+    // keeps parsed schema files on disk for faster loading
+    QString schemaCacheFile() const;
+    void setSchemaCacheFile(const QString &);
+
+    // compiles loaded schemas in the background rather than on first use
+    bool precompileSchemas() const;
+    void setPrecompileSchemas(bool);
+    bool waitForPrecompiled(int msecs = -1);
+
 protected:
     QJsonObject setSchema(const QString &schemaName, QJsonObject schema);
 
 signals:
+    void schemasReloaded(const QStringList &schemaNames);
 
 public slots:
 
+private slots:
+    void folderChanged(const QString &);
+    void reloadFolders();
+
 private:
+    bool setLastError(const QJsonSchemaError &);
     QJsonObject _loadFromFile(const QString &, SchemaNameInitialization = UseFilename, const QString & = QString::null);
     QJsonObject _loadFromFolder(const QString &, const QString & = QString::null, const QByteArray & ext = "json");
     QJsonObject _loadFromData(const QByteArray &, const QString &, SchemaNameInitialization = UseParameter);
 
+    // parse and name a schema without adding it
+    QJsonObject _readFromFile(const QString &, SchemaNameInitialization, const QString &, QJsonObject *, QString *);
+    QJsonObject _readFromData(const QByteArray &, const QString &, SchemaNameInitialization, QJsonObject *, QString *);
+    QJsonObject _readFromObject(const QJsonObject &, const QString &, SchemaNameInitialization, QString *);
+
 private:
     class QJsonSchemaValidatorPrivate;
     QJsonSchemaValidatorPrivate * const d_ptr;
@@ -107,6 +143,25 @@ private:
 
 public:
     // helper classes
+    class CompiledSchema
+    {
+    public:
+        CompiledSchema();
+        CompiledSchema(const CompiledSchema &);
+        ~CompiledSchema();
+        CompiledSchema &operator=(const CompiledSchema &);
+
+        bool isValid() const;
+        QString name() const;
+
+        bool validate(const QJsonObject &object, QJsonSchemaError *error = 0) const;
+
+    private:
+        friend class QJsonSchemaValidator;
+        class CompiledSchemaPrivate;
+        QExplicitlySharedDataPointer<CompiledSchemaPrivate> d;
+    };
+
     class SchemaNameMatcher
     {
     public:
@@ -0,0 +1,311 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "schemadiscriminator_p.h"
+
+#include <QJsonArray>
+#include <QJsonValue>
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+// schemas are told apart by at most this many properties
+const int knMaxDiscriminatorDepth = 4;
+// beyond this many nodes the remaining schemas are not told apart any more
+const int knMaxDiscriminatorNodes = 16384;
+
+// a key for a scalar value that is unique to its type and value; empty for objects and arrays
+static QString valueKey(const QJsonValue &value)
+{
+    switch (value.type()) {
+    case QJsonValue::Null:
+        return QStringLiteral("z");
+    case QJsonValue::Bool:
+        return value.toBool() ? QStringLiteral("t") : QStringLiteral("f");
+    case QJsonValue::Double: {
+        double number = value.toDouble();
+        if (number == 0)
+            number = 0; // -0 == +0
+        return QLatin1Char('n') + QString::number(number, 'g', 17);
+    }
+    case QJsonValue::String:
+        return QLatin1Char('s') + value.toString();
+    default:
+        break;
+    }
+    return QString();
+}
+
+static int valueKeyType(const QString &key)
+{
+    switch (key.at(0).unicode()) {
+    case 'z':
+        return QJsonValue::Null;
+    case 't':
+    case 'f':
+        return QJsonValue::Bool;
+    case 'n':
+        return QJsonValue::Double;
+    default:
+        break;
+    }
+    return QJsonValue::String;
+}
+
+// schema attribute names are not case sensitive
+static QJsonValue attribute(const QJsonObject &schema, const char *name)
+{
+    for (QJsonObject::const_iterator it = schema.constBegin(); it != schema.constEnd(); ++it) {
+        if (!it.key().compare(QLatin1String(name), Qt::CaseInsensitive))
+            return it.value();
+    }
+    return QJsonValue(QJsonValue::Undefined);
+}
+
+static int typeOf(const QString &name)
+{
+    const QString type = name.toLower();
+    if (type == QLatin1String("string"))
+        return QJsonValue::String;
+    if (type == QLatin1String("number") || type == QLatin1String("integer"))
+        return QJsonValue::Double;
+    if (type == QLatin1String("boolean"))
+        return QJsonValue::Bool;
+    if (type == QLatin1String("object"))
+        return QJsonValue::Object;
+    if (type == QLatin1String("array"))
+        return QJsonValue::Array;
+    if (type == QLatin1String("null"))
+        return QJsonValue::Null;
+    return -1;
+}
+
+// a pattern without special characters only matches itself
+static bool isLiteral(const QString &pattern)
+{
+    const QString special(QStringLiteral("\\^$.|?*+()[]{}"));
+    for (int i = 0; i < pattern.length(); ++i) {
+        if (special.contains(pattern.at(i)))
+            return false;
+    }
+    return true;
+}
+
+SchemaDiscriminator::SchemaDiscriminator(const QStringList &names, const QMap<QString, QJsonObject> &schemas)
+    : m_names(names)
+{
+    QVector<Constraints> constraints;
+    QVector<int> all;
+    constraints.reserve(names.size());
+    all.reserve(names.size());
+    for (int i = 0; i < names.size(); ++i) {
+        constraints.append(analyze(schemas.value(names.at(i))));
+        all.append(i);
+    }
+    build(constraints, all, QSet<QString>(), 0);
+}
+
+/*
+  Returns the positions in names() of the schemas \a object can match.
+*/
+const QVector<int> &SchemaDiscriminator::candidates(const QJsonObject &object) const
+{
+    int index = 0;
+    forever {
+        const Node &node = m_nodes.at(index);
+        if (node.absent < 0)
+            return node.schemas;
+
+        QJsonObject::const_iterator it = object.constFind(node.key);
+        if (it == object.constEnd()) {
+            index = node.absent;
+            continue;
+        }
+
+        const QJsonValue value = it.value();
+        QHash<QString, int>::const_iterator branch = node.values.constEnd();
+        if (!node.values.isEmpty() && value.type() != QJsonValue::Array && value.type() != QJsonValue::Object)
+            branch = node.values.constFind(valueKey(value));
+        index = branch != node.values.constEnd() ? branch.value() : node.types[value.type()];
+    }
+}
+
+SchemaDiscriminator::Constraints SchemaDiscriminator::analyze(const QJsonObject &schema)
+{
+    Constraints constraints;
+    const QJsonObject properties = attribute(schema, "properties").toObject();
+    for (QJsonObject::const_iterator it = properties.constBegin(); it != properties.constEnd(); ++it) {
+        const QJsonObject property = it.value().toObject();
+
+        // the Check tree takes "true" for true too
+        const QJsonValue required = attribute(property, "required");
+        if (!required.toBool() && required.toString().compare(QLatin1String("true"), Qt::CaseInsensitive))
+            continue;
+
+        Constraint constraint;
+        constraint.type = typeOf(attribute(property, "type").toString());
+
+        const QJsonValue values = attribute(property, "enum");
+        const QJsonValue pattern = attribute(property, "pattern");
+        if (values.isArray()) {
+            constraint.hasValues = true;
+            const QJsonArray array = values.toArray();
+            for (QJsonArray::const_iterator i = array.constBegin(); i != array.constEnd(); ++i) {
+                const QString key = valueKey(*i);
+                if (key.isEmpty()) {
+                    // objects and arrays are not indexed
+                    constraint.hasValues = false;
+                    break;
+                }
+                if (constraint.type < 0 || constraint.type == valueKeyType(key))
+                    constraint.values.insert(key);
+            }
+            if (!constraint.hasValues)
+                constraint.values.clear();
+        } else if (constraint.type == QJsonValue::String && pattern.isString() && isLiteral(pattern.toString())) {
+            constraint.hasValues = true;
+            constraint.values.insert(QLatin1Char('s') + pattern.toString());
+        }
+        constraints.insert(it.key(), constraint);
+    }
+    return constraints;
+}
+
+// whether a schema with \a constraint on a property can match an object that has \a value there
+bool SchemaDiscriminator::accepts(const Constraint &constraint, const QString &value, int type)
+{
+    if (constraint.hasValues)
+        return constraint.values.contains(value);
+    return constraint.type < 0 || constraint.type == type;
+}
+
+int SchemaDiscriminator::build(const QVector<Constraints> &constraints, const QVector<int> &schemas,
+                               QSet<QString> used, int depth)
+{
+    const int index = m_nodes.size();
+    m_nodes.append(Node());
+    Node node;
+
+    // test the property most schemas have conditions on, listed values count double
+    QString key;
+    if (schemas.size() > 1 && depth < knMaxDiscriminatorDepth && m_nodes.size() < knMaxDiscriminatorNodes) {
+        QHash<QString, int> scores;
+        int best = 0;
+        foreach (int schema, schemas) {
+            const Constraints &schemaConstraints = constraints.at(schema);
+            for (Constraints::const_iterator it = schemaConstraints.constBegin(); it != schemaConstraints.constEnd(); ++it) {
+                if (used.contains(it.key()))
+                    continue;
+                int &score = scores[it.key()];
+                score += it.value().hasValues ? 2 : 1;
+                if (score > best || (score == best && it.key() < key)) {
+                    best = score;
+                    key = it.key();
+                }
+            }
+        }
+    }
+
+    if (key.isNull()) {
+        node.schemas = schemas;
+        m_nodes[index] = node;
+        return index;
+    }
+
+    node.key = key;
+    used.insert(key);
+
+    // branches that keep the same schemas share a subtree
+    QHash<QByteArray, int> children;
+
+    QSet<QString> values;
+    foreach (int schema, schemas) {
+        const Constraint constraint = constraints.at(schema).value(key);
+        if (constraint.hasValues)
+            values.unite(constraint.values);
+    }
+
+    foreach (const QString &value, values) {
+        const int type = valueKeyType(value);
+        QVector<int> subset;
+        foreach (int schema, schemas) {
+            if (accepts(constraints.at(schema).value(key), value, type))
+                subset.append(schema);
+        }
+        node.values.insert(value, child(constraints, subset, used, depth + 1, &children));
+    }
+
+    // values nobody lists only match schemas without listed values
+    for (int type = QJsonValue::Null; type <= QJsonValue::Object; ++type) {
+        QVector<int> subset;
+        foreach (int schema, schemas) {
+            const Constraint constraint = constraints.at(schema).value(key);
+            if (!constraint.hasValues && (constraint.type < 0 || constraint.type == type))
+                subset.append(schema);
+        }
+        node.types[type] = child(constraints, subset, used, depth + 1, &children);
+    }
+
+    QVector<int> subset;
+    foreach (int schema, schemas) {
+        if (!constraints.at(schema).contains(key))
+            subset.append(schema);
+    }
+    node.absent = child(constraints, subset, used, depth + 1, &children);
+
+    m_nodes[index] = node;
+    return index;
+}
+
+// builds the subtree for \a schemas unless a sibling has the same schemas
+int SchemaDiscriminator::child(const QVector<Constraints> &constraints, const QVector<int> &schemas,
+                               const QSet<QString> &used, int depth, QHash<QByteArray, int> *siblings)
+{
+    const QByteArray key(reinterpret_cast<const char *>(schemas.constData()), schemas.size() * sizeof(int));
+    QHash<QByteArray, int>::const_iterator it = siblings->constFind(key);
+    if (it != siblings->constEnd())
+        return it.value();
+    const int index = build(constraints, schemas, used, depth);
+    siblings->insert(key, index);
+    return index;
+}
+
+QT_END_NAMESPACE_JSONSTREAM
@@ -0,0 +1,114 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#ifndef SCHEMADISCRIMINATOR_P_H
+#define SCHEMADISCRIMINATOR_P_H
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qmap.h>
+#include <QtCore/qset.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qvector.h>
+#include <QJsonObject>
+
+#include "qjsonschema-global.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+/**
+  \internal
+  A decision tree that routes an object to the schemas it can match.
+
+  Each schema is analyzed for its required top level properties, the JSON type
+  they must have and the values listed in their "enum" (or a "pattern" that is a
+  plain string).  The tree tests the property that tells most schemas apart, then
+  the next one, and its leaves list the schemas whose conditions the object meets.
+  The conditions are only necessary ones: every schema that would validate the
+  object is a candidate, in the order of names().
+  */
+class SchemaDiscriminator
+{
+public:
+    SchemaDiscriminator(const QStringList &names, const QMap<QString, QJsonObject> &schemas);
+
+    const QStringList &names() const { return m_names; }
+    const QVector<int> &candidates(const QJsonObject &object) const;
+
+private:
+    // what a schema requires of one property
+    struct Constraint
+    {
+        Constraint() : type(-1), hasValues(false) {}
+
+        int type;          // QJsonValue::Type the value must have, -1 for any
+        bool hasValues;    // the value must be one of values
+        QSet<QString> values;
+    };
+    typedef QHash<QString, Constraint> Constraints;
+
+    struct Node
+    {
+        Node() : absent(-1) { for (int i = 0; i < 6; ++i) types[i] = -1; }
+
+        QString key;                // the property tested
+        QHash<QString, int> values; // listed values
+        int types[6];               // other values, by QJsonValue::Type
+        int absent;                 // the property is missing; -1 for a leaf
+        QVector<int> schemas;       // candidates of a leaf
+    };
+
+    static Constraints analyze(const QJsonObject &schema);
+    static bool accepts(const Constraint &constraint, const QString &value, int type);
+    int build(const QVector<Constraints> &constraints, const QVector<int> &schemas,
+              QSet<QString> used, int depth);
+    int child(const QVector<Constraints> &constraints, const QVector<int> &schemas,
+              const QSet<QString> &used, int depth, QHash<QByteArray, int> *siblings);
+
+    QStringList m_names;
+    QVector<Node> m_nodes; // the root is 0
+};
+
+QT_END_NAMESPACE_JSONSTREAM
+
+#endif // SCHEMADISCRIMINATOR_P_H
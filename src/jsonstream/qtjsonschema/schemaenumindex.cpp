@@ -0,0 +1,116 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "schemaenumindex_p.h"
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+// numbers equal by operator== have the same key
+static inline quint64 numberKey(double number)
+{
+    if (number == 0)
+        number = 0; // -0 == +0
+    quint64 key;
+    memcpy(&key, &number, sizeof(key));
+    return key;
+}
+
+SchemaEnumIndex::SchemaEnumIndex()
+    : m_null(false), m_false(false), m_true(false)
+{
+}
+
+SchemaEnumIndex::SchemaEnumIndex(const QJsonArray &values)
+    : m_null(false), m_false(false), m_true(false)
+{
+    for (QJsonArray::const_iterator i = values.constBegin(); i != values.constEnd(); ++i) {
+        const QJsonValue value = *i;
+        switch (value.type()) {
+        case QJsonValue::Null:
+            m_null = true;
+            break;
+        case QJsonValue::Bool:
+            (value.toBool() ? m_true : m_false) = true;
+            break;
+        case QJsonValue::Double:
+            m_numbers.insert(numberKey(value.toDouble()));
+            break;
+        case QJsonValue::String:
+            m_strings.insert(value.toString());
+            break;
+        case QJsonValue::Array:
+        case QJsonValue::Object:
+            m_others.append(value);
+            break;
+        case QJsonValue::Undefined:
+            break;
+        }
+    }
+}
+
+bool SchemaEnumIndex::contains(const QJsonValue &value) const
+{
+    switch (value.type()) {
+    case QJsonValue::Null:
+        return m_null;
+    case QJsonValue::Bool:
+        return value.toBool() ? m_true : m_false;
+    case QJsonValue::Double:
+        return !m_numbers.isEmpty() && m_numbers.contains(numberKey(value.toDouble()));
+    case QJsonValue::String:
+        return !m_strings.isEmpty() && m_strings.contains(value.toString());
+    case QJsonValue::Array:
+    case QJsonValue::Object:
+        for (int i = 0; i < m_others.size(); ++i) {
+            if (value == m_others.at(i))
+                return true;
+        }
+        break;
+    case QJsonValue::Undefined:
+        break;
+    }
+    return false;
+}
+
+QT_END_NAMESPACE_JSONSTREAM
@@ -0,0 +1,83 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#ifndef SCHEMAENUMINDEX_P_H
+#define SCHEMAENUMINDEX_P_H
+
+#include <QtCore/qset.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qvector.h>
+#include <QJsonArray>
+#include <QJsonValue>
+
+#include "qjsonschema-global.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+/**
+  \internal
+  The values of an "enum" attribute, indexed by JSON kind.  Strings and numbers are
+  looked up in hash sets, so checking a value does not depend on the size of the
+  enum; only objects and arrays are compared one by one.  contains() gives the same
+  result as comparing the value with each member using QJsonValue::operator==().
+  */
+class SchemaEnumIndex
+{
+public:
+    SchemaEnumIndex();
+    explicit SchemaEnumIndex(const QJsonArray &values);
+
+    bool contains(const QJsonValue &value) const;
+
+private:
+    QSet<QString> m_strings;
+    QSet<quint64> m_numbers; // bit patterns, zero is always stored as +0
+    QVector<QJsonValue> m_others;
+    bool m_null;
+    bool m_false;
+    bool m_true;
+};
+
+QT_END_NAMESPACE_JSONSTREAM
+
+#endif // SCHEMAENUMINDEX_P_H
@@ -0,0 +1,264 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "schemaformat_p.h"
+
+#include <QDate>
+#include <QUrl>
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+/*!
+  \internal
+  Returns the format checked for the "format" attribute value \a name.
+*/
+SchemaFormat schemaFormat(const QString &name)
+{
+    static const struct {
+        const char *name;
+        SchemaFormat format;
+    } formats[] = {
+        { "date-time", FormatDateTime },
+        { "date", FormatDate },
+        { "time", FormatTime },
+        { "uri", FormatUri },
+        { "url", FormatUrl },
+        { "email", FormatEmail },
+        { "ip-address", FormatIpv4 },
+        { "ipv4", FormatIpv4 },
+        { "nonnegativeinteger", FormatNonNegativeInteger }
+    };
+
+    for (uint i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        if (!name.compare(QLatin1String(formats[i].name), Qt::CaseInsensitive))
+            return formats[i].format;
+    }
+    return FormatNone;
+}
+
+// the value of \a count decimal digits, or -1
+static inline int decimal(const QChar *str, int count)
+{
+    int value = 0;
+    for (int i = 0; i < count; ++i) {
+        const ushort c = str[i].unicode();
+        if (c < '0' || c > '9')
+            return -1;
+        value = value * 10 + (c - '0');
+    }
+    return value;
+}
+
+// yyyy-MM-dd
+static bool isDate(const QChar *str)
+{
+    if (str[4] != QLatin1Char('-') || str[7] != QLatin1Char('-'))
+        return false;
+    const int year = decimal(str, 4);
+    const int month = decimal(str + 5, 2);
+    const int day = decimal(str + 8, 2);
+    return year >= 0 && month >= 0 && day >= 0 && QDate::isValid(year, month, day);
+}
+
+// hh:mm:ss
+static bool isTime(const QChar *str)
+{
+    if (str[2] != QLatin1Char(':') || str[5] != QLatin1Char(':'))
+        return false;
+    const int hours = decimal(str, 2);
+    const int minutes = decimal(str + 3, 2);
+    const int seconds = decimal(str + 6, 2);
+    return hours >= 0 && hours < 24 && minutes >= 0 && minutes < 60 && seconds >= 0 && seconds < 60;
+}
+
+static inline bool isAsciiLetterOrDigit(ushort c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+static inline bool isHexDigit(ushort c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// characters allowed in a URI reference besides letters, digits and percent escapes (RFC 3986)
+static inline bool isUriCharacter(ushort c)
+{
+    return c && c < 0x80 && (isAsciiLetterOrDigit(c) || strchr("-._~:/?#[]@!$&'()*+,;=", c));
+}
+
+// characters allowed in the local part of an address besides letters and digits (RFC 5322 atext)
+static inline bool isEmailCharacter(ushort c)
+{
+    return c && c < 0x80 && (isAsciiLetterOrDigit(c) || strchr("!#$%&'*+-/=?^_`{|}~", c));
+}
+
+static bool isUri(const QString &str)
+{
+    if (str.contains(QLatin1Char(':')))
+        return true; // URN or URL
+
+    // a relative reference
+    const QChar *data = str.constData();
+    const int length = str.length();
+    for (int i = 0; i < length; ++i) {
+        const ushort c = data[i].unicode();
+        if (c == '%') {
+            if (i + 2 >= length || !isHexDigit(data[i + 1].unicode()) || !isHexDigit(data[i + 2].unicode()))
+                return false;
+            i += 2;
+        } else if (!isUriCharacter(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// local-part@domain, with a dot-atom local part and a host name domain
+static bool isEmail(const QString &str)
+{
+    const int at = str.lastIndexOf(QLatin1Char('@'));
+    if (at < 1 || at > 64 || str.length() > 254 || at == str.length() - 1)
+        return false;
+
+    const QChar *data = str.constData();
+    for (int i = 0; i < at; ++i) {
+        const ushort c = data[i].unicode();
+        if (c == '.') {
+            if (i == 0 || i == at - 1 || data[i - 1] == QLatin1Char('.'))
+                return false;
+        } else if (!isEmailCharacter(c)) {
+            return false;
+        }
+    }
+
+    int label = 0;
+    for (int i = at + 1; i < str.length(); ++i) {
+        const ushort c = data[i].unicode();
+        if (c == '.') {
+            if (!label || data[i - 1] == QLatin1Char('-'))
+                return false;
+            label = 0;
+        } else if (isAsciiLetterOrDigit(c) || (c == '-' && label)) {
+            if (++label > 63)
+                return false;
+        } else {
+            return false;
+        }
+    }
+    return label && data[str.length() - 1] != QLatin1Char('-');
+}
+
+// four decimal numbers up to 255, separated by dots
+static bool isIpv4(const QString &str)
+{
+    const QChar *data = str.constData();
+    const int length = str.length();
+    int i = 0;
+    for (int part = 0; part < 4; ++part) {
+        if (part) {
+            if (i == length || data[i] != QLatin1Char('.'))
+                return false;
+            ++i;
+        }
+        int value = 0;
+        int count = 0;
+        for (; i < length && count < 3 && data[i] >= QLatin1Char('0') && data[i] <= QLatin1Char('9'); ++i, ++count)
+            value = value * 10 + data[i].unicode() - '0';
+        if (!count || value > 255)
+            return false;
+    }
+    return i == length;
+}
+
+/*!
+  \internal
+  Returns true if \a str, which is not empty, is valid for \a format.
+*/
+bool checkSchemaFormat(SchemaFormat format, const QString &str)
+{
+    switch (format) {
+    case FormatDateTime:
+        // yyyy-MM-ddThh:mm:ssZ
+        return str.length() == 20 && isDate(str.constData()) && str.at(10) == QLatin1Char('T') &&
+                isTime(str.constData() + 11) && str.at(19) == QLatin1Char('Z');
+    case FormatDate:
+        return str.length() == 10 && isDate(str.constData());
+    case FormatTime:
+        return str.length() == 8 && isTime(str.constData());
+    case FormatUri:
+        return isUri(str);
+    case FormatUrl:
+        return QUrl(str, QUrl::StrictMode).isValid();
+    case FormatEmail:
+        return isEmail(str);
+    case FormatIpv4:
+        return isIpv4(str);
+    case FormatNone:
+    case FormatNonNegativeInteger:
+        break;
+    }
+    return true;
+}
+
+/*!
+  \internal
+  Returns \a pattern compiled to match whole strings only.  The expression is
+  optimized up front, so the first matches do not pay for it, and it may be
+  matched from several threads at once.
+*/
+QRegularExpression schemaPattern(const QString &pattern)
+{
+    QRegularExpression regexp(pattern);
+    if (!regexp.isValid())
+        return regexp;
+
+    regexp.setPattern(QLatin1String("\\A(?:") + pattern + QLatin1String(")\\z"));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
+    regexp.optimize();
+#endif
+    return regexp;
+}
+
+QT_END_NAMESPACE_JSONSTREAM
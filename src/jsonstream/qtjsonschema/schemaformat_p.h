@@ -0,0 +1,80 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+
+#ifndef SCHEMAFORMAT_P_H
+#define SCHEMAFORMAT_P_H
+
+#include <QtCore/qregularexpression.h>
+#include <QtCore/qstring.h>
+
+#include "qjsonschema-global.h"
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+/*
+  The values of the "format" attribute that are checked, resolved once when a
+  schema is compiled.  Other formats always match.
+*/
+enum SchemaFormat {
+    FormatNone,
+    FormatDateTime,
+    FormatDate,
+    FormatTime,
+    FormatUri,
+    FormatUrl,
+    FormatEmail,
+    FormatIpv4,
+    FormatNonNegativeInteger
+};
+
+SchemaFormat schemaFormat(const QString &name);
+
+// checks a non-empty string against one of the string formats
+bool checkSchemaFormat(SchemaFormat format, const QString &str);
+
+// a "pattern" attribute compiled to match whole strings, like QRegExp::exactMatch() did
+QRegularExpression schemaPattern(const QString &pattern);
+
+QT_END_NAMESPACE_JSONSTREAM
+
+#endif // SCHEMAFORMAT_P_H
@@ -58,66 +58,152 @@ bool SchemaManager<T,TT>::contains(const QString &name) const
 template<class T, class TT>
 T SchemaManager<T,TT>::value(const QString &name) const
 {
-    return m_schemas.value(name).first;
+    return m_schemas.value(name).object;
 }
 
 template<class T, class TT>
 SchemaValidation::Schema<TT> SchemaManager<T,TT>::schema(const QString &schemaName, TypesService *service)
 {
-    MapSchemaPair schemaPair = m_schemas.value(schemaName);
-    ensureCompiled(schemaName, &schemaPair, service);
-    return schemaPair.second;
+    typename QMap<QString, SchemaEntry>::iterator it = m_schemas.find(schemaName);
+    if (it == m_schemas.end())
+        return SchemaValidation::Schema<TT>();
+    ensureCompiled(&it.value(), service);
+    return it.value().schema;
 }
 
 template<class T, class TT>
 T SchemaManager<T,TT>::take(const QString &name)
 {
-    return m_schemas.take(name).first;
+    return m_schemas.take(name).object;
 }
 
 template<class T, class TT>
 T SchemaManager<T,TT>::insert(const QString &name, T &schema)
 {
-    m_schemas.insert(name, qMakePair(schema, SchemaValidation::Schema<TT>()));
+    SchemaEntry entry;
+    entry.object = schema;
+    m_schemas.insert(name, entry);
     return T();
 }
 
 template<class T, class TT>
-inline T SchemaManager<T,TT>::ensureCompiled(const QString &schemaName, MapSchemaPair *pair, TypesService *callbacks)
+T SchemaManager<T,TT>::insert(const QString &name, T &schema, const typename TT::Program &program)
 {
-    SchemaValidation::Schema<TT> schema(pair->second);
-    if (schema.hasErrors())
+    SchemaEntry entry;
+    entry.object = schema;
+    entry.program = program;
+    m_schemas.insert(name, entry);
+    return T();
+}
+
+// entries are updated in place, the map is never changed while a schema compiles
+template<class T, class TT>
+inline T SchemaManager<T,TT>::ensureCompiled(SchemaEntry *entry, TypesService *callbacks)
+{
+    if (entry->schema.hasErrors())
     {
         callbacks->setLoadError(QStringLiteral("Schema errors found. Schema can not be loaded properly."));
         return callbacks->error();
     }
-    else if (!schema.isValid()) {
+    else if (!entry->compiled) {
         // Try to compile schema
-        typename TT::Object schemaObject(pair->first);
-        SchemaValidation::Schema<TT> compiledSchema = SchemaValidation::Schema<TT>::compile(schemaObject, callbacks);
-        pair->second = compiledSchema;
-        m_schemas.insert(schemaName, *pair);
-        return callbacks->error();
+        typename TT::Object schemaObject(entry->object);
+        entry->schema = SchemaValidation::Schema<TT>::compile(schemaObject, callbacks);
+        entry->compiled = true;
+        if (!callbacks->error().isEmpty())
+            return callbacks->error();
+    }
+
+    if (m_useCompiledSchemas && entry->program.isNull()) {
+        // the Check tree has reported any schema errors, flatten it now
+        entry->program = TT::Program::compile(entry->object);
     }
     return T();
 }
 
 template<class T, class TT>
-inline T SchemaManager<T,TT>::validate(const QString &schemaName, T object)
+inline T SchemaManager<T,TT>::validate(const QString &schemaName, const T &object)
+{
+    typename QMap<QString, SchemaEntry>::iterator it = m_schemas.find(schemaName);
+    if (it == m_schemas.end()) {
+        TypesService callbacks(this);
+        callbacks.setValidationError(QString::fromLatin1("Schema '%1' not found.").arg(schemaName));
+        return callbacks.error();
+    }
+
+    SchemaEntry &entry = it.value();
+    if (!entry.compiled || entry.schema.hasErrors() || (m_useCompiledSchemas && entry.program.isNull())) {
+        TypesService callbacks(this);
+        const T error = ensureCompiled(&entry, &callbacks);
+        if (!error.isEmpty())
+            return error;
+    }
+    return check(entry.schema, m_useCompiledSchemas ? &entry.program : 0, object);
+}
+
+template<class T, class TT>
+inline bool SchemaManager<T,TT>::validateCompiled(const QString &schemaName, const T &object, T *error) const
+{
+    typename QMap<QString, SchemaEntry>::const_iterator it = m_schemas.constFind(schemaName);
+    if (it == m_schemas.constEnd())
+        return false;
+
+    const SchemaEntry &entry = it.value();
+    if (!entry.compiled || entry.schema.hasErrors() || (m_useCompiledSchemas && entry.program.isNull()))
+        return false;
+    *error = check(entry.schema, m_useCompiledSchemas ? &entry.program : 0, object);
+    return true;
+}
+
+template<class T, class TT>
+inline T SchemaManager<T,TT>::compile(const QString &schemaName, SchemaValidation::Schema<TT> *schema,
+                                      typename TT::Program *program)
 {
     TypesService callbacks(this);
-    if (!contains(schemaName)) {
+    typename QMap<QString, SchemaEntry>::iterator it = m_schemas.find(schemaName);
+    if (it == m_schemas.end()) {
         callbacks.setValidationError(QString::fromLatin1("Schema '%1' not found.").arg(schemaName));
         return callbacks.error();
     }
 
-    MapSchemaPair schemaPair = m_schemas.value(schemaName);
-    if (ensureCompiled(schemaName, &schemaPair, &callbacks).isEmpty()) {
-        // schema compiled successfully can validate an object
-        SchemaValidation::Schema<TT> schema(schemaPair.second);
-        typename TT::Value rootObject(QString(), object);
-        schema.check(rootObject, &callbacks);
+    const T error = ensureCompiled(&it.value(), &callbacks);
+    if (error.isEmpty()) {
+        *schema = it.value().schema;
+        *program = m_useCompiledSchemas ? it.value().program : typename TT::Program();
     }
+    return error;
+}
+
+template<class T, class TT>
+inline void SchemaManager<T,TT>::precompile(const QString &schemaName)
+{
+    typename QMap<QString, SchemaEntry>::iterator it = m_schemas.find(schemaName);
+    if (it != m_schemas.end() && !it.value().schema.hasErrors()) {
+        TypesService callbacks(this);
+        ensureCompiled(&it.value(), &callbacks);
+    }
+}
+
+/*
+  Validates \a object with \a program, or with the Check tree of \a schema if there
+  is no valid program.  Returns an empty object, without allocating, if it is valid.
+*/
+template<class T, class TT>
+inline T SchemaManager<T,TT>::check(const SchemaValidation::Schema<TT> &schema, const typename TT::Program *program,
+                                    const T &object)
+{
+    if (program && program->isValid()) {
+        QString message;
+        if (program->check(object, &message))
+            return T();
+        TypesService callbacks(0);
+        callbacks.setValidationError(message);
+        return callbacks.error();
+    }
+
+    TypesService callbacks(0);
+    typename TT::Value rootObject(QString(), object);
+    schema.check(rootObject, &callbacks);
     return callbacks.error();
 }
 
@@ -125,9 +211,9 @@ template<class T, class TT>
 inline QMap<QString, T> SchemaManager<T,TT>::schemas() const
 {
     QMap<QString, T> map;
-    typename QMap<QString, MapSchemaPair>::const_iterator it(m_schemas.constBegin());
+    typename QMap<QString, SchemaEntry>::const_iterator it(m_schemas.constBegin());
     while (it != m_schemas.constEnd()) {
-        map.insert(it.key(), it.value().first);
+        map.insert(it.key(), it.value().object);
         ++it;
     }
     return map;
@@ -64,13 +64,31 @@ class SchemaManager : public SchemaManagerBase
 public:
     typedef typename TT::Service TypesService;
 
+    SchemaManager() : m_useCompiledSchemas(true) {}
+
     inline bool contains(const QString &name) const;
     inline T value(const QString &name) const;
     inline SchemaValidation::Schema<TT> schema(const QString &name, TypesService *service);
     inline T take(const QString &name);
     inline T insert(const QString &name, T &schema);
+    // adds a schema whose program was compiled beforehand
+    inline T insert(const QString &name, T &schema, const typename TT::Program &program);
+
+    inline T validate(const QString &schemaName, const T &object);
+    // validates only if the schema is compiled already, changes nothing and so may
+    // run in several threads at once; returns false if validate() has to be used
+    inline bool validateCompiled(const QString &schemaName, const T &object, T *error) const;
 
-    inline T validate(const QString &schemaName, T object);
+    // compiles a schema ahead of its first use, errors are reported when it is used
+    inline void precompile(const QString &schemaName);
+    // resolves a schema for validating with check() without further lookups
+    inline T compile(const QString &schemaName, SchemaValidation::Schema<TT> *schema,
+                     typename TT::Program *program);
+    static inline T check(const SchemaValidation::Schema<TT> &schema, const typename TT::Program *program,
+                          const T &object);
+
+    bool useCompiledSchemas() const { return m_useCompiledSchemas; }
+    void setUseCompiledSchemas(bool use) { m_useCompiledSchemas = use; }
 
     QStringList names() const { return m_schemas.keys(); }
     inline QMap<QString, T> schemas() const;
@@ -79,10 +97,20 @@ public:
     void clear() { m_schemas.clear(); }
 
 private:
-    typedef QPair<T, SchemaValidation::Schema<TT> > MapSchemaPair;
-    inline T ensureCompiled(const QString &schemaName, MapSchemaPair *pair, TypesService *service);
-
-    QMap<QString, MapSchemaPair> m_schemas;
+    // the schema source, its Check tree and, once used, its compiled program
+    struct SchemaEntry
+    {
+        SchemaEntry() : compiled(false) {}
+
+        T object;
+        SchemaValidation::Schema<TT> schema;
+        typename TT::Program program;
+        bool compiled;
+    };
+    inline T ensureCompiled(SchemaEntry *entry, TypesService *service);
+
+    QMap<QString, SchemaEntry> m_schemas;
+    bool m_useCompiledSchemas;
 };
 
 QT_END_NAMESPACE_JSONSTREAM
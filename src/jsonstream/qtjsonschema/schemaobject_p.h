@@ -186,6 +186,18 @@ class SchemaPrivate : public QSharedData
         QSharedPointer< Schema<T> > m_additionalSchema;
     };
 
+    // the state of one check() of a schema, shared by the checks of its properties
+    class CheckContext
+    {
+    public:
+        CheckContext(Service *callbacks)
+            : m_callbacks(callbacks)
+            , m_requiredCount(0)
+        {}
+        Service *m_callbacks;
+        qint32 m_requiredCount;
+    };
+
     class Check {
     public:
         Check(SchemaPrivate *schema, QSharedPointer<CheckSharedData> &data, const char* errorMessage)
@@ -197,14 +209,14 @@ class SchemaPrivate : public QSharedData
             Q_ASSERT(errorMessage);
         }
         virtual ~Check() {}
-        bool check(const Value& value)
+        bool check(const Value& value, CheckContext &context)
         {
-            bool result = doCheck(value);
+            bool result = doCheck(value, context);
             if (!result) {
                 // TODO it is tricky, as we do not have access to source code of this schema.
                 // maybe we can set "additional, hidden " source property in each schema property, or some nice hash?
-                m_schema->m_callbacks->setValidationError(QLatin1String("Schema validation error: ") +
-                                                          QString::fromLatin1(m_errorMessage).arg(value.data()));
+                context.m_callbacks->setValidationError(QLatin1String("Schema validation error: ") +
+                                                       QString::fromLatin1(m_errorMessage).arg(value.data()));
             }
             return result;
         }
@@ -218,7 +230,7 @@ class SchemaPrivate : public QSharedData
         QSharedPointer<CheckSharedData> m_data; // is used to exchange information between attributes
 
         // return true if it is ok
-        virtual bool doCheck(const Value&) = 0;
+        virtual bool doCheck(const Value&, CheckContext &context) = 0;
     private:
         const char *m_errorMessage;
     };
@@ -272,12 +284,10 @@ class SchemaPrivate : public QSharedData
     class CheckDescription;
 
     inline Check *createCheckPoint(const Key &key, const Value &value, QSharedPointer<CheckSharedData> &data);
-    inline bool check(const Value &value) const;
 
 public:
     SchemaPrivate()
         : m_maxRequired(0)
-        , m_requiredCount(0)
         , m_callbacks(0)
         , m_bLoadError(false)
     {}
@@ -322,8 +332,7 @@ public:
 private:
     QVarLengthArray<Check *, 4> m_checks;
     qint32 m_maxRequired;
-    mutable qint32 m_requiredCount;
-    mutable Service *m_callbacks;
+    Service *m_callbacks; // only set while compiling
     bool m_bLoadError;
 };
 
@@ -0,0 +1,828 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "schemaprogram_p.h"
+#include "schemaformat_p.h"
+#include "schemaenumindex_p.h"
+
+#include <QtCore/qhash.h>
+#include <QtCore/qregularexpression.h>
+#include <QtCore/qvector.h>
+#include <QJsonArray>
+#include <QStringList>
+#include <QDebug>
+
+#include <math.h>
+
+QT_BEGIN_NAMESPACE_JSONSTREAM
+
+// one opcode for each check in checkpoints_p.h that does any work
+enum SchemaOpCode {
+    OpType,
+    OpProperties,
+    OpAdditionalProperties,
+    OpItems,
+    OpAdditionalItems,
+    OpRequired,
+    OpMinimum,
+    OpMaximum,
+    OpMinItems,
+    OpMaxItems,
+    OpPattern,
+    OpMinLength,
+    OpMaxLength,
+    OpEnum,
+    OpFormat,
+    OpDivisibleBy,
+    OpExtends,
+    OpRef
+};
+
+// indexed by SchemaOpCode; the messages of the matching checks
+static const char * const kSchemaOpMessages[] = {
+    "Type check failed for %1",
+    "Properties check failed for %1",
+    "Additional properties check failed for %1",
+    "Items check failed for %1",
+    "Additional items check failed for %1",
+    "Check required field",
+    "Minimum check failed for %1",
+    "Maximum check failed for %1",
+    "Minimum item count check failed for %1",
+    "Maximum item count check failed for %1",
+    "Pattern check failed for %1",
+    "Minimal string length check failed for %1",
+    "Maximal string length check failed for %1",
+    "Enum check failed for %1",
+    "Enum format failed for %1",
+    "DivisibleBy check failed for %1",
+    "Extends check failed for %1",
+    "$Ref check failed for %1"
+};
+
+// same values as CheckType::Type
+enum SchemaValueType {
+    StringType = 0x0001,
+    NumberType = 0x0002,
+    IntegerType = 0x0004,
+    BooleanType = 0x0008,
+    ObjectType = 0x0010,
+    ArrayType = 0x0020,
+    NullType = 0x0040,
+    AnyType = 0x0080,
+    SelfRefType = 0x0100
+};
+
+// same values as CheckSharedData::Flag
+enum SchemaCheckFlag {
+    ExclusiveMinimum = 0x1,
+    ExclusiveMaximum = 0x2,
+    NoAdditionalProperties = 0x4,
+    NoAdditionalItems = 0x8,
+    HasItems = 0x10,
+    HasProperties = 0x20
+};
+
+// property tables up to this size are searched linearly
+const int knLinearLookupLimit = 8;
+
+class SchemaProgramData : public QSharedData
+{
+public:
+    struct Instruction
+    {
+        quint8 op;
+        quint8 flags;       // SchemaCheckFlags shared by the checks of one property
+        qint32 arg;         // immediate operand or index into one of the pools below
+        qint32 additional;  // schema for additionalProperties/additionalItems, or -1
+    };
+
+    struct CodeRange
+    {
+        int begin;
+        int end;
+    };
+
+    // a schema with its own required count, SchemaPrivate in the Check tree
+    struct SubSchema
+    {
+        CodeRange code;
+        int maxRequired;
+    };
+
+    struct PropertyEntry
+    {
+        int key;
+        CodeRange code;
+    };
+
+    struct PropertyTable
+    {
+        int begin;
+        int end;
+        QHash<QString, int> index; // only for tables above knLinearLookupLimit
+    };
+
+    struct ItemsTable
+    {
+        int begin;
+        int end;
+        bool list;
+    };
+
+    SchemaProgramData() : m_supported(true) {}
+
+    QVector<Instruction>        m_code;
+    QVector<SubSchema>          m_schemas; // the root schema is 0
+    QVector<QString>            m_keys;
+    QVector<PropertyEntry>      m_properties;
+    QVector<PropertyTable>      m_propertyTables;
+    QVector<int>                m_itemSchemas;
+    QVector<ItemsTable>         m_itemsTables;
+    QVector<double>             m_numbers;
+    QVector<QRegularExpression> m_patterns;
+    QVector<SchemaEnumIndex>    m_enums;
+    bool                        m_supported;
+};
+
+typedef SchemaProgramData::Instruction SchemaInstruction;
+typedef SchemaProgramData::CodeRange SchemaCodeRange;
+
+/****************************************************************************/
+
+class SchemaProgramCompiler
+{
+public:
+    explicit SchemaProgramCompiler(SchemaProgramData *data) : d(data), m_schema(0) {}
+
+    int compileSchema(const QJsonObject &schema);
+
+private:
+    SchemaCodeRange compileChecks(const QJsonObject &checks);
+    int internKey(const QString &key);
+    int propertyTable(const QJsonObject &properties);
+    int itemsTable(const QJsonValue &items);
+    static uint typeMask(const QJsonValue &type);
+    static bool toBoolean(const QJsonValue &value);
+
+    SchemaProgramData *d;
+    QHash<QString, int> m_keyIds;
+    int m_schema; // the schema "required" checks count towards
+};
+
+int SchemaProgramCompiler::compileSchema(const QJsonObject &schema)
+{
+    const int id = d->m_schemas.size();
+    SchemaProgramData::SubSchema sub;
+    sub.code.begin = sub.code.end = 0;
+    sub.maxRequired = 0;
+    d->m_schemas.append(sub);
+
+    const int enclosing = m_schema;
+    m_schema = id;
+    const SchemaCodeRange code = compileChecks(schema);
+    m_schema = enclosing;
+
+    d->m_schemas[id].code = code;
+    return id;
+}
+
+/*
+  Compiles the checks of one schema or one property.  Checks that have nothing to
+  do at validation time (title, description, default, exclusive flags) are dropped;
+  nested schemas and properties are compiled first so each range stays contiguous.
+*/
+SchemaCodeRange SchemaProgramCompiler::compileChecks(const QJsonObject &checks)
+{
+    QVector<SchemaInstruction> group;
+    quint8 flags = 0;
+    int additional = -1;
+
+    for (QJsonObject::const_iterator it = checks.constBegin(); it != checks.constEnd(); ++it) {
+        const QString key = it.key().toLower();
+        const QJsonValue value = it.value();
+
+        SchemaInstruction instruction;
+        instruction.arg = 0;
+
+        if (key == QLatin1String("type")) {
+            instruction.op = OpType;
+            instruction.arg = typeMask(value);
+            if (!instruction.arg)
+                continue; // an unknown type matches anything
+        } else if (key == QLatin1String("properties")) {
+            instruction.op = OpProperties;
+            instruction.arg = propertyTable(value.toObject());
+            flags |= HasProperties;
+        } else if (key == QLatin1String("additionalproperties")) {
+            instruction.op = OpAdditionalProperties;
+            if (value.isBool() && !value.toBool())
+                flags |= NoAdditionalProperties;
+            else if (value.isObject())
+                additional = compileSchema(value.toObject());
+        } else if (key == QLatin1String("items")) {
+            instruction.op = OpItems;
+            instruction.arg = itemsTable(value);
+            flags |= HasItems;
+        } else if (key == QLatin1String("additionalitems")) {
+            instruction.op = OpAdditionalItems;
+            if (value.isBool() && !value.toBool())
+                flags |= NoAdditionalItems;
+            else if (value.isObject())
+                additional = compileSchema(value.toObject());
+        } else if (key == QLatin1String("required")) {
+            if (!toBoolean(value))
+                continue;
+            instruction.op = OpRequired;
+            d->m_schemas[m_schema].maxRequired++;
+        } else if (key == QLatin1String("minimum") || key == QLatin1String("maximum")) {
+            instruction.op = key == QLatin1String("minimum") ? OpMinimum : OpMaximum;
+            instruction.arg = d->m_numbers.size();
+            d->m_numbers.append(value.toDouble());
+        } else if (key == QLatin1String("exclusiveminimum")) {
+            if (toBoolean(value))
+                flags |= ExclusiveMinimum;
+            continue;
+        } else if (key == QLatin1String("exclusivemaximum")) {
+            if (toBoolean(value))
+                flags |= ExclusiveMaximum;
+            continue;
+        } else if (key == QLatin1String("minitems") || key == QLatin1String("maxitems")) {
+            instruction.op = key == QLatin1String("minitems") ? OpMinItems : OpMaxItems;
+            instruction.arg = (int)value.toDouble();
+        } else if (key == QLatin1String("minlength") || key == QLatin1String("maxlength")) {
+            instruction.op = key == QLatin1String("minlength") ? OpMinLength : OpMaxLength;
+            instruction.arg = (int)value.toDouble();
+        } else if (key == QLatin1String("pattern")) {
+            instruction.op = OpPattern;
+            instruction.arg = d->m_patterns.size();
+            d->m_patterns.append(schemaPattern(value.toString()));
+        } else if (key == QLatin1String("enum")) {
+            instruction.op = OpEnum;
+            instruction.arg = d->m_enums.size();
+            d->m_enums.append(SchemaEnumIndex(value.toArray()));
+        } else if (key == QLatin1String("format")) {
+            instruction.op = OpFormat;
+            instruction.arg = schemaFormat(value.toString());
+            if (instruction.arg == FormatNone)
+                continue; // formats without a check always match
+        } else if (key == QLatin1String("divisibleby")) {
+            instruction.op = OpDivisibleBy;
+            instruction.arg = d->m_numbers.size();
+            d->m_numbers.append(value.toDouble());
+        } else if (key == QLatin1String("extends")) {
+            instruction.op = OpExtends;
+            if (value.isObject()) {
+                instruction.arg = compileSchema(value.toObject());
+                group.append(instruction);
+            } else if (value.isArray()) {
+                const QJsonArray array = value.toArray();
+                for (QJsonArray::const_iterator i = array.constBegin(); i != array.constEnd(); ++i) {
+                    instruction.arg = compileSchema((*i).toObject());
+                    group.append(instruction);
+                }
+            } else if (value.isString() && value.toString().isEmpty()) {
+                d->m_supported = false; // extends a schema by name
+            }
+            continue;
+        } else if (key == QLatin1String("$ref")) {
+            if (value.toString() != QLatin1String("#")) {
+                d->m_supported = false; // refers to another schema by name
+                continue;
+            }
+            instruction.op = OpRef;
+        } else {
+            continue;
+        }
+        group.append(instruction);
+    }
+
+    for (int i = 0; i < group.size(); ++i) {
+        group[i].flags = flags;
+        group[i].additional = additional;
+    }
+
+    SchemaCodeRange range;
+    range.begin = d->m_code.size();
+    d->m_code += group;
+    range.end = d->m_code.size();
+    return range;
+}
+
+int SchemaProgramCompiler::internKey(const QString &key)
+{
+    QHash<QString, int>::const_iterator it = m_keyIds.constFind(key);
+    if (it != m_keyIds.constEnd())
+        return it.value();
+    const int id = d->m_keys.size();
+    d->m_keys.append(key);
+    m_keyIds.insert(key, id);
+    return id;
+}
+
+int SchemaProgramCompiler::propertyTable(const QJsonObject &properties)
+{
+    QVector<SchemaProgramData::PropertyEntry> entries;
+    entries.reserve(properties.size());
+    for (QJsonObject::const_iterator it = properties.constBegin(); it != properties.constEnd(); ++it) {
+        SchemaProgramData::PropertyEntry entry;
+        entry.key = internKey(it.key());
+        entry.code = compileChecks(it.value().toObject()); // same schema, required counts here
+        entries.append(entry);
+    }
+
+    SchemaProgramData::PropertyTable table;
+    table.begin = d->m_properties.size();
+    d->m_properties += entries;
+    table.end = d->m_properties.size();
+    if (entries.size() > knLinearLookupLimit) {
+        for (int i = table.begin; i < table.end; ++i)
+            table.index.insert(d->m_keys.at(d->m_properties.at(i).key), i);
+    }
+    d->m_propertyTables.append(table);
+    return d->m_propertyTables.size() - 1;
+}
+
+int SchemaProgramCompiler::itemsTable(const QJsonValue &items)
+{
+    QVector<int> schemas;
+    SchemaProgramData::ItemsTable table;
+    table.list = items.isArray();
+    if (items.isObject()) {
+        schemas.append(compileSchema(items.toObject()));
+    } else if (table.list) {
+        const QJsonArray array = items.toArray();
+        for (QJsonArray::const_iterator i = array.constBegin(); i != array.constEnd(); ++i) {
+            if ((*i).isObject())
+                schemas.append(compileSchema((*i).toObject()));
+        }
+    } else {
+        d->m_supported = false; // no schema to check the items with
+    }
+
+    table.begin = d->m_itemSchemas.size();
+    d->m_itemSchemas += schemas;
+    table.end = d->m_itemSchemas.size();
+    d->m_itemsTables.append(table);
+    return d->m_itemsTables.size() - 1;
+}
+
+uint SchemaProgramCompiler::typeMask(const QJsonValue &type)
+{
+    uint mask = 0;
+    QStringList names;
+    if (type.isString()) {
+        names << type.toString();
+    } else {
+        const QJsonArray types = type.toArray();
+        for (QJsonArray::const_iterator i = types.constBegin(); i != types.constEnd(); ++i) {
+            if ((*i).isString())
+                names << (*i).toString();
+            else if ((*i).toObject().value(QStringLiteral("$ref")).toString() == QLatin1String("#"))
+                mask |= ObjectType | SelfRefType;
+        }
+    }
+
+    foreach (const QString &name, names) {
+        const QString lower = name.toLower();
+        if (lower == QLatin1String("string"))
+            mask |= StringType;
+        else if (lower == QLatin1String("number"))
+            mask |= NumberType | IntegerType;
+        else if (lower == QLatin1String("integer"))
+            mask |= IntegerType;
+        else if (lower == QLatin1String("boolean"))
+            mask |= BooleanType;
+        else if (lower == QLatin1String("object"))
+            mask |= ObjectType;
+        else if (lower == QLatin1String("array"))
+            mask |= ArrayType;
+        else if (lower == QLatin1String("any"))
+            mask |= AnyType;
+        else if (lower == QLatin1String("null"))
+            mask |= NullType;
+    }
+    return mask;
+}
+
+// also accepts "true" and "false" strings, like the Check tree
+bool SchemaProgramCompiler::toBoolean(const QJsonValue &value)
+{
+    if (value.isBool())
+        return value.toBool();
+    return value.toString().toLower() == QLatin1String("true");
+}
+
+/****************************************************************************/
+
+/*
+  Runs a program over a value.  The root object is special: the Check tree lets it
+  pass as an empty string or list as well, so every helper takes a root flag.
+*/
+class SchemaProgramRunner
+{
+public:
+    explicit SchemaProgramRunner(const SchemaProgramData *data) : d(data), m_message(0) {}
+
+    bool runSchema(int schema, const QJsonValue &value, bool root);
+    QString errorMessage() const;
+
+private:
+    bool runChecks(const SchemaCodeRange &code, const QJsonValue &value, bool root, int *required);
+    bool execute(const SchemaInstruction &instruction, const QJsonValue &value, bool root, int *required);
+    int findProperty(const SchemaProgramData::PropertyTable &table, const QString &key) const;
+
+    const SchemaProgramData *d;
+    const char *m_message; // 0 if a required field is missing
+    QJsonValue m_value;
+};
+
+static inline bool isInteger(const QJsonValue &value, bool root)
+{
+    if (root || !value.isDouble())
+        return false;
+    const double d = value.toDouble();
+    return (double)(int)d == d;
+}
+
+// CheckType::findType
+static inline uint typeOf(const QJsonValue &value, bool root, uint mask)
+{
+    switch (mask) {
+    case StringType:
+        if (root || value.isString())
+            return StringType;
+        break;
+    case NumberType:
+        if (!root && value.isDouble())
+            return NumberType;
+        break;
+    case IntegerType:
+        if (isInteger(value, root))
+            return IntegerType;
+        break;
+    case BooleanType:
+        if (!root && value.isBool())
+            return BooleanType;
+        break;
+    case ObjectType:
+        if (root || value.isObject())
+            return ObjectType;
+        break;
+    case NullType:
+        if (!root && value.isNull())
+            return NullType;
+        break;
+    case AnyType:
+        return AnyType;
+    default:
+        break;
+    }
+
+    if (isInteger(value, root))
+        return IntegerType;
+    if (!root && value.isDouble())
+        return NumberType;
+    if (root || value.isObject())
+        return ObjectType;
+    if (value.isString())
+        return StringType;
+    if (value.isBool())
+        return BooleanType;
+    if (value.isArray())
+        return ArrayType;
+    return AnyType;
+}
+
+bool SchemaProgramRunner::runSchema(int schema, const QJsonValue &value, bool root)
+{
+    const SchemaProgramData::SubSchema &sub = d->m_schemas.at(schema);
+    int required = 0;
+    if (!runChecks(sub.code, value, root, &required))
+        return false;
+    if (required != sub.maxRequired) {
+        m_message = 0;
+        return false;
+    }
+    return true;
+}
+
+bool SchemaProgramRunner::runChecks(const SchemaCodeRange &code, const QJsonValue &value, bool root, int *required)
+{
+    const SchemaInstruction *instructions = d->m_code.constData();
+    for (int i = code.begin; i < code.end; ++i) {
+        if (!execute(instructions[i], value, root, required)) {
+            m_message = kSchemaOpMessages[instructions[i].op];
+            m_value = value;
+            return false;
+        }
+    }
+    return true;
+}
+
+int SchemaProgramRunner::findProperty(const SchemaProgramData::PropertyTable &table, const QString &key) const
+{
+    if (table.end - table.begin > knLinearLookupLimit)
+        return table.index.value(key, -1);
+
+    const SchemaProgramData::PropertyEntry *entries = d->m_properties.constData();
+    for (int i = table.begin; i < table.end; ++i) {
+        if (d->m_keys.at(entries[i].key) == key)
+            return i;
+    }
+    return -1;
+}
+
+bool SchemaProgramRunner::execute(const SchemaInstruction &instruction, const QJsonValue &value, bool root, int *required)
+{
+    switch (instruction.op) {
+    case OpType:
+        return typeOf(value, root, instruction.arg) & instruction.arg;
+
+    case OpProperties: {
+        if (!root && !value.isObject())
+            return false;
+        const QJsonObject object = value.toObject();
+        const SchemaProgramData::PropertyTable &table = d->m_propertyTables.at(instruction.arg);
+
+        // look the listed properties up rather than the object's keys, which would
+        // have to be copied out; only the outermost failing check names the error,
+        // so the order does not show
+        const SchemaProgramData::PropertyEntry *entries = d->m_properties.constData();
+        const QJsonObject::const_iterator end = object.constEnd();
+        int found = 0;
+        for (int i = table.begin; i < table.end; ++i) {
+            const QJsonObject::const_iterator it = object.constFind(d->m_keys.at(entries[i].key));
+            if (it != end) {
+                ++found;
+                if (!runChecks(entries[i].code, it.value(), false, required))
+                    return false;
+            }
+        }
+        if (found == object.size())
+            return true;
+
+        // the object has properties the schema does not list
+        if (instruction.flags & NoAdditionalProperties)
+            return false;
+        if (instruction.additional >= 0) {
+            for (QJsonObject::const_iterator it = object.constBegin(); it != end; ++it) {
+                if (findProperty(table, it.key()) < 0 && !runSchema(instruction.additional, it.value(), false))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    case OpAdditionalProperties: {
+        // most of the time the check is done by OpProperties
+        if (instruction.flags & (HasProperties | HasItems))
+            return true;
+        if (root || value.isArray())
+            return true;
+        if (instruction.flags & NoAdditionalProperties)
+            return false;
+        if (instruction.additional >= 0) {
+            if (!value.isObject())
+                return false;
+            const QJsonObject object = value.toObject();
+            for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it) {
+                if (!runSchema(instruction.additional, it.value(), false))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    case OpItems: {
+        const SchemaProgramData::ItemsTable &table = d->m_itemsTables.at(instruction.arg);
+        const int count = table.end - table.begin;
+        if (!root && !value.isArray()) {
+            if (value.isObject() && count >= 1)
+                return runSchema(d->m_itemSchemas.at(table.begin), value, root);
+            return false;
+        }
+
+        const QJsonArray array = root ? QJsonArray() : value.toArray();
+        if ((instruction.flags & NoAdditionalItems) && table.list && array.size() > count)
+            return false;
+        for (int i = 0; i < array.size(); ++i) {
+            int schema;
+            if (!table.list)
+                schema = d->m_itemSchemas.at(table.begin);
+            else if (i < count)
+                schema = d->m_itemSchemas.at(table.begin + i);
+            else if (instruction.additional >= 0)
+                schema = instruction.additional;
+            else
+                return true; // nothing to validate with
+            if (!runSchema(schema, array.at(i), false))
+                return false;
+        }
+        return true;
+    }
+
+    case OpAdditionalItems: {
+        // most of the time the check is done by OpItems
+        if (instruction.flags & HasItems)
+            return true;
+        if (instruction.flags & NoAdditionalItems)
+            return false;
+        if (instruction.additional >= 0 && !root) {
+            if (!value.isArray())
+                return false;
+            const QJsonArray array = value.toArray();
+            for (int i = 0; i < array.size(); ++i) {
+                if (!runSchema(instruction.additional, array.at(i), false))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    case OpRequired:
+        ++*required;
+        return true;
+
+    case OpMinimum:
+    case OpMaximum: {
+        if (root || !value.isDouble())
+            return false;
+        const double number = value.toDouble();
+        const double limit = d->m_numbers.at(instruction.arg);
+        if (instruction.op == OpMinimum)
+            return (instruction.flags & ExclusiveMinimum) ? number > limit : number >= limit;
+        return (instruction.flags & ExclusiveMaximum) ? number < limit : number <= limit;
+    }
+
+    case OpMinItems:
+    case OpMaxItems: {
+        if (!root && !value.isArray())
+            return false;
+        const int count = root ? 0 : value.toArray().size();
+        return instruction.op == OpMinItems ? count >= instruction.arg : count <= instruction.arg;
+    }
+
+    case OpPattern: {
+        if (!root && !value.isString())
+            return true;
+        return d->m_patterns.at(instruction.arg).match(root ? QString() : value.toString()).hasMatch();
+    }
+
+    case OpMinLength:
+    case OpMaxLength: {
+        if (!root && !value.isString())
+            return true;
+        const int length = root ? 0 : value.toString().length();
+        return instruction.op == OpMinLength ? length >= instruction.arg : length <= instruction.arg;
+    }
+
+    case OpEnum:
+        return d->m_enums.at(instruction.arg).contains(root ? QJsonValue() : value);
+
+    case OpFormat: {
+        if (instruction.arg == FormatNonNegativeInteger)
+            return isInteger(value, root) && value.toDouble() >= 0;
+        if (!root && !value.isString())
+            return false;
+        const QString str = root ? QString() : value.toString();
+        if (str.isEmpty())
+            return true;
+        return checkSchemaFormat(SchemaFormat(instruction.arg), str);
+    }
+
+    case OpDivisibleBy: {
+        if (root || !value.isDouble())
+            return false;
+        const double divisor = d->m_numbers.at(instruction.arg);
+        return divisor != 0 && fmod(value.toDouble(), divisor) == 0;
+    }
+
+    case OpExtends:
+        return runSchema(instruction.arg, value, root);
+
+    case OpRef:
+        return runSchema(0, value, root);
+    }
+    return true;
+}
+
+QString SchemaProgramRunner::errorMessage() const
+{
+    if (!m_message)
+        return QStringLiteral("Schema validation error: Required field is missing");
+
+    QString str;
+    QDebug(&str) << m_value;
+    return QLatin1String("Schema validation error: ") + QString::fromLatin1(m_message).arg(str);
+}
+
+/****************************************************************************/
+
+SchemaProgram::SchemaProgram()
+{
+}
+
+SchemaProgram::SchemaProgram(const SchemaProgram &other)
+    : d(other.d)
+{
+}
+
+SchemaProgram::~SchemaProgram()
+{
+}
+
+SchemaProgram &SchemaProgram::operator=(const SchemaProgram &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+  \internal
+  Compiles \a schema.  The result is never null, but it is not valid if the schema
+  needs features only the Check tree supports.
+*/
+SchemaProgram SchemaProgram::compile(const QJsonObject &schema)
+{
+    SchemaProgram program;
+    program.d = new SchemaProgramData;
+    SchemaProgramCompiler compiler(program.d.data());
+    compiler.compileSchema(schema);
+    return program;
+}
+
+/*!
+  \internal
+  Returns true if compile() has not been called for this program.
+*/
+bool SchemaProgram::isNull() const
+{
+    return !d;
+}
+
+/*!
+  \internal
+  Returns true if the program can be used to validate objects.
+*/
+bool SchemaProgram::isValid() const
+{
+    return d && d->m_supported;
+}
+
+/*!
+  \internal
+  Validates \a object and returns true if it matches the schema.  Otherwise
+  \a errorMessage is set to the message the Check tree would have reported.
+*/
+bool SchemaProgram::check(const QJsonObject &object, QString *errorMessage) const
+{
+    Q_ASSERT(isValid());
+    SchemaProgramRunner runner(d.data());
+    if (runner.runSchema(0, QJsonValue(object), true))
+        return true;
+    if (errorMessage)
+        *errorMessage = runner.errorMessage();
+    return false;
+}
+
+QT_END_NAMESPACE_JSONSTREAM
@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = jsonstream jsonschema jsonbuffer jsonconnection
+SUBDIRS = jsonstream jsonschema jsonbuffer jsonconnection jsonrpc
@@ -40,8 +40,14 @@
 ****************************************************************************/
 
 #include <QtTest>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QTextCodec>
+#include <QtEndian>
 
 #include "private/qjsonbuffer_p.h"
+#include "private/qjsoncbor_p.h"
+#include "private/qt-bson_p.h"
 
 QT_USE_NAMESPACE_JSONSTREAM
 
@@ -52,6 +58,19 @@ class tst_JsonBuffer : public QObject
 private slots:
     void utf8();
     void utf8extend();
+    void bsonCodec();
+    void bsonBuilder();
+    void bsonZeroCopy();
+    void bsonIteration();
+    void cborFraming();
+    void cborKeyDictionary();
+    void compressedFrames();
+    void benchmarkEncode_data();
+    void benchmarkEncode();
+    void benchmarkDecode_data();
+    void benchmarkDecode();
+    void benchmarkBsonArray_data();
+    void benchmarkBsonArray();
 };
 
 
@@ -120,6 +139,600 @@ void tst_JsonBuffer::utf8extend()
     QVERIFY(buf.size() == 0); // buffer should be empty at the end
 }
 
+static QJsonObject sampleMessage(int items)
+{
+    QJsonObject object;
+    object.insert("text", QStringLiteral("Standard text"));
+    object.insert("unicode", QString::fromUtf8("Gr\xc3\xb6\xc3\x9f" "e \xe2\x82\xac"));
+    object.insert(QString::fromUtf8("k\xc3\xa9y"), 1);
+    object.insert("int", 100);
+    object.insert("float", 100.5);
+    object.insert("true", true);
+    object.insert("false", false);
+    object.insert("null", QJsonValue());
+
+    QJsonArray array;
+    for (int i = 0; i < items; i++) {
+        QJsonObject item;
+        item.insert("index", i);
+        item.insert("name", QString::fromLatin1("item %1").arg(i));
+        QJsonArray tags;
+        tags.append(QStringLiteral("one"));
+        tags.append(QStringLiteral("two"));
+        tags.append(i % 2 == 0);
+        item.insert("tags", tags);
+        array.append(item);
+    }
+    object.insert("array", array);
+    return object;
+}
+
+static QByteArray encodeFrame(const QJsonObject &object, EncodingFormat format)
+{
+    QJsonDocument document(object);
+    QByteArray frame;
+    switch (format) {
+    case FormatQBJS:
+        frame = document.toBinaryData();
+        break;
+    case FormatUTF8:
+        frame = document.toJson();
+        break;
+    case FormatUTF16LE:
+        frame = QTextCodec::codecForName("UTF-16LE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(2);
+        break;
+    case FormatUTF32LE:
+        frame = QTextCodec::codecForName("UTF-32LE")->fromUnicode(QString::fromUtf8(document.toJson())).mid(4);
+        break;
+    case FormatBSON:
+        bsonAppendJsonObject(frame, object, "bson");
+        break;
+    case FormatFramedCBOR:
+        cborAppendFrame(frame, object);
+        break;
+    case FormatCBORDictionary: {
+        QJsonKeyDictionary dictionary;
+        cborAppendFrame(frame, object, &dictionary);
+    } break;
+    default:
+        break;
+    }
+    return frame;
+}
+
+// a document with \a depth levels of { "a": { "a": ... } }
+static QByteArray nestedBsonDocument(int depth)
+{
+    // every level adds a size, the type, the key and the terminating zero
+    QByteArray document;
+    document.reserve(8 * depth + 5);
+    for (int i = 0; i < depth; i++) {
+        uchar size[4];
+        qToLittleEndian<qint32>(8 * (depth - i) + 5, size);
+        document.append((const char *)size, 4);
+        document.append(char(0x03));
+        document.append("a", 2);
+    }
+    document.append("\x05\0\0\0\0", 5);
+    document.append(QByteArray(depth, 0));
+    return document;
+}
+
+void tst_JsonBuffer::bsonCodec()
+{
+    QJsonObject object = sampleMessage(3);
+
+    // the direct encoder produces the same bytes as the QVariantMap based one
+    QByteArray document;
+    bsonAppendJsonObject(document, object);
+    QCOMPARE(document, BsonObject(QJsonDocument(object).toVariant().toMap()).data());
+
+    QJsonObject decoded = bsonToJsonObject(document.constData(), document.size());
+    QVERIFY(decoded == object);
+    QVERIFY(QJsonDocument::fromVariant(BsonObject(document).toMap()).object() == object);
+
+    QJsonBuffer buf;
+    QByteArray frame = encodeFrame(object, FormatBSON);
+    QVERIFY(frame.startsWith("bson"));
+    buf.append(frame.left(frame.size() - 1));
+    QVERIFY(!buf.messageAvailable());
+    buf.append(frame.right(1));
+    QVERIFY(buf.messageAvailable());
+    QVERIFY(buf.format() == FormatBSON);
+    QVERIFY(buf.readMessage() == object);
+    QVERIFY(buf.size() == 0);
+
+    QTest::ignoreMessage(QtWarningMsg, "bsonToJsonObject: malformed BSON document");
+    QVERIFY(bsonToJsonObject(document.constData(), document.size() - 1).isEmpty());
+
+    // UTF-16 strings need not be aligned
+    QByteArray utf16("\x12\0\0\0\x13" "a\0" "\x06\0\0\0" "h\0i\0\0\0" "\0", 18);
+    QCOMPARE(bsonToJsonObject(utf16.constData(), utf16.size()).value("a").toString(), QStringLiteral("hi"));
+
+    // the length of a string has to cover its terminating zero
+    QByteArray unterminated("\x0f\0\0\0\x02" "s\0" "\x03\0\0\0" "abc" "\0", 15);
+    QTest::ignoreMessage(QtWarningMsg, "bsonToJsonObject: malformed BSON document");
+    QVERIFY(bsonToJsonObject(unterminated.constData(), unterminated.size()).isEmpty());
+
+    // documents received from a peer may be nested arbitrarily deep
+    QByteArray nested = nestedBsonDocument(512);
+    QVERIFY(!bsonToJsonObject(nested.constData(), nested.size()).isEmpty());
+    nested = nestedBsonDocument(100000);
+    QTest::ignoreMessage(QtWarningMsg, "bsonToJsonObject: documents nested too deeply");
+    QTest::ignoreMessage(QtWarningMsg, "bsonToJsonObject: malformed BSON document");
+    QVERIFY(bsonToJsonObject(nested.constData(), nested.size()).isEmpty());
+}
+
+void tst_JsonBuffer::bsonBuilder()
+{
+    QVariantMap nested;
+    nested.insert("list", QVariantList() << 1 << QStringLiteral("two") << QVariantMap());
+    QVariantMap map = QJsonDocument(sampleMessage(3)).toVariant().toMap();
+    map.insert("nested", nested);
+
+    // maps nested deeper than a bson_buffer can track are still encoded
+    QVariantMap deep;
+    deep.insert("leaf", true);
+    for (int i = 0; i < 40; i++) {
+        QVariantMap level;
+        level.insert("level", deep);
+        deep = level;
+    }
+    map.insert("deep", deep);
+
+    BsonObject bson(map);
+    QCOMPARE(bson.toMap(), map);
+    QCOMPARE(BsonObject(bson.data()).toMap(), map);
+
+    // inserting into an existing document merges, new values win
+    BsonObject merged(bson.data());
+    merged.insert(QStringLiteral("text"), QStringLiteral("replaced"));
+    merged.insert(QStringLiteral("added"), 5);
+    QCOMPARE(merged.value("text").toString(), QStringLiteral("replaced"));
+    QCOMPARE(merged.value("added").toInt(), 5);
+    QCOMPARE(merged.count(), map.size() + 1);
+
+    // array keys across digit boundaries, and the same document from both encoders
+    QVariantList numbers;
+    for (int i = 0; i < 1001; i++)
+        numbers.append(i * 0.5);
+    BsonObject array(numbers);
+    QCOMPARE(array.keys().at(10), QStringLiteral("10"));
+    QCOMPARE(array.keys().at(1000), QStringLiteral("1000"));
+    QCOMPARE(array.toList(), numbers);
+    QVariantMap wrapped;
+    wrapped.insert("numbers", numbers);
+    QCOMPARE(BsonObject(wrapped).data(), encodeFrame(QJsonObject::fromVariantMap(wrapped), FormatBSON).mid(4));
+}
+
+class RecordingVisitor : public BsonVisitor
+{
+public:
+    RecordingVisitor() : mCount(0), mSum(0), mStopAt(-1) {}
+
+    bool beginDocument(const char *key, bool isArray) {
+        mEvents << QString::fromLatin1("%1%2").arg(QLatin1String(key)).arg(isArray ? '[' : '{');
+        return true;
+    }
+    void endDocument(const char *key, bool isArray) {
+        mEvents << QString::fromLatin1("%1%2").arg(QLatin1String(key)).arg(isArray ? ']' : '}');
+    }
+    bool value(const char *key, const QVariant &value) {
+        if (mCount < 10)
+            mEvents << QString::fromLatin1("%1=%2").arg(QLatin1String(key)).arg(value.toString());
+        mSum += value.toDouble();
+        return ++mCount != mStopAt;
+    }
+
+    QStringList mEvents;
+    int         mCount;
+    double      mSum;
+    int         mStopAt;
+};
+
+void tst_JsonBuffer::bsonIteration()
+{
+    QVariantMap map;
+    map.insert("a", 1);
+    map.insert("b", QVariantMap());
+    map.insert("c", QVariantList() << true << QStringLiteral("two"));
+    BsonObject bson(map);
+
+    QStringList keys;
+    for (BsonObject::const_iterator it = bson.begin(); it != bson.end(); ++it)
+        keys << QString::fromUtf8(it.key());
+    QCOMPARE(keys, QStringList() << "a" << "b" << "c");
+    BsonObject::const_iterator it = bson.begin();
+    QCOMPARE(it.value().toInt(), 1);
+    it++;
+    QCOMPARE(it.type(), bson_object);
+    QVERIFY(it.subObject().isEmpty());
+    ++it;
+    QCOMPARE(it.value().toList(), map.value("c").toList());
+    QCOMPARE(it.subObject().toList(), map.value("c").toList());
+    QVERIFY(++it == bson.end());
+    QVERIFY(BsonObject().begin() == BsonObject().end());
+    QTest::ignoreMessage(QtWarningMsg, "BsonObject: incomplete BSON document");
+    BsonObject truncated = BsonObject::fromRawData("\x05\0", 2);
+    QVERIFY(truncated.begin() == truncated.end());
+    QVERIFY(truncated.begin().key().isEmpty());
+
+    RecordingVisitor visitor;
+    QVERIFY(bson.visit(&visitor));
+    QCOMPARE(visitor.mEvents, QStringList() << "a=1" << "b{" << "b}" << "c[" << "0=true" << "1=two" << "c]");
+
+    // a million numbers, read in place one at a time
+    const int knElements = 1000000;
+    bson_buffer buffer;
+    bson_buffer_init(&buffer);
+    bson_buffer_reserve(&buffer, knElements * 16);
+    bson_append_start_array(&buffer, "numbers");
+    char index[12] = "0";
+    for (int i = 0; i < knElements; i++) {
+        bson_append_double(&buffer, index, i);
+        bson_incnumstr(index);
+    }
+    bson_append_finish_object(&buffer);
+    char *data = bson_buffer_finish(&buffer);
+    int size;
+    bson_little_endian32(&size, data);
+    QByteArray document(data, size);
+    free(data);
+
+    BsonObject large(document);
+    BsonObject::const_iterator numbers = large.begin();
+    QCOMPARE(numbers.key(), QByteArray("numbers"));
+    BsonObject array = numbers.subObject();
+    int count = 0;
+    double sum = 0;
+    for (BsonObject::const_iterator i = array.begin(); i != array.end(); ++i) {
+        sum += i.value().toDouble();
+        count++;
+    }
+    QCOMPARE(count, knElements);
+    QCOMPARE(sum, (knElements - 1) * (knElements / 2.0));
+
+    RecordingVisitor counter;
+    QVERIFY(large.visit(&counter));
+    QCOMPARE(counter.mCount, knElements);
+    QCOMPARE(counter.mSum, sum);
+
+    RecordingVisitor stopper;
+    stopper.mStopAt = 3;
+    QVERIFY(!large.visit(&stopper));
+    QCOMPARE(stopper.mCount, 3);
+}
+
+void tst_JsonBuffer::bsonZeroCopy()
+{
+    QJsonObject object = sampleMessage(3);
+    QByteArray frame = encodeFrame(object, FormatBSON);
+
+    BsonObject raw = BsonObject::fromRawData(frame.constData() + 4, frame.size() - 4);
+    QVERIFY(raw.contains("text"));
+    QVERIFY(!raw.contains("missing"));
+    QCOMPARE(raw.value("text").toString(), QStringLiteral("Standard text"));
+    QCOMPARE(raw.subList("array").size(), 3);
+    QCOMPARE(raw.subList("array").at(1).value("index").toDouble(), 1.0);
+
+    QJsonBuffer buf;
+    buf.append(frame);
+    buf.append(frame);
+    for (int i = 0; i < 2; i++) {
+        QVERIFY(buf.messageAvailable());
+        int consumed;
+        BsonObject bson = buf.readBsonMessage(&consumed);
+        QCOMPARE(consumed, frame.size());
+        QCOMPARE(bson.value("unicode").toString(), object.value("unicode").toString());
+        QCOMPARE(bson.subObject("array").count(), 3);
+        QVERIFY(QJsonDocument::fromVariant(bson.toMap()).object() == object);
+    }
+    QVERIFY(!buf.messageAvailable());
+    QVERIFY(buf.size() == 0);
+
+    QTest::ignoreMessage(QtWarningMsg, "BsonObject: incomplete BSON document");
+    QVERIFY(BsonObject::fromRawData(frame.constData() + 4, frame.size() - 5).isEmpty());
+
+    // a document has to end with a zero byte
+    QByteArray unterminated = frame.mid(4);
+    unterminated[unterminated.size() - 1] = 'x';
+    QTest::ignoreMessage(QtWarningMsg, "BsonObject: incomplete BSON document");
+    QVERIFY(BsonObject::fromRawData(unterminated.constData(), unterminated.size()).isEmpty());
+    QTest::ignoreMessage(QtWarningMsg, "BsonObject: incomplete BSON document");
+    QVERIFY(BsonObject(unterminated).isEmpty());
+}
+
+void tst_JsonBuffer::cborFraming()
+{
+    QJsonObject object = sampleMessage(3);
+    object.insert("negative", -25);
+    object.insert("large", 4294967296.0);
+    object.insert("fraction", -0.125);
+
+    QByteArray frame = encodeFrame(object, FormatFramedCBOR);
+    QVERIFY(cborIsFrame(frame.constData(), frame.size()));
+    QVERIFY(frame.size() < encodeFrame(object, FormatQBJS).size());
+
+    int payloadSize = 0;
+    int headerSize = cborReadFrameHeader(frame.constData(), frame.size(), &payloadSize);
+    QVERIFY(headerSize > 3);
+    QCOMPARE(headerSize + payloadSize, frame.size());
+    QVERIFY(cborToJsonObject(frame.constData() + headerSize, payloadSize) == object);
+
+    // payloads of 128 bytes and more need a second varint byte
+    QByteArray large = encodeFrame(sampleMessage(64), FormatFramedCBOR);
+    QCOMPARE(cborReadFrameHeader(large.constData(), large.size(), &payloadSize), 5);
+    QCOMPARE(cborReadFrameHeader(large.constData(), 4, &payloadSize), 0);
+
+    // the end of a frame is known as soon as its header has arrived
+    QJsonBuffer buf;
+    QByteArray stream = frame + large;
+    for (int i = 0; i < frame.size() - 1; i++) {
+        buf.append(stream.constData() + i, 1);
+        QVERIFY(!buf.messageAvailable());
+    }
+    buf.append(stream.mid(frame.size() - 1));
+    QVERIFY(buf.format() == FormatFramedCBOR);
+    QVERIFY(buf.messageAvailable());
+    int consumed;
+    QVERIFY(buf.readMessage(&consumed) == object);
+    QCOMPARE(consumed, frame.size());
+    QVERIFY(buf.messageAvailable());
+    QVERIFY(buf.readMessage() == sampleMessage(64));
+    QVERIFY(buf.size() == 0);
+
+    QTest::ignoreMessage(QtWarningMsg, "cborToJsonObject: malformed CBOR document");
+    QVERIFY(cborToJsonObject(frame.constData() + headerSize, payloadSize - 1).isEmpty());
+
+    QTest::ignoreMessage(QtWarningMsg, "QJsonBuffer: discarding 5 bytes that do not start with a message");
+    buf.append("{\"a\":1}", 5);
+    QVERIFY(!buf.messageAvailable());
+    QVERIFY(buf.size() == 0);
+}
+
+void tst_JsonBuffer::cborKeyDictionary()
+{
+    QJsonObject object = sampleMessage(3);
+    QJsonKeyDictionary sent;
+    QByteArray first, second;
+    cborAppendFrame(first, object, &sent);
+    cborAppendFrame(second, object, &sent);
+    QVERIFY(cborIsFrame(first.constData(), first.size()));
+    QVERIFY(cborFrameUsesDictionary(first.constData()));
+    QCOMPARE(sent.mIds.size(), 12);
+
+    // keys repeated within the first frame are already sent as ids
+    QByteArray plain = encodeFrame(object, FormatFramedCBOR);
+    QVERIFY(first.size() < plain.size());
+    QVERIFY(second.size() < first.size());
+
+    // plain frames may be mixed in and leave the dictionary alone
+    QJsonBuffer buf;
+    buf.append(first + plain + second);
+    QVERIFY(buf.format() == FormatCBORDictionary);
+    for (int i = 0; i < 3; i++) {
+        QVERIFY(buf.messageAvailable());
+        QVERIFY(buf.readMessage() == object);
+    }
+    QVERIFY(buf.size() == 0);
+
+    // a new session starts with an empty dictionary
+    buf.clear();
+    buf.append(second);
+    QVERIFY(buf.messageAvailable());
+    QTest::ignoreMessage(QtWarningMsg, "cborToJsonObject: malformed CBOR document");
+    QVERIFY(buf.readMessage().isEmpty());
+}
+
+void tst_JsonBuffer::compressedFrames()
+{
+    QJsonObject object = sampleMessage(64);
+    QList<EncodingFormat> formats = QList<EncodingFormat>() << FormatUTF8 << FormatUTF16LE << FormatUTF32LE
+                                                            << FormatQBJS << FormatBSON << FormatFramedCBOR;
+    foreach (EncodingFormat format, formats) {
+        QByteArray plain = encodeFrame(object, format);
+        QByteArray compressed = QJsonBuffer::compressFrame(plain, 1);
+        QVERIFY(compressed.size() < plain.size());
+
+        // compressed and plain messages mix, also as the first message of the stream
+        QJsonBuffer buf;
+        QByteArray stream = compressed + plain + compressed;
+        for (int i = 0; i < compressed.size() - 1; i++) {
+            buf.append(stream.constData() + i, 1);
+            QVERIFY(!buf.messageAvailable());
+        }
+        buf.append(stream.mid(compressed.size() - 1));
+        QCOMPARE((int)buf.format(), (int)format);
+        for (int i = 0; i < 3; i++) {
+            QVERIFY(buf.messageAvailable());
+            int consumed;
+            QVERIFY(buf.readMessage(&consumed) == object);
+            QCOMPARE(consumed, i == 1 ? plain.size() : compressed.size());
+        }
+        QVERIFY(!buf.messageAvailable());
+        QVERIFY(buf.size() == 0);
+
+        qint64 frames, compressedBytes, bytes, nsecs;
+        buf.inflateStatistics(&frames, &compressedBytes, &bytes, &nsecs);
+        QCOMPARE(frames, Q_INT64_C(2));
+        QCOMPARE(compressedBytes, 2 * (qint64)compressed.size());
+        QCOMPARE(bytes, 2 * (qint64)plain.size());
+    }
+
+    // whitespace between text messages
+    QJsonBuffer buf;
+    buf.append("{\"a\":1}\n");
+    QVERIFY(buf.readMessage().value("a").toDouble() == 1.0);
+    buf.append("\n");
+    buf.append(QJsonBuffer::compressFrame(encodeFrame(object, FormatUTF8), 1));
+    QVERIFY(buf.messageAvailable());
+    QVERIFY(buf.readMessage() == object);
+
+    // a frame that would inflate beyond the limit is dropped before inflating it
+    QJsonObject large;
+    large.insert("padding", QString(64 * 1024, QLatin1Char('x')));
+    QByteArray bomb = QJsonBuffer::compressFrame(encodeFrame(large, FormatUTF8), 9);
+    QVERIFY(bomb.size() < 1024);
+    QJsonBuffer limited;
+    limited.setMaxFrameSize(16 * 1024);
+    QTest::ignoreMessage(QtWarningMsg, QString("QJsonBuffer: discarding a compressed frame of %1 bytes, the limit is 16384")
+                         .arg(encodeFrame(large, FormatUTF8).size()).toLatin1());
+    limited.append(bomb);
+    limited.append(encodeFrame(object, FormatUTF8));
+    QVERIFY(limited.messageAvailable());
+    QVERIFY(limited.readMessage() == object);
+    qint64 frames, compressedBytes, bytes, nsecs;
+    limited.inflateStatistics(&frames, &compressedBytes, &bytes, &nsecs);
+    QCOMPARE(bytes, Q_INT64_C(0));
+
+    // a frame whose size prefix understates its contents is dropped as well
+    QByteArray lying = bomb;
+    qToBigEndian<quint32>(100, reinterpret_cast<uchar *>(lying.data()) + 8);
+    QJsonBuffer checked;
+    checked.setMaxFrameSize(16 * 1024);
+    QTest::ignoreMessage(QtWarningMsg, QString("QJsonBuffer: discarding a compressed frame of %1 bytes that declared 100")
+                         .arg(encodeFrame(large, FormatUTF8).size()).toLatin1());
+    checked.append(lying);
+    checked.append(encodeFrame(object, FormatUTF8));
+    QVERIFY(checked.messageAvailable());
+    QVERIFY(checked.readMessage() == object);
+}
+
+void tst_JsonBuffer::benchmarkEncode_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::newRow("qbjs") << (int)FormatQBJS;
+    QTest::newRow("utf8") << (int)FormatUTF8;
+    QTest::newRow("utf16le") << (int)FormatUTF16LE;
+    QTest::newRow("utf32le") << (int)FormatUTF32LE;
+    QTest::newRow("bson") << (int)FormatBSON;
+    QTest::newRow("cbor") << (int)FormatFramedCBOR;
+    QTest::newRow("cbor-dictionary") << (int)FormatCBORDictionary;
+    QTest::newRow("bson-variantmap") << -1;  // the previous BSON encoder, for comparison
+}
+
+void tst_JsonBuffer::benchmarkEncode()
+{
+    QFETCH(int, format);
+    QJsonObject object = sampleMessage(64);
+    QByteArray frame;
+    if (format < 0) {
+        QBENCHMARK {
+            BsonObject bson(QJsonDocument(object).toVariant().toMap());
+            frame = bson.data();
+            frame.prepend("bson");
+        }
+        QCOMPARE(frame, encodeFrame(object, FormatBSON));
+    } else if (format == FormatCBORDictionary) {
+        // once the session knows every key
+        QJsonKeyDictionary dictionary;
+        cborAppendFrame(frame, object, &dictionary);
+        QBENCHMARK {
+            frame.clear();
+            cborAppendFrame(frame, object, &dictionary);
+        }
+        QVERIFY(frame.size() < encodeFrame(object, FormatFramedCBOR).size());
+    } else {
+        QBENCHMARK {
+            frame = encodeFrame(object, (EncodingFormat)format);
+        }
+        QVERIFY(!frame.isEmpty());
+    }
+}
+
+void tst_JsonBuffer::benchmarkDecode_data()
+{
+    benchmarkEncode_data();
+}
+
+void tst_JsonBuffer::benchmarkDecode()
+{
+    QFETCH(int, format);
+    QJsonObject object = sampleMessage(64);
+    QJsonObject decoded;
+    if (format < 0) {
+        QByteArray document = encodeFrame(object, FormatBSON).mid(4);
+        QBENCHMARK {
+            decoded = QJsonDocument::fromVariant(BsonObject(document).toMap()).object();
+        }
+    } else if (format == FormatCBORDictionary) {
+        QJsonKeyDictionary dictionary;
+        QByteArray frame;
+        cborAppendFrame(frame, object, &dictionary);
+        QJsonBuffer buf;
+        buf.append(frame);
+        buf.readMessage();
+        frame.clear();
+        cborAppendFrame(frame, object, &dictionary);
+        QBENCHMARK {
+            buf.append(frame);
+            decoded = buf.readMessage();
+        }
+        QVERIFY(buf.size() == 0);
+    } else {
+        QByteArray frame = encodeFrame(object, (EncodingFormat)format);
+        QJsonBuffer buf;
+        QBENCHMARK {
+            buf.append(frame);
+            decoded = buf.readMessage();
+        }
+        QVERIFY(buf.size() == 0);
+    }
+    QVERIFY(decoded == object);
+}
+
+void tst_JsonBuffer::benchmarkBsonArray_data()
+{
+    QTest::addColumn<bool>("variant");
+    QTest::addColumn<bool>("encode");
+    QTest::newRow("json-encode") << false << true;
+    QTest::newRow("json-decode") << false << false;
+    QTest::newRow("variant-encode") << true << true;
+    QTest::newRow("variant-decode") << true << false;
+}
+
+void tst_JsonBuffer::benchmarkBsonArray()
+{
+    QFETCH(bool, variant);
+    QFETCH(bool, encode);
+    const int knNumbers = 100000;
+    QVariantList numbers;
+    numbers.reserve(knNumbers);
+    for (int i = 0; i < knNumbers; i++)
+        numbers.append(i * 0.5);
+    QVariantMap map;
+    map.insert("numbers", numbers);
+    QJsonObject object = QJsonObject::fromVariantMap(map);
+    QByteArray document = encodeFrame(object, FormatBSON).mid(4);
+
+    if (variant && encode) {
+        QByteArray data;
+        QBENCHMARK {
+            data = BsonObject(map).data();
+        }
+        QCOMPARE(data, document);
+    } else if (variant) {
+        QVariantList decoded;
+        QBENCHMARK {
+            decoded = BsonObject(document).toMap().value("numbers").toList();
+        }
+        QCOMPARE(decoded, numbers);
+    } else if (encode) {
+        QByteArray frame;
+        QBENCHMARK {
+            frame.clear();
+            bsonAppendJsonObject(frame, object, 0);
+        }
+        QCOMPARE(frame, document);
+    } else {
+        QJsonObject decoded;
+        QBENCHMARK {
+            decoded = bsonToJsonObject(document.constData(), document.size());
+        }
+        QVERIFY(decoded == object);
+    }
+}
+
 QTEST_MAIN(tst_JsonBuffer)
 
 #include "tst_jsonbuffer.moc"
@@ -1,7 +1,7 @@
 CONFIG += testcase
 CONFIG -= app_bundle
 
-QT = jsonstream testlib qml quick
+QT = jsonstream testlib qml quick jsonstream-private
 
 SOURCES = ../tst_jsonconnection.cpp
 TARGET = ../tst_jsonconnection
@@ -45,6 +45,8 @@
 #include "qjsonserver.h"
 #include "qjsonconnection.h"
 #include "qjsonendpoint.h"
+#include "qjsonstream.h"
+#include "private/qjsonconnectionprocessor_p.h"
 
 #include <QtQml/qqmlengine.h>
 #include <QtQml/qqmlcomponent.h>
@@ -127,6 +129,145 @@ private:
     QProcess *process;
 };
 
+/****************************/
+// in-process server that the tests can take down and bring back at will
+class LocalServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    LocalServer(const QString &socketname)
+        : mSocketName(socketname), mSocket(0), mStream(0), mReading(true), mHolding(false)
+        , mFlowControlWindow(0)
+    {
+        mServer = new QLocalServer(this);
+        connect(mServer, SIGNAL(newConnection()), SLOT(handleConnection()));
+    }
+
+    bool listen()
+    {
+        QLocalServer::removeServer(mSocketName);
+        QFile::remove(mSocketName);
+        return mServer->listen(mSocketName);
+    }
+
+    // stops listening and leaves a file behind that refuses every connection attempt
+    void refuseConnections()
+    {
+        dropConnection();
+        mServer->close();
+        QFile file(mSocketName);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+
+    void dropConnection()
+    {
+        if (mSocket) {
+            mSocket->disconnect(this);
+            mSocket->abort();
+            mSocket->deleteLater();
+            mSocket = 0;
+            mStream = 0;
+        }
+    }
+
+    // new connections are not read from, so that the client has to buffer
+    void setReading(bool reading) { mReading = reading; }
+    void setAcceptedFormats(const QList<EncodingFormat> &formats) { mAcceptedFormats = formats; }
+    void setFlowControlWindow(int messages) { mFlowControlWindow = messages; }
+
+    // messages are left unread, and no credit is granted, until release()
+    void setHolding(bool holding) { mHolding = holding; }
+    void release()
+    {
+        mHolding = false;
+        processMessages();
+    }
+
+    QJsonStream *stream() const { return mStream; }
+
+signals:
+    void connected();
+    void messageReceived(const QJsonObject &);
+
+private slots:
+    void handleConnection()
+    {
+        QLocalSocket *socket = mServer->nextPendingConnection();
+        dropConnection();
+        mSocket = socket;
+        if (mReading) {
+            mStream = new QJsonStream(mSocket);
+            mStream->setParent(mSocket);
+            mStream->setAcceptedFormats(mAcceptedFormats);
+            mStream->setFlowControlWindow(mFlowControlWindow);
+            connect(mStream, SIGNAL(readyReadMessage()), SLOT(processMessages()));
+        }
+        else {
+            mSocket->setReadBufferSize(1024);
+        }
+        emit connected();
+    }
+
+    void processMessages()
+    {
+        while (mStream && !mHolding && mStream->messageAvailable()) {
+            QJsonObject obj = mStream->readMessage();
+            if (!obj.isEmpty())
+                emit messageReceived(obj);
+        }
+    }
+
+private:
+    QString mSocketName;
+    QLocalServer *mServer;
+    QLocalSocket *mSocket;
+    QJsonStream *mStream;
+    bool mReading;
+    bool mHolding;
+    int mFlowControlWindow;
+    QList<EncodingFormat> mAcceptedFormats;
+};
+
+// records when the connection goes down and when each reconnection attempt fails
+class AttemptRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    AttemptRecorder(QJsonConnection *connection)
+        : mDisconnectedAt(-1)
+    {
+        mTimer.start();
+        connect(connection, SIGNAL(stateChanged(QJsonConnection::State)),
+                SLOT(stateChanged(QJsonConnection::State)));
+        connect(connection, SIGNAL(error(QJsonConnection::Error,int)),
+                SLOT(error(QJsonConnection::Error,int)));
+    }
+
+    qint64 disconnectedAt() const { return mDisconnectedAt; }
+    QList<qint64> attempts() const { return mAttempts; }
+
+private slots:
+    void stateChanged(QJsonConnection::State state)
+    {
+        if (state == QJsonConnection::Connecting && mDisconnectedAt < 0)
+            mDisconnectedAt = mTimer.elapsed();
+    }
+
+    void error(QJsonConnection::Error, int subError)
+    {
+        // the lost connection reports an error of its own
+        if (mDisconnectedAt >= 0 && subError != QLocalSocket::PeerClosedError)
+            mAttempts.append(mTimer.elapsed());
+    }
+
+private:
+    QElapsedTimer mTimer;
+    qint64 mDisconnectedAt;
+    QList<qint64> mAttempts;
+};
+
 /****************************/
 class EndpointContainer : public QObject
 {
@@ -304,6 +445,14 @@ private slots:
     void multipleEndpointsTest();
     void multipleThreadTest();
     void autoreconnectTest();
+    void autoreconnectBackoffTest();
+    void outboundBufferTest();
+    void reconnectScheduleTest();
+    void replayUnacknowledgedTest();
+    void outboundSpillFileTest();
+    void outboundFlowControlTest();
+    void outboundFlushQueueTest();
+    void threadPoolTest();
     void nameChangeTest();
 private:
     void registerQmlTypes();
@@ -859,6 +1008,446 @@ void tst_JsonConnection::autoreconnectTest()
     child.waitForFinished();
 }
 
+void tst_JsonConnection::autoreconnectBackoffTest()
+{
+    QString socketname = "/tmp/tst_socket";
+
+    Child child("testClient/testClient",
+                QStringList() << "-socket" << socketname);
+
+    QSignalSpy spy0(&child, SIGNAL(serverReady()));
+    waitForSpy(spy0, 1);
+
+    ConnectionContainer c(socketname,true);
+    QJsonConnection *connection = c.connection();
+    connection->setAutoReconnectEnabled(true);
+
+    // defaults keep the fixed five second interval
+    QCOMPARE(connection->reconnectInitialDelay(), 5000);
+    QCOMPARE(connection->reconnectBackoffMultiplier(), qreal(1.0));
+    QCOMPARE(connection->reconnectJitter(), qreal(0.0));
+    QVERIFY(!connection->reconnectImmediately());
+    QVERIFY(!connection->replayUnacknowledgedMessages());
+
+    connection->setReconnectInitialDelay(100);
+    connection->setReconnectBackoffMultiplier(2.0);
+    connection->setReconnectMaximumDelay(1000);
+    connection->setReconnectJitter(0.5);
+    connection->setReconnectImmediately(true);
+    connection->setReplayUnacknowledgedMessages(true);
+
+    // invalid values are ignored
+    connection->setReconnectBackoffMultiplier(0.5);
+    connection->setReconnectJitter(2.0);
+    QCOMPARE(connection->reconnectBackoffMultiplier(), qreal(2.0));
+    QCOMPARE(connection->reconnectJitter(), qreal(0.5));
+    QCOMPARE(connection->reconnectMaximumDelay(), 1000);
+
+    QJsonEndpoint *endpoint = c.addEndpoint("test");
+
+    c.doConnect();
+    QVERIFY(connection->state() == QJsonConnection::Connected);
+
+    QSignalSpy spy1(connection, SIGNAL(stateChanged(QJsonConnection::State)));
+
+    QJsonObject msg;
+    msg.insert("endpoint", QLatin1String("test"));
+    msg.insert("command", QLatin1String("disconnect"));
+    msg.insert("timeout", 100);
+    endpoint->send(msg);
+
+    // the server keeps listening, so the immediate retry succeeds well before
+    // the initial delay of the old fixed policy
+    waitForSpy(spy1, 1);
+    QVERIFY(qvariant_cast<QJsonConnection::State>(spy1.last().at(0)) == QJsonConnection::Connecting);
+    QTime stopWatch;
+    stopWatch.start();
+    waitForSpy(spy1, 2, 2000);
+    QVERIFY(qvariant_cast<QJsonConnection::State>(spy1.last().at(0)) == QJsonConnection::Connected);
+    QVERIFY(stopWatch.elapsed() < 2000);
+
+    // the connection is usable again
+    QSignalSpy spy2(&c, SIGNAL(messageReceived(QJsonObject,QObject *)));
+    msg = QJsonObject();
+    msg.insert("endpoint", QLatin1String("test"));
+    msg.insert("text", QLatin1String("New message"));
+    endpoint->send(msg);
+    waitForSpy(spy2, 1);
+    msg = qvariant_cast<QJsonObject>(spy2.last().at(0));
+    QVERIFY(msg.value("text").toString() == QLatin1String("New message"));
+
+    c.closeConnection();
+
+    child.waitForFinished();
+}
+
+void tst_JsonConnection::outboundBufferTest()
+{
+    QString socketname = "/tmp/tst_socket";
+
+    Child child("testClient/testClient",
+                QStringList() << "-socket" << socketname);
+
+    QSignalSpy spy0(&child, SIGNAL(serverReady()));
+    waitForSpy(spy0, 1);
+
+    ConnectionContainer c(socketname,true);
+    QJsonConnection *connection = c.connection();
+    connection->setAutoReconnectEnabled(true);
+    connection->setReconnectInitialDelay(1000);
+    connection->setOutboundBufferMaxBytes(64*1024);
+    connection->setOutboundBufferMaxMessages(2);
+    QCOMPARE(connection->outboundBufferMaxBytes(), Q_INT64_C(64*1024));
+    QCOMPARE(connection->outboundBufferMaxMessages(), 2);
+
+    QJsonEndpoint *endpoint = c.addEndpoint("test");
+
+    c.doConnect();
+    QVERIFY(connection->state() == QJsonConnection::Connected);
+
+    QSignalSpy spy1(connection, SIGNAL(stateChanged(QJsonConnection::State)));
+    QSignalSpy spyOverflow(connection, SIGNAL(outboundBufferOverflow(qint64)));
+
+    QJsonObject msg;
+    msg.insert("endpoint", QLatin1String("test"));
+    msg.insert("command", QLatin1String("disconnect"));
+    msg.insert("timeout", 100);
+    endpoint->send(msg);
+
+    waitForSpy(spy1, 1);
+    QVERIFY(qvariant_cast<QJsonConnection::State>(spy1.last().at(0)) == QJsonConnection::Connecting);
+
+    // messages sent while reconnecting are buffered up to the message limit
+    QSignalSpy spy2(&c, SIGNAL(messageReceived(QJsonObject,QObject *)));
+    for (int i = 0; i < 3; i++) {
+        msg = QJsonObject();
+        msg.insert("endpoint", QLatin1String("test"));
+        msg.insert("number", i);
+        QCOMPARE(endpoint->send(msg), i < 2);
+    }
+    waitForSpy(spyOverflow, 1);
+
+    // ... and delivered in order once the connection is back
+    waitForSpy(spy1, 2, 5000);
+    QVERIFY(qvariant_cast<QJsonConnection::State>(spy1.last().at(0)) == QJsonConnection::Connected);
+    waitForSpy(spy2, 2);
+    QCOMPARE(qvariant_cast<QJsonObject>(spy2.at(0).at(0)).value("number").toDouble(), 0.0);
+    QCOMPARE(qvariant_cast<QJsonObject>(spy2.at(1).at(0)).value("number").toDouble(), 1.0);
+
+    c.closeConnection();
+
+    child.waitForFinished();
+}
+
+void tst_JsonConnection::reconnectScheduleTest()
+{
+    QString socketname = "/tmp/tst_socket_local";
+    LocalServer server(socketname);
+    QVERIFY(server.listen());
+
+    ConnectionContainer c(socketname,true);
+    QJsonConnection *connection = c.connection();
+    connection->setAutoReconnectEnabled(true);
+    connection->setReconnectInitialDelay(200);
+    connection->setReconnectBackoffMultiplier(2.0);
+    connection->setReconnectMaximumDelay(1000);
+    connection->setReconnectJitter(0.25);
+    connection->setOutboundBufferMaxBytes(64*1024);
+
+    QSignalSpy spyConnected(&server, SIGNAL(connected()));
+    c.doConnect();
+    QVERIFY(connection->state() == QJsonConnection::Connected);
+    waitForSpy(spyConnected, 1);
+
+    AttemptRecorder recorder(connection);
+    QSignalSpy spyState(connection, SIGNAL(stateChanged(QJsonConnection::State)));
+    server.refuseConnections();
+    waitForSpy(spyState, 1);
+    QVERIFY(qvariant_cast<QJsonConnection::State>(spyState.last().at(0)) == QJsonConnection::Connecting);
+
+    // messages sent during the outage are held in the outbound buffer
+    for (int i = 0; i < 10; i++) {
+        QJsonObject msg;
+        msg.insert("number", i);
+        QVERIFY(c.connection()->defaultEndpoint()->send(msg));
+    }
+
+    QTRY_VERIFY_WITH_TIMEOUT(recorder.attempts().size() >= 4, 5000);
+    QList<qint64> attempts = recorder.attempts();
+    qint64 previous = recorder.disconnectedAt();
+    qreal nominal = 200;
+    for (int i = 0; i < 4; i++) {
+        qint64 interval = attempts.at(i) - previous;
+        qreal delay = qMin(nominal, qreal(1000));
+        // timers may fire slightly early, and the attempt is reported through two threads
+        qreal lower = delay * 0.75 * 0.95 - 20;
+        qreal upper = qMin(delay * 1.25, qreal(1000)) + 150;
+        QVERIFY2(interval >= lower && interval <= upper,
+                 qPrintable(QString("attempt %1 after %2 ms, expected %3 to %4 ms")
+                            .arg(i + 1).arg(interval).arg(lower).arg(upper)));
+        previous = attempts.at(i);
+        nominal *= 2;
+    }
+
+    // once the server is back the buffered messages arrive exactly once, in order
+    QSignalSpy spyReceived(&server, SIGNAL(messageReceived(QJsonObject)));
+    QVERIFY(server.listen());
+    waitForSpy(spyState, 2, 5000);
+    QVERIFY(qvariant_cast<QJsonConnection::State>(spyState.last().at(0)) == QJsonConnection::Connected);
+    waitForSpy(spyReceived, 10);
+    QTest::qWait(200);
+    QCOMPARE(spyReceived.count(), 10);
+    for (int i = 0; i < 10; i++)
+        QCOMPARE(qvariant_cast<QJsonObject>(spyReceived.at(i).at(0)).value("number").toDouble(), double(i));
+
+    c.closeConnection();
+}
+
+void tst_JsonConnection::replayUnacknowledgedTest()
+{
+    QString socketname = "/tmp/tst_socket_local";
+    LocalServer server(socketname);
+    server.setReading(false);
+    QVERIFY(server.listen());
+
+    ConnectionContainer c(socketname,true);
+    QJsonConnection *connection = c.connection();
+    connection->setAutoReconnectEnabled(true);
+    connection->setReconnectImmediately(true);
+    connection->setReplayUnacknowledgedMessages(true);
+
+    QSignalSpy spyConnected(&server, SIGNAL(connected()));
+    c.doConnect();
+    QVERIFY(connection->state() == QJsonConnection::Connected);
+    waitForSpy(spyConnected, 1);
+
+    // the server does not read, so most of the message stays in the client's write buffer
+    QJsonObject big;
+    big.insert("number", 0);
+    big.insert("payload", QString(2*1024*1024, QLatin1Char('x')));
+    QVERIFY(connection->defaultEndpoint()->send(big));
+    QTest::qWait(200);
+
+    QSignalSpy spyState(connection, SIGNAL(stateChanged(QJsonConnection::State)));
+    QSignalSpy spyReceived(&server, SIGNAL(messageReceived(QJsonObject)));
+    server.setReading(true);
+    server.dropConnection();
+
+    waitForSpy(spyState, 2, 5000);
+    QVERIFY(qvariant_cast<QJsonConnection::State>(spyState.last().at(0)) == QJsonConnection::Connected);
+
+    QJsonObject msg;
+    msg.insert("number", 1);
+    QVERIFY(connection->defaultEndpoint()->send(msg));
+
+    // the partly written message is sent again in full, and only once
+    waitForSpy(spyReceived, 2);
+    QTest::qWait(200);
+    QCOMPARE(spyReceived.count(), 2);
+    QJsonObject replayed = qvariant_cast<QJsonObject>(spyReceived.at(0).at(0));
+    QCOMPARE(replayed.value("number").toDouble(), 0.0);
+    QCOMPARE(replayed.value("payload").toString().size(), 2*1024*1024);
+    QCOMPARE(qvariant_cast<QJsonObject>(spyReceived.at(1).at(0)).value("number").toDouble(), 1.0);
+
+    c.closeConnection();
+}
+
+void tst_JsonConnection::outboundSpillFileTest()
+{
+    QString socketname = "/tmp/tst_socket_local";
+    QString spillFile = QDir::temp().filePath("tst_jsonconnection_spool");
+    LocalServer server(socketname);
+    QVERIFY(server.listen());
+
+    ConnectionContainer c(socketname,true);
+    QJsonConnection *connection = c.connection();
+    connection->setAutoReconnectEnabled(true);
+    connection->setReconnectInitialDelay(200);
+    connection->setOutboundBufferMaxBytes(8*1024*1024);
+    connection->setOutboundBufferSpillFile(spillFile);
+
+    QSignalSpy spyConnected(&server, SIGNAL(connected()));
+    c.doConnect();
+    waitForSpy(spyConnected, 1);
+
+    QSignalSpy spyState(connection, SIGNAL(stateChanged(QJsonConnection::State)));
+    server.refuseConnections();
+    waitForSpy(spyState, 1);
+
+    // well beyond the part of the outbound buffer kept in memory
+    const int count = 2000;
+    const QString payload(1024, QLatin1Char('x'));
+    for (int i = 0; i < count; i++) {
+        QJsonObject msg;
+        msg.insert("number", i);
+        msg.insert("payload", payload);
+        QVERIFY(connection->defaultEndpoint()->send(msg));
+    }
+    QVERIFY(QFile::exists(spillFile));
+
+    QSignalSpy spyReceived(&server, SIGNAL(messageReceived(QJsonObject)));
+    QVERIFY(server.listen());
+    waitForSpy(spyState, 2, 5000);
+
+    // a message sent meanwhile follows the buffered ones
+    QJsonObject last;
+    last.insert("number", count);
+    QVERIFY(connection->defaultEndpoint()->send(last));
+
+    waitForSpy(spyReceived, count + 1, 10000);
+    for (int i = 0; i <= count; i++)
+        QCOMPARE(qvariant_cast<QJsonObject>(spyReceived.at(i).at(0)).value("number").toDouble(), double(i));
+    QTRY_VERIFY(!QFile::exists(spillFile));
+
+    c.closeConnection();
+}
+
+void tst_JsonConnection::outboundFlowControlTest()
+{
+    QString socketname = "/tmp/tst_socket_local";
+    LocalServer server(socketname);
+    QVERIFY(server.listen());
+
+    ConnectionContainer c(socketname,true);
+    QJsonConnection *connection = c.connection();
+    connection->setAutoReconnectEnabled(true);
+    connection->setReconnectInitialDelay(200);
+    connection->setOutboundBufferMaxBytes(8*1024*1024);
+
+    QSignalSpy spyConnected(&server, SIGNAL(connected()));
+    c.doConnect();
+    waitForSpy(spyConnected, 1);
+
+    QSignalSpy spyState(connection, SIGNAL(stateChanged(QJsonConnection::State)));
+    server.refuseConnections();
+    waitForSpy(spyState, 1);
+
+    const int count = 2000;
+    const QString payload(1024, QLatin1Char('x'));
+    for (int i = 0; i < count; i++) {
+        QJsonObject msg;
+        msg.insert("number", i);
+        msg.insert("payload", payload);
+        QVERIFY(connection->defaultEndpoint()->send(msg));
+    }
+
+    // the new server grants credit for 10 messages and does not read yet
+    server.setFlowControlWindow(10);
+    server.setHolding(true);
+    QSignalSpy spyReceived(&server, SIGNAL(messageReceived(QJsonObject)));
+    QVERIFY(server.listen());
+    waitForSpy(spyState, 2, 5000);
+    QTest::qWait(500);
+
+    // the buffered messages wait for credit like any other
+    server.release();
+    QVERIFY(spyReceived.count() < count);
+
+    waitForSpy(spyReceived, count, 10000);
+    for (int i = 0; i < count; i++)
+        QCOMPARE(qvariant_cast<QJsonObject>(spyReceived.at(i).at(0)).value("number").toDouble(), double(i));
+
+    c.closeConnection();
+}
+
+void tst_JsonConnection::outboundFlushQueueTest()
+{
+    QString socketname = "/tmp/tst_socket_local";
+    LocalServer server(socketname);
+    QVERIFY(server.listen());
+
+    ConnectionContainer c(socketname,true);
+    QJsonConnection *connection = c.connection();
+    connection->setAutoReconnectEnabled(true);
+    connection->setReconnectInitialDelay(200);
+    connection->setOutboundBufferMaxBytes(8*1024*1024);
+    connection->setOutboundBufferMaxMessages(100);
+
+    QSignalSpy spyConnected(&server, SIGNAL(connected()));
+    c.doConnect();
+    waitForSpy(spyConnected, 1);
+
+    QSignalSpy spyState(connection, SIGNAL(stateChanged(QJsonConnection::State)));
+    server.refuseConnections();
+    waitForSpy(spyState, 1);
+
+    const int count = 100;
+    for (int i = 0; i < count; i++) {
+        QJsonObject msg;
+        msg.insert("number", i);
+        QVERIFY(connection->defaultEndpoint()->send(msg));
+    }
+
+    // keep the buffered messages waiting for credit after reconnection
+    server.setFlowControlWindow(10);
+    server.setHolding(true);
+    QSignalSpy spyReceived(&server, SIGNAL(messageReceived(QJsonObject)));
+    QSignalSpy spyOverflow(connection, SIGNAL(outboundBufferOverflow(qint64)));
+    QVERIFY(server.listen());
+    waitForSpy(spyState, 2, 5000);
+
+    // the limits of the outbound buffer do not apply to a live connection
+    for (int i = count; i < 2 * count; i++) {
+        QJsonObject msg;
+        msg.insert("number", i);
+        QVERIFY(connection->defaultEndpoint()->send(msg));
+    }
+    QCOMPARE(spyOverflow.count(), 0);
+
+    server.release();
+    waitForSpy(spyReceived, 2 * count, 10000);
+    for (int i = 0; i < 2 * count; i++)
+        QCOMPARE(qvariant_cast<QJsonObject>(spyReceived.at(i).at(0)).value("number").toDouble(), double(i));
+
+    c.closeConnection();
+}
+
+void tst_JsonConnection::threadPoolTest()
+{
+    QString socketname = "/tmp/tst_socket";
+
+    Child child("testClient/testClient",
+                QStringList() << "-socket" << socketname);
+
+    QSignalSpy spy0(&child, SIGNAL(serverReady()));
+    waitForSpy(spy0, 1);
+
+    QCOMPARE(QJsonConnection::processingThreadPoolSize(), 0);
+    QJsonConnection::setProcessingThreadPoolSize(2);
+    QJsonConnection::setProcessingThreadAssignment(QJsonConnection::RoundRobin);
+    QCOMPARE(QJsonConnection::processingThreadPoolSize(), 2);
+
+    QList<ConnectionContainer *> containers;
+    for (int i = 0; i < 3; i++) {
+        ConnectionContainer *c = new ConnectionContainer(socketname, true);
+        c->doConnect();
+        QVERIFY(c->connection()->state() == QJsonConnection::Connected);
+        containers.append(c);
+    }
+
+    QThread *t0 = containers.at(0)->connection()->processor()->thread();
+    QThread *t1 = containers.at(1)->connection()->processor()->thread();
+    QThread *t2 = containers.at(2)->connection()->processor()->thread();
+    QVERIFY(t0 != QThread::currentThread());
+    QVERIFY(t1 != QThread::currentThread());
+    QVERIFY(t0 != t1);
+    QVERIFY(t2 == t0);
+
+    // the last connection is the one the server talks to
+    QSignalSpy spy(containers.at(2), SIGNAL(messageReceived(QJsonObject,QObject *)));
+    containers.at(2)->sendMessage();
+    waitForSpy(spy, 1);
+    QJsonObject msg = qvariant_cast<QJsonObject>(spy.last().at(0));
+    QVERIFY(msg.value("text").toString() == QLatin1String("Standard text"));
+
+    foreach (ConnectionContainer *c, containers)
+        c->closeConnection();
+    qDeleteAll(containers);
+    QJsonConnection::setProcessingThreadPoolSize(0);
+
+    child.waitForFinished();
+}
+
 void tst_JsonConnection::nameChangeTest()
 {
     QString socketname = "/tmp/tst_socket";
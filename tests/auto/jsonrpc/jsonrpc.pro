@@ -0,0 +1,7 @@
+CONFIG += testcase
+CONFIG -= app_bundle
+
+QT = jsonstream testlib
+
+SOURCES = tst_jsonrpc.cpp
+TARGET = tst_jsonrpc
@@ -0,0 +1,273 @@
+/****************************************************************************
+**
+** Copyright (C) 2013 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtAddOn.JsonStream module of the Qt.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include <QtTest>
+#include "qjsonserver.h"
+#include "qjsonconnection.h"
+#include "qjsonendpoint.h"
+#include "qjsonrpcclient.h"
+#include "qjsonrpcserver.h"
+
+#include <algorithm>
+
+QT_USE_NAMESPACE_JSONSTREAM
+
+#if defined(Q_OS_LINUX_ANDROID)
+QString s_socketname = QStringLiteral("/dev/socket/tst_jsonrpc");
+#else
+QString s_socketname = QStringLiteral("/tmp/tst_jsonrpc");
+#endif
+
+bool waitForFuture(const QFuture<QJsonObject> &future, int timeout = 5000)
+{
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    while (!future.isFinished()) {
+        if (stopWatch.elapsed() >= timeout)
+            return false;
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 10);
+    }
+    return true;
+}
+
+/****************************/
+class Handler : public QObject
+{
+    Q_OBJECT
+public:
+    Handler(QJsonRpcServer *rpc) : mRpc(rpc)
+    {
+        connect(rpc, SIGNAL(callReceived(QString,QString,QJsonValue,QJsonObject)),
+                SLOT(handleCall(QString,QString,QJsonValue,QJsonObject)));
+    }
+
+public slots:
+    void handleCall(const QString &identifier, const QString &method,
+                    const QJsonValue &params, const QJsonObject &call)
+    {
+        if (method == QLatin1String("echo")) {
+            mRpc->reply(identifier, call, params);
+        }
+        else if (method == QLatin1String("add")) {
+            QJsonArray args = params.toArray();
+            mRpc->reply(identifier, call, args.at(0).toDouble() + args.at(1).toDouble());
+        }
+        else if (method == QLatin1String("ignore")) {
+            // never answered
+        }
+        else {
+            mRpc->replyError(identifier, call, -32601, QStringLiteral("Unknown method"));
+        }
+    }
+
+private:
+    QJsonRpcServer *mRpc;
+};
+
+/****************************/
+
+class tst_JsonRpc : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void callTest();
+    void errorTest();
+    void timeoutTest();
+    void pipeliningTest();
+    void unrelatedMessageTest();
+
+    void benchmarkCallLatency_data();
+    void benchmarkCallLatency();
+
+private:
+    QJsonServer     *mServer;
+    QJsonRpcServer  *mRpcServer;
+    Handler         *mHandler;
+    QJsonConnection *mConnection;
+    QJsonEndpoint   *mEndpoint;
+    QJsonRpcClient  *mClient;
+};
+
+void tst_JsonRpc::initTestCase()
+{
+    qRegisterMetaType<QJsonObject>();
+}
+
+void tst_JsonRpc::init()
+{
+    mServer = new QJsonServer;
+    QVERIFY(mServer->listen(s_socketname));
+    mRpcServer = new QJsonRpcServer(mServer);
+    mHandler = new Handler(mRpcServer);
+
+    mConnection = new QJsonConnection;
+    mConnection->setFormat(FormatQBJS);
+    mEndpoint = new QJsonEndpoint(QStringLiteral("rpc"), mConnection);
+    mClient = new QJsonRpcClient(mEndpoint);
+    QVERIFY(mConnection->connectLocal(s_socketname));
+}
+
+void tst_JsonRpc::cleanup()
+{
+    delete mClient;
+    delete mEndpoint;
+    delete mConnection;
+    delete mHandler;
+    delete mRpcServer;
+    delete mServer;
+}
+
+void tst_JsonRpc::callTest()
+{
+    QJsonArray args;
+    args.append(1);
+    args.append(2);
+    QFuture<QJsonObject> future = mClient->call(QStringLiteral("add"), args);
+    QCOMPARE(mClient->pendingCallCount(), 1);
+    QVERIFY(waitForFuture(future));
+    QCOMPARE(mClient->pendingCallCount(), 0);
+
+    QJsonObject response = future.result();
+    QVERIFY(!response.contains("error"));
+    QCOMPARE(response.value("result").toDouble(), 3.0);
+    QCOMPARE(response.value("endpoint").toString(), QStringLiteral("rpc"));
+}
+
+void tst_JsonRpc::errorTest()
+{
+    QFuture<QJsonObject> future = mClient->call(QStringLiteral("unknown"));
+    QVERIFY(waitForFuture(future));
+
+    QJsonObject error = future.result().value("error").toObject();
+    QCOMPARE(error.value("code").toDouble(), -32601.0);
+    QCOMPARE(error.value("message").toString(), QStringLiteral("Unknown method"));
+}
+
+void tst_JsonRpc::timeoutTest()
+{
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    QFuture<QJsonObject> future = mClient->call(QStringLiteral("ignore"), QJsonValue(), 100);
+    QFuture<QJsonObject> answered = mClient->call(QStringLiteral("echo"), QStringLiteral("hello"), 100);
+    QVERIFY(waitForFuture(future));
+    QVERIFY(stopWatch.elapsed() >= 100);
+    QVERIFY(stopWatch.elapsed() < 2000);
+
+    QCOMPARE(future.result().value("error").toObject().value("code").toDouble(),
+             double(QJsonRpcClient::TimeoutError));
+    QVERIFY(answered.isFinished());
+    QCOMPARE(answered.result().value("result").toString(), QStringLiteral("hello"));
+    QCOMPARE(mClient->pendingCallCount(), 0);
+}
+
+void tst_JsonRpc::pipeliningTest()
+{
+    const int knCalls = 500;
+    QList<QFuture<QJsonObject> > futures;
+    for (int i = 0; i < knCalls; i++)
+        futures.append(mClient->call(QStringLiteral("echo"), i));
+    QCOMPARE(mClient->pendingCallCount(), knCalls);
+
+    for (int i = 0; i < knCalls; i++) {
+        QVERIFY(waitForFuture(futures.at(i)));
+        QCOMPARE(futures.at(i).result().value("result").toDouble(), double(i));
+    }
+    QCOMPARE(mClient->pendingCallCount(), 0);
+}
+
+void tst_JsonRpc::unrelatedMessageTest()
+{
+    QSignalSpy spy(mClient, SIGNAL(messageReceived(const QJsonObject&)));
+    QFuture<QJsonObject> future = mClient->call(QStringLiteral("echo"), 1);
+    QVERIFY(waitForFuture(future));
+    QCOMPARE(mServer->connections().size(), 1);
+
+    QJsonObject msg;
+    msg.insert("endpoint", QLatin1String("rpc"));
+    msg.insert("text", QLatin1String("Not a response"));
+    QVERIFY(mServer->send(mServer->connections().at(0), msg));
+
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    while (!spy.count() && stopWatch.elapsed() < 5000)
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 10);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(qvariant_cast<QJsonObject>(spy.at(0).at(0)).value("text").toString(),
+             QStringLiteral("Not a response"));
+}
+
+void tst_JsonRpc::benchmarkCallLatency_data()
+{
+    QTest::addColumn<int>("percentile");
+    QTest::newRow("p50") << 50;
+    QTest::newRow("p99") << 99;
+}
+
+void tst_JsonRpc::benchmarkCallLatency()
+{
+    QFETCH(int, percentile);
+    const int knCalls = 1000;
+    QVector<qint64> latencies;
+    latencies.reserve(knCalls);
+
+    QElapsedTimer timer;
+    for (int i = 0; i < knCalls; i++) {
+        timer.start();
+        QFuture<QJsonObject> future = mClient->call(QStringLiteral("echo"), i);
+        QVERIFY(waitForFuture(future));
+        latencies.append(timer.nsecsElapsed());
+    }
+
+    // call latency over a local socket
+    std::sort(latencies.begin(), latencies.end());
+    QTest::setBenchmarkResult(latencies.at(knCalls * percentile / 100) / 1000000.0,
+                              QTest::WalltimeMilliseconds);
+}
+
+QTEST_MAIN(tst_JsonRpc)
+
+#include "tst_jsonrpc.moc"
@@ -41,7 +41,12 @@
 
 #include <QtTest/QtTest>
 
+#ifdef Q_OS_UNIX
+#include <utime.h>
+#endif
+
 #include "qjsonschemavalidator.h"
+#include "qjsonserver.h"
 
 QT_USE_NAMESPACE_JSONSTREAM
 
@@ -49,7 +54,11 @@ class tst_JsonSchema : public QObject
 {
     Q_OBJECT
 
+public:
+    tst_JsonSchema() : mEngineMismatches(0) {}
+
 private slots:
+    void cleanup();
     void schemaTest();
     // 5.1 type
     void testTypeValidation();
@@ -95,11 +104,123 @@ private slots:
     // 5.28
     void testRefValidation();
 
+    void compiledSchemaTest();
+    void compiledSchemaHandleTest();
+    void benchmarkServerValidation_data();
+    void benchmarkServerValidation();
+    void benchmarkCompiledSchemaHandle_data();
+    void benchmarkCompiledSchemaHandle();
+    void concurrentValidationTest_data();
+    void concurrentValidationTest();
+    void benchmarkConcurrentValidation_data();
+    void benchmarkConcurrentValidation();
+    void discriminatorTest();
+    void benchmarkSchemaDispatch_data();
+    void benchmarkSchemaDispatch();
+    void schemaCacheTest();
+    void precompileTest();
+    void benchmarkSchemaCache_data();
+    void benchmarkSchemaCache();
+    void parallelLoadTest_data();
+    void parallelLoadTest();
+    void benchmarkLoadFromFolder_data();
+    void benchmarkLoadFromFolder();
+    void watchFolderTest();
+    void serverSamplingTest();
+    void serverAsyncValidationTest();
+    void benchmarkServerValidationModes_data();
+    void benchmarkServerValidationModes();
+
 private:
     bool validate(const char *data,  const QByteArray & schema);
     bool validate(const QJsonValue & object, const QByteArray & schema);
+
+    int mEngineMismatches;
+};
+
+// gives the benchmark access to the server's inbound message path
+class TestJsonServer : public QJsonServer
+{
+public:
+    using QJsonServer::receiveMessage;
+};
+
+static const char kMessageSchema[] =
+    "{ \"title\": \"Message\", \"type\": \"object\", \"additionalProperties\": false,"
+    "  \"properties\": {"
+    "    \"command\": { \"type\": \"string\", \"required\": true, \"enum\": [\"start\", \"stop\", \"update\"] },"
+    "    \"id\": { \"type\": \"integer\", \"required\": true, \"minimum\": 0 },"
+    "    \"name\": { \"type\": \"string\", \"pattern\": \"[a-z][a-z0-9_]*\", \"maxLength\": 32 },"
+    "    \"source\": { \"type\": \"string\", \"format\": \"uri\" },"
+    "    \"tags\": { \"type\": \"array\", \"maxItems\": 8, \"items\": { \"type\": \"string\", \"minLength\": 1 } },"
+    "    \"position\": { \"type\": \"object\", \"properties\": {"
+    "        \"x\": { \"type\": \"number\" }, \"y\": { \"type\": \"number\" } } }"
+    "  } }";
+
+static QJsonObject sampleMessage(bool valid);
+
+// validates messages with a validator shared with other threads
+class ValidationTask : public QRunnable
+{
+public:
+    ValidationTask(QJsonSchemaValidator *validator, int count)
+        : mValidator(validator), mCount(count), mFailures(0)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        const QJsonObject valid = sampleMessage(true);
+        const QJsonObject invalid = sampleMessage(false);
+        for (int i = 0; i < mCount; ++i) {
+            // every other message is invalid, the error must be this thread's own
+            const bool expected = !(i & 1);
+            if (mValidator->validateSchema("Message", expected ? valid : invalid) != expected)
+                mFailures++;
+            else if (mValidator->getLastError().errorCode() !=
+                     (expected ? QJsonSchemaError::NoError : QJsonSchemaError::FailedSchemaValidation))
+                mFailures++;
+        }
+    }
+
+    int failures() const { return mFailures; }
+
+private:
+    QJsonSchemaValidator *mValidator;
+    int mCount;
+    int mFailures;
 };
 
+static QJsonObject sampleMessage(bool valid)
+{
+    QJsonObject position;
+    position.insert("x", 1.5);
+    position.insert("y", -2.0);
+    QJsonArray tags;
+    tags.append(QLatin1String("alpha"));
+    tags.append(QLatin1String("beta"));
+    tags.append(QLatin1String("gamma"));
+
+    QJsonObject message;
+    message.insert("command", QLatin1String("update"));
+    message.insert("id", valid ? 42 : -1);
+    message.insert("name", QLatin1String("sensor_7"));
+    message.insert("source", QLatin1String("urn:sensor:7"));
+    message.insert("tags", tags);
+    message.insert("position", position);
+    return message;
+}
+
+void tst_JsonSchema::cleanup()
+{
+    // validate() checks every case with both the compiled program and the Check tree;
+    // reset the count first so that a failure does not carry over to the next test
+    const int mismatches = mEngineMismatches;
+    mEngineMismatches = 0;
+    QCOMPARE(mismatches, 0);
+}
+
 void tst_JsonSchema::schemaTest()
 {
     bool result;
@@ -419,6 +540,29 @@ void tst_JsonSchema::testEnumValidation()
     QVERIFY(!validate(QJsonValue(true), "{ \"enum\" : [\"false\", \"true\"] }"));
     QVERIFY(!validate(QJsonValue(4), "{ \"enum\" : [1, 2, 3, \"4\"] }"));
     QVERIFY(!validate(QJsonValue(QString()), "{ \"enum\" : [] }"));
+
+    // every kind of member
+    const char *mixed = "{ \"enum\" : [null, false, 0, 2.5, \"a\", [1, 2], { \"b\" : 1 }] }";
+    QVERIFY(validate(QJsonValue(false), mixed));
+    QVERIFY(!validate(QJsonValue(true), mixed));
+    QVERIFY(validate(QJsonValue(-0.0), mixed));
+    QVERIFY(validate(QJsonValue(2.5), mixed));
+    QVERIFY(!validate(QJsonValue(2), mixed));
+    QVERIFY(validate(QJsonValue(QString("a")), mixed));
+    QVERIFY(!validate(QJsonValue(QString("b")), mixed));
+    QVERIFY(validate(QJsonDocument::fromJson("[1, 2]").array(), mixed));
+    QVERIFY(!validate(QJsonDocument::fromJson("[2, 1]").array(), mixed));
+    QVERIFY(validate(QJsonDocument::fromJson("{ \"b\" : 1 }").object(), mixed));
+    QVERIFY(!validate(QJsonDocument::fromJson("{ \"b\" : 2 }").object(), mixed));
+
+    // large enums are looked up in a hash
+    QStringList ids;
+    for (int i = 0; i < 600; ++i)
+        ids.append(QString("\"device-%1\"").arg(i));
+    const QByteArray large = QString("{ \"enum\" : [%1] }").arg(ids.join(", ")).toUtf8();
+    QVERIFY(validate(QJsonValue(QString("device-0")), large));
+    QVERIFY(validate(QJsonValue(QString("device-599")), large));
+    QVERIFY(!validate(QJsonValue(QString("device-600")), large));
 //FIX    QVERIFY(!validate({}, "{ \"properties\" : { \"a\" : { \"enum\" : [\"a\"], \"optional\" : false, \"required\" : true } } }"));
 }
 
@@ -447,17 +591,37 @@ void tst_JsonSchema::testFormatValidation()
     // format=date-time
     QVERIFY(validate(QJsonValue(QString("2112-12-12T12:34:56Z")), "{ \"format\" : \"date-time\" }"));
     QVERIFY(!validate(QJsonValue(QString("21121212T123456Z")), "{ \"format\" : \"date-time\" }"));
+    QVERIFY(!validate(QJsonValue(QString("2112-12-12T24:34:56Z")), "{ \"format\" : \"date-time\" }"));
+    QVERIFY(!validate(QJsonValue(QString("2112-12-12T12:34:56")), "{ \"format\" : \"date-time\" }"));
     // format=date
     QVERIFY(validate(QJsonValue(QString("2112-12-12")), "{ \"format\" : \"date\" }"));
+    QVERIFY(validate(QJsonValue(QString("2012-02-29")), "{ \"format\" : \"date\" }"));
+    QVERIFY(!validate(QJsonValue(QString("2013-02-29")), "{ \"format\" : \"date\" }"));
     QVERIFY(!validate(QJsonValue(QString("21121212")), "{ \"format\" : \"date\" }"));
     // format=time
     QVERIFY(validate(QJsonValue(QString("12:34:56")), "{ \"format\" : \"time\" }"));
+    QVERIFY(!validate(QJsonValue(QString("12:60:56")), "{ \"format\" : \"time\" }"));
     QVERIFY(!validate(QJsonValue(QString("123456")), "{ \"format\" : \"time\" }"));
     // format=url
     QVERIFY(validate(QJsonValue(QString("http://www.zzz.zu/zzz")), "{ \"format\" : \"url\" }"));
     // format=uri
     QVERIFY(validate(QJsonValue(QString("uuid:{zxcvbnm}")), "{ \"format\" : \"uri\" }"));
     QVERIFY(validate(QJsonValue(QString("urn:issn:1536-3613")), "{ \"format\" : \"uri\" }"));
+    QVERIFY(validate(QJsonValue(QString("../a%20b/c?d=e")), "{ \"format\" : \"uri\" }"));
+    QVERIFY(!validate(QJsonValue(QString("a b")), "{ \"format\" : \"uri\" }"));
+    QVERIFY(!validate(QJsonValue(QString("a%2")), "{ \"format\" : \"uri\" }"));
+    // format=email
+    QVERIFY(validate(QJsonValue(QString("first.last+tag@example.com")), "{ \"format\" : \"email\" }"));
+    QVERIFY(validate(QJsonValue(QString("root@localhost")), "{ \"format\" : \"email\" }"));
+    QVERIFY(!validate(QJsonValue(QString("example.com")), "{ \"format\" : \"email\" }"));
+    QVERIFY(!validate(QJsonValue(QString("first..last@example.com")), "{ \"format\" : \"email\" }"));
+    QVERIFY(!validate(QJsonValue(QString("user@-example.com")), "{ \"format\" : \"email\" }"));
+    // format=ip-address
+    QVERIFY(validate(QJsonValue(QString("192.168.0.255")), "{ \"format\" : \"ip-address\" }"));
+    QVERIFY(validate(QJsonValue(QString("10.0.0.1")), "{ \"format\" : \"ipv4\" }"));
+    QVERIFY(!validate(QJsonValue(QString("192.168.0.256")), "{ \"format\" : \"ip-address\" }"));
+    QVERIFY(!validate(QJsonValue(QString("192.168.0")), "{ \"format\" : \"ip-address\" }"));
+    QVERIFY(!validate(QJsonValue(QString("1.2.3.4.5")), "{ \"format\" : \"ip-address\" }"));
     // format=NonNegativeInteger
     QVERIFY(validate(QJsonValue(56), "{ \"format\" : \"NonNegativeInteger\" }"));
     QVERIFY(!validate(QJsonValue(56.5), "{ \"format\" : \"NonNegativeInteger\" }"));
@@ -502,6 +666,691 @@ void tst_JsonSchema::testRefValidation()
     QVERIFY(!validate("{ \"a\" : \"1\" }", "{ \"type\" : \"object\", \"additionalProperties\" : { \"$ref\" : \"#\" } }"));
 }
 
+void tst_JsonSchema::compiledSchemaTest()
+{
+    QJsonSchemaValidator compiled;
+    QJsonSchemaValidator reference;
+    reference.setUseCompiledSchemas(false);
+    QVERIFY(compiled.useCompiledSchemas());
+    QVERIFY(!reference.useCompiledSchemas());
+
+    QVERIFY(compiled.loadFromData(kMessageSchema, "Message"));
+    QVERIFY(reference.loadFromData(kMessageSchema, "Message"));
+
+    QVERIFY(compiled.validateSchema("Message", sampleMessage(true)));
+    QVERIFY(reference.validateSchema("Message", sampleMessage(true)));
+
+    // both report the same error
+    QJsonObject invalid = sampleMessage(false);
+    QVERIFY(!compiled.validateSchema("Message", invalid));
+    QVERIFY(!reference.validateSchema("Message", invalid));
+    QCOMPARE(compiled.getLastError().errorCode(), QJsonSchemaError::FailedSchemaValidation);
+    QCOMPARE(compiled.getLastError().errorString(), reference.getLastError().errorString());
+
+    invalid = sampleMessage(true);
+    invalid.remove("command");
+    QVERIFY(!compiled.validateSchema("Message", invalid));
+    QVERIFY(!reference.validateSchema("Message", invalid));
+    QCOMPARE(compiled.getLastError().errorString(), reference.getLastError().errorString());
+
+    invalid = sampleMessage(true);
+    invalid.insert("unknown", 1);
+    QVERIFY(!compiled.validateSchema("Message", invalid));
+    QVERIFY(!reference.validateSchema("Message", invalid));
+    QCOMPARE(compiled.getLastError().errorString(), reference.getLastError().errorString());
+
+    // schemas referring to other schemas by name fall back to the Check tree
+    QVERIFY(compiled.loadFromData("{ \"properties\": { \"m\": { \"$ref\": \"Message\" } } }", "Wrapper"));
+    QJsonObject wrapper;
+    wrapper.insert("m", sampleMessage(true));
+    QVERIFY(compiled.validateSchema("Wrapper", wrapper));
+    wrapper.insert("m", sampleMessage(false));
+    QVERIFY(!compiled.validateSchema("Wrapper", wrapper));
+}
+
+void tst_JsonSchema::compiledSchemaHandleTest()
+{
+    QJsonSchemaValidator validator;
+    QVERIFY(!validator.compiledSchema("Message").isValid());
+    QCOMPARE(validator.getLastError().errorCode(), QJsonSchemaError::FailedSchemaValidation);
+
+    QVERIFY(validator.loadFromData(kMessageSchema, "Message"));
+    QJsonSchemaValidator::CompiledSchema schema = validator.compiledSchema("Message");
+    QVERIFY(schema.isValid());
+    QCOMPARE(schema.name(), QString("Message"));
+
+    QJsonSchemaError error;
+    QVERIFY(schema.validate(sampleMessage(true)));
+    QVERIFY(schema.validate(sampleMessage(true), &error));
+    QVERIFY(!schema.validate(sampleMessage(false), &error));
+    QCOMPARE(error.errorCode(), QJsonSchemaError::FailedSchemaValidation);
+    QVERIFY(!validator.validateSchema("Message", sampleMessage(false)));
+    QCOMPARE(error.errorString(), validator.getLastError().errorString());
+
+    // the error can be returned directly, without touching the last error
+    QJsonSchemaError direct;
+    QVERIFY(validator.validateSchema("Message", sampleMessage(true)));
+    QVERIFY(!validator.validateSchema("Message", sampleMessage(false), &direct));
+    QCOMPARE(direct.errorString(), error.errorString());
+    direct = QJsonSchemaError();
+    QVERIFY(!validator.validateSchema(sampleMessage(false), &direct));
+    QCOMPARE(direct.errorCode(), QJsonSchemaError::FailedSchemaValidation);
+    QCOMPARE(validator.getLastError().errorCode(), QJsonSchemaError::NoError);
+
+    // a handle is a snapshot of the schema
+    validator.removeSchema("Message");
+    QVERIFY(schema.validate(sampleMessage(true)));
+
+    // schemas that can not be loaded do not give a valid handle
+    QVERIFY(validator.loadFromData("{ \"properties\": { \"a\": { \"minimum\": \"x\" } } }", "Broken"));
+    QVERIFY(!validator.compiledSchema("Broken").isValid());
+    QCOMPARE(validator.getLastError().errorCode(), QJsonSchemaError::InvalidSchemaLoading);
+
+    QJsonSchemaValidator::CompiledSchema invalid;
+    QVERIFY(!invalid.validate(sampleMessage(true), &error));
+    QCOMPARE(error.errorCode(), QJsonSchemaError::InvalidSchemaOperation);
+}
+
+// a message for the SchemaTestObject schema in create-test.json
+static QJsonObject createTestMessage(bool valid)
+{
+    QJsonObject message;
+    message.insert("create-test", valid ? 11 : 10);
+    message.insert("create-test0", 1);
+    message.insert("another-field", QLatin1String("http://qt-project.org/"));
+    return message;
+}
+
+void tst_JsonSchema::benchmarkServerValidation_data()
+{
+    QTest::addColumn<bool>("compiled");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<bool>("folderSchema");
+    QTest::newRow("check-tree") << false << true << false;
+    QTest::newRow("compiled") << true << true << false;
+    QTest::newRow("check-tree-invalid") << false << false << false;
+    QTest::newRow("compiled-invalid") << true << false << false;
+    // the schemas loaded from this folder
+    QTest::newRow("check-tree-folder") << false << true << true;
+    QTest::newRow("compiled-folder") << true << true << true;
+    QTest::newRow("check-tree-folder-invalid") << false << false << true;
+    QTest::newRow("compiled-folder-invalid") << true << false << true;
+}
+
+void tst_JsonSchema::benchmarkServerValidation()
+{
+    QFETCH(bool, compiled);
+    QFETCH(bool, valid);
+    QFETCH(bool, folderSchema);
+
+    TestJsonServer server;
+    server.setValidatorFlags(QJsonServer::DropIfInvalid);
+    server.inboundValidator()->setUseCompiledSchemas(compiled);
+    QVERIFY(server.inboundValidator()->loadFromFolder(QDir::currentPath(), "title"));
+    QVERIFY(server.inboundValidator()->loadFromData(kMessageSchema, "Message"));
+
+    const QString identifier(QStringLiteral("client"));
+    const QJsonObject message = folderSchema ? createTestMessage(valid) : sampleMessage(valid);
+
+    {
+        QSignalSpy received(&server, SIGNAL(messageReceived(QString,QJsonObject)));
+        server.receiveMessage(identifier, message);
+        QCOMPARE(received.count(), valid ? 1 : 0);
+    }
+
+    QBENCHMARK {
+        server.receiveMessage(identifier, message);
+    }
+}
+
+void tst_JsonSchema::benchmarkCompiledSchemaHandle_data()
+{
+    QTest::addColumn<bool>("handle");
+    QTest::newRow("by-name") << false;
+    QTest::newRow("handle") << true;
+}
+
+void tst_JsonSchema::benchmarkCompiledSchemaHandle()
+{
+    QFETCH(bool, handle);
+
+    QJsonSchemaValidator validator;
+    QVERIFY(validator.loadFromData(kMessageSchema, "Message"));
+    const QJsonObject message = sampleMessage(true);
+    bool result = false;
+
+    if (handle) {
+        const QJsonSchemaValidator::CompiledSchema schema = validator.compiledSchema("Message");
+        QBENCHMARK {
+            result = schema.validate(message);
+        }
+    } else {
+        QBENCHMARK {
+            result = validator.validateSchema("Message", message);
+        }
+    }
+    QVERIFY(result);
+}
+
+void tst_JsonSchema::concurrentValidationTest_data()
+{
+    QTest::addColumn<bool>("compiled");
+    QTest::newRow("check-tree") << false;
+    QTest::newRow("compiled") << true;
+}
+
+void tst_JsonSchema::concurrentValidationTest()
+{
+    QFETCH(bool, compiled);
+
+    // the schema is compiled on first use, by whichever thread comes first
+    QJsonSchemaValidator validator;
+    validator.setUseCompiledSchemas(compiled);
+    QVERIFY(validator.loadFromData(kMessageSchema, "Message"));
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(8);
+    QList<QSharedPointer<ValidationTask> > tasks;
+    for (int i = 0; i < 8; ++i) {
+        tasks.append(QSharedPointer<ValidationTask>(new ValidationTask(&validator, 500)));
+        pool.start(tasks.last().data());
+    }
+    pool.waitForDone();
+
+    foreach (const QSharedPointer<ValidationTask> &task, tasks)
+        QCOMPARE(task->failures(), 0);
+
+    // the other threads have not touched this thread's last error
+    QCOMPARE(validator.getLastError().errorCode(), QJsonSchemaError::NoError);
+}
+
+void tst_JsonSchema::benchmarkConcurrentValidation_data()
+{
+    QTest::addColumn<int>("threads");
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("2 threads") << 2;
+    QTest::newRow("4 threads") << 4;
+    QTest::newRow("8 threads") << 8;
+    QTest::newRow("16 threads") << 16;
+}
+
+void tst_JsonSchema::benchmarkConcurrentValidation()
+{
+    QFETCH(int, threads);
+
+    // the same number of validations shared by all threads
+    const int total = 16 * 1024;
+
+    QJsonSchemaValidator validator;
+    QVERIFY(validator.loadFromData(kMessageSchema, "Message"));
+    QVERIFY(validator.validateSchema("Message", sampleMessage(true)));
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QList<QSharedPointer<ValidationTask> > tasks;
+    for (int i = 0; i < threads; ++i)
+        tasks.append(QSharedPointer<ValidationTask>(new ValidationTask(&validator, total / threads)));
+
+    QBENCHMARK {
+        foreach (const QSharedPointer<ValidationTask> &task, tasks)
+            pool.start(task.data());
+        pool.waitForDone();
+    }
+
+    foreach (const QSharedPointer<ValidationTask> &task, tasks)
+        QCOMPARE(task->failures(), 0);
+}
+
+void tst_JsonSchema::discriminatorTest()
+{
+    QJsonSchemaValidator validator;
+    QVERIFY(validator.loadFromData("{ \"properties\": { \"kind\": { \"type\": \"string\", \"required\": true, \"enum\": [\"alpha\", \"a\"] },"
+                                   " \"x\": { \"type\": \"number\", \"required\": true } } }", "Alpha"));
+    QVERIFY(validator.loadFromData("{ \"properties\": { \"kind\": { \"type\": \"string\", \"required\": true, \"pattern\": \"beta\" },"
+                                   " \"y\": { \"type\": \"string\", \"required\": \"true\" } } }", "Beta"));
+    QVERIFY(validator.loadFromData("{ \"properties\": { \"kind\": { \"type\": \"string\", \"required\": true, \"pattern\": \"g.*\" } } }", "Gamma"));
+    QVERIFY(validator.loadFromData("{ \"properties\": { \"count\": { \"type\": \"integer\", \"required\": true },"
+                                   " \"kind\": { \"enum\": [1, 2, null] } } }", "Count"));
+
+    const char *objects[] = {
+        "{ \"kind\": \"alpha\", \"x\": 1 }",
+        "{ \"kind\": \"a\", \"x\": 1 }",
+        "{ \"kind\": \"alpha\", \"x\": \"1\" }",
+        "{ \"kind\": \"beta\", \"y\": \"1\" }",
+        "{ \"kind\": \"beta\" }",
+        "{ \"kind\": \"gamma\" }",
+        "{ \"kind\": \"delta\", \"x\": 1 }",
+        "{ \"kind\": 1, \"count\": 3 }",
+        "{ \"kind\": 3, \"count\": 3 }",
+        "{ \"kind\": null, \"count\": 3 }",
+        "{ \"count\": 3 }",
+        "{ \"kind\": [], \"x\": 1 }",
+        "{}"
+    };
+
+    // the result and error are the same as when checking every schema in turn
+    const QStringList names = validator.schemaNames();
+    for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); ++i) {
+        const QJsonObject object = QJsonDocument::fromJson(objects[i]).object();
+        bool expected = false;
+        foreach (const QString &name, names)
+            expected = expected || validator.validateSchema(name, object);
+        const QString expectedError = validator.getLastError().errorString();
+
+        QCOMPARE(validator.validateSchema(object), expected);
+        if (!expected)
+            QCOMPARE(validator.getLastError().errorString(), expectedError);
+    }
+
+    // schemas loaded later take part
+    QVERIFY(!validator.validateSchema(QJsonDocument::fromJson("{ \"kind\": \"delta\" }").object()));
+    QVERIFY(validator.loadFromData("{ \"properties\": { \"kind\": { \"type\": \"string\", \"required\": true, \"enum\": [\"delta\"] } } }", "Delta"));
+    QVERIFY(validator.validateSchema(QJsonDocument::fromJson("{ \"kind\": \"delta\" }").object()));
+}
+
+void tst_JsonSchema::benchmarkSchemaDispatch_data()
+{
+    QTest::addColumn<bool>("matcher");
+    QTest::newRow("discriminator") << false;
+    QTest::newRow("unique-key-matcher") << true;
+}
+
+void tst_JsonSchema::benchmarkSchemaDispatch()
+{
+    QFETCH(bool, matcher);
+
+    const int count = 200;
+    QJsonSchemaValidator validator;
+    for (int i = 0; i < count; ++i) {
+        QVERIFY(validator.loadFromData(QString("{ \"properties\": {"
+                                               " \"type\": { \"type\": \"string\", \"required\": true, \"pattern\": \"type%1\" },"
+                                               " \"value\": { \"type\": \"number\", \"required\": true } } }").arg(i).toUtf8(),
+                                       QString("Type%1").arg(i)));
+    }
+    if (matcher)
+        validator.setSchemaNameMatcher(QJsonSchemaValidator::SchemaUniqueKeyNameMatcher("type"));
+
+    QJsonObject object;
+    object.insert("type", QString("type%1").arg(count - 1));
+    object.insert("value", 1);
+    QVERIFY(validator.validateSchema(object));
+
+    bool result = false;
+    QBENCHMARK {
+        result = validator.validateSchema(object);
+    }
+    QVERIFY(result);
+}
+
+static bool writeFile(const QString &filename, const QByteArray &data)
+{
+    QFile file(filename);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+void tst_JsonSchema::schemaCacheTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString schemas(dir.path() + "/schemas");
+    const QString cacheFile(dir.path() + "/schemas.cache");
+    QVERIFY(QDir(dir.path()).mkdir("schemas"));
+    QVERIFY(writeFile(schemas + "/Message.json", kMessageSchema));
+    QVERIFY(writeFile(schemas + "/Broken.json", "{ \"properties\": "));
+
+    // the first load fills the cache
+    {
+        QJsonSchemaValidator validator;
+        validator.setSchemaCacheFile(cacheFile);
+        QCOMPARE(validator.schemaCacheFile(), cacheFile);
+        QVERIFY(!validator.loadFromFolder(schemas));
+        QCOMPARE(validator.getLastError().errorCode(), QJsonSchemaError::InvalidSchemaLoading);
+        QVERIFY(validator.validateSchema("Message", sampleMessage(true)));
+        QVERIFY(QFile::exists(cacheFile));
+    }
+
+    // later loads report the same, files that fail are parsed again
+    {
+        QJsonSchemaValidator validator;
+        validator.setSchemaCacheFile(cacheFile);
+        QVERIFY(!validator.loadFromFolder(schemas));
+        QCOMPARE(validator.getLastError().errorCode(), QJsonSchemaError::InvalidSchemaLoading);
+        QCOMPARE(validator.schemaNames(), QStringList() << "Message");
+        QVERIFY(validator.validateSchema("Message", sampleMessage(true)));
+        QVERIFY(!validator.validateSchema("Message", sampleMessage(false)));
+    }
+
+    // changed files are not taken from the cache
+    QVERIFY(writeFile(schemas + "/Message.json", "{ \"properties\": { \"id\": { \"type\": \"string\", \"required\": true } } }"));
+    QVERIFY(QFile::remove(schemas + "/Broken.json"));
+    {
+        QJsonSchemaValidator validator;
+        validator.setSchemaCacheFile(cacheFile);
+        QVERIFY(validator.loadFromFolder(schemas));
+        QJsonObject object;
+        object.insert("id", QString("x"));
+        QVERIFY(validator.validateSchema("Message", object));
+        QVERIFY(!validator.validateSchema("Message", sampleMessage(true)));
+    }
+
+    // a damaged cache is ignored
+    QVERIFY(writeFile(cacheFile, "not a cache"));
+    {
+        QJsonSchemaValidator validator;
+        validator.setSchemaCacheFile(cacheFile);
+        QVERIFY(validator.loadFromFolder(schemas));
+        QVERIFY(validator.hasSchema("Message"));
+    }
+}
+
+void tst_JsonSchema::precompileTest()
+{
+    QJsonSchemaValidator validator;
+    QVERIFY(!validator.precompileSchemas());
+    validator.setPrecompileSchemas(true);
+    QVERIFY(validator.precompileSchemas());
+
+    QVERIFY(validator.loadFromData(kMessageSchema, "Message"));
+    QVERIFY(validator.loadFromData("{ \"properties\": { \"a\": { \"minimum\": \"x\" } } }", "Broken"));
+    QVERIFY(validator.waitForPrecompiled());
+
+    QVERIFY(validator.validateSchema("Message", sampleMessage(true)));
+    QVERIFY(!validator.validateSchema("Message", sampleMessage(false)));
+    QVERIFY(!validator.validateSchema("Broken", sampleMessage(true)));
+    QCOMPARE(validator.getLastError().errorCode(), QJsonSchemaError::InvalidSchemaLoading);
+}
+
+void tst_JsonSchema::benchmarkSchemaCache_data()
+{
+    QTest::addColumn<bool>("cache");
+    QTest::newRow("parse") << false;
+    QTest::newRow("cache") << true;
+}
+
+void tst_JsonSchema::benchmarkSchemaCache()
+{
+    QFETCH(bool, cache);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString cacheFile(dir.path() + "/schemas.cache");
+    for (int i = 0; i < 200; ++i)
+        QVERIFY(writeFile(QString("%1/Message%2.json").arg(dir.path()).arg(i), kMessageSchema));
+
+    if (cache) {
+        QJsonSchemaValidator validator;
+        validator.setSchemaCacheFile(cacheFile);
+        QVERIFY(validator.loadFromFolder(dir.path()));
+    }
+
+    QBENCHMARK {
+        QJsonSchemaValidator validator;
+        if (cache)
+            validator.setSchemaCacheFile(cacheFile);
+        QVERIFY(validator.loadFromFolder(dir.path()));
+    }
+}
+
+void tst_JsonSchema::parallelLoadTest_data()
+{
+    QTest::addColumn<bool>("precompile");
+    QTest::newRow("load") << false;
+    QTest::newRow("precompile") << true;
+}
+
+void tst_JsonSchema::parallelLoadTest()
+{
+    QFETCH(bool, precompile);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QStringList files;
+    for (int i = 0; i < 20; ++i) {
+        files.append(QString("Message%1.json").arg(i));
+        QVERIFY(writeFile(dir.path() + "/" + files.last(), kMessageSchema));
+    }
+    files << "Syntax.json" << "Empty.json" << "Array.json" << "Unnamed.json";
+    QVERIFY(writeFile(dir.path() + "/Syntax.json", "{\n  \"properties\": {\n"));
+    QVERIFY(writeFile(dir.path() + "/Empty.json", "{}"));
+    QVERIFY(writeFile(dir.path() + "/Array.json", "[]"));
+    QVERIFY(writeFile(dir.path() + "/Unnamed.json", "{ \"properties\": {} }"));
+
+    // every file reports the error it reports on its own
+    QJsonObject expected;
+    int loaded = 0;
+    foreach (const QString &file, QDir(dir.path()).entryList(QStringList() << "*.json", QDir::Files)) {
+        QJsonSchemaValidator single;
+        if (single.loadFromFile(dir.path() + QDir::separator() + file, QJsonSchemaValidator::UseProperty, "title"))
+            loaded++;
+        else
+            expected.insert(file, single.getLastError().object());
+    }
+    QCOMPARE(loaded, 20);
+    QCOMPARE(expected.count(), 4);
+    expected.insert(QJsonSchemaError::kCodeStr, QJsonSchemaError::InvalidSchemaLoading);
+    expected.insert(QJsonSchemaError::kMessageStr,
+                    QString("Loading failed for 4 schemas. 20 schemas are loaded successfully."));
+    expected.insert(QJsonSchemaError::kCounterStr, 20);
+    expected.insert(QJsonSchemaError::kSourceStr, QDir(dir.path()).path());
+
+    QJsonSchemaValidator validator;
+    validator.setPrecompileSchemas(precompile);
+    QVERIFY(!validator.loadFromFolder(dir.path(), "title"));
+    QCOMPARE(validator.getLastError().object(), expected);
+    QVERIFY(validator.waitForPrecompiled());
+
+    QCOMPARE(validator.schemaNames().count(), 1);
+    const QString name = validator.schemaNames().first();
+    QVERIFY(validator.validateSchema(name, sampleMessage(true)));
+    QVERIFY(!validator.validateSchema(name, sampleMessage(false)));
+
+    // an empty folder
+    QTemporaryDir empty;
+    QVERIFY(!validator.loadFromFolder(empty.path()));
+    QCOMPARE(validator.getLastError().errorCode(), QJsonSchemaError::InvalidSchemaLoading);
+}
+
+void tst_JsonSchema::benchmarkLoadFromFolder_data()
+{
+    QTest::addColumn<bool>("precompile");
+    QTest::newRow("load") << false;
+    QTest::newRow("precompile") << true;
+}
+
+void tst_JsonSchema::benchmarkLoadFromFolder()
+{
+    QFETCH(bool, precompile);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    for (int i = 0; i < 400; ++i)
+        QVERIFY(writeFile(QString("%1/Message%2.json").arg(dir.path()).arg(i), kMessageSchema));
+
+    QBENCHMARK {
+        QJsonSchemaValidator validator;
+        validator.setPrecompileSchemas(precompile);
+        QVERIFY(validator.loadFromFolder(dir.path()));
+        QVERIFY(validator.waitForPrecompiled());
+    }
+}
+
+void tst_JsonSchema::watchFolderTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(writeFile(dir.path() + "/Base.json", "{ \"properties\": { \"id\": { \"type\": \"integer\", \"required\": true } } }"));
+    QVERIFY(writeFile(dir.path() + "/Wrapper.json", "{ \"properties\": { \"m\": { \"$ref\": \"Base\" } } }"));
+#ifdef Q_OS_UNIX
+    // a modification time without a fraction of a second, to be restored after an edit
+    struct utimbuf times;
+    times.actime = times.modtime = 1000000000;
+    QVERIFY(::utime(QFile::encodeName(dir.path() + "/Base.json").constData(), &times) == 0);
+#endif
+
+    QJsonSchemaValidator validator;
+    QSignalSpy reloaded(&validator, SIGNAL(schemasReloaded(QStringList)));
+    QVERIFY(validator.watchFolder(dir.path()));
+    QCOMPARE(validator.watchedFolders(), QStringList() << QDir(dir.path()).absolutePath());
+    QCOMPARE(validator.schemaNames(), QStringList() << "Base" << "Wrapper");
+
+    QJsonObject number;
+    number.insert("id", 1);
+    QJsonObject text;
+    text.insert("id", QString("x"));
+    QJsonObject wrapper;
+    wrapper.insert("m", number);
+    QVERIFY(validator.validateSchema("Wrapper", wrapper));
+    QVERIFY(validator.validateSchema(wrapper));
+    wrapper.insert("m", text);
+    QVERIFY(!validator.validateSchema("Wrapper", wrapper));
+
+#ifdef Q_OS_UNIX
+    // an edit that keeps both the size and the modification time
+    QVERIFY(writeFile(dir.path() + "/Base.json", "{ \"properties\": { \"id\": { \"type\": \"boolean\", \"required\": true } } }"));
+    QVERIFY(::utime(QFile::encodeName(dir.path() + "/Base.json").constData(), &times) == 0);
+    QTRY_COMPARE_WITH_TIMEOUT(reloaded.count(), 1, 5000);
+    QStringList touched = reloaded.takeFirst().at(0).toStringList();
+    touched.sort();
+    QCOMPARE(touched, QStringList() << "Base" << "Wrapper");
+    QJsonObject flag;
+    flag.insert("id", true);
+    QVERIFY(validator.validateSchema("Base", flag));
+    QVERIFY(!validator.validateSchema("Base", number));
+#endif
+
+    // the changed schema and the one referring to it are replaced
+    QVERIFY(writeFile(dir.path() + "/Base.json", "{ \"properties\": { \"id\": { \"type\": \"string\", \"required\": true } } }"));
+    QTRY_COMPARE_WITH_TIMEOUT(reloaded.count(), 1, 5000);
+    QStringList names = reloaded.takeFirst().at(0).toStringList();
+    names.sort();
+    QCOMPARE(names, QStringList() << "Base" << "Wrapper");
+    QVERIFY(validator.validateSchema("Base", text));
+    QVERIFY(validator.validateSchema("Wrapper", wrapper));
+    QVERIFY(validator.validateSchema(wrapper));
+
+    // added and removed files
+    QVERIFY(writeFile(dir.path() + "/Extra.json", "{ \"properties\": { \"extra\": { \"required\": true } } }"));
+    QTRY_COMPARE_WITH_TIMEOUT(reloaded.count(), 1, 5000);
+    QCOMPARE(reloaded.takeFirst().at(0).toStringList(), QStringList() << "Extra");
+    QVERIFY(validator.hasSchema("Extra"));
+
+    QVERIFY(QFile::remove(dir.path() + "/Extra.json"));
+    QTRY_COMPARE_WITH_TIMEOUT(reloaded.count(), 1, 5000);
+    QCOMPARE(reloaded.takeFirst().at(0).toStringList(), QStringList() << "Extra");
+    QVERIFY(!validator.hasSchema("Extra"));
+
+    validator.unwatchFolder(dir.path());
+    QVERIFY(validator.watchedFolders().isEmpty());
+    QVERIFY(validator.hasSchema("Base"));
+}
+
+void tst_JsonSchema::serverSamplingTest()
+{
+    TestJsonServer server;
+    server.setValidatorFlags(QJsonServer::SampleValidation | QJsonServer::WarnIfInvalid |
+                             QJsonServer::DropIfInvalid);
+    server.setValidationSampleRate(0.25);
+    QCOMPARE(server.validationSampleRate(), 0.25);
+    QVERIFY(server.inboundValidator()->loadFromData(kMessageSchema, "Message"));
+
+    QSignalSpy received(&server, SIGNAL(messageReceived(QString,QJsonObject)));
+    QSignalSpy failed(&server, SIGNAL(inboundMessageValidationFailed(QJsonObject,QtAddOn::QtJsonStream::QJsonSchemaError)));
+    const QJsonObject invalid = sampleMessage(false);
+    for (int i = 0; i < 100; i++)
+        server.receiveMessage(QStringLiteral("client"), invalid);
+
+    // only the sampled messages are validated, and dropped
+    QCOMPARE(failed.count(), 25);
+    QCOMPARE(received.count(), 75);
+
+    QVariantMap statistics = server.validationStatistics();
+    QCOMPARE(statistics.value("validated").toInt(), 25);
+    QCOMPARE(statistics.value("failed").toInt(), 25);
+    QCOMPARE(statistics.value("skipped").toInt(), 75);
+    QCOMPARE(statistics.value("pending").toInt(), 0);
+
+    server.resetValidationStatistics();
+    QCOMPARE(server.validationStatistics().value("validated").toInt(), 0);
+
+    // each direction is sampled on its own, however the messages interleave
+    QVERIFY(server.outboundValidator()->loadFromData(kMessageSchema, "Message"));
+    server.setValidationSampleRate(0.25);
+    failed.clear();
+    QSignalSpy outboundFailed(&server, SIGNAL(outboundMessageValidationFailed(QJsonObject,QtAddOn::QtJsonStream::QJsonSchemaError)));
+    for (int i = 0; i < 100; i++) {
+        server.receiveMessage(QStringLiteral("client"), invalid);
+        server.broadcast(invalid);
+    }
+    QCOMPARE(failed.count(), 25);
+    QCOMPARE(outboundFailed.count(), 25);
+
+    // out of range rates are clamped
+    server.setValidationSampleRate(2.0);
+    QCOMPARE(server.validationSampleRate(), 1.0);
+}
+
+void tst_JsonSchema::serverAsyncValidationTest()
+{
+    TestJsonServer server;
+    server.setValidatorFlags(QJsonServer::AsyncValidation | QJsonServer::WarnIfInvalid |
+                             QJsonServer::DropIfInvalid);
+    QVERIFY(server.inboundValidator()->loadFromData(kMessageSchema, "Message"));
+
+    QSignalSpy received(&server, SIGNAL(messageReceived(QString,QJsonObject)));
+    QSignalSpy failed(&server, SIGNAL(inboundMessageValidationFailed(QJsonObject,QtAddOn::QtJsonStream::QJsonSchemaError)));
+    server.receiveMessage(QStringLiteral("client"), sampleMessage(true));
+    server.receiveMessage(QStringLiteral("client"), sampleMessage(false));
+
+    // messages are delivered before they are validated
+    QCOMPARE(received.count(), 2);
+    QVERIFY(server.waitForValidation(5000));
+    QTRY_COMPARE(failed.count(), 1);
+    QCOMPARE(failed.at(0).at(0).value<QJsonObject>(), sampleMessage(false));
+
+    QVariantMap statistics = server.validationStatistics();
+    QCOMPARE(statistics.value("validated").toInt(), 2);
+    QCOMPARE(statistics.value("failed").toInt(), 1);
+    QCOMPARE(statistics.value("pending").toInt(), 0);
+    QCOMPARE(statistics.value("overflowed").toInt(), 0);
+    QVERIFY(statistics.contains("averageQueueUsecs"));
+
+    // every message is either validated or counted as overflowed
+    server.resetValidationStatistics();
+    for (int i = 0; i < 1000; i++)
+        server.receiveMessage(QStringLiteral("client"), sampleMessage(true));
+    QVERIFY(server.waitForValidation(5000));
+    statistics = server.validationStatistics();
+    QCOMPARE(statistics.value("validated").toInt() + statistics.value("overflowed").toInt(), 1000);
+    QCOMPARE(statistics.value("pending").toInt(), 0);
+}
+
+void tst_JsonSchema::benchmarkServerValidationModes_data()
+{
+    QTest::addColumn<int>("flags");
+    QTest::newRow("inline") << int(QJsonServer::WarnIfInvalid);
+    QTest::newRow("sampled") << int(QJsonServer::WarnIfInvalid | QJsonServer::SampleValidation);
+    QTest::newRow("async") << int(QJsonServer::WarnIfInvalid | QJsonServer::AsyncValidation);
+}
+
+void tst_JsonSchema::benchmarkServerValidationModes()
+{
+    QFETCH(int, flags);
+
+    TestJsonServer server;
+    server.setValidatorFlags(QJsonServer::ValidatorFlags(flags));
+    server.setValidationSampleRate(0.1);
+    QVERIFY(server.inboundValidator()->loadFromFolder(QDir::currentPath(), "title"));
+    QVERIFY(server.inboundValidator()->loadFromData(kMessageSchema, "Message"));
+
+    const QString identifier(QStringLiteral("client"));
+    const QJsonObject message = sampleMessage(true);
+
+    QBENCHMARK {
+        server.receiveMessage(identifier, message);
+    }
+    QVERIFY(server.waitForValidation());
+}
+
 bool tst_JsonSchema::validate(const char *data, const QByteArray & schemaBody)
 {
     QJsonDocument doc = QJsonDocument::fromJson(data);
@@ -535,6 +1384,13 @@ bool tst_JsonSchema::validate(const QJsonValue & value, const QByteArray & schem
     {
         result = validator.validateSchema("testSchema", object);
         //qDebug() << "####### validation result: " << result << " message is:" << validator.getLastError().errorString();
+
+        validator.setUseCompiledSchemas(false);
+        bool reference = validator.validateSchema("testSchema", object);
+        if (reference != result) {
+            qWarning() << "compiled schema and check tree disagree:" << schemaBody << object;
+            mEngineMismatches++;
+        }
     }
     else
     {
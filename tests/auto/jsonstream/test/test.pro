@@ -1,7 +1,7 @@
 CONFIG += testcase
 CONFIG -= app_bundle
 
-QT = jsonstream testlib
+QT = jsonstream testlib jsonstream-private
 
 SOURCES = ../tst_jsonstream.cpp
 TARGET = ../tst_jsonstream
@@ -91,6 +91,10 @@ Container::Container()
         mClient->setFormat(FormatUTF32BE);
     else if (gFormat == "utf32le")
         mClient->setFormat(FormatUTF32LE);
+    else if (gFormat == "cbor")
+        mClient->setFormat(FormatFramedCBOR);
+    else if (gFormat == "cbordict")
+        mClient->setFormat(FormatCBORDictionary);
 
     if (!mClient->connectLocal(gSocketname)) {
         qWarning() << "Unable to connect to" << gSocketname;
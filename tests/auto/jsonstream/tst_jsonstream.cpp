@@ -42,12 +42,17 @@
 #include <QtTest>
 #include <QLocalSocket>
 #include <QLocalServer>
+#include <QJsonDocument>
+#include <QtEndian>
 #include "qjsonserver.h"
+#include "qjsonclient.h"
 #include "qjsonstream.h"
 #include "qjsonpipe.h"
+#include "qjsoncodec.h"
 #include "qjsonuidauthority.h"
 #include "qjsonuidrangeauthority.h"
 #include "qjsonschemavalidator.h"
+#include "private/qt-bson_p.h"
 
 #include <unistd.h>
 
@@ -297,9 +302,17 @@ private slots:
     void schemaTest();
     void pipeTest();
     void pipeFormatTest();
+    void pipeCustomCodecTest();
     void pipeWaitTest();
     void bufferSizeTest();
     void bufferMaxReadSizeFailTest();
+    void flowControlTest();
+    void compressionTest();
+    void formatNegotiationTest();
+    void dictionaryOverflowTest();
+    void formatResetTest();
+    void reservedKeyTest();
+    void bsonReadTest();
 };
 
 void tst_JsonStream::initTestCase()
@@ -412,7 +425,7 @@ void tst_JsonStream::authRangeFail()
 
 void tst_JsonStream::formatTest()
 {
-    QStringList formats = QStringList() << "qbjs" << "bson" << "utf8" << "utf16be" << "utf16le" << "utf32be" << "utf32le";
+    QStringList formats = QStringList() << "qbjs" << "bson" << "utf8" << "utf16be" << "utf16le" << "utf32be" << "utf32le" << "cbor" << "cbordict";
 
     foreach (const QString& format, formats) {
         BasicServer server(s_socketname);
@@ -445,6 +458,10 @@ void tst_JsonStream::formatTest()
             QVERIFY(server.format() == FormatUTF32BE);
         else if (format == "utf32le")
             QVERIFY(server.format() == FormatUTF32LE);
+        else if (format == "cbor")
+            QVERIFY(server.format() == FormatFramedCBOR);
+        else if (format == "cbordict")
+            QVERIFY(server.format() == FormatCBORDictionary);
         else
             QFAIL("Unrecognized format");
 
@@ -711,6 +728,39 @@ public:
     QSignalSpy msg, err;
 };
 
+// a user format: "JSN1", the size of the message (32-bit little endian) and the JSON text
+class LengthPrefixedCodec : public QJsonCodec
+{
+public:
+    LengthPrefixedCodec() : QJsonCodec(EncodingFormat(FormatUser + 1)) {}
+
+    int detect(const char *data, int size) const {
+        return (size >= 4 && strncmp(data, "JSN1", 4) == 0) ? 0 : -1;
+    }
+    void encode(QByteArray& out, const QJsonObject& object, QJsonCodecSession *) const {
+        QByteArray json = QJsonDocument(object).toJson();
+        char header[8];
+        memcpy(header, "JSN1", 4);
+        qToLittleEndian<qint32>(json.size(), reinterpret_cast<uchar *>(header) + 4);
+        out.append(header, sizeof(header));
+        out.append(json);
+    }
+    bool scan(const QByteArray& buffer, ScanState *state, QJsonCodecSession *) const {
+        if (buffer.size() < 8)
+            return false;
+        qint32 size = qFromLittleEndian<qint32>(reinterpret_cast<const uchar *>(buffer.constData()) + 4);
+        if (buffer.size() < size + 8)
+            return false;
+        state->start = 8;
+        state->size = size;
+        state->end = size + 8;
+        return true;
+    }
+    QJsonObject decode(const char *data, int size, QJsonCodecSession *) const {
+        return QJsonDocument::fromJson(QByteArray(data, size)).object();
+    }
+};
+
 void tst_JsonStream::pipeTest()
 {
     Pipes pipes;
@@ -740,7 +790,7 @@ void tst_JsonStream::pipeTest()
 
 void tst_JsonStream::pipeFormatTest()
 {
-    QList<EncodingFormat> formats = QList<EncodingFormat>() << FormatUTF8 << FormatBSON << FormatQBJS << FormatUTF16BE << FormatUTF16LE << FormatUTF32BE << FormatUTF32LE;
+    QList<EncodingFormat> formats = QList<EncodingFormat>() << FormatUTF8 << FormatBSON << FormatQBJS << FormatUTF16BE << FormatUTF16LE << FormatUTF32BE << FormatUTF32LE << FormatFramedCBOR << FormatCBORDictionary;
 
     foreach (EncodingFormat format, formats) {
         Pipes pipes;
@@ -759,6 +809,29 @@ void tst_JsonStream::pipeFormatTest()
     }
 }
 
+void tst_JsonStream::pipeCustomCodecTest()
+{
+    static LengthPrefixedCodec codec;
+    QJsonCodec::registerCodec(&codec);
+    QVERIFY(QJsonCodec::codecForFormat(codec.format()) == &codec);
+    QVERIFY(QJsonCodec::codecForFormat(FormatUTF8) != 0);
+
+    Pipes pipes;
+    QJsonPipe jpipe1, jpipe2;
+    pipes.join(jpipe1, jpipe2);
+    PipeSpy spy(jpipe2);
+    jpipe1.setFormat(codec.format());
+
+    QJsonObject msg;
+    msg.insert("name", QStringLiteral("Fred"));
+    QVERIFY(jpipe1.send(msg));
+    QVERIFY(jpipe1.send(msg));
+    waitForSpy(spy.msg, 2);
+    QCOMPARE(spy.at(1).value("name").toString(), QStringLiteral("Fred"));
+    // the receiver recognizes the registered format on its own
+    QCOMPARE(jpipe2.format(), codec.format());
+}
+
 void tst_JsonStream::pipeWaitTest()
 {
     Pipes pipes;
@@ -775,6 +848,483 @@ void tst_JsonStream::pipeWaitTest()
     QVERIFY(!jpipe1.waitForBytesWritten());
 }
 
+void tst_JsonStream::flowControlTest()
+{
+    QLocalServer::removeServer(s_socketname);
+    QLocalServer localServer;
+    QVERIFY(localServer.listen(s_socketname));
+
+    QLocalSocket clientSocket;
+    clientSocket.connectToServer(s_socketname);
+    QVERIFY(clientSocket.waitForConnected(5000));
+    QVERIFY(localServer.waitForNewConnection(5000));
+    QLocalSocket *serverSocket = localServer.nextPendingConnection();
+    QVERIFY(serverSocket);
+
+    QJsonStream receiver(serverSocket);
+    receiver.setFlowControlWindow(4);
+    QJsonStream sender(&clientSocket);
+    QSignalSpy spy(&receiver, SIGNAL(readyReadMessage()));
+    QTest::qWait(200);  // deliver the window advertisement
+    QVERIFY(!sender.isSendPaused());
+    QCOMPARE(spy.count(), 0);
+
+    QJsonObject msg;
+    msg.insert("text", QStringLiteral("flow"));
+    for (int i = 0; i < 20; i++) {
+        msg.insert("count", i);
+        QVERIFY(sender.send(msg));
+    }
+    QVERIFY(sender.isSendPaused());
+    QVERIFY(sender.bytesToWrite() > 0);
+
+    // nothing is read, so nothing beyond the window is released
+    QTest::qWait(200);
+    QVERIFY(sender.isSendPaused());
+
+    int received = 0;
+    QTime stopWatch;
+    stopWatch.start();
+    while (received < 20) {
+        while (receiver.messageAvailable()) {
+            QJsonObject obj = receiver.readMessage();
+            QCOMPARE(obj.value("count").toDouble(), (double)received);
+            received++;
+        }
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(!sender.isSendPaused());
+    QVERIFY(!receiver.messageAvailable());
+
+    // credit does not limit the side that did not enable flow control
+    for (int i = 0; i < 20; i++)
+        QVERIFY(receiver.send(msg));
+    QVERIFY(!receiver.isSendPaused());
+}
+
+void tst_JsonStream::compressionTest()
+{
+    QLocalServer::removeServer(s_socketname);
+    QLocalServer localServer;
+    QVERIFY(localServer.listen(s_socketname));
+
+    QLocalSocket clientSocket;
+    clientSocket.connectToServer(s_socketname);
+    QVERIFY(clientSocket.waitForConnected(5000));
+    QVERIFY(localServer.waitForNewConnection(5000));
+    QLocalSocket *serverSocket = localServer.nextPendingConnection();
+    QVERIFY(serverSocket);
+
+    QJsonStream receiver(serverSocket);
+    QJsonStream sender(&clientSocket);
+    sender.setFormat(FormatUTF8);
+    sender.setCompressionThreshold(1024);
+    QTest::qWait(200);
+    // the peer has not enabled compression
+    QVERIFY(!sender.isCompressionActive());
+
+    receiver.setCompressionThreshold(1024);
+    QTest::qWait(200);  // deliver the advertisement
+    QVERIFY(sender.isCompressionActive());
+    QVERIFY(receiver.isCompressionActive());
+    QVERIFY(!receiver.messageAvailable());
+
+    QJsonObject small;
+    small.insert("text", QStringLiteral("small"));
+    QJsonObject large;
+    QJsonArray items;
+    for (int i = 0; i < 1000; i++)
+        items.append(QString::fromLatin1("item number %1").arg(i));
+    large.insert("items", items);
+
+    QVERIFY(sender.send(small));
+    QVERIFY(sender.send(large));
+    QVERIFY(sender.send(small));
+
+    QList<QJsonObject> received;
+    QTime stopWatch;
+    stopWatch.start();
+    while (received.size() < 3) {
+        while (receiver.messageAvailable())
+            received.append(receiver.readMessage());
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(received.at(0) == small);
+    QVERIFY(received.at(1) == large);
+    QVERIFY(received.at(2) == small);
+    QVERIFY(receiver.format() == FormatUTF8);
+
+    QVariantMap sent = sender.compressionStatistics();
+    QCOMPARE(sent.value("compressedFrames").toLongLong(), Q_INT64_C(1));
+    QVERIFY(sent.value("compressionRatio").toDouble() < 0.5);
+    QVariantMap inflated = receiver.compressionStatistics();
+    QCOMPARE(inflated.value("decompressedFrames").toLongLong(), Q_INT64_C(1));
+    QCOMPARE(inflated.value("bytesAfterDecompression"), sent.value("bytesBeforeCompression"));
+
+    // withdrawing the advertisement stops the peer from compressing
+    receiver.setCompressionThreshold(0);
+    QTest::qWait(200);
+    QVERIFY(!sender.isCompressionActive());
+    QVERIFY(sender.send(large));
+    stopWatch.restart();
+    while (!receiver.messageAvailable()) {
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(receiver.readMessage() == large);
+    QCOMPARE(sender.compressionStatistics().value("compressedFrames").toLongLong(), Q_INT64_C(1));
+
+    // a compressed message the receiver cannot take is dropped and reported
+    receiver.setReadBufferSize(1000);
+    QTest::ignoreMessage(QtWarningMsg, "QJsonBuffer: discarding a compressed frame of 2147483647 bytes, the limit is 1000");
+    QCOMPARE(clientSocket.write("\xc1jsz\x08\0\0\0\x7f\xff\xff\xffjunk", 16), Q_INT64_C(16));
+    QTRY_VERIFY(receiver.lastError() == QJsonStream::DecompressionFailed);
+    QVERIFY(!receiver.messageAvailable());
+    QVERIFY(sender.send(small));
+    stopWatch.restart();
+    while (!receiver.messageAvailable()) {
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(receiver.readMessage() == small);
+}
+
+void tst_JsonStream::formatNegotiationTest()
+{
+    QLocalServer::removeServer(s_socketname);
+    QLocalServer localServer;
+    QVERIFY(localServer.listen(s_socketname));
+
+    QLocalSocket clientSocket;
+    clientSocket.connectToServer(s_socketname);
+    QVERIFY(clientSocket.waitForConnected(5000));
+    QVERIFY(localServer.waitForNewConnection(5000));
+    QLocalSocket *serverSocket = localServer.nextPendingConnection();
+    QVERIFY(serverSocket);
+
+    QJsonStream receiver(serverSocket);
+    receiver.setAcceptedFormats(QList<EncodingFormat>() << FormatCBORDictionary << FormatUTF8);
+    QJsonStream sender(&clientSocket);
+    sender.setFormat(FormatUTF8);
+    sender.setAcceptedFormats(QList<EncodingFormat>() << FormatFramedCBOR << FormatCBORDictionary);
+    sender.negotiateFormat();
+
+    QJsonObject msg;
+    msg.insert("text", QStringLiteral("hello"));
+    msg.insert("number", 42);
+    QVERIFY(sender.send(msg));
+
+    QTime stopWatch;
+    stopWatch.start();
+    while (!receiver.messageAvailable()) {
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(receiver.readMessage() == msg);
+    QVERIFY(!receiver.messageAvailable());  // consumes the offer
+    QTest::qWait(200);  // deliver the answer and the switch
+    // the receiving side picks from its own preferences
+    QVERIFY(receiver.format() == FormatCBORDictionary);
+    QVERIFY(sender.format() == FormatCBORDictionary);
+    QVERIFY(!receiver.messageAvailable());
+    QVERIFY(!sender.messageAvailable());
+
+    for (int i = 0; i < 3; i++) {
+        QVERIFY(sender.send(msg));
+        QVERIFY(receiver.send(msg));
+    }
+    int fromSender = 0, fromReceiver = 0;
+    stopWatch.restart();
+    while (fromSender < 3 || fromReceiver < 3) {
+        while (receiver.messageAvailable()) {
+            QVERIFY(receiver.readMessage() == msg);
+            fromSender++;
+        }
+        while (sender.messageAvailable()) {
+            QVERIFY(sender.readMessage() == msg);
+            fromReceiver++;
+        }
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+
+    // QJsonServer answers QJsonClient offers and counts the result
+    localServer.close();
+    QJsonServer server;
+    Spy spy(&server);
+    server.setAcceptedFormats(QList<EncodingFormat>() << FormatFramedCBOR);
+    QVERIFY(server.listen(s_socketname));
+
+    QJsonClient client;
+    client.setFormat(FormatUTF8);
+    client.setAcceptedFormats(QList<EncodingFormat>() << FormatBSON << FormatFramedCBOR);
+    QSignalSpy clientSpy(&client, SIGNAL(messageReceived(const QJsonObject&)));
+    QVERIFY(client.connectLocal(s_socketname));
+    spy.waitAdded();
+    QString identifier = server.connections().first();
+    QTest::qWait(200);
+    QVERIFY(server.connectionFormat(identifier) == FormatFramedCBOR);
+    QCOMPARE(server.formatStatistics().value("cbor").toInt(), 1);
+    QVERIFY(!server.formatStatistics().contains("utf8"));
+
+    QVERIFY(client.send(msg));
+    spy.waitReceived();
+    QVERIFY(spy.lastMessage() == msg);
+    QVERIFY(server.send(identifier, msg));
+    stopWatch.restart();
+    while (!clientSpy.count()) {
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(qvariant_cast<QJsonObject>(clientSpy.last().at(0)) == msg);
+}
+
+void tst_JsonStream::dictionaryOverflowTest()
+{
+    QLocalServer::removeServer(s_socketname);
+    QLocalServer localServer;
+    QVERIFY(localServer.listen(s_socketname));
+
+    QLocalSocket clientSocket;
+    clientSocket.connectToServer(s_socketname);
+    QVERIFY(clientSocket.waitForConnected(5000));
+    QVERIFY(localServer.waitForNewConnection(5000));
+    QLocalSocket *serverSocket = localServer.nextPendingConnection();
+    QVERIFY(serverSocket);
+
+    QJsonStream receiver(serverSocket);
+    QJsonStream sender(&clientSocket);
+    sender.setFormat(FormatCBORDictionary);
+
+    QJsonObject first;
+    first.insert("first", 1);
+    QVERIFY(sender.send(first));
+
+    // the dropped message defines keys the receiver never sees
+    QJsonObject dropped;
+    dropped.insert("dropped", QString(500, QLatin1Char('*')));
+    dropped.insert("shared", 1);
+    sender.setWriteBufferSize(100);
+    QVERIFY(!sender.send(dropped));
+    QVERIFY(sender.lastError() == QJsonStream::MaxWriteBufferSizeExceeded);
+    sender.setWriteBufferSize(0);
+
+    QJsonObject later;
+    later.insert("shared", 2);
+    later.insert("first", 2);
+    later.insert("later", 3);
+    QVERIFY(sender.send(later));
+    QVERIFY(sender.send(later));
+
+    QList<QJsonObject> received;
+    QTime stopWatch;
+    stopWatch.start();
+    while (received.size() < 3) {
+        while (receiver.messageAvailable())
+            received.append(receiver.readMessage());
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(receiver.format() == FormatCBORDictionary);
+    QVERIFY(received.at(0) == first);
+    QVERIFY(received.at(1) == later);
+    QVERIFY(received.at(2) == later);
+}
+
+void tst_JsonStream::formatResetTest()
+{
+    QLocalServer::removeServer(s_socketname);
+    QLocalServer localServer;
+    QVERIFY(localServer.listen(s_socketname));
+
+    QLocalSocket clientSocket;
+    clientSocket.connectToServer(s_socketname);
+    QVERIFY(clientSocket.waitForConnected(5000));
+    QVERIFY(localServer.waitForNewConnection(5000));
+    QLocalSocket *serverSocket = localServer.nextPendingConnection();
+    QVERIFY(serverSocket);
+
+    QJsonStream peer(serverSocket);
+    peer.setAcceptedFormats(QList<EncodingFormat>() << FormatCBORDictionary);
+    QJsonStream stream(&clientSocket);
+    stream.setFormat(FormatUTF8);
+    stream.setAcceptedFormats(QList<EncodingFormat>() << FormatCBORDictionary);
+    stream.negotiateFormat();
+
+    QJsonObject msg;
+    msg.insert("text", QStringLiteral("hello"));
+    QVERIFY(stream.send(msg));
+    QTime stopWatch;
+    stopWatch.start();
+    while (!peer.messageAvailable()) {
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(peer.readMessage() == msg);
+    QTest::qWait(200);  // deliver the answer and the switch
+    QVERIFY(stream.format() == FormatCBORDictionary);
+    QVERIFY(peer.send(msg));
+    stopWatch.restart();
+    while (!stream.messageAvailable()) {
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(stream.readMessage() == msg);
+
+    // the next peer does not negotiate: both directions start over
+    QLocalSocket secondSocket;
+    secondSocket.connectToServer(s_socketname);
+    QVERIFY(secondSocket.waitForConnected(5000));
+    QVERIFY(localServer.waitForNewConnection(5000));
+    QLocalSocket *secondServerSocket = localServer.nextPendingConnection();
+    QVERIFY(secondServerSocket);
+
+    stream.setDevice(&secondSocket);
+    QVERIFY(stream.format() == FormatUTF8);
+    QJsonStream second(secondServerSocket);
+    second.setFormat(FormatBSON);
+    QVERIFY(stream.send(msg));
+    QVERIFY(second.send(msg));
+    stopWatch.restart();
+    while (!second.messageAvailable() || !stream.messageAvailable()) {
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(second.readMessage() == msg);
+    QVERIFY(stream.readMessage() == msg);
+    QVERIFY(stream.format() == FormatUTF8);
+}
+
+void tst_JsonStream::reservedKeyTest()
+{
+    QLocalServer::removeServer(s_socketname);
+    QLocalServer localServer;
+    QVERIFY(localServer.listen(s_socketname));
+
+    QLocalSocket clientSocket;
+    clientSocket.connectToServer(s_socketname);
+    QVERIFY(clientSocket.waitForConnected(5000));
+    QVERIFY(localServer.waitForNewConnection(5000));
+    QLocalSocket *serverSocket = localServer.nextPendingConnection();
+    QVERIFY(serverSocket);
+
+    QJsonStream receiver(serverSocket);
+    QJsonStream sender(&clientSocket);
+
+    // application messages that look like control messages are delivered as they are
+    QList<QJsonObject> messages;
+    QJsonObject credit;
+    credit.insert("messages", 0);
+    credit.insert("window", 1);
+    QJsonObject msg;
+    msg.insert("$credit", credit);
+    messages.append(msg);
+    msg = QJsonObject();
+    msg.insert("$compression", QStringLiteral("zlib"));
+    messages.append(msg);
+    msg = QJsonObject();
+    msg.insert("$formats", QJsonObject());
+    messages.append(msg);
+    msg = QJsonObject();
+    msg.insert("$message", 1);
+    messages.append(msg);
+    foreach (const QJsonObject &message, messages)
+        QVERIFY(receiver.send(message));
+
+    QList<QJsonObject> received;
+    QTime stopWatch;
+    stopWatch.start();
+    while (received.size() < messages.size()) {
+        while (sender.messageAvailable())
+            received.append(sender.readMessage());
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(received == messages);
+
+    // ... and do not touch the flow control state
+    for (int i = 0; i < 5; i++)
+        QVERIFY(sender.send(msg));
+    QVERIFY(!sender.isSendPaused());
+}
+
+void tst_JsonStream::bsonReadTest()
+{
+    QLocalServer::removeServer(s_socketname);
+    QLocalServer localServer;
+    QVERIFY(localServer.listen(s_socketname));
+
+    QLocalSocket clientSocket;
+    clientSocket.connectToServer(s_socketname);
+    QVERIFY(clientSocket.waitForConnected(5000));
+    QVERIFY(localServer.waitForNewConnection(5000));
+    QLocalSocket *serverSocket = localServer.nextPendingConnection();
+    QVERIFY(serverSocket);
+
+    QJsonStream receiver(serverSocket);
+    receiver.setFlowControlWindow(2);
+    QJsonStream sender(&clientSocket);
+    sender.setFormat(FormatBSON);
+    QTest::qWait(200);  // deliver the window advertisement
+
+    const int count = 10;
+    QJsonObject msg;
+    msg.insert("text", QStringLiteral("bson"));
+    for (int i = 0; i < count; i++) {
+        msg.insert("count", i);
+        QVERIFY(sender.send(msg));
+    }
+    QJsonObject reserved;
+    reserved.insert("$credit", msg);
+    QVERIFY(sender.send(reserved));
+    QVERIFY(sender.isSendPaused());
+
+    // messages are read in place; credit is granted as for readMessage()
+    int received = 0;
+    QTime stopWatch;
+    stopWatch.start();
+    while (received < count) {
+        while (receiver.messageAvailable()) {
+            BsonObject bson = receiver.readBsonMessage();
+            QVERIFY(bson.contains("count"));
+            QCOMPARE(bson.value("count").toDouble(), (double)received);
+            QCOMPARE(bson.value("text").toString(), QStringLiteral("bson"));
+            received++;
+            if (received == count)
+                break;
+        }
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    QVERIFY(receiver.format() == FormatBSON);
+
+    stopWatch.restart();
+    while (!receiver.messageAvailable()) {
+        if (stopWatch.elapsed() >= 5000)
+            QFAIL("Timed out");
+        QTest::qWait(10);
+    }
+    BsonObject bson = receiver.readBsonMessage();
+    QCOMPARE(bson.subObject("$credit").value("count").toDouble(), (double)(count - 1));
+    QVERIFY(!sender.isSendPaused());
+    QVERIFY(receiver.readBsonMessage().isEmpty());
+}
+
 QTEST_MAIN(tst_JsonStream)
 
 #include "tst_jsonstream.moc"